@@ -0,0 +1,7 @@
+#!/bin/sh
+mkdir -p bin
+cc -g -Wall -Wextra -std=gnu11 -o bin/viewer src/main.c -lX11 -lGL -lm -lpthread
+cc -O2 -Wall -Wextra -std=gnu11 -o bin/bench src/bench.c -lEGL -lGL -lm
+cc -O2 -Wall -Wextra -std=gnu11 -DFRAME_SOFTWARE -DRESAMPLE_MIPMAP_FLAGS='(RESAMPLE_LINEAR_LIGHT | RESAMPLE_PREMULTIPLY)' -o bin/viewer_soft src/main.c -lX11 -lXext -lm -lpthread
+cc -O2 -Wall -Wextra -std=gnu11 -DFRAME_SOFTWARE -DRESAMPLE_MIPMAP_FLAGS='(RESAMPLE_LINEAR_LIGHT | RESAMPLE_PREMULTIPLY)' -o bin/bench_soft src/bench.c -lm -lpthread
+cc -O2 -Wall -Wextra -std=gnu11 -o bin/smoke src/smoke.c -lX11
@@ -0,0 +1,5 @@
+#!/bin/sh
+# Runs both X11 viewers under Xvfb and drives them, see src/smoke.c
+for viewer in bin/viewer bin/viewer_soft; do
+  xvfb-run -a -s "-screen 0 1024x1024x24" bin/smoke $viewer || exit 1
+done
@@ -0,0 +1,437 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+// Counts the allocations of the decoders, per decoder and per scope.
+//
+//   Alloc_Stats stats;
+//   alloc_stats(ALLOC_TAG_QOI, &stats);
+//
+//   Alloc_Scope load;
+//   alloc_scope_begin(&load); ...decode... alloc_scope_end();
+//
+// Every block carries its size and tag in front of it, so anything that
+// came out of a decoder must go back through 'alloc_free'.
+//
+// With an arena, every allocation of the thread is bumped out of it and
+// 'alloc_free' only counts. Resetting it invalidates all of them at once:
+//
+//   alloc_arena_begin(&arena); ...decode, copy out... alloc_arena_end();
+//   alloc_arena_reset(&arena);
+//
+// A reset keeps the memory for the next round, but not more than
+// ALLOC_ARENA_SLACK times what the round used, nor more than 'keep'.
+// 'alloc_arena_trim' gives it all back, for callers under memory pressure.
+//
+// Include this before pnm.h, qoi.h, stb_image.h, downscale.h and resample.h
+// to route their PNM_/QOI_/STBI_/DOWNSCALE_/RESAMPLE_MALLOC hooks through here.
+// Uses thread.h, include it first.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ALLOC_DEF
+#  define ALLOC_DEF static inline
+#endif //ALLOC_DEF
+
+typedef enum{
+  ALLOC_TAG_OTHER = 0,
+  ALLOC_TAG_QOI,
+  ALLOC_TAG_PNM,
+  ALLOC_TAG_STBI,
+  ALLOC_TAG_COUNT,
+}Alloc_Tag;
+
+// bucket 0 holds sizes up to 64 bytes, bucket n up to 64 << n, the last
+// one everything above
+#define ALLOC_BUCKETS 24
+
+typedef struct{
+  long long allocs; // including reallocs
+  long long frees;
+  long long bytes; // requested in total
+  long long live;
+  long long peak; // of 'live'
+  long long histogram[ALLOC_BUCKETS];
+}Alloc_Stats;
+
+// Only sees the calling thread, between 'alloc_scope_begin' and 'alloc_scope_end'
+typedef struct{
+  Alloc_Stats tags[ALLOC_TAG_COUNT];
+  Alloc_Stats total;
+}Alloc_Scope;
+
+#ifndef PNM_MALLOC
+#  define PNM_MALLOC(size) alloc_malloc(ALLOC_TAG_PNM, size)
+#  define PNM_FREE(ptr) alloc_free(ptr)
+#endif //PNM_MALLOC
+
+#ifndef QOI_MALLOC
+#  define QOI_MALLOC(size) alloc_malloc(ALLOC_TAG_QOI, size)
+#  define QOI_FREE(ptr) alloc_free(ptr)
+#endif //QOI_MALLOC
+
+#ifndef STBI_MALLOC
+#  define STBI_MALLOC(size) alloc_malloc(ALLOC_TAG_STBI, size)
+#  define STBI_REALLOC(ptr, size) alloc_realloc(ALLOC_TAG_STBI, ptr, size)
+#  define STBI_FREE(ptr) alloc_free(ptr)
+#endif //STBI_MALLOC
+
+// reused by every pass, an arena would keep one per pass
+#ifndef STBI_PROGRESS_MALLOC
+#  define STBI_PROGRESS_MALLOC(size) alloc_malloc_heap(ALLOC_TAG_STBI, size)
+#  define STBI_PROGRESS_FREE(ptr) alloc_free(ptr)
+#endif //STBI_PROGRESS_MALLOC
+
+#ifndef DOWNSCALE_MALLOC
+#  define DOWNSCALE_MALLOC(size) alloc_malloc(ALLOC_TAG_OTHER, size)
+#  define DOWNSCALE_FREE(ptr) alloc_free(ptr)
+#endif //DOWNSCALE_MALLOC
+
+#ifndef RESAMPLE_MALLOC
+#  define RESAMPLE_MALLOC(size) alloc_malloc(ALLOC_TAG_OTHER, size)
+#  define RESAMPLE_FREE(ptr) alloc_free(ptr)
+#endif //RESAMPLE_MALLOC
+
+// Alloc_Arena
+
+#ifndef ALLOC_ARENA_CHUNK
+#  define ALLOC_ARENA_CHUNK (1 << 20)
+#endif //ALLOC_ARENA_CHUNK
+
+#ifndef ALLOC_ARENA_SLACK
+#  define ALLOC_ARENA_SLACK 4 // times the peak of a round, that a reset keeps at most
+#endif //ALLOC_ARENA_SLACK
+
+typedef struct Alloc_Arena_Chunk Alloc_Arena_Chunk;
+struct Alloc_Arena_Chunk{
+  Alloc_Arena_Chunk *next;
+  size_t cap, len;
+  size_t pad;
+};
+
+typedef struct{
+  Alloc_Arena_Chunk *chunks; // the first one is bumped
+  void *last; // most recent block, a realloc grows it in place
+  size_t used, peak; // bytes, since the last reset
+  size_t held; // bytes of all chunks
+  size_t keep; // held after a reset at most, 0 for no limit
+  long long system_allocs; // chunks taken from malloc
+}Alloc_Arena;
+
+ALLOC_DEF void alloc_arena_begin(Alloc_Arena *arena); // for the calling thread
+ALLOC_DEF void alloc_arena_end();
+ALLOC_DEF void alloc_arena_reset(Alloc_Arena *arena); // keeps the memory, merged into one chunk
+// Frees the chunks of an arena without live blocks if it holds more than
+// 'keep' bytes, returns the bytes freed
+ALLOC_DEF size_t alloc_arena_trim(Alloc_Arena *arena, size_t keep);
+ALLOC_DEF void alloc_arena_free(Alloc_Arena *arena);
+
+ALLOC_DEF void *alloc_malloc(Alloc_Tag tag, size_t size);
+ALLOC_DEF void *alloc_malloc_heap(Alloc_Tag tag, size_t size); // past the arena of the thread
+ALLOC_DEF void *alloc_realloc(Alloc_Tag tag, void *ptr, size_t size);
+ALLOC_DEF void alloc_free(void *ptr);
+
+ALLOC_DEF void alloc_stats(Alloc_Tag tag, Alloc_Stats *stats); // ALLOC_TAG_COUNT for all of them
+ALLOC_DEF const char *alloc_tag_name(Alloc_Tag tag);
+ALLOC_DEF int alloc_bucket(size_t size);
+
+ALLOC_DEF void alloc_scope_begin(Alloc_Scope *scope);
+ALLOC_DEF void alloc_scope_end();
+
+ALLOC_DEF void alloc_report(FILE *f, const char *title, const Alloc_Stats *stats);
+
+#ifdef ALLOC_IMPLEMENTATION
+
+#ifdef _MSC_VER
+#  define ALLOC_THREAD_LOCAL __declspec(thread)
+#else
+#  define ALLOC_THREAD_LOCAL __thread
+#endif //_MSC_VER
+
+// In front of every block, keeps it 16 byte aligned
+typedef struct{
+  size_t size;
+  int tag;
+  int arena; // bumped, not malloc'd
+}Alloc_Header;
+
+#define ALLOC_ALIGN(n) (((n) + 15) & ~(size_t) 15)
+
+typedef struct{
+  Thread_Atomic allocs, frees, bytes, live, peak;
+  Thread_Atomic histogram[ALLOC_BUCKETS];
+}Alloc_Counters;
+
+static Alloc_Counters alloc_counters[ALLOC_TAG_COUNT + 1]; // the last one is the total
+static ALLOC_THREAD_LOCAL Alloc_Scope *alloc_scope = NULL;
+static ALLOC_THREAD_LOCAL Alloc_Arena *alloc_arena = NULL;
+
+static void alloc_atomic_max(Thread_Atomic *a, long long value) {
+  long long current = thread_atomic_load(a);
+  while(value > current && !thread_atomic_cas(a, current, value)) {
+    current = thread_atomic_load(a);
+  }
+}
+
+ALLOC_DEF int alloc_bucket(size_t size) {
+  int bucket = 0;
+  while(bucket < ALLOC_BUCKETS - 1 && size > ((size_t) 64 << bucket)) bucket++;
+  return bucket;
+}
+
+static void alloc_count(Alloc_Stats *s, long long allocated, long long freed, size_t size) {
+  if(allocated) {
+    s->allocs++;
+    s->bytes += allocated;
+    s->histogram[alloc_bucket(size)]++;
+  }
+  if(freed) s->frees++;
+  s->live += allocated - freed;
+  if(s->live > s->peak) s->peak = s->live;
+}
+
+// 'allocated' and 'freed' are bytes, a realloc does both
+static void alloc_record(int tag, long long allocated, long long freed, size_t size) {
+  Alloc_Counters *counters[2] = {&alloc_counters[tag], &alloc_counters[ALLOC_TAG_COUNT]};
+  for(int i=0;i<2;i++) {
+    Alloc_Counters *c = counters[i];
+    if(allocated) {
+      thread_atomic_add(&c->allocs, 1);
+      thread_atomic_add(&c->bytes, allocated);
+      thread_atomic_add(&c->histogram[alloc_bucket(size)], 1);
+    }
+    if(freed) thread_atomic_add(&c->frees, 1);
+    long long live = thread_atomic_add(&c->live, allocated - freed) + allocated - freed;
+    alloc_atomic_max(&c->peak, live);
+  }
+
+  Alloc_Scope *s = alloc_scope;
+  if(s) {
+    alloc_count(&s->tags[tag], allocated, freed, size);
+    alloc_count(&s->total, allocated, freed, size);
+  }
+}
+
+static Alloc_Arena_Chunk *alloc_arena_chunk(Alloc_Arena *a, size_t cap) {
+  Alloc_Arena_Chunk *c = malloc(sizeof(Alloc_Arena_Chunk) + cap);
+  if(!c) return NULL;
+  c->cap = cap;
+  c->len = 0;
+  c->next = a->chunks;
+  a->chunks = c;
+  a->held += cap;
+  a->system_allocs++;
+  return c;
+}
+
+static Alloc_Header *alloc_arena_bump(Alloc_Arena *a, size_t size) {
+  size_t need = sizeof(Alloc_Header) + ALLOC_ALIGN(size);
+
+  Alloc_Arena_Chunk *c = a->chunks;
+  if(!c || c->len + need > c->cap) {
+    c = alloc_arena_chunk(a, need > ALLOC_ARENA_CHUNK ? need : ALLOC_ARENA_CHUNK);
+    if(!c) return NULL;
+  }
+
+  Alloc_Header *h = (Alloc_Header *) ((unsigned char *) (c + 1) + c->len);
+  c->len += need;
+  a->used += need;
+  if(a->used > a->peak) a->peak = a->used;
+  a->last = h;
+  return h;
+}
+
+// Only the last block of the first chunk can grow
+static bool alloc_arena_grow(Alloc_Arena *a, Alloc_Header *h, size_t size) {
+  Alloc_Arena_Chunk *c = a->chunks;
+  if(!c || a->last != h) return false;
+
+  size_t offset = (size_t) ((unsigned char *) h - (unsigned char *) (c + 1));
+  size_t old_need = sizeof(Alloc_Header) + ALLOC_ALIGN(h->size);
+  size_t need = sizeof(Alloc_Header) + ALLOC_ALIGN(size);
+  if(offset + need > c->cap) return false;
+
+  c->len = offset + need;
+  a->used = a->used - old_need + need;
+  if(a->used > a->peak) a->peak = a->used;
+  return true;
+}
+
+ALLOC_DEF void alloc_arena_begin(Alloc_Arena *arena) {
+  alloc_arena = arena;
+}
+
+ALLOC_DEF void alloc_arena_end() {
+  alloc_arena = NULL;
+}
+
+ALLOC_DEF void alloc_arena_reset(Alloc_Arena *a) {
+  // one large round does not pin its memory for all the small ones after it
+  size_t want = a->peak;
+  if(a->keep > 0 && want > a->keep) want = a->keep;
+  want = (want + ALLOC_ARENA_CHUNK - 1) / ALLOC_ARENA_CHUNK * ALLOC_ARENA_CHUNK;
+
+  if(a->held > want * ALLOC_ARENA_SLACK || (a->keep > 0 && a->held > a->keep)) {
+    alloc_arena_free(a);
+    if(want > 0) alloc_arena_chunk(a, want);
+  } else if(a->chunks && a->chunks->next) {
+    // a reset after spilling into more chunks merges them, the next round fits
+    size_t cap = a->held;
+    alloc_arena_free(a);
+    alloc_arena_chunk(a, cap);
+  } else if(a->chunks) {
+    a->chunks->len = 0;
+  }
+
+  a->last = NULL;
+  a->used = 0;
+  a->peak = 0;
+}
+
+ALLOC_DEF size_t alloc_arena_trim(Alloc_Arena *a, size_t keep) {
+  if(a->used > 0 || a->held <= keep) return 0;
+
+  size_t held = a->held;
+  alloc_arena_free(a);
+  return held;
+}
+
+ALLOC_DEF void alloc_arena_free(Alloc_Arena *a) {
+  Alloc_Arena_Chunk *c = a->chunks;
+  while(c) {
+    Alloc_Arena_Chunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  a->chunks = NULL;
+  a->last = NULL;
+  a->used = 0;
+  a->held = 0;
+}
+
+ALLOC_DEF void *alloc_malloc(Alloc_Tag tag, size_t size) {
+  Alloc_Header *h;
+  if(alloc_arena) {
+    h = alloc_arena_bump(alloc_arena, size);
+  } else {
+    h = malloc(sizeof(Alloc_Header) + size);
+  }
+  if(!h) return NULL;
+  h->size = size;
+  h->tag = (int) tag;
+  h->arena = alloc_arena != NULL;
+
+  alloc_record(tag, (long long) size, 0, size);
+  return h + 1;
+}
+
+ALLOC_DEF void *alloc_malloc_heap(Alloc_Tag tag, size_t size) {
+  Alloc_Arena *arena = alloc_arena;
+  alloc_arena = NULL;
+  void *ptr = alloc_malloc(tag, size);
+  alloc_arena = arena;
+  return ptr;
+}
+
+ALLOC_DEF void *alloc_realloc(Alloc_Tag tag, void *ptr, size_t size) {
+  if(!ptr) return alloc_malloc(tag, size);
+
+  Alloc_Header *h = (Alloc_Header *) ptr - 1;
+  size_t old_size = h->size;
+  tag = (Alloc_Tag) h->tag;
+
+  if(h->arena) {
+    if(alloc_arena && alloc_arena_grow(alloc_arena, h, size)) {
+      h->size = size;
+      alloc_record(tag, (long long) size, (long long) old_size, size);
+      return ptr;
+    }
+
+    void *moved = alloc_malloc(tag, size);
+    if(!moved) return NULL;
+    memcpy(moved, ptr, old_size < size ? old_size : size);
+    alloc_free(ptr);
+    return moved;
+  }
+
+  h = realloc(h, sizeof(Alloc_Header) + size);
+  if(!h) return NULL;
+  h->size = size;
+
+  alloc_record(tag, (long long) size, (long long) old_size, size);
+  return h + 1;
+}
+
+ALLOC_DEF void alloc_free(void *ptr) {
+  if(!ptr) return;
+
+  Alloc_Header *h = (Alloc_Header *) ptr - 1;
+  alloc_record(h->tag, 0, (long long) h->size, 0);
+  if(!h->arena) free(h);
+}
+
+ALLOC_DEF void alloc_stats(Alloc_Tag tag, Alloc_Stats *stats) {
+  Alloc_Counters *c = &alloc_counters[tag];
+
+  stats->allocs = thread_atomic_load(&c->allocs);
+  stats->frees = thread_atomic_load(&c->frees);
+  stats->bytes = thread_atomic_load(&c->bytes);
+  stats->live = thread_atomic_load(&c->live);
+  stats->peak = thread_atomic_load(&c->peak);
+  for(int i=0;i<ALLOC_BUCKETS;i++) {
+    stats->histogram[i] = thread_atomic_load(&c->histogram[i]);
+  }
+}
+
+ALLOC_DEF const char *alloc_tag_name(Alloc_Tag tag) {
+  switch(tag) {
+  case ALLOC_TAG_OTHER: return "other";
+  case ALLOC_TAG_QOI: return "qoi";
+  case ALLOC_TAG_PNM: return "pnm";
+  case ALLOC_TAG_STBI: return "stbi";
+  default: return "total";
+  }
+}
+
+ALLOC_DEF void alloc_scope_begin(Alloc_Scope *scope) {
+  memset(scope, 0, sizeof(*scope));
+  alloc_scope = scope;
+}
+
+ALLOC_DEF void alloc_scope_end() {
+  alloc_scope = NULL;
+}
+
+static void alloc_format_size(char *buf, size_t buf_cap, double bytes) {
+  if(bytes >= 1024 * 1024) {
+    snprintf(buf, buf_cap, "%.1f MB", bytes / (1024 * 1024));
+  } else if(bytes >= 1024) {
+    snprintf(buf, buf_cap, "%.1f KB", bytes / 1024);
+  } else {
+    snprintf(buf, buf_cap, "%.0f B", bytes);
+  }
+}
+
+ALLOC_DEF void alloc_report(FILE *f, const char *title, const Alloc_Stats *stats) {
+  char bytes[32], live[32], peak[32];
+  alloc_format_size(bytes, sizeof(bytes), (double) stats->bytes);
+  alloc_format_size(live, sizeof(live), (double) stats->live);
+  alloc_format_size(peak, sizeof(peak), (double) stats->peak);
+  fprintf(f, "%-8s: %lld allocs, %lld frees, %s total, %s live, %s peak\n",
+	  title, stats->allocs, stats->frees, bytes, live, peak);
+
+  for(int i=0;i<ALLOC_BUCKETS;i++) {
+    if(stats->histogram[i] == 0) continue;
+
+    bool last = i == ALLOC_BUCKETS - 1;
+    char size[32];
+    alloc_format_size(size, sizeof(size), (double) ((size_t) 64 << (last ? i - 1 : i)));
+    fprintf(f, "  %s %-9s: %lld\n", last ? "> " : "<=", size, stats->histogram[i]);
+  }
+}
+
+#endif //ALLOC_IMPLEMENTATION
+
+#endif //ALLOC_H
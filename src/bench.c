@@ -0,0 +1,1296 @@
+
+// Headless benchmark, replays a scripted session and reports frame times.
+//
+//   bench [-frames N] [-size WxH] [-quads N | -sprites N] [-nomips]
+//         [-dump DIR] [-every K] [-qoi] [-csv FILE] [-hud]
+//         [-trace FILE] [-stats] [-loads N [-scaled WxH]]
+//         [-resample WxH] [-thumbs DIR] [-ramcache N] [-pool N]
+//         [-flushes N] [-throughput] [image]
+//
+// Without an image, a synthetic 4096x4096 one is zoomed, panned and shrunk.
+//
+//   -nomips      samples without mipmaps, to compare the minified frames
+//   -dump        writes every K-th frame as .pam (.qoi with -qoi) into DIR
+//   -csv         writes the CPU phase and GPU times of every frame
+//   -hud         draws the timing overlay
+//   -trace       records the run as Chrome trace JSON
+//   -stats       reports the allocations of the decoders
+//   -loads       decodes the image N times, from the heap and from an arena
+//   -scaled      adds a pass of -loads that shrinks it into WxH
+//   -resample    checks every filter of resample.h, and the mipmaps, at WxH
+//   -thumbs      makes thumbnails of DIR and reads them back into an atlas
+//   -ramcache    reads the image back N times raw, as QOI and as kept
+//   -pool        checks the priorities and cancellation of N thumbnails
+//   -flushes     checks N software frames on more and more workers
+//   -throughput  reports how many quads and sprites a millisecond fits
+
+#define THREAD_IMPLEMENTATION
+#include "thread.h"
+
+#define TRACE_IMPLEMENTATION
+#include "trace.h"
+
+#define ALLOC_IMPLEMENTATION
+#include "alloc.h"
+
+#ifdef __GLIBC__
+#  include <malloc.h>
+#endif //__GLIBC__
+
+#define POOL_IMPLEMENTATION
+#include "pool.h"
+
+#define RESAMPLE_IMPLEMENTATION
+#include "resample.h"
+
+#define FRAME_HEADLESS
+#define FRAME_IMPLEMENTATION
+#include "frame.h"
+
+#define PNM_IMPLEMENTATION
+#include "pnm.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define QOI_IMPLEMENTATION
+#include "qoi.h"
+
+#define DOWNSCALE_IMPLEMENTATION
+#include "downscale.h"
+
+#define IO_QUIET
+#define IO_IMPLEMENTATION
+#include "io.h"
+
+#define CACHE_IMPLEMENTATION
+#include "cache.h"
+
+#define RAM_CACHE_IMPLEMENTATION
+#include "ramcache.h"
+
+#define IMAGE_IMPLEMENTATION
+#include "image.h"
+
+#define VIEW_IMPLEMENTATION
+#include "view.h"
+
+#define PADDING 48
+#define SYNTHETIC_SIZE 4096
+#define SPRITE_SIZE 64
+#define SPRITE_LAYERS 4
+#define THUMB_SIZE 128 // like the viewer
+#define THUMB_UPLOADS 128 // into the atlas per frame, like the viewer
+#define GRID_THUMBS 5000 // a folder the grid should fill within a second
+#define GRID_BATCH 256 // read at once, then copied into the atlas
+#define GRID_ATLAS 2048
+
+static Frame frame;
+
+typedef enum{
+  STEP_ZOOM,
+  STEP_PAN,
+  STEP_SHRINK,
+}Step_Kind;
+
+// one wheel step, 'dx', 'dy' pixels of dragging or a zoom factor of 'dx',
+// per frame
+typedef struct{
+  Step_Kind kind;
+  int frames;
+  float dx, dy;
+}Step;
+
+static Step session[] = {
+  {STEP_ZOOM, 60,  1.f,  0.f},
+  {STEP_PAN,  60,  6.f,  4.f},
+  {STEP_ZOOM, 30, -2.f,  0.f},
+  {STEP_PAN,  60, -6.f, -4.f},
+  {STEP_ZOOM, 30,  1.f,  0.f},
+  {STEP_PAN,  60,  0.f, -8.f},
+  {STEP_ZOOM, 30, -1.f,  0.f},
+  {STEP_PAN,  60,  0.f,  8.f},
+  {STEP_SHRINK, 30, 0.933f, 0.f},
+  {STEP_PAN,  60,  4.f,  4.f},
+  {STEP_SHRINK, 30, 1.f / 0.933f, 0.f},
+};
+
+typedef struct{
+  size_t step;
+  int step_frame;
+  float mouse_x, mouse_y;
+  float zoom_factor; // of this frame, 'STEP_SHRINK'
+}Script;
+
+static void script_next(Script *s) {
+  Step *step = &session[s->step];
+  Frame_Event e = {0};
+
+  s->zoom_factor = 1.f;
+  if(step->kind == STEP_SHRINK) {
+    s->zoom_factor = step->dx;
+  } else if(step->kind == STEP_ZOOM) {
+    e.type = FRAME_EVENT_MOUSEWHEEL;
+    e.as.amount = (int) step->dx;
+    frame_push_event(&frame, &e);
+  } else {
+    if(s->step_frame == 0) {
+      s->mouse_x = (float) frame.width / 2;
+      s->mouse_y = (float) frame.height / 2;
+      frame_set_mouse_position(&frame, s->mouse_x, s->mouse_y);
+      e.type = FRAME_EVENT_MOUSEPRESS;
+      e.as.key = 'l';
+      frame_push_event(&frame, &e);
+    }
+    s->mouse_x += step->dx;
+    s->mouse_y += step->dy;
+    frame_set_mouse_position(&frame, s->mouse_x, s->mouse_y);
+    if(s->step_frame == step->frames - 1) {
+      e.type = FRAME_EVENT_MOUSERELEASE;
+      e.as.key = 'l';
+      frame_push_event(&frame, &e);
+    }
+  }
+
+  if(++s->step_frame == step->frames) {
+    s->step_frame = 0;
+    s->step = (s->step + 1) % (sizeof(session) / sizeof(session[0]));
+  }
+}
+
+static void synthetic_fill(unsigned char *pixels, int width, int height) {
+  for(int y=0;y<height;y++) {
+    for(int x=0;x<width;x++) {
+      unsigned char *p = pixels + ((size_t) y * (size_t) width + (size_t) x) * 4;
+      bool checker = ((x >> 6) ^ (y >> 6)) & 1;
+      p[0] = (unsigned char) (x * 255 / width);
+      p[1] = (unsigned char) (y * 255 / height);
+      p[2] = checker ? 255 : 64;
+      p[3] = 255;
+    }
+  }
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(double *sorted, int count, double p) {
+  int i = (int) (p * (double) (count - 1) + 0.5);
+  return sorted[i];
+}
+
+static bool dump(const char *dir, bool as_qoi, long long n, const unsigned char *pixels, unsigned char *flipped) {
+  size_t stride = (size_t) frame.width * 4;
+  for(int y=0;y<frame.height;y++) {
+    memcpy(flipped + (size_t) y * stride, pixels + (size_t) (frame.height - 1 - y) * stride, stride);
+  }
+
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/frame_%05lld.%s", dir, n, as_qoi ? "qoi" : "pam");
+  if(as_qoi) {
+    qoi_desc desc = { (unsigned int) frame.width, (unsigned int) frame.height, 4, QOI_SRGB };
+    return qoi_write(path, flipped, &desc) > 0;
+  }
+  return pnm_write(path, frame.width, frame.height, 4, flipped) != 0;
+}
+
+// Decodes like the viewer does, into an upload buffer that outlives the decode
+static bool bench_loads(const char *path, int loads, int scaled_width, int scaled_height) {
+  int width, height;
+  unsigned char *data = image_decode(path, &width, &height);
+  if(!data) return false;
+  alloc_free(data);
+  size_t upload_size = (size_t) width * (size_t) height * 4;
+  unsigned char *upload = malloc(upload_size);
+  if(!upload) return false;
+
+  int passes = 3;
+  int src_width = width, src_height = height;
+  if(scaled_width > 0) {
+    downscale_fit(src_width, src_height, scaled_width, scaled_height, &scaled_width, &scaled_height);
+    passes = 4;
+  }
+
+  printf("loads    : %d of %s\n", loads, path);
+  // decode into a copy, into a copy with an arena, straight into the upload,
+  // and shrunk into it. The second round runs them backwards, whatever the
+  // first pass warms up (page cache, heap) is then on the other side.
+  const char *names[4] = {"heap", "arena", "into", "scaled"};
+  for(int round=0;round<2 * passes;round++) {
+    int pass = round < passes ? round : 2 * passes - 1 - round;
+    Alloc_Arena arena = {0};
+    Alloc_Stats before, after;
+    alloc_stats(ALLOC_TAG_COUNT, &before);
+    Alloc_Scope scope;
+    alloc_scope_begin(&scope);
+
+    double start = frame_clock_ms();
+    for(int i=0;i<loads;i++) {
+      if(pass == 1 || pass == 2) alloc_arena_begin(&arena);
+      if(pass == 3) {
+	image_decode_scaled_into(path, src_width, src_height, upload, scaled_width, scaled_height);
+      } else if(pass == 2) {
+	image_decode_into(path, &width, &height, upload, upload_size, 0, false);
+      } else {
+	data = image_decode(path, &width, &height);
+	if(data) memcpy(upload, data, (size_t) width * (size_t) height * 4);
+	alloc_free(data);
+      }
+      if(pass == 1 || pass == 2) {
+	alloc_arena_end();
+	alloc_arena_reset(&arena);
+      }
+    }
+    double ms = frame_clock_ms() - start;
+    alloc_scope_end();
+
+    alloc_stats(ALLOC_TAG_COUNT, &after);
+    long long system_allocs = (pass == 1 || pass == 2) ? arena.system_allocs : after.allocs - before.allocs;
+    printf("%-6s %d : %.3f ms per load, %lld mallocs, peak %.2f MB of the decoders",
+	   names[pass], round < passes ? 1 : 2, ms / loads, system_allocs, (double) scope.total.peak / (1024 * 1024));
+    if(pass == 3) printf(" into %dx%d", scaled_width, scaled_height);
+#ifdef __GLIBC__
+    // what the allocator holds on to, and how much of it is unused
+    struct mallinfo2 info = mallinfo2();
+    printf(", heap %.1f MB, %.1f MB of it free, %.1f MB mapped",
+	   (double) info.arena / (1024 * 1024), (double) info.fordblks / (1024 * 1024),
+	   (double) info.hblkhd / (1024 * 1024));
+#endif //__GLIBC__
+    printf("\n");
+
+    alloc_arena_free(&arena);
+  }
+
+  free(upload);
+  return true;
+}
+
+typedef struct{
+  Cache *cache;
+  const char *path;
+  unsigned char *pixels;
+  int width, height;
+  bool ok;
+}Bench_Grid_Thumb;
+
+static void bench_grid_job(void *arg, Pool_Token *token) {
+  (void) token;
+  Bench_Grid_Thumb *t = (Bench_Grid_Thumb *) arg;
+  unsigned long long key;
+  t->ok = cache_key(t->path, THUMB_SIZE, &key) &&
+    cache_get(t->cache, key, t->pixels, THUMB_SIZE * THUMB_SIZE * 4, &t->width, &t->height);
+}
+
+// GRID_THUMBS thumbnails of 'paths', again and again, read from the warm
+// cache on every core and copied into an atlas, like the grid of the viewer.
+// Reports whether a folder of them fills within a second, and how many
+// frames the copies take at THUMB_UPLOADS a frame.
+static bool bench_grid(Cache *cache, char **paths, int count) {
+  if(!frame_init(&frame, 640, 480, "bench", 0)) return false;
+
+  size_t size = THUMB_SIZE * THUMB_SIZE * 4;
+  Bench_Grid_Thumb *batch = malloc(sizeof(Bench_Grid_Thumb) * GRID_BATCH);
+  unsigned char *pixels = malloc(size * GRID_BATCH);
+  unsigned int atlas;
+  bool ok = batch && pixels && frame_renderer_push_texture(GRID_ATLAS, GRID_ATLAS, NULL, false, &atlas);
+  Pool p;
+  pool_init(&p, thread_cpu_count(), NULL, NULL);
+
+  int columns = GRID_ATLAS / (THUMB_SIZE + 2);
+  int shown = 0;
+  double read_ms = 0, upload_ms = 0;
+  for(int first=0;ok && first<GRID_THUMBS;first+=GRID_BATCH) {
+    int n = GRID_THUMBS - first < GRID_BATCH ? GRID_THUMBS - first : GRID_BATCH;
+    Pool_Token token = {0};
+    double start = frame_clock_ms();
+    for(int i=0;i<n;i++) {
+      Bench_Grid_Thumb *t = &batch[i];
+      t->cache = cache;
+      t->path = paths[(first + i) % count];
+      t->pixels = pixels + size * (size_t) i;
+      t->ok = false;
+      if(!pool_submit(&p, POOL_THUMBNAIL, bench_grid_job, NULL, t, &token)) bench_grid_job(t, &token);
+    }
+    pool_wait(&p, &token);
+    double read = frame_clock_ms();
+
+    for(int i=0;i<n;i++) {
+      if(!batch[i].ok) continue;
+      int slot = (first + i) % (columns * columns);
+      int x = (slot % columns) * (THUMB_SIZE + 2) + 1;
+      int y = (slot / columns) * (THUMB_SIZE + 2) + 1;
+      ok = ok && frame_renderer_push_to_texture(atlas, batch[i].pixels, x, y, batch[i].width, batch[i].height);
+      shown++;
+    }
+#ifndef FRAME_SOFTWARE
+    glFinish();
+#endif //FRAME_SOFTWARE
+    read_ms += read - start;
+    upload_ms += frame_clock_ms() - read;
+  }
+
+  int workers = p.workers_count;
+  pool_free(&p);
+  frame_free(&frame);
+  free(batch);
+  free(pixels);
+
+  double ms = read_ms + upload_ms;
+  int frames = (shown + THUMB_UPLOADS - 1) / THUMB_UPLOADS;
+  printf("grid     : %d of %d in %.1f ms on %d workers, %.1f ms read, %.1f ms into the atlas, %s a second\n",
+	 shown, GRID_THUMBS, ms, workers, read_ms, upload_ms, ms <= 1000 ? "within" : "NOT within");
+  printf("uploads  : %.3f ms per thumbnail, %d frames at %d a frame, %.2f ms of every frame\n",
+	 shown ? upload_ms / shown : 0, frames, THUMB_UPLOADS, shown ? upload_ms / shown * THUMB_UPLOADS : 0);
+  return ok && shown == GRID_THUMBS;
+}
+
+// Thumbnails of every image in 'dir', made from the images and then read
+// back from a cache of them, like the grid of the viewer does on a warm start
+static bool bench_thumbs(const char *dir) {
+  char dir_path[IO_MAX_PATH];
+  int len = snprintf(dir_path, sizeof(dir_path), "%s/", dir);
+  if(len < 0 || len >= (int) sizeof(dir_path)) return false;
+
+  char **paths = NULL;
+  int count = 0, cap = 0;
+  Io_Dir d;
+  if(!io_dir_open(&d, dir_path)) return false;
+  Io_Dir_Entry entry;
+  while(io_dir_next(&d, &entry)) {
+    if(entry.is_dir) continue;
+    if(count == cap) {
+      cap = cap ? cap * 2 : 64;
+      paths = realloc(paths, sizeof(char *) * (size_t) cap);
+      if(!paths) return false;
+    }
+    paths[count] = malloc(strlen(entry.abs_name) + 1);
+    if(!paths[count]) break;
+    strcpy(paths[count++], entry.abs_name);
+  }
+  io_dir_close(&d);
+
+  Cache cache;
+  if(!cache_open(&cache, "viewer-bench", 1ULL << 40)) return false;
+  cache_evict(&cache); // what a run before left
+  unsigned char *thumb = malloc(THUMB_SIZE * THUMB_SIZE * 4);
+
+  printf("thumbs   : %d files of %s, into %s\n", count, dir, cache.dir);
+  int made = 0, hits = 0;
+  unsigned long long bytes = 0;
+  for(int pass=0;pass<2;pass++) {
+    double start = frame_clock_ms();
+    for(int i=0;thumb && i<count;i++) {
+      unsigned long long key;
+      if(!cache_key(paths[i], THUMB_SIZE, &key)) continue;
+      int width, height;
+      if(pass == 1) {
+	hits += cache_get(&cache, key, thumb, THUMB_SIZE * THUMB_SIZE * 4, &width, &height);
+	continue;
+      }
+
+      if(image_thumb(paths[i], THUMB_SIZE, thumb, &width, &height) &&
+	 cache_put(&cache, key, thumb, width, height)) {
+	made++;
+      }
+    }
+    double ms = frame_clock_ms() - start;
+    if(pass == 0) {
+      bytes = cache.size;
+      printf("cold     : %.3f ms per thumbnail, %d made, %.1f KB each on disk\n",
+	     made ? ms / made : 0, made, made ? (double) bytes / made / 1024 : 0);
+    } else {
+      printf("warm     : %.3f ms per thumbnail, %d of %d hit\n", hits ? ms / hits : 0, hits, made);
+    }
+  }
+
+  // only the files that have a thumbnail
+  int kept = 0;
+  for(int i=0;i<count;i++) {
+    unsigned long long key;
+    int width, height;
+    if(thumb && cache_key(paths[i], THUMB_SIZE, &key) &&
+       cache_get(&cache, key, thumb, THUMB_SIZE * THUMB_SIZE * 4, &width, &height)) {
+      char *path = paths[kept];
+      paths[kept++] = paths[i];
+      paths[i] = path;
+    }
+  }
+  bool grid_ok = kept > 0 && bench_grid(&cache, paths, kept);
+
+  io_delete_dir(cache.dir);
+  cache_close(&cache);
+  free(thumb);
+  for(int i=0;i<count;i++) free(paths[i]);
+  free(paths);
+  return made > 0 && hits == made && grid_ok;
+}
+
+// Keeps the image in a Ram_Cache, raw, as QOI and with the adaptive
+// policy, and times 'hits' reads of it against decoding the file again
+static bool bench_ram_cache(const char *path, const unsigned char *pixels, int width, int height, int hits) {
+  size_t size = (size_t) width * (size_t) height * 4;
+  unsigned char *out = malloc(size);
+  if(!out) return false;
+
+  printf("ramcache : %d hits of %dx%d, %.1f MB raw\n", hits, width, height, (double) size / (1024 * 1024));
+  if(path) {
+    double start = frame_clock_ms();
+    int w, h;
+    for(int i=0;i<hits;i++) image_decode_into(path, &w, &h, out, size, 0, false);
+    printf("%-9s: %.3f ms per load\n", "file", (frame_clock_ms() - start) / hits);
+  }
+
+  const char *names[3] = {"raw", "qoi", "adaptive"};
+  float ratios[3] = {0, .75f, RAM_CACHE_MIN_RATIO}; // .75 leaves room for any image
+  bool ok = true;
+  for(int pass=0;pass<3;pass++) {
+    Ram_Cache c;
+    ram_cache_init(&c, size * 2);
+    c.min_ratio = ratios[pass];
+
+    double start = frame_clock_ms();
+    ok = ok && ram_cache_put(&c, 1, pixels, width, height);
+    double put_ms = frame_clock_ms() - start;
+
+    start = frame_clock_ms();
+    int w, h;
+    for(int i=0;ok && i<hits;i++) ok = ram_cache_get(&c, 1, out, size, &w, &h);
+    double hit_ms = (frame_clock_ms() - start) / hits;
+    ok = ok && memcmp(out, pixels, size) == 0;
+
+    printf("%-9s: %.3f ms per hit, %.3f ms to keep, %.2f MB kept (%.2fx)%s\n",
+	   names[pass], hit_ms, put_ms, (double) c.size / (1024 * 1024),
+	   c.size ? (double) size / (double) c.size : 0, c.puts_raw ? ", raw" : ", as QOI");
+    ram_cache_free(&c);
+  }
+
+  free(out);
+  return ok;
+}
+
+// Thumbnails of one synthetic tile, shared by the jobs of '-pool'
+typedef struct{
+  unsigned char *tile;
+  unsigned long long *sums; // of every job
+  int jobs;
+  Thread_Atomic gate; // the blocking job spins until it is set
+  Thread_Atomic started;
+  Thread_Atomic order[POOL_PRIORITY_COUNT * 4];
+  Thread_Atomic order_count;
+  int cancelled;
+}Bench_Pool;
+
+static Bench_Pool bench_pool_state;
+
+static unsigned long long bench_pool_thumb(const unsigned char *tile) {
+  unsigned char thumb[THUMB_SIZE * THUMB_SIZE * 4];
+  if(!resample(tile, 512, 512, 512 * 4, thumb, THUMB_SIZE, THUMB_SIZE, THUMB_SIZE * 4,
+	       RESAMPLE_BICUBIC, RESAMPLE_PREMULTIPLY, NULL)) {
+    return 0;
+  }
+  unsigned long long h = 14695981039346656037ULL;
+  for(size_t i=0;i<sizeof(thumb);i++) h = (h ^ thumb[i]) * 1099511628211ULL;
+  return h;
+}
+
+static void bench_pool_job(void *arg, Pool_Token *token) {
+  (void) token;
+  Bench_Pool *b = &bench_pool_state;
+  b->sums[(unsigned long long *) arg - b->sums] = bench_pool_thumb(b->tile);
+}
+
+// Submits every job onto its own deque, the other workers have to steal them
+static void bench_pool_root(void *arg, Pool_Token *token) {
+  Pool *p = (Pool *) arg;
+  Bench_Pool *b = &bench_pool_state;
+  for(int i=0;i<b->jobs;i++) pool_submit(p, POOL_THUMBNAIL, bench_pool_job, NULL, &b->sums[i], token);
+}
+
+static void bench_pool_block(void *arg, Pool_Token *token) {
+  (void) arg;
+  (void) token;
+  thread_atomic_store(&bench_pool_state.started, 1);
+  while(!thread_atomic_load(&bench_pool_state.gate)) thread_yield();
+}
+
+static void bench_pool_record(void *arg, Pool_Token *token) {
+  (void) token;
+  Bench_Pool *b = &bench_pool_state;
+  long i = thread_atomic_add(&b->order_count, 1);
+  if(i < POOL_PRIORITY_COUNT * 4) thread_atomic_store(&b->order[i], (long) (size_t) arg);
+}
+
+static void bench_pool_done(void *arg, bool cancelled) {
+  (void) arg;
+  if(cancelled) bench_pool_state.cancelled++;
+}
+
+// Blocks the only worker of 'p', so what is submitted next queues up
+static void bench_pool_hold(Pool *p, Pool_Token *token) {
+  thread_atomic_store(&bench_pool_state.gate, 0);
+  thread_atomic_store(&bench_pool_state.started, 0);
+  pool_submit(p, POOL_VISIBLE, bench_pool_block, NULL, NULL, token);
+  while(!thread_atomic_load(&bench_pool_state.started)) thread_yield();
+}
+
+// Makes 'jobs' thumbnails on 1, 2, 4.. workers up to the cores, each time
+// submitted from outside and fanned out from one job. Then checks the
+// order of the priorities and that cancelled jobs are skipped.
+static bool bench_pool(int jobs) {
+  Bench_Pool *b = &bench_pool_state;
+  memset(b, 0, sizeof(*b));
+  b->jobs = jobs;
+  b->tile = malloc(512 * 512 * 4);
+  b->sums = malloc(sizeof(unsigned long long) * (size_t) jobs);
+  if(!b->tile || !b->sums) return false;
+  synthetic_fill(b->tile, 512, 512);
+  unsigned long long expected = bench_pool_thumb(b->tile);
+
+  int cores = thread_cpu_count();
+  if(cores > POOL_WORKERS_CAP) cores = POOL_WORKERS_CAP;
+  printf("pool     : %d thumbnails of 512x512, %d cores\n", jobs, cores);
+  bool ok = expected != 0;
+  double base_ms[2] = {0, 0};
+  for(int workers=1;ok;workers*=2) {
+    if(workers > cores) workers = cores;
+    for(int fan=0;fan<2 && ok;fan++) {
+      Pool p;
+      pool_init(&p, workers, NULL, NULL);
+      Pool_Token token = {0};
+      memset(b->sums, 0, sizeof(unsigned long long) * (size_t) jobs);
+
+      double start = frame_clock_ms();
+      if(fan) {
+	pool_submit(&p, POOL_THUMBNAIL, bench_pool_root, NULL, &p, &token);
+      } else {
+	for(int i=0;i<jobs;i++) pool_submit(&p, POOL_THUMBNAIL, bench_pool_job, NULL, &b->sums[i], &token);
+      }
+      pool_wait(&p, &token);
+      double ms = frame_clock_ms() - start;
+
+      long ran = 0, stolen = 0;
+      for(int i=0;i<p.workers_count;i++) {
+	ran += thread_atomic_load(&p.workers[i].ran);
+	stolen += thread_atomic_load(&p.workers[i].stolen);
+      }
+      int started = p.workers_count;
+      pool_free(&p);
+      for(int i=0;i<jobs;i++) ok = ok && b->sums[i] == expected;
+
+      if(workers == 1) base_ms[fan] = ms;
+      printf("%-9s: %2d workers, %8.2f ms, %.3f ms per job, %.2fx, %ld of %ld stolen\n",
+	     fan ? "fanned" : "outside", started, ms, ms / jobs, ms > 0 ? base_ms[fan] / ms : 0, stolen, ran);
+    }
+    if(workers == cores) break;
+  }
+
+  // one worker, held while four jobs of every priority queue up, lowest first
+  Pool p;
+  pool_init(&p, 1, NULL, NULL);
+  Pool_Token token = {0};
+  bench_pool_hold(&p, &token);
+  for(int priority=POOL_PRIORITY_COUNT-1;priority>=0;priority--) {
+    for(int i=0;i<4;i++) pool_submit(&p, (Pool_Priority) priority, bench_pool_record, NULL, (void *) (size_t) priority, &token);
+  }
+  thread_atomic_store(&b->gate, 1);
+  pool_wait(&p, &token);
+  bool ordered = thread_atomic_load(&b->order_count) == POOL_PRIORITY_COUNT * 4;
+  for(int i=1;ordered && i<POOL_PRIORITY_COUNT * 4;i++) {
+    ordered = thread_atomic_load(&b->order[i - 1]) <= thread_atomic_load(&b->order[i]);
+  }
+  printf("priority : %s\n", ordered ? "highest first" : "out of order");
+
+  // the same, with the jobs cancelled before the worker is let go
+  Pool_Token hold = {0};
+  bench_pool_hold(&p, &hold);
+  for(int i=0;i<jobs;i++) pool_submit(&p, POOL_THUMBNAIL, bench_pool_job, bench_pool_done, &b->sums[i], &token);
+  memset(b->sums, 0, sizeof(unsigned long long) * (size_t) jobs);
+  pool_cancel(&token);
+  thread_atomic_store(&b->gate, 1);
+  pool_wait(&p, &token);
+  pool_wait(&p, &hold);
+  pool_poll(&p);
+  bool skipped = b->cancelled == jobs;
+  for(int i=0;i<jobs;i++) skipped = skipped && b->sums[i] == 0;
+  printf("cancel   : %d of %d skipped\n", b->cancelled, jobs);
+  pool_free(&p);
+
+  free(b->tile);
+  free(b->sums);
+  return ok && ordered && skipped;
+}
+
+#define THROUGHPUT_FRAMES 60
+
+static double bench_throughput_frame(int width, int height, bool sprites, int count, int n) {
+  Frame_Event event;
+  while(frame_peek(&frame, &event)) ;
+
+  double start = frame_clock_ms();
+  for(int i=0;i<count;i++) {
+    float x = (float) ((i * 37 + n) % width);
+    float y = (float) ((i * 91) % height);
+    if(sprites) {
+      frame_renderer_sprite(vec2f(x, y), vec2f(8, 8), vec2f(0, 0), vec2f(1, 1), WHITE, i % SPRITE_LAYERS);
+    } else {
+      frame_renderer_solid_rect(vec2f(x, y), vec2f(8, 8), vec4f(1, (float) (i & 255) / 255.f, 0, 1));
+    }
+  }
+  frame_swap_buffers(&frame);
+#ifndef FRAME_SOFTWARE
+  glFinish();
+#endif //FRAME_SOFTWARE
+  return frame_clock_ms() - start;
+}
+
+static void bench_throughput(int width, int height) {
+  for(int sprites=0;sprites<2;sprites++) {
+    for(int count=100;count<=100000;count*=10) {
+      bench_throughput_frame(width, height, sprites, count, -1);
+      double ms = 0;
+      for(int n=0;n<THROUGHPUT_FRAMES;n++) ms += bench_throughput_frame(width, height, sprites, count, n);
+      ms /= THROUGHPUT_FRAMES;
+      printf("%s  : %6d per frame, %.3f ms/frame, %.0f quads/ms\n",
+	     sprites ? "sprites" : "quads  ", count, ms, (double) count / ms);
+    }
+  }
+}
+
+#ifdef FRAME_SOFTWARE
+static unsigned long long bench_flushes_frame(int width, int height, int n) {
+  Frame_Event event;
+  while(frame_peek(&frame, &event)) ;
+  for(int i=0;i<256;i++) {
+    float x = (float) ((i * 37 + n) % width);
+    float y = (float) ((i * 91) % height);
+    frame_renderer_solid_rect(vec2f(x, y), vec2f(48, 48), vec4f(1, (float) (i & 255) / 255.f, 0, 0.5f));
+  }
+  frame_swap_buffers(&frame);
+
+  // FNV-1a
+  unsigned long long hash = 14695981039346656037ULL;
+  for(size_t i=0;i<(size_t) width * (size_t) height;i++) {
+    hash = (hash ^ frame.framebuffer[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+static bool bench_flushes(int width, int height, int flushes) {
+  if(!frame_init(&frame, width, height, "bench", 0)) return false;
+
+  frame_renderer_software_threads(1);
+  unsigned long long expected[4];
+  for(int n=0;n<4;n++) expected[n] = bench_flushes_frame(width, height, n);
+
+  // a few workers even on fewer cores, so that the bands interleave
+  int workers = thread_cpu_count() > 3 ? thread_cpu_count() : 3;
+  Pool p;
+  pool_init(&p, workers, NULL, NULL);
+  frame_renderer_software_pool(&p);
+  int wrong = 0;
+  double start = frame_clock_ms();
+  for(int i=0;i<flushes;i++) {
+    frame_renderer_software_threads(2 + i % (p.workers_count > 0 ? p.workers_count : 1));
+    for(int n=0;n<4;n++) {
+      if(bench_flushes_frame(width, height, n) != expected[n]) wrong++;
+    }
+  }
+  double ms = frame_clock_ms() - start;
+  frame_renderer_software_pool(NULL);
+  frame_renderer_software_threads(0);
+  pool_free(&p);
+  frame_free(&frame);
+
+  printf("flushes   : %d rounds on 2-%d threads, %d frames, %.3f ms/frame, %d wrong\n",
+	 flushes, p.workers_count + 1, flushes * 4, ms / (flushes * 4), wrong);
+  return wrong == 0;
+}
+#endif //FRAME_SOFTWARE
+
+static double srgb_to_linear(double v) {
+  return v <= .04045 ? v / 12.92 : pow((v + .055) / 1.055, 2.4);
+}
+
+static double linear_to_srgb(double v) {
+  return v <= .0031308 ? v * 12.92 : 1.055 * pow(v, 1 / 2.4) - .055;
+}
+
+// Straight from the definition: every target pixel sums the kernel over
+// its whole 2D footprint, in double, without tables or passes
+static void resample_reference(const unsigned char *src, int src_width, int src_height,
+			       unsigned char *dst, int dst_width, int dst_height,
+			       Resample_Filter filter, int flags) {
+  double scale_x = (double) dst_width / src_width, scale_y = (double) dst_height / src_height;
+  double stretch_x = scale_x < 1 ? 1 / scale_x : 1, stretch_y = scale_y < 1 ? 1 / scale_y : 1;
+  double support = resample_filter_support(filter);
+  double support_x = support * stretch_x, support_y = support * stretch_y;
+  bool premultiply = (flags & RESAMPLE_PREMULTIPLY) != 0;
+  bool linear = (flags & RESAMPLE_LINEAR_LIGHT) != 0;
+
+  for(int y=0;y<dst_height;y++) {
+    double center_y = (y + .5) / scale_y;
+    for(int x=0;x<dst_width;x++) {
+      double center_x = (x + .5) / scale_x;
+      double sum[4] = {0}, total = 0;
+      for(int j=(int) floor(center_y - support_y) - 1;j<=(int) ceil(center_y + support_y);j++) {
+	double wy = resample_filter(filter, (float) ((j + .5 - center_y) / stretch_y));
+	if(wy == 0) continue;
+	int sy = j < 0 ? 0 : (j >= src_height ? src_height - 1 : j);
+	for(int i=(int) floor(center_x - support_x) - 1;i<=(int) ceil(center_x + support_x);i++) {
+	  double w = wy * resample_filter(filter, (float) ((i + .5 - center_x) / stretch_x));
+	  if(w == 0) continue;
+	  int sx = i < 0 ? 0 : (i >= src_width ? src_width - 1 : i);
+	  const unsigned char *p = src + ((size_t) sy * (size_t) src_width + (size_t) sx) * 4;
+	  double a = p[3] / 255.;
+	  for(int c=0;c<3;c++) {
+	    double v = linear ? srgb_to_linear(p[c] / 255.) : p[c] / 255.;
+	    sum[c] += w * (premultiply ? v * a : v);
+	  }
+	  sum[3] += w * a;
+	  total += w;
+	}
+      }
+
+      unsigned char *q = dst + ((size_t) y * (size_t) dst_width + (size_t) x) * 4;
+      double a = sum[3] / total;
+      a = a < 0 ? 0 : (a > 1 ? 1 : a);
+      for(int c=0;c<3;c++) {
+	double v = sum[c] / total;
+	if(premultiply) v = a > 0 ? v / a : 0;
+	v = v < 0 ? 0 : (v > 1 ? 1 : v);
+	if(linear) v = linear_to_srgb(v);
+	q[c] = (unsigned char) (v * 255 + .5);
+      }
+      q[3] = (unsigned char) (a * 255 + .5);
+    }
+  }
+}
+
+#if defined(FRAME_SOFTWARE) && defined(RESAMPLE_MIPMAP_FLAGS)
+// The mipmaps of the software renderer through resample.h against its own
+// box filter. Where the source is flat the two agree, elsewhere linear light
+// shifts the averages.
+static bool bench_mipmaps(const unsigned char *pixels, int width, int height) {
+  int w = width > 1 ? width / 2 : 1;
+  int h = height > 1 ? height / 2 : 1;
+  // level 1 of both, then the smaller ones in turns
+  unsigned char *first[2], *scratch[2];
+  for(int k=0;k<2;k++) first[k] = malloc((size_t) w * (size_t) h * 4);
+  for(int k=0;k<2;k++) scratch[k] = malloc((size_t) w * (size_t) h * 4);
+  bool ok = first[0] && first[1] && scratch[0] && scratch[1];
+
+  // the whole chain, every level from the one before it
+  double ms[2] = {0};
+  for(int k=0;ok && k<2;k++) {
+    double start = frame_clock_ms();
+    const unsigned char *src = pixels;
+    int src_width = width, src_height = height;
+    for(int level=1;src_width > 1 || src_height > 1;level++) {
+      int lw = src_width > 1 ? src_width / 2 : 1;
+      int lh = src_height > 1 ? src_height / 2 : 1;
+      unsigned char *dst = level == 1 ? first[k] : scratch[level & 1];
+      if(k == 0) frame_renderer_mipmap_box(src, src_width, src_height, dst, lw, lh);
+      else FRAME_MIPMAP_LEVEL(src, src_width, src_height, dst, lw, lh);
+      src = dst;
+      src_width = lw;
+      src_height = lh;
+    }
+    ms[k] = frame_clock_ms() - start;
+  }
+
+  // the first level, compared where the footprints of both filters are flat
+  int max_flat = 0, max_error = 0;
+  for(int y=0;ok && y<h;y++) {
+    for(int x=0;x<w;x++) {
+      const unsigned char *corner = pixels + ((size_t) (y * 2) * (size_t) width + (size_t) (x * 2)) * 4;
+      bool flat = true;
+      for(int sy=y*2-1;flat && sy<=y*2+2;sy++) {
+	for(int sx=x*2-1;flat && sx<=x*2+2;sx++) {
+	  int cy = sy < 0 ? 0 : sy >= height ? height - 1 : sy;
+	  int cx = sx < 0 ? 0 : sx >= width ? width - 1 : sx;
+	  flat = memcmp(pixels + ((size_t) cy * (size_t) width + (size_t) cx) * 4, corner, 4) == 0;
+	}
+      }
+      for(int i=0;i<4;i++) {
+	size_t at = ((size_t) y * (size_t) w + (size_t) x) * 4 + (size_t) i;
+	int e = abs((int) first[0][at] - (int) first[1][at]);
+	if(e > max_error) max_error = e;
+	if(flat && e > max_flat) max_flat = e;
+      }
+    }
+  }
+
+  printf("mipmaps  : box %.3f ms, RESAMPLE_MIPMAP_FLAGS %.3f ms, level 1 max error %d, flat %d\n",
+	 ms[0], ms[1], max_error, max_flat);
+  for(int k=0;k<2;k++) {
+    free(first[k]);
+    free(scratch[k]);
+  }
+  return ok && max_flat <= 1;
+}
+#endif //FRAME_SOFTWARE && RESAMPLE_MIPMAP_FLAGS
+
+// Every filter, with and without linear light and premultiplied alpha
+static bool bench_resample(const unsigned char *pixels, int width, int height, int dst_width, int dst_height) {
+  unsigned char *dst = malloc((size_t) dst_width * (size_t) dst_height * 4);
+
+  // the reference is too slow for all of it, compare on a crop of the middle
+  int crop_width = width < 256 ? width : 256;
+  int crop_height = height < 256 ? height : 256;
+  int crop_dst_width = (int) ((long long) crop_width * dst_width / width);
+  int crop_dst_height = (int) ((long long) crop_height * dst_height / height);
+  if(crop_dst_width < 1) crop_dst_width = 1;
+  if(crop_dst_height < 1) crop_dst_height = 1;
+  unsigned char *crop = malloc((size_t) crop_width * (size_t) crop_height * 4);
+  unsigned char *crop_dst = malloc((size_t) crop_dst_width * (size_t) crop_dst_height * 4);
+  unsigned char *crop_ref = malloc((size_t) crop_dst_width * (size_t) crop_dst_height * 4);
+  bool ok = dst && crop && crop_dst && crop_ref;
+
+  if(ok) {
+    int x0 = (width - crop_width) / 2, y0 = (height - crop_height) / 2;
+    for(int y=0;y<crop_height;y++) {
+      memcpy(crop + (size_t) y * (size_t) crop_width * 4,
+	     pixels + ((size_t) (y0 + y) * (size_t) width + (size_t) x0) * 4, (size_t) crop_width * 4);
+    }
+
+    int cores = thread_cpu_count();
+    Pool pool;
+    pool_init(&pool, cores, NULL, NULL);
+    printf("resample : %dx%d into %dx%d, %d cores, crop %dx%d into %dx%d\n",
+	   width, height, dst_width, dst_height, cores, crop_width, crop_height, crop_dst_width, crop_dst_height);
+    const char *modes[2] = {"srgb", "linear"};
+    int mode_flags[2] = {0, RESAMPLE_LINEAR_LIGHT | RESAMPLE_PREMULTIPLY};
+    for(int f=0;ok && f<RESAMPLE_FILTER_COUNT;f++) {
+      for(int m=0;ok && m<2;m++) {
+	Resample_Filter filter = (Resample_Filter) f;
+	double start = frame_clock_ms();
+	ok = resample(pixels, width, height, (size_t) width * 4, dst, dst_width, dst_height, (size_t) dst_width * 4, filter, mode_flags[m], NULL);
+	double single_ms = frame_clock_ms() - start;
+	start = frame_clock_ms();
+	ok = ok && resample(pixels, width, height, (size_t) width * 4, dst, dst_width, dst_height, (size_t) dst_width * 4, filter, mode_flags[m], &pool);
+	double all_ms = frame_clock_ms() - start;
+
+	start = frame_clock_ms();
+	ok = ok && resample(crop, crop_width, crop_height, (size_t) crop_width * 4, crop_dst, crop_dst_width, crop_dst_height, (size_t) crop_dst_width * 4, filter, mode_flags[m], NULL);
+	double crop_ms = frame_clock_ms() - start;
+	start = frame_clock_ms();
+	resample_reference(crop, crop_width, crop_height, crop_ref, crop_dst_width, crop_dst_height, filter, mode_flags[m]);
+	double ref_ms = frame_clock_ms() - start;
+
+	int max_error = 0;
+	double squares = 0;
+	size_t count = (size_t) crop_dst_width * (size_t) crop_dst_height * 4;
+	for(size_t i=0;i<count;i++) {
+	  int e = abs((int) crop_dst[i] - (int) crop_ref[i]);
+	  if(e > max_error) max_error = e;
+	  squares += (double) e * e;
+	}
+	double psnr = squares == 0 ? INFINITY : 10 * log10(255. * 255. / (squares / (double) count));
+
+	printf("%-8s %-6s: %.3f ms, %.3f ms on all cores | crop %.3f ms, reference %.3f ms, max error %d, psnr %.1f dB\n",
+	       resample_filter_name(filter), modes[m], single_ms, all_ms, crop_ms, ref_ms, max_error, psnr);
+      }
+    }
+    pool_free(&pool);
+  }
+#if defined(FRAME_SOFTWARE) && defined(RESAMPLE_MIPMAP_FLAGS)
+  ok = ok && bench_mipmaps(pixels, width, height);
+#endif //FRAME_SOFTWARE && RESAMPLE_MIPMAP_FLAGS
+
+  free(dst);
+  free(crop);
+  free(crop_dst);
+  free(crop_ref);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+
+  int frames = 600;
+  int width = 1280, height = 720;
+  int quads = 0, sprites = 0;
+  bool mips = true;
+  bool throughput = false;
+  const char *dump_dir = NULL;
+  int every = 60;
+  bool as_qoi = false;
+  const char *csv_path = NULL;
+  const char *trace_path = NULL;
+  bool stats_report = false;
+  int loads = 0;
+  int scaled_width = 0, scaled_height = 0;
+  int resample_width = 0, resample_height = 0;
+  const char *thumbs_dir = NULL;
+  int ram_hits = 0;
+  int pool_jobs = 0;
+  int flushes = 0;
+  bool hud = false;
+  const char *path = NULL;
+
+  for(int i=1;i<argc;i++) {
+    const char *arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if(strcmp(arg, "-frames") == 0 && has_value) {
+      frames = atoi(argv[++i]);
+    } else if(strcmp(arg, "-size") == 0 && has_value) {
+      if(sscanf(argv[++i], "%dx%d", &width, &height) != 2) {
+	fprintf(stderr, "ERROR: Expected WxH for '-size'\n");
+	return 1;
+      }
+    } else if(strcmp(arg, "-quads") == 0 && has_value) {
+      quads = atoi(argv[++i]);
+    } else if(strcmp(arg, "-sprites") == 0 && has_value) {
+      sprites = atoi(argv[++i]);
+    } else if(strcmp(arg, "-throughput") == 0) {
+      throughput = true;
+    } else if(strcmp(arg, "-nomips") == 0) {
+      mips = false;
+    } else if(strcmp(arg, "-dump") == 0 && has_value) {
+      dump_dir = argv[++i];
+    } else if(strcmp(arg, "-every") == 0 && has_value) {
+      every = atoi(argv[++i]);
+    } else if(strcmp(arg, "-qoi") == 0) {
+      as_qoi = true;
+    } else if(strcmp(arg, "-csv") == 0 && has_value) {
+      csv_path = argv[++i];
+    } else if(strcmp(arg, "-trace") == 0 && has_value) {
+      trace_path = argv[++i];
+    } else if(strcmp(arg, "-loads") == 0 && has_value) {
+      loads = atoi(argv[++i]);
+    } else if(strcmp(arg, "-scaled") == 0 && has_value) {
+      if(sscanf(argv[++i], "%dx%d", &scaled_width, &scaled_height) != 2 || scaled_width < 1 || scaled_height < 1) {
+	fprintf(stderr, "ERROR: Expected WxH for '-scaled'\n");
+	return 1;
+      }
+    } else if(strcmp(arg, "-resample") == 0 && has_value) {
+      if(sscanf(argv[++i], "%dx%d", &resample_width, &resample_height) != 2 || resample_width < 1 || resample_height < 1) {
+	fprintf(stderr, "ERROR: Expected WxH for '-resample'\n");
+	return 1;
+      }
+    } else if(strcmp(arg, "-ramcache") == 0 && has_value) {
+      ram_hits = atoi(argv[++i]);
+    } else if(strcmp(arg, "-pool") == 0 && has_value) {
+      pool_jobs = atoi(argv[++i]);
+    } else if(strcmp(arg, "-flushes") == 0 && has_value) {
+      flushes = atoi(argv[++i]);
+    } else if(strcmp(arg, "-thumbs") == 0 && has_value) {
+      thumbs_dir = argv[++i];
+    } else if(strcmp(arg, "-stats") == 0) {
+      stats_report = true;
+    } else if(strcmp(arg, "-hud") == 0) {
+      hud = true;
+    } else if(arg[0] != '-') {
+      path = arg;
+    } else {
+      fprintf(stderr, "ERROR: Unknown argument '%s'\n", arg);
+      return 1;
+    }
+  }
+  if(frames < 1 || width < 1 || height < 1 || every < 1) {
+    fprintf(stderr, "ERROR: Invalid arguments\n");
+    return 1;
+  }
+
+  if(loads > 0) {
+    if(!path || !bench_loads(path, loads, scaled_width, scaled_height)) {
+      fprintf(stderr, "ERROR: '-loads' needs an image that can be decoded\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  if(pool_jobs > 0) {
+    if(!bench_pool(pool_jobs)) {
+      fprintf(stderr, "ERROR: The pool lost, reordered or did not cancel jobs\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  if(flushes > 0) {
+#ifdef FRAME_SOFTWARE
+    if(!bench_flushes(width, height, flushes)) {
+      fprintf(stderr, "ERROR: The software renderer drew frames differently on more threads\n");
+      return 1;
+    }
+    return 0;
+#else
+    fprintf(stderr, "ERROR: '-flushes' needs the software renderer\n");
+    return 1;
+#endif //FRAME_SOFTWARE
+  }
+
+  if(thumbs_dir) {
+    if(!bench_thumbs(thumbs_dir)) {
+      fprintf(stderr, "ERROR: Can not cache the thumbnails of '%s'\n", thumbs_dir);
+      return 1;
+    }
+    return 0;
+  }
+
+  if(ram_hits > 0) {
+    int w = SYNTHETIC_SIZE, h = SYNTHETIC_SIZE;
+    unsigned char *data = path ? image_decode(path, &w, &h) : malloc((size_t) w * (size_t) h * 4);
+    if(data && !path) synthetic_fill(data, w, h);
+    bool ok = data && bench_ram_cache(path, data, w, h, ram_hits);
+    if(path) alloc_free(data);
+    else free(data);
+    if(!ok) {
+      fprintf(stderr, "ERROR: Can not cache the image\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  if(resample_width > 0) {
+    int w = SYNTHETIC_SIZE, h = SYNTHETIC_SIZE;
+    unsigned char *data = path ? image_decode(path, &w, &h) : malloc((size_t) w * (size_t) h * 4);
+    if(data && !path) synthetic_fill(data, w, h);
+    bool ok = data && bench_resample(data, w, h, resample_width, resample_height);
+    if(path) alloc_free(data);
+    else free(data);
+    if(!ok) {
+      fprintf(stderr, "ERROR: Can not resample the image\n");
+      return 1;
+    }
+    return 0;
+  }
+
+  if(trace_path) {
+    trace_thread_name("main");
+    trace_start();
+  }
+
+  FILE *csv = NULL;
+  if(csv_path) {
+    csv = fopen(csv_path, "wb");
+    if(!csv) {
+      fprintf(stderr, "ERROR: Can not open '%s'\n", csv_path);
+      return 1;
+    }
+    frame_timing_csv_header(csv);
+  }
+
+  if(!frame_init(&frame, width, height, argv[0], dump_dir ? FRAME_READBACK : 0)) {
+    fprintf(stderr, "ERROR: Can not create a headless frame\n");
+    return 1;
+  }
+#ifdef FRAME_SOFTWARE
+  // the bands of the renderer on the workers, like the viewer
+  Pool render_pool;
+  pool_init(&render_pool, thread_cpu_count(), NULL, NULL);
+  frame_renderer_software_pool(&render_pool);
+#endif //FRAME_SOFTWARE
+
+  // upload the image
+  int img_width = SYNTHETIC_SIZE, img_height = SYNTHETIC_SIZE;
+  unsigned char *data = NULL;
+  Alloc_Scope decode_allocs = {0};
+  if(path) {
+    TRACE_BEGIN("image_decode");
+    alloc_scope_begin(&decode_allocs);
+    data = image_decode(path, &img_width, &img_height);
+    alloc_scope_end();
+    TRACE_END("image_decode");
+    if(!data) {
+      fprintf(stderr, "ERROR: Can not open '%s'\n", path);
+      return 1;
+    }
+  }
+
+  unsigned int tex;
+  void *pixels;
+  if(!frame_renderer_upload_begin(img_width, img_height, &tex, &pixels)) {
+    fprintf(stderr, "ERROR: Can not upload the image\n");
+    return 1;
+  }
+  if(data) {
+    memcpy(pixels, data, (size_t) img_width * (size_t) img_height * 4);
+    alloc_free(data);
+  } else {
+    synthetic_fill(pixels, img_width, img_height);
+  }
+  frame_renderer_upload_commit(tex);
+
+  Frame_Event event;
+  while(!frame_renderer_upload_done(tex)) {
+    while(frame_peek(&frame, &event)) ;
+    frame_swap_buffers(&frame);
+  }
+
+  if(sprites > 0 || throughput) {
+    if(!frame_renderer_sprites_init(SPRITE_SIZE, SPRITE_SIZE, SPRITE_LAYERS)) {
+      fprintf(stderr, "ERROR: Can not create the sprite array\n");
+      return 1;
+    }
+    unsigned char *layer = malloc(SPRITE_SIZE * SPRITE_SIZE * 4);
+    if(!layer) return 1;
+    for(int i=0;i<SPRITE_LAYERS;i++) {
+      synthetic_fill(layer, SPRITE_SIZE, SPRITE_SIZE);
+      for(int j=0;j<SPRITE_SIZE * SPRITE_SIZE;j++) layer[j * 4 + 2] = (unsigned char) (i * 64);
+      frame_renderer_sprites_upload(i, 0, 0, SPRITE_SIZE, SPRITE_SIZE, layer);
+    }
+    free(layer);
+  }
+
+  if(throughput) {
+    bench_throughput(width, height);
+#ifdef FRAME_SOFTWARE
+    frame_renderer_software_pool(NULL);
+    pool_free(&render_pool);
+#endif //FRAME_SOFTWARE
+    frame_free(&frame);
+    return 0;
+  }
+
+  View view = {0};
+  view_fit(&view, width, height, img_width, img_height, PADDING);
+
+  unsigned char *flipped = NULL;
+  if(dump_dir) {
+    flipped = malloc((size_t) width * (size_t) height * 4);
+    if(!flipped) return 1;
+  }
+  long long dumped = -1;
+
+  double *times = malloc(sizeof(double) * (size_t) frames);
+  if(!times) return 1;
+  Frame_Renderer_Stats stats = {0};
+  Script script = {0};
+  double minified_sum = 0;
+  int minified_count = 0;
+  bool minified = false;
+
+  // the first 'frame_peek' measures the time since warmup, throw it away
+  for(int n=-1;n<frames;n++) {
+    script_next(&script);
+    view.zoom *= script.zoom_factor;
+
+    while(frame_peek(&frame, &event)) {
+      Vec2f mouse;
+      frame_get_mouse_position(&frame, &mouse.x, &mouse.y);
+
+      switch(event.type) {
+      case FRAME_EVENT_MOUSEWHEEL: {
+	view_wheel(&view, event.as.amount);
+      } break;
+      case FRAME_EVENT_MOUSEPRESS: {
+	view_press(&view, mouse.x, mouse.y);
+      } break;
+      case FRAME_EVENT_MOUSERELEASE: {
+	view_release(&view);
+      } break;
+      default: {
+      } break;
+      }
+    }
+    if(n >= 0) {
+      times[n] = frame.dt;
+      // 'dt' is the time of the frame before
+      if(minified) {
+	minified_sum += frame.dt;
+	minified_count++;
+      }
+    }
+
+    float mouse_x, mouse_y;
+    frame_get_mouse_position(&frame, &mouse_x, &mouse_y);
+    view_drag(&view, mouse_x, mouse_y);
+
+    Vec2f pos, size;
+    view_rect(&view, width, height, img_width, img_height, &pos.x, &pos.y, &size.x, &size.y);
+
+    minified = view.zoom < 1.f;
+    frame_renderer_texture_filter(tex, mips ? view.zoom : 1.f);
+    frame_renderer_texture(tex, pos, size, vec2f(0, 0), vec2f(1, 1));
+
+    for(int i=0;i<quads;i++) {
+      float x = (float) ((i * 37) % width);
+      float y = (float) ((i * 91 + n) % height);
+      frame_renderer_solid_rect(vec2f(x, y), vec2f(8, 8), vec4f(1, (float) (i & 255) / 255.f, 0, 1));
+    }
+    for(int i=0;i<sprites;i++) {
+      float x = (float) ((i * 37 + n) % width);
+      float y = (float) ((i * 91) % height);
+      frame_renderer_sprite(vec2f(x, y), vec2f(SPRITE_SIZE / 2, SPRITE_SIZE / 2),
+			    vec2f(0, 0), vec2f(1, 1), WHITE, i % SPRITE_LAYERS);
+    }
+    if(hud) {
+      frame_renderer_hud(vec2f(8, (float) height - 8), 2);
+    }
+
+    frame_swap_buffers(&frame);
+#ifndef FRAME_SOFTWARE
+    // count the work of the frame, not only its submission
+    glFinish();
+#endif //FRAME_SOFTWARE
+
+    frame_renderer_stats(&stats);
+
+    // the GPU time of the last frame arrives with the next one
+    Frame_Timing timing;
+    if(csv && frame_timing(&timing, 1)) {
+      frame_timing_csv(csv, &timing);
+    }
+
+    if(dump_dir) {
+      long long done;
+      const unsigned char *read = frame_read_pixels(&frame, n == frames - 1, &done);
+      if(read && done != dumped && done % every == 0) {
+	if(!dump(dump_dir, as_qoi, done, read, flipped)) {
+	  fprintf(stderr, "ERROR: Can not write frame %lld into '%s'\n", done, dump_dir);
+	  return 1;
+	}
+	dumped = done;
+      }
+    }
+  }
+
+  double sum = 0;
+  for(int i=0;i<frames;i++) sum += times[i];
+  qsort(times, (size_t) frames, sizeof(double), compare_double);
+
+  printf("frames   : %d at %dx%d, image %dx%d", frames, width, height, img_width, img_height);
+  if(quads) printf(", %d quads", quads);
+  if(sprites) printf(", %d sprites", sprites);
+  printf("\n");
+  printf("time ms  : mean %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+	 sum / frames,
+	 percentile(times, frames, 0.5),
+	 percentile(times, frames, 0.9),
+	 percentile(times, frames, 0.99),
+	 times[frames - 1]);
+  if(minified_count > 0) {
+    printf("minified : %d frames, mean %.3f ms, mipmaps %s\n",
+	   minified_count, minified_sum / minified_count, mips ? "on" : "off");
+  }
+  printf("per frame: %u draw calls, %u gl calls, %u uniform uploads, %u verticies\n",
+	 stats.draw_calls, stats.gl_calls, stats.uniform_uploads, stats.verticies);
+
+  if(stats_report) {
+    if(path) alloc_report(stdout, "decode", &decode_allocs.total);
+    for(int i=0;i<=ALLOC_TAG_COUNT;i++) {
+      Alloc_Stats alloc;
+      alloc_stats((Alloc_Tag) i, &alloc);
+      if(alloc.allocs == 0 && i != ALLOC_TAG_COUNT) continue;
+      alloc_report(stdout, alloc_tag_name((Alloc_Tag) i), &alloc);
+    }
+  }
+
+  if(csv) fclose(csv);
+  if(trace_path && !trace_write(trace_path)) {
+    fprintf(stderr, "ERROR: Can not write the trace '%s'\n", trace_path);
+  }
+  free(times);
+  free(flipped);
+#ifdef FRAME_SOFTWARE
+  frame_renderer_software_pool(NULL);
+  pool_free(&render_pool);
+#endif //FRAME_SOFTWARE
+  frame_free(&frame);
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+// Keeps what the parts of a program hold in RAM and VRAM within limits.
+// Every part registers as a client and charges what it allocates. When a
+// reservation does not fit, the clients of a lower priority are asked to
+// evict, lowest first, until it does. A client that can not free anything
+// registers without a callback and is only ever refused.
+//
+//   Budget b;
+//   budget_init(&b, 4ULL << 30, 2ULL << 30);
+//   int cache = budget_register(&b, "cache", BUDGET_RAM, 0, cache_evict, &c);
+//   int decode = budget_register(&b, "decode", BUDGET_RAM, 1, NULL, NULL);
+//   if(budget_reserve(&b, decode, size)) {
+//     ...
+//     budget_release(&b, decode, size);
+//   }
+//
+// Callbacks run on the thread that reserves, without a lock held, and
+// report what they freed with 'budget_release'. Uses thread.h, include it first.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef BUDGET_DEF
+#  define BUDGET_DEF static inline
+#endif //BUDGET_DEF
+
+#define BUDGET_CLIENTS_CAP 16
+
+typedef enum{
+  BUDGET_RAM = 0,
+  BUDGET_VRAM,
+  BUDGET_KIND_COUNT,
+}Budget_Kind;
+
+// Frees about 'bytes' if it can
+typedef void (*Budget_Evict)(void *user, size_t bytes);
+
+typedef struct{
+  const char *name;
+  Budget_Kind kind;
+  int priority;
+  Budget_Evict evict;
+  void *user;
+  size_t used;
+  size_t peak;
+}Budget_Client;
+
+typedef struct{
+  size_t limits[BUDGET_KIND_COUNT]; // 0 for none
+  size_t used[BUDGET_KIND_COUNT];
+  size_t peaks[BUDGET_KIND_COUNT];
+  Budget_Client clients[BUDGET_CLIENTS_CAP];
+  int count;
+  long long evictions; // callbacks
+  long long refusals;
+  Thread_Mutex mutex;
+}Budget;
+
+BUDGET_DEF void budget_init(Budget *b, size_t ram_limit, size_t vram_limit);
+BUDGET_DEF void budget_free(Budget *b);
+
+// -1 once BUDGET_CLIENTS_CAP are registered
+BUDGET_DEF int budget_register(Budget *b, const char *name, Budget_Kind kind, int priority, Budget_Evict evict, void *user);
+
+// Fails if evicting every client of a lower priority does not make room
+BUDGET_DEF bool budget_reserve(Budget *b, int client, size_t bytes);
+// For what is taken either way, never fails
+BUDGET_DEF void budget_charge(Budget *b, int client, size_t bytes);
+BUDGET_DEF void budget_release(Budget *b, int client, size_t bytes);
+
+BUDGET_DEF const char *budget_kind_name(Budget_Kind kind);
+BUDGET_DEF void budget_report(Budget *b, FILE *f);
+
+#ifdef BUDGET_IMPLEMENTATION
+
+BUDGET_DEF void budget_init(Budget *b, size_t ram_limit, size_t vram_limit) {
+  memset(b, 0, sizeof(*b));
+  b->limits[BUDGET_RAM] = ram_limit;
+  b->limits[BUDGET_VRAM] = vram_limit;
+  thread_mutex_init(&b->mutex);
+}
+
+BUDGET_DEF void budget_free(Budget *b) {
+  thread_mutex_free(&b->mutex);
+}
+
+BUDGET_DEF int budget_register(Budget *b, const char *name, Budget_Kind kind, int priority, Budget_Evict evict, void *user) {
+  thread_mutex_lock(&b->mutex);
+  int index = -1;
+  if(b->count < BUDGET_CLIENTS_CAP) {
+    index = b->count++;
+    Budget_Client *c = &b->clients[index];
+    memset(c, 0, sizeof(*c));
+    c->name = name;
+    c->kind = kind;
+    c->priority = priority;
+    c->evict = evict;
+    c->user = user;
+  }
+  thread_mutex_unlock(&b->mutex);
+  return index;
+}
+
+static void budget_add(Budget *b, Budget_Client *c, size_t bytes) {
+  c->used += bytes;
+  if(c->used > c->peak) c->peak = c->used;
+  b->used[c->kind] += bytes;
+  if(b->used[c->kind] > b->peaks[c->kind]) b->peaks[c->kind] = b->used[c->kind];
+}
+
+BUDGET_DEF bool budget_reserve(Budget *b, int client, size_t bytes) {
+  if(client < 0) return true;
+  Budget_Client *c = &b->clients[client];
+  size_t limit = b->limits[c->kind];
+
+  // every client is asked once, and may free more than it was asked for
+  unsigned int asked = 0;
+  thread_mutex_lock(&b->mutex);
+  while(true) {
+    if(limit == 0 || b->used[c->kind] + bytes <= limit) {
+      budget_add(b, c, bytes);
+      thread_mutex_unlock(&b->mutex);
+      return true;
+    }
+
+    int victim = -1;
+    for(int i=0;i<b->count;i++) {
+      Budget_Client *v = &b->clients[i];
+      if(v->kind != c->kind || !v->evict || v->used == 0 || v->priority >= c->priority || (asked & (1u << i))) continue;
+      if(victim < 0 || v->priority < b->clients[victim].priority) victim = i;
+    }
+    if(victim < 0) break;
+    asked |= 1u << victim;
+
+    Budget_Client *v = &b->clients[victim];
+    size_t want = b->used[c->kind] + bytes - limit;
+    b->evictions++;
+    thread_mutex_unlock(&b->mutex);
+    v->evict(v->user, want);
+    thread_mutex_lock(&b->mutex);
+  }
+  b->refusals++;
+  thread_mutex_unlock(&b->mutex);
+  return false;
+}
+
+BUDGET_DEF void budget_charge(Budget *b, int client, size_t bytes) {
+  if(client < 0) return;
+  thread_mutex_lock(&b->mutex);
+  budget_add(b, &b->clients[client], bytes);
+  thread_mutex_unlock(&b->mutex);
+}
+
+BUDGET_DEF void budget_release(Budget *b, int client, size_t bytes) {
+  if(client < 0) return;
+  thread_mutex_lock(&b->mutex);
+  Budget_Client *c = &b->clients[client];
+  if(bytes > c->used) bytes = c->used;
+  c->used -= bytes;
+  b->used[c->kind] -= bytes;
+  thread_mutex_unlock(&b->mutex);
+}
+
+BUDGET_DEF const char *budget_kind_name(Budget_Kind kind) {
+  switch(kind) {
+  case BUDGET_RAM: return "ram";
+  case BUDGET_VRAM: return "vram";
+  default: return "?";
+  }
+}
+
+BUDGET_DEF void budget_report(Budget *b, FILE *f) {
+  thread_mutex_lock(&b->mutex);
+  for(int k=0;k<BUDGET_KIND_COUNT;k++) {
+    fprintf(f, "budget %-4s: %.1f MB, peak %.1f MB of %.0f MB\n", budget_kind_name((Budget_Kind) k),
+	    (double) b->used[k] / (1024 * 1024), (double) b->peaks[k] / (1024 * 1024),
+	    (double) b->limits[k] / (1024 * 1024));
+    for(int i=0;i<b->count;i++) {
+      Budget_Client *c = &b->clients[i];
+      if((int) c->kind != k) continue;
+      fprintf(f, "  %-12s: %.1f MB, peak %.1f MB\n", c->name,
+	      (double) c->used / (1024 * 1024), (double) c->peak / (1024 * 1024));
+    }
+  }
+  fprintf(f, "budget: %lld evictions, %lld refusals\n", b->evictions, b->refusals);
+  thread_mutex_unlock(&b->mutex);
+}
+
+#endif //BUDGET_IMPLEMENTATION
+
+#endif //BUDGET_H
@@ -0,0 +1,247 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// Keeps decoded images as QOI files in a folder, named after a hash of the
+// path, size and mtime of their source and of the size they were fitted
+// into. A lookup opens that one file, nothing is scanned. Hits touch the
+// file, and once the folder grows past its budget the files used longest
+// ago are deleted.
+//
+//   Cache c;
+//   cache_open(&c, "viewer", 256 << 20);
+//   cache_evict(&c); // on a thread that may wait for the disk
+//   unsigned long long key;
+//   if(cache_key(path, 128, &key) && !cache_get(&c, key, out, out_size, &width, &height)) {
+//     ...
+//     cache_put(&c, key, out, width, height);
+//   }
+//   cache_close(&c);
+//
+// Uses thread.h, io.h and qoi.h, include them first. Every call but open
+// and close may come from any thread.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef CACHE_DEF
+#  define CACHE_DEF static inline
+#endif //CACHE_DEF
+
+#define CACHE_PATH_CAP 1024
+#define CACHE_NAME_CAP 24 // 16 hex digits and the extension
+
+typedef struct{
+  char dir[CACHE_PATH_CAP]; // with a trailing '/'
+  unsigned long long budget; // bytes
+  unsigned long long size; // of its files, as far as it knows
+  bool evicting;
+  Thread_Mutex mutex;
+}Cache;
+
+// In $XDG_CACHE_HOME/'name'/ (~/.cache without it), %LOCALAPPDATA%\'name'\ on windows,
+// created with its parents. It does not look at the files, their size is
+// learned by the first 'cache_evict'.
+CACHE_DEF bool cache_open(Cache *c, const char *name, unsigned long long budget);
+CACHE_DEF void cache_close(Cache *c);
+
+// Fails unless 'path' exists. 'side' keeps images fitted into different sizes apart.
+CACHE_DEF bool cache_key(const char *path, int side, unsigned long long *key);
+// RGBA with packed rows, fails if it is not cached or does not fit
+CACHE_DEF bool cache_get(Cache *c, unsigned long long key, void *out, size_t out_size, int *width, int *height);
+CACHE_DEF bool cache_put(Cache *c, unsigned long long key, const void *pixels, int width, int height);
+
+// Reads the size of every file, and deletes the files used longest ago
+// until 3/4 of the budget is left
+CACHE_DEF void cache_evict(Cache *c);
+
+#ifdef CACHE_IMPLEMENTATION
+
+static void cache_path(Cache *c, unsigned long long key, const char *ext, char *path) {
+  snprintf(path, CACHE_PATH_CAP + CACHE_NAME_CAP, "%s%016llx%s", c->dir, key, ext);
+}
+
+// Like mkdir -p
+static bool cache_create_dirs(const char *path) {
+  char dir[CACHE_PATH_CAP];
+  size_t len = strlen(path);
+  if(len == 0 || len >= sizeof(dir)) return false;
+  memcpy(dir, path, len + 1);
+
+  for(size_t i=1;i<=len;i++) {
+    if(i < len && dir[i] != '/' && dir[i] != '\\') continue;
+    char c = dir[i];
+    dir[i] = 0;
+    bool is_file;
+    bool ok = io_exists(dir, &is_file) ? !is_file : io_create_dir(dir, NULL);
+    dir[i] = c;
+    if(!ok) return false;
+  }
+  return true;
+}
+
+CACHE_DEF bool cache_open(Cache *c, const char *name, unsigned long long budget) {
+  memset(c, 0, sizeof(*c));
+  c->budget = budget;
+
+  char base[CACHE_PATH_CAP];
+#ifdef _WIN32
+  if(!io_getenv("LOCALAPPDATA", base, sizeof(base), NULL)) return false;
+#else
+  if(!io_getenv("XDG_CACHE_HOME", base, sizeof(base), NULL) || base[0] == 0) {
+    if(!io_getenv("HOME", base, sizeof(base), NULL)) return false;
+    size_t len = strlen(base);
+    if(len + 8 >= sizeof(base)) return false;
+    memcpy(base + len, "/.cache", 8);
+  }
+#endif //_WIN32
+
+  int len = snprintf(c->dir, sizeof(c->dir), "%s/%s/", base, name);
+  if(len < 0 || len >= (int) sizeof(c->dir)) return false;
+  if(!cache_create_dirs(c->dir)) return false;
+
+  thread_mutex_init(&c->mutex);
+  return true;
+}
+
+CACHE_DEF void cache_close(Cache *c) {
+  thread_mutex_free(&c->mutex);
+}
+
+CACHE_DEF bool cache_key(const char *path, int side, unsigned long long *key) {
+  unsigned long long size;
+  long long mtime;
+  if(!io_stat(path, &size, &mtime)) return false;
+
+  // FNV-1a
+  unsigned long long h = 14695981039346656037ULL;
+  for(const unsigned char *p=(const unsigned char *) path;*p;p++) {
+    h = (h ^ *p) * 1099511628211ULL;
+  }
+  unsigned long long values[3] = {size, (unsigned long long) mtime, (unsigned long long) side};
+  for(int i=0;i<3;i++) {
+    for(int k=0;k<8;k++) {
+      h = (h ^ ((values[i] >> (k * 8)) & 0xFF)) * 1099511628211ULL;
+    }
+  }
+  *key = h;
+  return true;
+}
+
+CACHE_DEF bool cache_get(Cache *c, unsigned long long key, void *out, size_t out_size, int *width, int *height) {
+  char path[CACHE_PATH_CAP + CACHE_NAME_CAP];
+  cache_path(c, key, ".qoi", path);
+
+  qoi_desc desc;
+  if(out_size > 0x7fffffff || !qoi_read_into(path, &desc, 4, out, (int) out_size, 0, 0)) {
+    return false;
+  }
+  *width = (int) desc.width;
+  *height = (int) desc.height;
+
+  // the mtime is when it was used last
+  io_touch(path);
+  return true;
+}
+
+CACHE_DEF bool cache_put(Cache *c, unsigned long long key, const void *pixels, int width, int height) {
+  char path[CACHE_PATH_CAP + CACHE_NAME_CAP];
+  char tmp[CACHE_PATH_CAP + CACHE_NAME_CAP];
+  cache_path(c, key, ".qoi", path);
+  cache_path(c, key, ".tmp", tmp);
+
+  // written aside and renamed, a reader never sees half of it
+  qoi_desc desc = {(unsigned int) width, (unsigned int) height, 4, QOI_SRGB};
+  int size = qoi_write(tmp, pixels, &desc);
+  if(size <= 0) {
+    remove(tmp);
+    return false;
+  }
+  unsigned long long old = 0;
+  if(!io_stat(path, &old, NULL)) old = 0;
+#ifdef _WIN32
+  bool ok = MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  bool ok = rename(tmp, path) == 0;
+#endif //_WIN32
+  if(!ok) {
+    remove(tmp);
+    return false;
+  }
+
+  thread_mutex_lock(&c->mutex);
+  c->size += (unsigned long long) size;
+  c->size = c->size > old ? c->size - old : 0; // it replaced 'old' bytes
+  bool over = c->size > c->budget && !c->evicting;
+  thread_mutex_unlock(&c->mutex);
+
+  if(over) cache_evict(c);
+  return true;
+}
+
+typedef struct{
+  unsigned long long key;
+  unsigned long long size;
+  long long mtime;
+}Cache_File;
+
+static int cache_file_compare(const void *a, const void *b) {
+  long long x = ((const Cache_File *) a)->mtime;
+  long long y = ((const Cache_File *) b)->mtime;
+  return x < y ? -1 : x > y;
+}
+
+CACHE_DEF void cache_evict(Cache *c) {
+  thread_mutex_lock(&c->mutex);
+  bool busy = c->evicting;
+  c->evicting = true;
+  thread_mutex_unlock(&c->mutex);
+  if(busy) return;
+
+  Cache_File *files = NULL;
+  size_t count = 0, cap = 0;
+  unsigned long long total = 0;
+  Io_Dir dir;
+  if(io_dir_open(&dir, c->dir)) {
+    Io_Dir_Entry entry;
+    while(io_dir_next(&dir, &entry)) {
+      char *end;
+      unsigned long long key = strtoull(entry.name, &end, 16);
+      if(entry.is_dir || end != entry.name + 16 || strcmp(end, ".qoi") != 0) continue;
+
+      Cache_File file = {key, 0, 0};
+      if(!io_stat(entry.abs_name, &file.size, &file.mtime)) continue;
+      if(count == cap) {
+	size_t new_cap = cap ? cap * 2 : 256;
+	Cache_File *new_files = realloc(files, sizeof(Cache_File) * new_cap);
+	if(!new_files) break;
+	files = new_files;
+	cap = new_cap;
+      }
+      files[count++] = file;
+      total += file.size;
+    }
+    io_dir_close(&dir);
+  }
+
+  if(total > c->budget) {
+    qsort(files, count, sizeof(Cache_File), cache_file_compare);
+    unsigned long long target = c->budget / 4 * 3;
+    char path[CACHE_PATH_CAP + CACHE_NAME_CAP];
+    for(size_t i=0;i<count && total>target;i++) {
+      cache_path(c, files[i].key, ".qoi", path);
+      if(remove(path) == 0) total -= files[i].size;
+    }
+  }
+  free(files);
+
+  thread_mutex_lock(&c->mutex);
+  c->size = total;
+  c->evicting = false;
+  thread_mutex_unlock(&c->mutex);
+}
+
+#endif //CACHE_IMPLEMENTATION
+
+#endif //CACHE_H
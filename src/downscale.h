@@ -0,0 +1,211 @@
+#ifndef DOWNSCALE_H
+#define DOWNSCALE_H
+
+// Shrinks an image while its rows stream in. Every target pixel is the
+// average of the source area it covers. Only one shrunk source row and two
+// target rows are held, so a source row can be dropped right after it is fed.
+//
+//   Downscale d;
+//   downscale_init(&d, src_width, src_height, dst_width, dst_height, 4, out, dst_width * 4);
+//   while(...) downscale_rows(&d, strip, rows, src_width * 4);
+//   downscale_free(&d);
+//
+// 'dst_y' counts the finished rows of 'out', all of them once 'src_height'
+// rows are in.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef DOWNSCALE_DEF
+#  define DOWNSCALE_DEF static inline
+#endif //DOWNSCALE_DEF
+
+#ifndef DOWNSCALE_MALLOC
+#  define DOWNSCALE_MALLOC(size) malloc(size)
+#  define DOWNSCALE_FREE(ptr) free(ptr)
+#endif //DOWNSCALE_MALLOC
+
+typedef struct{
+  int src_width, src_height;
+  int dst_width, dst_height;
+  int channels;
+  unsigned char *out;
+  size_t out_stride;
+
+  // Target column x sums the source columns from 'first[x]' up to 'first[x + 1]',
+  // all of them weighted 'full'. The last one may reach into the next target
+  // column, by 'cut[x]', a source pixel never spans more than two.
+  int *first; // dst_width + 1
+  float *cut; // dst_width + 1
+  float full;
+  float *row; // dst_width pixels
+  float *acc[2]; // target rows 'dst_y' and 'dst_y + 1'
+  int src_y;
+  int dst_y;
+}Downscale;
+
+// Fails unless 0 < dst <= src in both directions
+DOWNSCALE_DEF bool downscale_init(Downscale *d, int src_width, int src_height, int dst_width, int dst_height, int channels, void *out, size_t out_stride);
+DOWNSCALE_DEF void downscale_rows(Downscale *d, const void *rows, int count, size_t stride);
+DOWNSCALE_DEF void downscale_free(Downscale *d);
+
+// The largest size within 'max_width' x 'max_height' with the aspect of the source,
+// never larger than the source
+DOWNSCALE_DEF void downscale_fit(int src_width, int src_height, int max_width, int max_height, int *dst_width, int *dst_height);
+
+#ifdef DOWNSCALE_IMPLEMENTATION
+
+DOWNSCALE_DEF bool downscale_init(Downscale *d, int src_width, int src_height, int dst_width, int dst_height, int channels, void *out, size_t out_stride) {
+  memset(d, 0, sizeof(*d));
+  if(dst_width < 1 || dst_height < 1 || dst_width > src_width || dst_height > src_height ||
+     channels < 1 || channels > 4 || !out) {
+    return false;
+  }
+
+  d->src_width = src_width;
+  d->src_height = src_height;
+  d->dst_width = dst_width;
+  d->dst_height = dst_height;
+  d->channels = channels;
+  d->out = (unsigned char *) out;
+  d->out_stride = out_stride;
+
+  size_t row_len = (size_t) dst_width * (size_t) channels;
+  d->first = DOWNSCALE_MALLOC(sizeof(int) * ((size_t) dst_width + 1));
+  d->cut = DOWNSCALE_MALLOC(sizeof(float) * ((size_t) dst_width + 1));
+  d->row = DOWNSCALE_MALLOC(sizeof(float) * row_len);
+  d->acc[0] = DOWNSCALE_MALLOC(sizeof(float) * row_len);
+  d->acc[1] = DOWNSCALE_MALLOC(sizeof(float) * row_len);
+  if(!d->first || !d->cut || !d->row || !d->acc[0] || !d->acc[1]) {
+    downscale_free(d);
+    return false;
+  }
+  memset(d->acc[0], 0, sizeof(float) * row_len);
+  memset(d->acc[1], 0, sizeof(float) * row_len);
+
+  // Source column x covers [x * dst_width, (x + 1) * dst_width) in units
+  // where the target columns are 'src_width' wide, exact in integers.
+  d->full = (float) dst_width / (float) src_width;
+  for(int x=0;x<=dst_width;x++) {
+    unsigned long long boundary = (unsigned long long) x * (unsigned long long) src_width;
+    unsigned long long first = (boundary + (unsigned long long) dst_width - 1) / (unsigned long long) dst_width;
+    d->first[x] = (int) first;
+    d->cut[x] = (float) (first * (unsigned long long) dst_width - boundary) / (float) src_width;
+  }
+
+  return true;
+}
+
+static void downscale_emit(Downscale *d, float *acc) {
+  unsigned char *out = d->out + d->out_stride * (size_t) d->dst_y;
+  int len = d->dst_width * d->channels;
+  for(int i=0;i<len;i++) {
+    int v = (int) (acc[i] + .5f);
+    out[i] = (unsigned char) (v > 255 ? 255 : v);
+  }
+  memset(acc, 0, sizeof(float) * (size_t) len);
+  d->dst_y++;
+}
+
+DOWNSCALE_DEF void downscale_rows(Downscale *d, const void *rows, int count, size_t stride) {
+  int channels = d->channels;
+
+  for(int i=0;i<count && d->src_y<d->src_height;i++) {
+    const unsigned char *src = (const unsigned char *) rows + stride * (size_t) i;
+
+    // horizontally, into 'row'. Column x loses the part of its last source
+    // column past it and gains the one of the column before it.
+    float *row = d->row;
+    float full = d->full;
+    if(channels == 4) {
+      for(int x=0;x<d->dst_width;x++) {
+	int begin = d->first[x];
+	int end = d->first[x + 1];
+	unsigned int r = 0, g = 0, b = 0, a = 0;
+	for(int k=begin;k<end;k++) {
+	  const unsigned char *s = src + k * 4;
+	  r += s[0]; g += s[1]; b += s[2]; a += s[3];
+	}
+	// without branches, which columns are cut follows no pattern
+	const unsigned char *last = src + (end - 1) * 4;
+	const unsigned char *before = src + (begin > 0 ? begin - 1 : 0) * 4;
+	float out = d->cut[x + 1];
+	float in = d->cut[x];
+	float *p = row + x * 4;
+	p[0] = full * (float) r - out * last[0] + in * before[0];
+	p[1] = full * (float) g - out * last[1] + in * before[1];
+	p[2] = full * (float) b - out * last[2] + in * before[2];
+	p[3] = full * (float) a - out * last[3] + in * before[3];
+      }
+    } else {
+      for(int x=0;x<d->dst_width;x++) {
+	int begin = d->first[x];
+	int end = d->first[x + 1];
+	float *p = row + x * channels;
+	for(int c=0;c<channels;c++) {
+	  unsigned int sum = 0;
+	  for(int k=begin;k<end;k++) sum += src[k * channels + c];
+	  p[c] = full * (float) sum;
+	  if(d->cut[x + 1] > 0) p[c] -= d->cut[x + 1] * src[(end - 1) * channels + c];
+	  if(d->cut[x] > 0) p[c] += d->cut[x] * src[(begin - 1) * channels + c];
+	}
+      }
+    }
+
+    // vertically, the same split as the columns
+    unsigned long long a = (unsigned long long) d->src_y * (unsigned long long) d->dst_height;
+    unsigned long long b = a + (unsigned long long) d->dst_height;
+    unsigned long long boundary = ((unsigned long long) d->dst_y + 1) * (unsigned long long) d->src_height;
+    unsigned long long split = b < boundary ? b : boundary;
+    float v0 = (float) (split - a) / (float) d->src_height;
+    float v1 = (float) (b - split) / (float) d->src_height;
+
+    float *acc = d->acc[d->dst_y & 1];
+    float *next = d->acc[(d->dst_y + 1) & 1];
+    size_t len = (size_t) d->dst_width * (size_t) channels;
+    for(size_t k=0;k<len;k++) acc[k] += v0 * row[k];
+    if(v1 > 0) {
+      for(size_t k=0;k<len;k++) next[k] += v1 * row[k];
+    }
+
+    d->src_y++;
+    if(b >= boundary) downscale_emit(d, acc);
+  }
+}
+
+DOWNSCALE_DEF void downscale_free(Downscale *d) {
+  if(d->first) DOWNSCALE_FREE(d->first);
+  if(d->cut) DOWNSCALE_FREE(d->cut);
+  if(d->row) DOWNSCALE_FREE(d->row);
+  if(d->acc[0]) DOWNSCALE_FREE(d->acc[0]);
+  if(d->acc[1]) DOWNSCALE_FREE(d->acc[1]);
+  d->first = NULL;
+  d->cut = NULL;
+  d->row = NULL;
+  d->acc[0] = NULL;
+  d->acc[1] = NULL;
+}
+
+DOWNSCALE_DEF void downscale_fit(int src_width, int src_height, int max_width, int max_height, int *dst_width, int *dst_height) {
+  if(src_width <= max_width && src_height <= max_height) {
+    *dst_width = src_width;
+    *dst_height = src_height;
+    return;
+  }
+
+  // whichever side hits its limit first
+  if((long long) src_width * max_height > (long long) src_height * max_width) {
+    *dst_width = max_width;
+    *dst_height = (int) (((long long) src_height * max_width + src_width / 2) / src_width);
+  } else {
+    *dst_height = max_height;
+    *dst_width = (int) (((long long) src_width * max_height + src_height / 2) / src_height);
+  }
+  if(*dst_width < 1) *dst_width = 1;
+  if(*dst_height < 1) *dst_height = 1;
+}
+
+#endif //DOWNSCALE_IMPLEMENTATION
+
+#endif //DOWNSCALE_H
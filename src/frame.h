@@ -4,6 +4,13 @@
 // win32
 //   msvc : user32.lib gdi32.lib opengl32.lib (shell32.lib)
 //   mingw:
+// linux
+//   cc   : -lX11 -lGL (-lXi with FRAME_XINPUT2)
+// headless (FRAME_HEADLESS, EGL surfaceless, no window)
+//   cc   : -lEGL -lGL
+// software (FRAME_SOFTWARE, linux only, CPU rasterizer instead of GL)
+//   cc   : -lX11 -lXext -lpthread (headless: -lpthread)
+//   uses thread.h and pool.h, include them first
 
 #ifndef FRAME_LOG
 #  ifndef FRAME_QUIET
@@ -15,15 +22,89 @@
 #endif // FRAME_LOG
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <math.h>
 
-#include <windows.h>
-#include <GL/GL.h>
+#ifdef _WIN32
+#  include <windows.h>
+#  include <GL/GL.h>
+#  ifdef FRAME_HEADLESS
+#    error "FRAME_HEADLESS needs EGL, which is only supported on linux"
+#  endif //FRAME_HEADLESS
+#  ifdef FRAME_SOFTWARE
+#    error "FRAME_SOFTWARE is only supported on linux"
+#  endif //FRAME_SOFTWARE
+#elif defined(FRAME_HEADLESS)
+#  ifndef FRAME_SOFTWARE
+#    include <EGL/egl.h>
+#    include <EGL/eglext.h>
+#    define GL_GLEXT_PROTOTYPES
+#    include <GL/gl.h>
+#    include <GL/glext.h>
+#  endif //FRAME_SOFTWARE
+#  include <time.h>
+#  include <string.h>
+#  include <stdlib.h>
+#  include <stddef.h>
+#else // linux
+#  include <X11/Xlib.h>
+#  include <X11/Xutil.h>
+#  include <X11/Xatom.h>
+#  include <X11/XKBlib.h>
+#  ifdef FRAME_SOFTWARE
+#    include <X11/extensions/XShm.h>
+#    include <sys/ipc.h>
+#    include <sys/shm.h>
+#  else
+#    define GL_GLEXT_PROTOTYPES
+#    include <GL/gl.h>
+#    include <GL/glext.h>
+#    include <GL/glx.h>
+#  endif //FRAME_SOFTWARE
+#  include <poll.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <time.h>
+#  include <string.h>
+#  include <stdlib.h>
+#  include <stdint.h>
+#  include <limits.h>
+#  ifdef FRAME_XINPUT2
+#    include <X11/extensions/XInput2.h>
+#  endif //FRAME_XINPUT2
+#endif //_WIN32
+
+#ifdef FRAME_SOFTWARE
+#  ifdef __SSE2__
+#    include <emmintrin.h>
+#  endif //__SSE2__
+// No GL at all. The renderer state keeps its GL types, they are only names here.
+typedef unsigned int GLuint;
+typedef int GLint;
+typedef unsigned int GLenum;
+typedef ptrdiff_t GLsizeiptr;
+typedef struct __GLsync *GLsync;
+#  define GL_TEXTURE0 0x84C0
+#  define GL_LINEAR 0x2601
+#  define GL_LINEAR_MIPMAP_LINEAR 0x2703
+#endif //FRAME_SOFTWARE
 
 #ifndef FRAME_DEF
 #  define FRAME_DEF static inline
 #endif //FRAME_DEF
 
+// see trace.h
+#ifndef FRAME_TRACE_BEGIN
+#  define FRAME_TRACE_BEGIN(name)
+#  define FRAME_TRACE_END(name)
+#endif //FRAME_TRACE_BEGIN
+
+// Shrinks rgba 'src' into the next mip level 'dst', a box of the sRGB values
+// unless resample.h is asked for another
+#ifndef FRAME_MIPMAP_LEVEL
+#  define FRAME_MIPMAP_LEVEL(src, width, height, dst, w, h) frame_renderer_mipmap_box(src, width, height, dst, w, h)
+#endif //FRAME_MIPMAP_LEVEL
+
 #ifndef PI
 #  define PI 3.141592653589793f
 #endif //PI
@@ -49,6 +130,8 @@ typedef enum{
   FRAME_EVENT_FILEDROP,
 }Frame_Event_Type;
 
+#ifdef _WIN32
+
 typedef struct{
   MSG msg;
   Frame_Event_Type type;
@@ -79,27 +162,202 @@ typedef struct{
   double dt;
   int running;
   int width, height;
+
+  // FRAME_EVENT_DRIVEN
+  volatile LONG dirty;
+  LARGE_INTEGER redraw_time;
+  bool redraw_scheduled;
 }Frame;
 
 typedef struct{
   HANDLE handle;
 }Frame_Clipboard;
 
+#elif defined(FRAME_HEADLESS)
+
+typedef struct{
+  Frame_Event_Type type;
+  union{
+    char key;
+    long long value;
+    int amount;
+  }as;
+}Frame_Event;
+
+typedef struct{
+  int unused;
+}Frame_Dragged_Files;
+
+#ifndef FRAME_HEADLESS_EVENTS_CAP
+#  define FRAME_HEADLESS_EVENTS_CAP 64
+#endif //FRAME_HEADLESS_EVENTS_CAP
+
+#define FRAME_HEADLESS_PBOS 3
+
+typedef struct{
+#ifdef FRAME_SOFTWARE
+  unsigned int *framebuffer; // 0xAARRGGBB, top-down
+#else
+  EGLDisplay display;
+  EGLContext context;
+  GLuint fbo, color;
+
+  // FRAME_READBACK, frame n is read into pbos[n % FRAME_HEADLESS_PBOS]
+  GLuint pbos[FRAME_HEADLESS_PBOS];
+  GLsync fences[FRAME_HEADLESS_PBOS];
+#endif //FRAME_SOFTWARE
+  long long frames; // swapped so far
+  long long pixels_frame; // frame in 'pixels', -1 if none
+  unsigned char *pixels; // rgba, bottom-up
+
+  // scripted input, see 'frame_push_event'
+  Frame_Event events[FRAME_HEADLESS_EVENTS_CAP];
+  int events_start, events_count;
+  float mouse_x, mouse_y;
+  char *clipboard_text;
+
+  double time; // ms
+  double dt;
+  int running;
+  int width, height;
+
+  // FRAME_EVENT_DRIVEN, only bookkeeping since nothing can wake us
+  volatile long dirty;
+  double redraw_time;
+  bool redraw_scheduled;
+}Frame;
+
+typedef struct{
+  char *text;
+}Frame_Clipboard;
+
+#else // linux
+
+typedef struct{
+  XEvent xev;
+  Frame_Event_Type type;
+  union{
+    char key;
+    long long value;
+    int amount;
+  }as;
+}Frame_Event;
+
+typedef struct{
+  char *data; // text/uri-list of the drop
+  char *next;
+  char path[PATH_MAX];
+}Frame_Dragged_Files;
+
+typedef struct{
+  Display *display;
+  Window window;
+#ifdef FRAME_SOFTWARE
+  Visual *visual;
+  int depth;
+  GC gc;
+  XImage *image; // framebuffer, follows the window size on swap
+  XShmSegmentInfo shm; // 'shmaddr' is NULL without MIT-SHM
+  int shm_completion; // event type, -1 without MIT-SHM
+  bool shm_pending; // the server still reads 'image'
+#else
+  GLXContext context;
+#endif //FRAME_SOFTWARE
+  Colormap colormap;
+  Cursor hidden_cursor;
+  int wake[2]; // pipe, see 'frame_request_redraw'
+  int xi_opcode; // FRAME_XINPUT2, 0 if unavailable
+
+  Atom wm_protocols, wm_delete_window;
+  Atom net_wm_name, net_wm_state, net_wm_state_fullscreen;
+  Atom utf8_string, clipboard, targets, selection;
+  Atom xdnd_aware, xdnd_enter, xdnd_position, xdnd_status, xdnd_drop;
+  Atom xdnd_finished, xdnd_selection, xdnd_action_copy, text_uri_list;
+
+  Window xdnd_source;
+  char *clipboard_text; // owned while we hold CLIPBOARD
+  size_t clipboard_len;
+  bool keys_down[256];
+  float mouse_x, mouse_y;
+
+  double time; // ms
+  double dt;
+  int running;
+  int width, height;
+
+  // FRAME_EVENT_DRIVEN
+  volatile long dirty;
+  double redraw_time;
+  bool redraw_scheduled;
+}Frame;
+
+typedef struct{
+  char *text;
+}Frame_Clipboard;
+
+#endif //_WIN32
+
 #define FRAME_RUNNING       0x1
 #define FRAME_NOT_RESIZABLE 0x2
 #define FRAME_DRAG_N_DROP   0x4
 #define FRAME_FULLSCREEN    0x8
+#define FRAME_EVENT_DRIVEN  0x10 // 'frame_peek' blocks until there is something to draw
+#define FRAME_READBACK      0x20 // FRAME_HEADLESS, read every frame back, see 'frame_read_pixels'
 
 FRAME_DEF bool frame_init(Frame *w, int width, int height, const char *title, int flags);
 FRAME_DEF bool frame_set_vsync(Frame *w, bool use_vsync);
 FRAME_DEF bool frame_peek(Frame *w, Frame_Event *event);
 FRAME_DEF bool frame_get_mouse_position(Frame *w, float *x, float *y);
 FRAME_DEF void frame_swap_buffers(Frame *w);
+FRAME_DEF void frame_request_redraw(Frame *w); // may be called from any thread
+FRAME_DEF void frame_schedule_redraw(Frame *w, double ms);
 FRAME_DEF bool frame_toggle_fullscreen(Frame *w);
 FRAME_DEF void frame_free(Frame *w);
 FRAME_DEF bool frame_set_title(Frame *f, const char *title);
 FRAME_DEF bool frame_show_cursor(Frame *w, bool show);
 
+// CPU time of a frame is split into phases. 'frame_peek', 'frame_renderer_begin'
+// and 'frame_swap_buffers' switch between their own, the application marks
+// the rest with 'frame_phase'.
+typedef enum{
+  FRAME_PHASE_WAIT = 0, // FRAME_EVENT_DRIVEN, blocked in 'frame_peek'
+  FRAME_PHASE_EVENTS,
+  FRAME_PHASE_DECODE,
+  FRAME_PHASE_UPLOAD,
+  FRAME_PHASE_BATCH, // after 'frame_peek', unless marked otherwise
+  FRAME_PHASE_SWAP,
+  FRAME_PHASE_COUNT,
+}Frame_Phase;
+
+typedef struct{
+  long long frame; // swaps before this one
+  double cpu_ms[FRAME_PHASE_COUNT];
+  double cpu_frame_ms; // every phase but FRAME_PHASE_WAIT
+  double gpu_frame_ms; // -1 if unknown
+  double gpu_draw_ms;  // the draw calls alone, -1 if unknown
+  unsigned int draw_calls;
+  unsigned int verticies;
+}Frame_Timing;
+
+#define FRAME_TIMING_HISTORY 128
+
+FRAME_DEF double frame_clock_ms(); // monotonic
+FRAME_DEF void frame_phase(Frame_Phase phase);
+// 'ago' 0 is the last swapped frame. GPU times arrive a frame late, so a
+// record is complete from 'ago' 1 on.
+FRAME_DEF bool frame_timing(Frame_Timing *timing, int ago);
+FRAME_DEF void frame_timing_csv_header(FILE *f);
+FRAME_DEF void frame_timing_csv(FILE *f, const Frame_Timing *timing);
+
+#ifdef FRAME_HEADLESS
+// Queues an event for 'frame_peek', to script a session
+FRAME_DEF bool frame_push_event(Frame *w, const Frame_Event *e);
+FRAME_DEF void frame_set_mouse_position(Frame *w, float x, float y);
+// Returns the last frame that finished reading back (rgba, bottom-up) or NULL.
+// Readback runs FRAME_HEADLESS_PBOS - 1 frames behind, unless 'wait' is set.
+FRAME_DEF const unsigned char *frame_read_pixels(Frame *w, bool wait, long long *frame);
+#endif //FRAME_HEADLESS
+
 FRAME_DEF bool frame_dragged_files_init(Frame_Dragged_Files *files, Frame_Event *event);
 FRAME_DEF bool frame_dragged_files_next(Frame_Dragged_Files *files, char **path);
 FRAME_DEF void frame_dragged_files_free(Frame_Dragged_Files *files);
@@ -108,8 +366,17 @@ FRAME_DEF bool frame_clipboard_init(Frame_Clipboard *clipboard, Frame *w, char *
 FRAME_DEF bool frame_clipboard_set(Frame *w, const char *text, size_t text_len);
 FRAME_DEF void frame_clipboard_free(Frame_Clipboard *clipboard);
 
+#ifndef FRAME_SOFTWARE
 FRAME_DEF bool frame_compile_shader(GLuint *shader, GLenum shader_type, const char *shader_source);
 FRAME_DEF bool frame_link_program(GLuint *program, GLuint vertex_shader, GLuint fragment_shader);
+#endif //FRAME_SOFTWARE
+
+#ifdef _WIN32
+// GL 3.2, missing from <GL/GL.h>
+typedef struct __GLsync *GLsync;
+typedef unsigned long long GLuint64;
+typedef ptrdiff_t GLsizeiptr;
+#endif //_WIN32
 
 #ifndef FRAME_NO_RENDERER
 
@@ -125,25 +392,141 @@ typedef struct{
 
 FRAME_DEF Frame_Renderer_Vec4f frame_renderer_vec4f(float x, float y, float z, float w);
 
+// 16 bytes. Verticies always come in fours, every quad is drawn through the
+// static index buffer. A triangle is a quad with the last vertex repeated.
 typedef struct{
   Frame_Renderer_Vec2f position;
-  Frame_Renderer_Vec4f color;
-  Frame_Renderer_Vec2f uv;
+  unsigned char color[4]; // unorm8
+  unsigned short uv[2];   // see FRAME_RENDERER_UV_*
 }Frame_Renderer_Vertex;
 
 #define FRAME_RENDERER_VERTEX_ATTR_POSITION 0
 #define FRAME_RENDERER_VERTEX_ATTR_COLOR 1
 #define FRAME_RENDERER_VERTEX_ATTR_UV 2
 
-#define FRAME_RENDERER_CAP (1024 * 4)
+// uv is stored as 'uv * FRAME_RENDERER_UV_ONE', the top bit of uv[0] selects
+// 'font_tex' and uv[0] == FRAME_RENDERER_UV_SOLID draws the plain color.
+// That leaves 15 bits: a uv lands within a quarter texel of where it was
+// asked for on textures up to 16384 wide, and within half a texel at 32768.
+// Crops of larger textures need the unorm16 uvs of the sprite path.
+#define FRAME_RENDERER_UV_ONE   0x7FFF
+#define FRAME_RENDERER_UV_FONT  0x8000
+#define FRAME_RENDERER_UV_SOLID 0xFFFF
 
+// One instance of the sprite path, see 'frame_renderer_sprite'
 typedef struct{
-  GLuint vao, vbo;
+  float rect[4];         // position, size
+  unsigned short uv[4];  // unorm16 position, size inside the layer
+  unsigned char tint[4]; // unorm8
+  float layer;
+}Frame_Renderer_Sprite;
+
+#define FRAME_RENDERER_SPRITE_ATTR_RECT 0
+#define FRAME_RENDERER_SPRITE_ATTR_UV 1
+#define FRAME_RENDERER_SPRITE_ATTR_TINT 2
+#define FRAME_RENDERER_SPRITE_ATTR_LAYER 3
+
+#define FRAME_RENDERER_CAP (1024 * 4) // initial verticies, the batch grows
+#define FRAME_RENDERER_RING_SEGMENTS 3 // frames in flight
+#define FRAME_RENDERER_IMAGES_CAP 4
+#define FRAME_RENDERER_TIMER_FRAMES 2 // query sets in flight
+#define FRAME_RENDERER_TIMER_DRAWS 64 // timed draw calls per frame
+
+#ifndef FRAME_RENDERER_UPLOAD_STRIPE
+#  define FRAME_RENDERER_UPLOAD_STRIPE (16 * 1024 * 1024)
+#endif //FRAME_RENDERER_UPLOAD_STRIPE
+
+#ifdef FRAME_SOFTWARE
+#  define FRAME_SOFTWARE_BAND 32 // rows per unit of work
+#  define FRAME_SOFTWARE_LEVELS 16
+
+// A triangle ready for scanline conversion. Every attribute is a plane
+// 'value + dx * x + dy * y' over pixel coordinates.
+typedef struct{
+  float x[3], y[3]; // sorted by y
+  float slope01, slope02, slope12; // dx/dy of the edges
+  float u, dudx, dudy; // in texels of 'level'
+  float v, dvdx, dvdy;
+  float c[4], dcdx[4], dcdy[4]; // 0..255
+  short source; // 'images' index, or FRAME_RENDERER_IMAGES_CAP + sprite layer
+  unsigned char kind;
+  unsigned char level;
+  bool flat; // one color for the whole triangle
+}Frame_Renderer_Triangle;
+#endif //FRAME_SOFTWARE
+
+typedef struct{
+  GLuint id;
+  int width, height;
+  bool grey;
+  bool mipmaps_dirty; // level 0 changed since the last glGenerateMipmap
+  bool streaming; // more strips to come, see 'frame_renderer_texture_streaming'
+  GLint min_filter;
+  float anisotropy;
+
+  // streaming upload, see 'frame_renderer_upload_begin'. The buffer outlives
+  // the upload, the next one of the same size reuses it.
+  GLuint pbo;
+  GLsizeiptr pbo_size;
+  GLsync pbo_fence; // after the last read out of it
+  void *pbo_pixels;
+  bool pbo_persistent;
+  bool uploading;
+  bool committed;
+  int rows_uploaded;
+
+#ifdef FRAME_SOFTWARE
+  unsigned char *levels[FRAME_SOFTWARE_LEVELS]; // rgba, or alpha if 'grey', rows as given to GL
+  int levels_count;
+#endif //FRAME_SOFTWARE
+}Frame_Renderer_Image;
+
+// Counted per frame, see 'frame_renderer_stats'
+typedef struct{
+  unsigned int gl_calls;
+  unsigned int draw_calls;
+  unsigned int uniform_uploads;
+  unsigned int verticies;
+}Frame_Renderer_Stats;
+
+typedef struct{
+  GLuint vao, vbo, ebo;
   GLuint vertex_shader, fragment_shader;
   GLuint program;
+
+  // resolved once after linking
+  GLint resolution_location;
+  GLint tex_location;
+  GLint font_tex_location;
+
+  // last values uploaded to the program, to skip redundant glUniform* calls
+  float resolution_uploaded[2];
+  GLint tex_uploaded;
+  GLint font_tex_uploaded;
+
+  Frame_Renderer_Stats stats;
+  Frame_Renderer_Stats last_stats;
+
+  // GPU timing, see 'frame_renderer_end_frame'. The query sets alternate, so
+  // one frame is read back while the GPU still works on the next.
+  bool timer_query; // GL_ARB_timer_query
+  GLuint timer_stamps[FRAME_RENDERER_TIMER_FRAMES][2]; // GL_TIMESTAMP, begin and end
+  GLuint timer_draws[FRAME_RENDERER_TIMER_FRAMES][FRAME_RENDERER_TIMER_DRAWS]; // GL_TIME_ELAPSED
+  int timer_draws_count[FRAME_RENDERER_TIMER_FRAMES];
+  bool timer_issued[FRAME_RENDERER_TIMER_FRAMES];
+  bool timer_running;
+  int timer_slot;
+
+  // last result, taken by 'frame_swap_buffers'
+  bool gpu_ready;
+  int gpu_lag; // frames since the measured one
+  double gpu_frame_ms, gpu_draw_ms;
   
-  GLuint textures;
+  Frame_Renderer_Image images[FRAME_RENDERER_IMAGES_CAP];
   unsigned int images_count;
+  float max_anisotropy; // 1 if GL_EXT_texture_filter_anisotropic is missing
+  int max_texture_size; // GL_MAX_TEXTURE_SIZE, the side of the largest texture
+  bool buffer_storage;  // GL_ARB_buffer_storage, persistent mappings
 
 #ifdef FRAME_STB_TRUETYPE
   float font_height;
@@ -156,8 +539,41 @@ typedef struct{
   float width, height;
   Frame_Renderer_Vec4f background;
 
-  Frame_Renderer_Vertex verticies[FRAME_RENDERER_CAP];
+  Frame_Renderer_Vertex *verticies;
   int verticies_count;
+  int verticies_cap;
+  int buffers_cap; // verticies per ring segment, 'ebo' covers one segment
+
+  // streaming vertex ring, see 'frame_renderer_ring_next'
+  Frame_Renderer_Vertex *ring; // persistent mapping, NULL without 'buffer_storage'
+  GLsync ring_fences[FRAME_RENDERER_RING_SEGMENTS];
+  int ring_segment;
+  int ring_offset; // verticies already drawn from 'ring_segment'
+
+  // instanced sprites, all sampled from one GL_TEXTURE_2D_ARRAY
+  GLuint sprite_vao, sprite_vbo;
+  GLuint sprite_vertex_shader, sprite_fragment_shader;
+  GLuint sprite_program;
+  GLuint sprite_texture;
+  GLint sprite_resolution_location;
+  float sprite_resolution_uploaded[2];
+  int sprite_width, sprite_height, sprite_layers;
+  bool sprite_mipmaps_dirty;
+  Frame_Renderer_Sprite *sprites;
+  int sprites_count;
+  int sprites_cap;
+
+#ifdef FRAME_SOFTWARE
+  // see 'frame_renderer_software_flush'
+  unsigned char *sprite_texels; // layers of rgba
+  Frame_Renderer_Triangle *sw_triangles;
+  int sw_triangles_count;
+  int sw_triangles_cap;
+  unsigned int *sw_target;
+  int sw_width, sw_height, sw_stride;
+  Pool *sw_pool; // helps with the bands, NULL for only the calling thread
+  int sw_threads; // the calling one included, 0 for every worker
+#endif //FRAME_SOFTWARE
 
   //Imgui things
   Frame_Renderer_Vec2f input;
@@ -217,6 +633,20 @@ FRAME_DEF void frame_renderer_free();
 FRAME_DEF void frame_renderer_begin(int width, int height);
 FRAME_DEF void frame_renderer_set_color(Frame_Renderer_Vec4f color);
 FRAME_DEF void frame_renderer_end();
+FRAME_DEF void frame_renderer_stats(Frame_Renderer_Stats *stats); // of the last finished frame
+FRAME_DEF void frame_renderer_end_frame(); // 'frame_renderer_end' and the GPU timer of the frame
+FRAME_DEF float frame_renderer_hud(Frame_Renderer_Vec2f pos, float scale); // 'pos' is the top left, returns the height
+FRAME_DEF void frame_renderer_debug_text(const char *cstr, size_t cstr_len, Frame_Renderer_Vec2f pos, float scale, Frame_Renderer_Vec4f color);
+#ifdef FRAME_SOFTWARE
+// Ends the batch and rasterizes the frame into 'pixels' (0xAARRGGBB, top-down)
+FRAME_DEF void frame_renderer_software_flush(unsigned int *pixels, int width, int height, int stride);
+// The workers of 'pool' help with the bands of a flush, NULL leaves them to
+// the calling thread. Clear it before freeing the pool.
+FRAME_DEF void frame_renderer_software_pool(Pool *pool);
+// At most 'threads' on the bands, the calling one included (0 for every
+// worker of the pool)
+FRAME_DEF void frame_renderer_software_threads(int threads);
+#endif //FRAME_SOFTWARE
 
 FRAME_DEF void frame_renderer_imgui_begin(Frame *w, Frame_Event *e);
 FRAME_DEF void frame_renderer_imgui_update(Frame *w, Frame_Event *e);
@@ -235,10 +665,33 @@ FRAME_DEF void frame_renderer_solid_rect_angle(Frame_Renderer_Vec2f pos, Frame_R
 FRAME_DEF bool frame_renderer_create_texture(int width, int height, unsigned int *index);
 FRAME_DEF bool frame_renderer_push_to_texture(unsigned int tex, const void *data, int x_off, int y_off, int width, int height);
 FRAME_DEF bool frame_renderer_push_texture(int width, int height, const void *data, bool grey, unsigned int *index);
+// Gives the storage of a texture back. The slot stays, the next push into it allocates again.
+FRAME_DEF void frame_renderer_texture_free(unsigned int texture);
+
+// Asynchronous uploads
+//   'frame_renderer_upload_begin' returns a mapped pixel buffer of width*height*4 bytes,
+//   which may be filled from any thread. Once it is complete, the GL thread calls
+//   'frame_renderer_upload_commit'. Every 'frame_renderer_begin' then moves up to
+//   FRAME_RENDERER_UPLOAD_STRIPE bytes into the texture, until 'frame_renderer_upload_done'.
+FRAME_DEF bool frame_renderer_upload_begin(int width, int height, unsigned int *index, void **pixels);
+FRAME_DEF void frame_renderer_upload_commit(unsigned int index);
+FRAME_DEF void frame_renderer_upload_cancel(unsigned int index);
+FRAME_DEF bool frame_renderer_upload_done(unsigned int index);
+FRAME_DEF bool frame_renderer_upload_step(size_t budget);
 FRAME_DEF void frame_renderer_texture(unsigned int texture, Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s, Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs);
 FRAME_DEF void frame_renderer_texture_colored(unsigned int texture, Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s, Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs, Frame_Renderer_Vec4f c);
+FRAME_DEF void frame_renderer_texture_filter(unsigned int texture, float scale);
+FRAME_DEF void frame_renderer_texture_streaming(unsigned int texture, bool streaming);
 FRAME_DEF void frame_renderer_solid_circle(Frame_Renderer_Vec2f pos, float start_angle, float end_angle, float radius, int parts, Frame_Renderer_Vec4f color);
 
+// Sprites
+//   Instanced quads from a texture array of 'layers' layers of width*height texels.
+//   Each layer may be an atlas, 'uvp'/'uvs' select the part of the layer. Consecutive
+//   sprites are drawn with one call, drawing anything else in between splits them.
+FRAME_DEF bool frame_renderer_sprites_init(int width, int height, int layers);
+FRAME_DEF bool frame_renderer_sprites_upload(int layer, int x_off, int y_off, int width, int height, const void *data);
+FRAME_DEF void frame_renderer_sprite(Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s, Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs, Frame_Renderer_Vec4f tint, int layer);
+
 //Imgui-things
 FRAME_DEF bool frame_renderer_button(Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s, Frame_Renderer_Vec4f c);
 FRAME_DEF bool frame_renderer_texture_button(unsigned int texture, Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s);
@@ -264,6 +717,7 @@ FRAME_DEF bool frame_renderer_push_image_memory(unsigned char *data, size_t data
 #endif //FRAME_NO_RENDERER
 
 
+#ifdef _WIN32
 // opengl - functions / types / definitions
 #define GL_TEXTURE0 0x84C0
 #define GL_TEXTURE1 0x84C1
@@ -273,6 +727,8 @@ FRAME_DEF bool frame_renderer_push_image_memory(unsigned char *data, size_t data
 #define GL_TEXTURE5 0x84C5
 
 #define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
 #define GL_DYNAMIC_DRAW 0x88E8
 #define GL_ACTIVE_UNIFORMS 0x8B86
 
@@ -299,7 +755,36 @@ FRAME_DEF bool frame_renderer_push_image_memory(unsigned char *data, size_t data
 #define GL_SAMPLE_BUFFERS 0x80A8
 #define GL_SAMPLES 0x80A9
 
-typedef ptrdiff_t GLsizeiptr;
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+
+#define GL_MAJOR_VERSION 0x821B
+#define GL_MINOR_VERSION 0x821C
+#define GL_NUM_EXTENSIONS 0x821D
+
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define GL_STREAM_DRAW 0x88E0
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_TIMEOUT_EXPIRED 0x911B
+
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#define GL_MAX_ARRAY_TEXTURE_LAYERS 0x88FF
+#define GL_R8 0x8229
+#define GL_TEXTURE_SWIZZLE_RGBA 0x8E46
+
+#define GL_TIME_ELAPSED 0x88BF
+#define GL_TIMESTAMP 0x8E28
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+
 typedef ptrdiff_t GLintptr;
 typedef char GLchar;
 
@@ -334,7 +819,29 @@ void glGetUniformfv(GLuint program, GLint location, GLfloat *params);
 void glGetUniformiv(GLuint program, GLint location, GLsizei bufSize, GLint *params);
 void glSampleCoverage(GLfloat value, GLboolean invert);
 void glCreateTextures(GLenum target, GLsizei n, GLuint *textures);
+void glGenerateMipmap(GLenum target);
+void glDeleteBuffers(GLsizei n, const GLuint *buffers);
+void *glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+GLboolean glUnmapBuffer(GLenum target);
+void glBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+const GLubyte *glGetStringi(GLenum name, GLuint index);
+GLsync glFenceSync(GLenum condition, GLbitfield flags);
+GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+void glDeleteSync(GLsync sync);
+void glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex);
+void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+void glVertexAttribDivisor(GLuint index, GLuint divisor);
+void glTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels);
+void glTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels);
+void glGenQueries(GLsizei n, GLuint *ids);
+void glDeleteQueries(GLsizei n, const GLuint *ids);
+void glBeginQuery(GLenum target, GLuint id);
+void glEndQuery(GLenum target);
+void glQueryCounter(GLuint id, GLenum target);
+void glGetQueryObjectiv(GLuint id, GLenum pname, GLint *params);
+void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params);
 int wglSwapIntervalEXT(GLint interval);
+#endif //_WIN32
 
 #ifdef FRAME_IMPLEMENTATION
 
@@ -343,6 +850,112 @@ static Frame_Renderer frame_renderer;
 static bool frame_renderer_inited = false;
 #endif //FRAME_NO_RENDERER
 
+////////////////////////////////////////////////////////////////////////
+// timing
+////////////////////////////////////////////////////////////////////////
+
+typedef struct{
+  Frame_Phase phase;
+  double phase_start; // 0 before the first 'frame_phase'
+  double cpu_ms[FRAME_PHASE_COUNT];
+  long long frames;
+  Frame_Timing history[FRAME_TIMING_HISTORY];
+}Frame_Timer;
+
+static Frame_Timer frame_timer = {0};
+
+#ifdef _WIN32
+FRAME_DEF double frame_clock_ms() {
+  static LARGE_INTEGER frequency = {0};
+  if(frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  LARGE_INTEGER time;
+  QueryPerformanceCounter(&time);
+  return (double) time.QuadPart * 1000 / (double) frequency.QuadPart;
+}
+#else
+FRAME_DEF double frame_clock_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1000 + (double) ts.tv_nsec / 1000000;
+}
+#endif //_WIN32
+
+FRAME_DEF void frame_phase(Frame_Phase phase) {
+  Frame_Timer *t = &frame_timer;
+
+  double now = frame_clock_ms();
+  if(t->phase_start > 0) {
+    t->cpu_ms[t->phase] += now - t->phase_start;
+  }
+  t->phase = phase;
+  t->phase_start = now;
+}
+
+// Closes the record of the frame, at the end of 'frame_swap_buffers'
+static void frame_timer_swapped() {
+  Frame_Timer *t = &frame_timer;
+  frame_phase(FRAME_PHASE_EVENTS);
+
+  Frame_Timing *timing = &t->history[t->frames % FRAME_TIMING_HISTORY];
+  memset(timing, 0, sizeof(*timing));
+  timing->frame = t->frames;
+  for(int i=0;i<FRAME_PHASE_COUNT;i++) {
+    timing->cpu_ms[i] = t->cpu_ms[i];
+    if(i != FRAME_PHASE_WAIT) {
+      timing->cpu_frame_ms += t->cpu_ms[i];
+    }
+    t->cpu_ms[i] = 0;
+  }
+  timing->gpu_frame_ms = -1;
+  timing->gpu_draw_ms = -1;
+
+#ifndef FRAME_NO_RENDERER
+  Frame_Renderer *r = &frame_renderer;
+  timing->draw_calls = r->stats.draw_calls;
+  timing->verticies = r->stats.verticies;
+
+  // the result belongs to an earlier record
+  if(r->gpu_ready && r->gpu_lag <= t->frames && r->gpu_lag < FRAME_TIMING_HISTORY) {
+    Frame_Timing *measured = &t->history[(t->frames - r->gpu_lag) % FRAME_TIMING_HISTORY];
+    measured->gpu_frame_ms = r->gpu_frame_ms;
+    measured->gpu_draw_ms = r->gpu_draw_ms;
+  }
+  r->gpu_ready = false;
+#endif //FRAME_NO_RENDERER
+
+  t->frames++;
+}
+
+FRAME_DEF bool frame_timing(Frame_Timing *timing, int ago) {
+  Frame_Timer *t = &frame_timer;
+  if(ago < 0 || ago >= FRAME_TIMING_HISTORY || ago >= t->frames) {
+    return false;
+  }
+
+  *timing = t->history[(t->frames - 1 - ago) % FRAME_TIMING_HISTORY];
+  return true;
+}
+
+FRAME_DEF void frame_timing_csv_header(FILE *f) {
+  fprintf(f, "frame,wait_ms,events_ms,decode_ms,upload_ms,batch_ms,swap_ms,"
+	  "cpu_ms,gpu_ms,gpu_draw_ms,draw_calls,verticies\n");
+}
+
+FRAME_DEF void frame_timing_csv(FILE *f, const Frame_Timing *timing) {
+  fprintf(f, "%lld", timing->frame);
+  for(int i=0;i<FRAME_PHASE_COUNT;i++) {
+    fprintf(f, ",%.3f", timing->cpu_ms[i]);
+  }
+  fprintf(f, ",%.3f,%.3f,%.3f,%u,%u\n",
+	  timing->cpu_frame_ms, timing->gpu_frame_ms, timing->gpu_draw_ms,
+	  timing->draw_calls, timing->verticies);
+}
+
+#ifdef _WIN32
+
 LRESULT CALLBACK Frame_Implementation_WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
 
   if(message == WM_CLOSE ||
@@ -354,6 +967,13 @@ LRESULT CALLBACK Frame_Implementation_WndProc(HWND hWnd, UINT message, WPARAM wP
     PostQuitMessage(0);
     return 0;
   } else {
+    // sent messages never reach 'frame_peek'
+    if(message == WM_SIZE || message == WM_PAINT) {
+      Frame *w = (Frame *) GetWindowLongPtr(hWnd, 0);
+      if(w != NULL) {
+	InterlockedExchange(&w->dirty, 1);
+      }
+    }
     return DefWindowProc(hWnd, message, wParam, lParam);
   }
   
@@ -475,10 +1095,12 @@ FRAME_DEF bool frame_init(Frame *w, int width, int height, const char *title, in
   ShowWindow(w->hwnd, nCmdShow);
   UpdateWindow(w->hwnd);
 
-  w->running = FRAME_RUNNING;
+  w->running = FRAME_RUNNING | (flags & FRAME_EVENT_DRIVEN);
   w->width = width;
   w->height = height;
   w->is_shift_down = false;
+  w->dirty = 1;
+  w->redraw_scheduled = false;
 
   // load non-default-opengl-functions
   frame_win32_opengl_init();
@@ -527,17 +1149,54 @@ static char frame_german_keyboard[10] = {
   [0] = '=',
 };
 
+static bool frame_win32_take_redraw(Frame *w) {
+  if(w->redraw_scheduled) {
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    if(time.QuadPart >= w->redraw_time.QuadPart) {
+      w->redraw_scheduled = false;
+      InterlockedExchange(&w->dirty, 0);
+      return true;
+    }
+  }
+
+  return InterlockedExchange(&w->dirty, 0) != 0;
+}
+
+static void frame_win32_wait(Frame *w) {
+  DWORD timeout = INFINITE;
+
+  if(w->redraw_scheduled) {
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    double ms = ((double) w->redraw_time.QuadPart - (double) time.QuadPart)
+      * 1000
+      / (double) w->performance_frequency.QuadPart;
+    timeout = ms > 0 ? (DWORD) ms + 1 : 0;
+  }
+
+  // MWMO_INPUTAVAILABLE: also wake for messages that are already queued
+  MsgWaitForMultipleObjectsEx(0, NULL, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+}
+
 FRAME_DEF bool frame_peek(Frame *w, Frame_Event *e) {
     
   MSG *msg = &e->msg;
 
   while(true) {
     if(!PeekMessage(msg, w->hwnd, 0, 0, PM_REMOVE)) {
+      if((w->running & FRAME_EVENT_DRIVEN) && !frame_win32_take_redraw(w)) {
+	frame_phase(FRAME_PHASE_WAIT);
+	frame_win32_wait(w);
+	frame_phase(FRAME_PHASE_EVENTS);
+	continue;
+      }
       break;
     }
 
     TranslateMessage(msg);
     DispatchMessage(msg);
+    InterlockedExchange(&w->dirty, 1);
 
     e->type = FRAME_EVENT_NONE;
 
@@ -640,6 +1299,8 @@ FRAME_DEF bool frame_peek(Frame *w, Frame_Event *e) {
     / (double) w->performance_frequency.QuadPart;
   w->time = time;
 
+  frame_phase(FRAME_PHASE_BATCH);
+
   //frame_renderer
 #ifndef FRAME_NO_RENDERER
   frame_renderer_imgui_begin(w, e);
@@ -660,12 +1321,34 @@ FRAME_DEF bool frame_get_mouse_position(Frame *w, float *x, float *y) {
 }
   
 FRAME_DEF void frame_swap_buffers(Frame *w) {
+  frame_phase(FRAME_PHASE_SWAP);
+  FRAME_TRACE_BEGIN("frame_swap_buffers");
 #ifndef FRAME_NO_RENDERER
-  frame_renderer_end();
+  frame_renderer_end_frame();
   frame_renderer_imgui_end();
 #endif // FRAME_NO_RENDERER
   
   SwapBuffers(w->dc);
+  FRAME_TRACE_END("frame_swap_buffers");
+  frame_timer_swapped();
+}
+
+FRAME_DEF void frame_request_redraw(Frame *w) {
+  // wake 'frame_peek' only once per frame
+  if(InterlockedExchange(&w->dirty, 1) == 0) {
+    PostMessage(w->hwnd, WM_NULL, 0, 0);
+  }
+}
+
+FRAME_DEF void frame_schedule_redraw(Frame *w, double ms) {
+  LARGE_INTEGER time;
+  QueryPerformanceCounter(&time);
+  time.QuadPart += (LONGLONG) (ms * (double) w->performance_frequency.QuadPart / 1000);
+
+  if(!w->redraw_scheduled || time.QuadPart < w->redraw_time.QuadPart) {
+    w->redraw_time = time;
+    w->redraw_scheduled = true;
+  }
 }
 
 FRAME_DEF bool frame_toggle_fullscreen(Frame *w) {
@@ -833,85 +1516,1428 @@ FRAME_DEF void frame_clipboard_free(Frame_Clipboard *clipboard) {
   CloseClipboard();  
 }
 
-FRAME_DEF const char *frame_shader_type_name(GLenum shader) {
-  switch (shader) {
-  case GL_VERTEX_SHADER:
-    return "GL_VERTEX_SHADER";
-  case GL_FRAGMENT_SHADER:
-    return "GL_FRAGMENT_SHADER";
-  default:
-    return "(Unknown)";
-  }
+#elif defined(FRAME_HEADLESS)
+
+static double frame_headless_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1000 + (double) ts.tv_nsec / 1000000;
 }
 
-FRAME_DEF bool frame_compile_shader(GLuint *shader, GLenum shader_type, const char *shader_source) {
-  *shader = glCreateShader(shader_type);
-  glShaderSource(*shader, 1, &shader_source, NULL);
-  glCompileShader(*shader);
+FRAME_DEF bool frame_init(Frame *w, int width, int height, const char *title, int flags) {
+  (void) title;
 
-  GLint compiled = 0;
-  glGetShaderiv(*shader, GL_COMPILE_STATUS, &compiled);
+#ifdef FRAME_SOFTWARE
+  w->framebuffer = malloc((size_t) width * (size_t) height * 4);
+  if(!w->framebuffer) {
+    return false;
+  }
+#else
+  //BEGIN egl
+  w->display = EGL_NO_DISPLAY;
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if(get_platform_display) {
+    w->display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  }
+  if(w->display == EGL_NO_DISPLAY) {
+    w->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if(w->display == EGL_NO_DISPLAY) {
+    FRAME_LOG("Can not open an EGL display\n");
+    return false;
+  }
 
-  if (!compiled) {
-    GLchar message[1024];
-    GLsizei message_size = 0;
-    glGetShaderInfoLog(*shader, sizeof(message), &message_size, message);
-    FRAME_LOG("Could not compile shader: %s\n", frame_shader_type_name(shader_type));
-    FRAME_LOG("%.*s\n", message_size, message);
+  EGLint major, minor;
+  if(!eglInitialize(w->display, &major, &minor) ||
+     !eglBindAPI(EGL_OPENGL_API)) {
+    FRAME_LOG("Can not initialize EGL\n");
+    return false;
+  }
+
+  // there is no surface, the config does not matter
+  w->context = eglCreateContext(w->display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, NULL);
+  if(w->context == EGL_NO_CONTEXT ||
+     !eglMakeCurrent(w->display, EGL_NO_SURFACE, EGL_NO_SURFACE, w->context)) {
+    FRAME_LOG("Can not create a surfaceless context\n");
     return false;
   }
+  //END egl
+
+  //BEGIN framebuffer
+  glGenRenderbuffers(1, &w->color);
+  glBindRenderbuffer(GL_RENDERBUFFER, w->color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+  glGenFramebuffers(1, &w->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, w->fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, w->color);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    FRAME_LOG("Framebuffer is incomplete\n");
+    return false;
+  }
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  //END framebuffer
+#endif //FRAME_SOFTWARE
+
+  w->width = width;
+  w->height = height;
+  w->running = FRAME_RUNNING | (flags & (FRAME_EVENT_DRIVEN | FRAME_FULLSCREEN | FRAME_READBACK));
+  w->frames = 0;
+  w->pixels_frame = -1;
+  w->pixels = NULL;
+  w->events_start = 0;
+  w->events_count = 0;
+  w->mouse_x = 0.f;
+  w->mouse_y = 0.f;
+  w->clipboard_text = NULL;
+  w->dirty = 1;
+  w->redraw_scheduled = false;
+
+  if(flags & FRAME_READBACK) {
+    size_t size = (size_t) width * (size_t) height * 4;
+#ifndef FRAME_SOFTWARE
+    glGenBuffers(FRAME_HEADLESS_PBOS, w->pbos);
+    for(int i=0;i<FRAME_HEADLESS_PBOS;i++) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, w->pbos[i]);
+      glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) size, NULL, GL_STREAM_READ);
+      w->fences[i] = NULL;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+#endif //FRAME_SOFTWARE
+
+    w->pixels = malloc(size);
+    if(!w->pixels) {
+      return false;
+    }
+  }
+
+#ifndef FRAME_NO_RENDERER
+  if(!frame_renderer_inited) {
+    if(!frame_renderer_init(&frame_renderer)) {
+      return false;
+    }
+
+    frame_renderer_inited = true;
+  }
+#endif //FRAME_NO_RENDERER
+
+  w->time = frame_headless_time();
+  w->dt = 0;
 
   return true;
 }
 
-FRAME_DEF bool frame_link_program(GLuint *program, GLuint vertex_shader, GLuint fragment_shader) {
-  *program = glCreateProgram();
-  glAttachShader(*program, vertex_shader);
-  glAttachShader(*program, fragment_shader);
+FRAME_DEF bool frame_set_vsync(Frame *w, bool use_vsync) {
+  (void) w;
+  return !use_vsync;
+}
 
-  glLinkProgram(*program);
-  
-  GLint linked = 0;
-  glGetProgramiv(*program, GL_LINK_STATUS, &linked);
-  if(!linked) {
-    GLsizei message_size = 0;
-    GLchar message[1024];
+FRAME_DEF bool frame_peek(Frame *w, Frame_Event *e) {
 
-    glGetProgramInfoLog(*program, sizeof(message), &message_size, message);
-    FRAME_LOG("Could not link program: %.*s\n", message_size, message);
+  if(w->events_count > 0) {
+    *e = w->events[w->events_start];
+    w->events_start = (w->events_start + 1) % FRAME_HEADLESS_EVENTS_CAP;
+    w->events_count--;
+
+#ifndef FRAME_NO_RENDERER
+    frame_renderer_imgui_update(w, e);
+#endif //FRAME_NO_RENDERER
+
+    return true;
+  }
+
+  e->type = FRAME_EVENT_NONE;
+  w->dirty = 0;
+  w->redraw_scheduled = false;
+
+  //dt
+  double time = frame_headless_time();
+  w->dt = time - w->time;
+  w->time = time;
+
+  frame_phase(FRAME_PHASE_BATCH);
+
+  //frame_renderer
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_imgui_begin(w, e);
+  frame_renderer_begin(w->width, w->height);
+#endif // FRAME_NO_RENDERER
+
+  return false;
+}
+
+FRAME_DEF bool frame_push_event(Frame *w, const Frame_Event *e) {
+  if(w->events_count == FRAME_HEADLESS_EVENTS_CAP) {
     return false;
   }
-  
+
+  int i = (w->events_start + w->events_count) % FRAME_HEADLESS_EVENTS_CAP;
+  w->events[i] = *e;
+  w->events_count++;
+
   return true;
-    
 }
 
-////////////////////////////////////////////////////////////////////////
-// renderer - definitions
-////////////////////////////////////////////////////////////////////////
+FRAME_DEF void frame_set_mouse_position(Frame *w, float x, float y) {
+  w->mouse_x = x;
+  w->mouse_y = y;
+}
 
-#ifndef FRAME_NO_RENDERER
+FRAME_DEF bool frame_get_mouse_position(Frame *w, float *x, float *y) {
+  *x = w->mouse_x;
+  *y = w->mouse_y;
+  return true;
+}
 
-static const char* frame_renderer_vertex_shader_source =
-  "#version 330 core\n"
-  "\n"
-  "layout(location = 0) in vec2 position;\n"
-  "layout(location = 1) in vec4 color;\n"
-  "layout(location = 2) in vec2 uv;\n"
-  "\n"
-  "uniform float resolution_x;\n"
-  "uniform float resolution_y;\n"
+#ifndef FRAME_SOFTWARE
+static void frame_headless_map(Frame *w, long long frame) {
+  int i = (int) (frame % FRAME_HEADLESS_PBOS);
+  if(!w->fences[i]) {
+    return;
+  }
+
+  glClientWaitSync(w->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(w->fences[i]);
+  w->fences[i] = NULL;
+
+  size_t size = (size_t) w->width * (size_t) w->height * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, w->pbos[i]);
+  void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) size, GL_MAP_READ_BIT);
+  if(data) {
+    memcpy(w->pixels, data, size);
+    w->pixels_frame = frame;
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF void frame_swap_buffers(Frame *w) {
+  frame_phase(FRAME_PHASE_SWAP);
+  FRAME_TRACE_BEGIN("frame_swap_buffers");
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_end_frame();
+  frame_renderer_imgui_end();
+#endif // FRAME_NO_RENDERER
+
+#ifdef FRAME_SOFTWARE
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_software_flush(w->framebuffer, w->width, w->height, w->width);
+#endif // FRAME_NO_RENDERER
+
+  // the frame is done once it is rasterized, readback is only a conversion
+  if(w->running & FRAME_READBACK) {
+    for(int y=0;y<w->height;y++) {
+      const unsigned int *src = w->framebuffer + (size_t) (w->height - 1 - y) * (size_t) w->width;
+      unsigned char *dst = w->pixels + (size_t) y * (size_t) w->width * 4;
+      for(int x=0;x<w->width;x++) {
+	unsigned int p = src[x];
+	dst[x * 4 + 0] = (unsigned char) (p >> 16);
+	dst[x * 4 + 1] = (unsigned char) (p >> 8);
+	dst[x * 4 + 2] = (unsigned char) p;
+	dst[x * 4 + 3] = (unsigned char) (p >> 24);
+      }
+    }
+    w->pixels_frame = w->frames;
+  }
+#else
+  if(w->running & FRAME_READBACK) {
+    // the pbo is reused FRAME_HEADLESS_PBOS frames later, collect it first
+    long long oldest = w->frames - (FRAME_HEADLESS_PBOS - 1);
+    if(oldest >= 0) {
+      frame_headless_map(w, oldest);
+    }
+
+    int i = (int) (w->frames % FRAME_HEADLESS_PBOS);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, w->pbos[i]);
+    glReadPixels(0, 0, w->width, w->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    w->fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  glFlush();
+#endif //FRAME_SOFTWARE
+
+  w->frames++;
+  FRAME_TRACE_END("frame_swap_buffers");
+  frame_timer_swapped();
+}
+
+FRAME_DEF const unsigned char *frame_read_pixels(Frame *w, bool wait, long long *frame) {
+  if(!(w->running & FRAME_READBACK)) {
+    return NULL;
+  }
+
+#ifdef FRAME_SOFTWARE
+  (void) wait;
+#else
+  if(wait) {
+    for(long long n=w->pixels_frame + 1;n<w->frames;n++) {
+      frame_headless_map(w, n);
+    }
+  }
+#endif //FRAME_SOFTWARE
+
+  if(w->pixels_frame < 0) {
+    return NULL;
+  }
+  if(frame) *frame = w->pixels_frame;
+
+  return w->pixels;
+}
+
+FRAME_DEF void frame_request_redraw(Frame *w) {
+  __atomic_store_n(&w->dirty, 1, __ATOMIC_SEQ_CST);
+}
+
+FRAME_DEF void frame_schedule_redraw(Frame *w, double ms) {
+  w->redraw_time = frame_headless_time() + ms;
+  w->redraw_scheduled = true;
+}
+
+FRAME_DEF bool frame_toggle_fullscreen(Frame *w) {
+  w->running ^= FRAME_FULLSCREEN;
+  return true;
+}
+
+FRAME_DEF void frame_free(Frame *w) {
+#ifdef FRAME_SOFTWARE
+  free(w->framebuffer);
+#else
+  if(w->running & FRAME_READBACK) {
+    for(int i=0;i<FRAME_HEADLESS_PBOS;i++) {
+      if(w->fences[i]) glDeleteSync(w->fences[i]);
+    }
+    glDeleteBuffers(FRAME_HEADLESS_PBOS, w->pbos);
+  }
+
+  glDeleteFramebuffers(1, &w->fbo);
+  glDeleteRenderbuffers(1, &w->color);
+  eglMakeCurrent(w->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(w->display, w->context);
+  eglTerminate(w->display);
+#endif //FRAME_SOFTWARE
+  free(w->pixels);
+  free(w->clipboard_text);
+}
+
+FRAME_DEF bool frame_set_title(Frame *f, const char *title) {
+  (void) f;
+  (void) title;
+  return true;
+}
+
+FRAME_DEF bool frame_show_cursor(Frame *w, bool show) {
+  (void) w;
+  (void) show;
+  return true;
+}
+
+FRAME_DEF bool frame_dragged_files_init(Frame_Dragged_Files *files, Frame_Event *event) {
+  (void) files;
+  (void) event;
+  return false;
+}
+
+FRAME_DEF bool frame_dragged_files_next(Frame_Dragged_Files *files, char **path) {
+  (void) files;
+  (void) path;
+  return false;
+}
+
+FRAME_DEF void frame_dragged_files_free(Frame_Dragged_Files *files) {
+  (void) files;
+}
+
+// the clipboard only lives inside the process
+FRAME_DEF bool frame_clipboard_init(Frame_Clipboard *clipboard, Frame *w, char **text) {
+  if(!w->clipboard_text) {
+    return false;
+  }
+
+  size_t len = strlen(w->clipboard_text);
+  clipboard->text = malloc(len + 1);
+  if(!clipboard->text) {
+    return false;
+  }
+  memcpy(clipboard->text, w->clipboard_text, len + 1);
+  *text = clipboard->text;
+
+  return true;
+}
+
+FRAME_DEF bool frame_clipboard_set(Frame *w, const char *text, size_t text_len) {
+  char *copy = malloc(text_len + 1);
+  if(!copy) {
+    return false;
+  }
+  memcpy(copy, text, text_len);
+  copy[text_len] = 0;
+
+  free(w->clipboard_text);
+  w->clipboard_text = copy;
+
+  return true;
+}
+
+FRAME_DEF void frame_clipboard_free(Frame_Clipboard *clipboard) {
+  free(clipboard->text);
+}
+
+#else // linux
+
+// 'button' is a renderer alias, but also a member of XButtonEvent
+#pragma push_macro("button")
+#undef button
+
+static double frame_x11_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1000 + (double) ts.tv_nsec / 1000000;
+}
+
+#ifndef FRAME_SOFTWARE
+static int frame_x11_context_failed = 0;
+
+static int frame_x11_context_error(Display *display, XErrorEvent *e) {
+  (void) display;
+  (void) e;
+  frame_x11_context_failed = 1;
+  return 0;
+}
+
+// A 3.3 core context, like the shaders ask for. Without
+// GLX_ARB_create_context, whatever 'glXCreateNewContext' gives.
+static GLXContext frame_x11_context(Display *d, GLXFBConfig config) {
+  const char *extensions = glXQueryExtensionsString(d, DefaultScreen(d));
+  PFNGLXCREATECONTEXTATTRIBSARBPROC create_context = NULL;
+  if(extensions && strstr(extensions, "GLX_ARB_create_context_profile")) {
+    create_context = (PFNGLXCREATECONTEXTATTRIBSARBPROC)
+      glXGetProcAddress((const GLubyte *) "glXCreateContextAttribsARB");
+  }
+  if(!create_context) {
+    return glXCreateNewContext(d, config, GLX_RGBA_TYPE, NULL, True);
+  }
+
+  int attribs[] = {
+    GLX_CONTEXT_MAJOR_VERSION_ARB, 3,
+    GLX_CONTEXT_MINOR_VERSION_ARB, 3,
+    GLX_CONTEXT_PROFILE_MASK_ARB, GLX_CONTEXT_CORE_PROFILE_BIT_ARB,
+    None
+  };
+
+  // an unsupported version only shows up as an X error
+  frame_x11_context_failed = 0;
+  XErrorHandler handler = XSetErrorHandler(frame_x11_context_error);
+  GLXContext context = create_context(d, config, NULL, True, attribs);
+  XSync(d, False);
+  XSetErrorHandler(handler);
+
+  if(frame_x11_context_failed) {
+    if(context) glXDestroyContext(d, context);
+    return NULL;
+  }
+  return context;
+}
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF bool frame_init(Frame *w, int width, int height, const char *title, int flags) {
+
+  w->display = XOpenDisplay(NULL);
+  if(!w->display) {
+    return false;
+  }
+  Display *d = w->display;
+  int screen = DefaultScreen(d);
+  Window root = RootWindow(d, screen);
+
+#ifdef FRAME_SOFTWARE
+  //BEGIN software
+  // the rasterizer writes 0xAARRGGBB, which a 24 bit TrueColor visual takes as is
+  XVisualInfo desired_visual = {0};
+  desired_visual.screen = screen;
+  desired_visual.depth = 24;
+  desired_visual.class = TrueColor;
+  int visuals_count = 0;
+  XVisualInfo *visual = XGetVisualInfo(d, VisualScreenMask | VisualDepthMask | VisualClassMask,
+				       &desired_visual, &visuals_count);
+  if(!visual) {
+    return false;
+  }
+  if(visual->red_mask != 0xFF0000 || visual->blue_mask != 0xFF) {
+    XFree(visual);
+    return false;
+  }
+  w->visual = visual->visual;
+  w->depth = visual->depth;
+  //END software
+#else
+  //BEGIN opengl
+  int desired_format[] = {
+    GLX_X_RENDERABLE, True,
+    GLX_DRAWABLE_TYPE, GLX_WINDOW_BIT,
+    GLX_RENDER_TYPE, GLX_RGBA_BIT,
+    GLX_RED_SIZE, 8,
+    GLX_GREEN_SIZE, 8,
+    GLX_BLUE_SIZE, 8,
+    GLX_ALPHA_SIZE, 8,
+    GLX_DOUBLEBUFFER, True,
+    None
+  };
+  int configs_count = 0;
+  GLXFBConfig *configs = glXChooseFBConfig(d, screen, desired_format, &configs_count);
+  if(!configs || configs_count == 0) {
+    return false;
+  }
+  GLXFBConfig config = configs[0];
+  XFree(configs);
+
+  XVisualInfo *visual = glXGetVisualFromFBConfig(d, config);
+  if(!visual) {
+    return false;
+  }
+  //END opengl
+#endif //FRAME_SOFTWARE
+
+  w->colormap = XCreateColormap(d, root, visual->visual, AllocNone);
+
+  XSetWindowAttributes attributes = {0};
+  attributes.colormap = w->colormap;
+  attributes.event_mask = KeyPressMask | KeyReleaseMask |
+    ButtonPressMask | ButtonReleaseMask | PointerMotionMask |
+    StructureNotifyMask | ExposureMask;
+
+  w->window = XCreateWindow(d, root,
+			    DisplayWidth(d, screen) / 2 - width / 2,
+			    DisplayHeight(d, screen) / 2 - height / 2,
+			    (unsigned int) width,
+			    (unsigned int) height,
+			    0,
+			    visual->depth,
+			    InputOutput,
+			    visual->visual,
+			    CWColormap | CWEventMask,
+			    &attributes);
+  XFree(visual);
+  if(!w->window) {
+    return false;
+  }
+
+  if(flags & FRAME_NOT_RESIZABLE) {
+    XSizeHints hints = {0};
+    hints.flags = PMinSize | PMaxSize;
+    hints.min_width = hints.max_width = width;
+    hints.min_height = hints.max_height = height;
+    XSetWMNormalHints(d, w->window, &hints);
+  }
+
+  w->wm_protocols = XInternAtom(d, "WM_PROTOCOLS", False);
+  w->wm_delete_window = XInternAtom(d, "WM_DELETE_WINDOW", False);
+  w->net_wm_name = XInternAtom(d, "_NET_WM_NAME", False);
+  w->net_wm_state = XInternAtom(d, "_NET_WM_STATE", False);
+  w->net_wm_state_fullscreen = XInternAtom(d, "_NET_WM_STATE_FULLSCREEN", False);
+  w->utf8_string = XInternAtom(d, "UTF8_STRING", False);
+  w->clipboard = XInternAtom(d, "CLIPBOARD", False);
+  w->targets = XInternAtom(d, "TARGETS", False);
+  w->selection = XInternAtom(d, "FRAME_SELECTION", False);
+  w->xdnd_aware = XInternAtom(d, "XdndAware", False);
+  w->xdnd_enter = XInternAtom(d, "XdndEnter", False);
+  w->xdnd_position = XInternAtom(d, "XdndPosition", False);
+  w->xdnd_status = XInternAtom(d, "XdndStatus", False);
+  w->xdnd_drop = XInternAtom(d, "XdndDrop", False);
+  w->xdnd_finished = XInternAtom(d, "XdndFinished", False);
+  w->xdnd_selection = XInternAtom(d, "XdndSelection", False);
+  w->xdnd_action_copy = XInternAtom(d, "XdndActionCopy", False);
+  w->text_uri_list = XInternAtom(d, "text/uri-list", False);
+
+  XSetWMProtocols(d, w->window, &w->wm_delete_window, 1);
+
+  if(flags & FRAME_DRAG_N_DROP) {
+    Atom version = 5;
+    XChangeProperty(d, w->window, w->xdnd_aware, XA_ATOM, 32,
+		    PropModeReplace, (unsigned char *) &version, 1);
+  }
+
+  // report held keys once, like WM_KEYDOWN without repeats
+  XkbSetDetectableAutoRepeat(d, True, NULL);
+  memset(w->keys_down, 0, sizeof(w->keys_down));
+
+  w->xi_opcode = 0;
+#ifdef FRAME_XINPUT2
+  // raw motion arrives before the server has done any pointer acceleration
+  // or event compression, so the cursor is queried as soon as it moves
+  int xi_event, xi_error;
+  if(XQueryExtension(d, "XInputExtension", &w->xi_opcode, &xi_event, &xi_error)) {
+    int major = 2, minor = 0;
+    if(XIQueryVersion(d, &major, &minor) == Success) {
+      unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = {0};
+      XIEventMask mask;
+      mask.deviceid = XIAllMasterDevices;
+      mask.mask_len = sizeof(mask_bits);
+      mask.mask = mask_bits;
+      XISetMask(mask_bits, XI_RawMotion);
+      XISelectEvents(d, root, &mask, 1);
+    } else {
+      w->xi_opcode = 0;
+    }
+  }
+#endif //FRAME_XINPUT2
+
+#ifdef FRAME_SOFTWARE
+  XMapWindow(d, w->window);
+  w->gc = XCreateGC(d, w->window, 0, NULL);
+  w->image = NULL;
+  w->shm.shmaddr = NULL;
+  w->shm_completion = XShmQueryExtension(d) ? XShmGetEventBase(d) + ShmCompletion : -1;
+  w->shm_pending = false;
+#else
+  w->context = frame_x11_context(d, config);
+  if(!w->context) {
+    return false;
+  }
+
+  XMapWindow(d, w->window);
+  if(!glXMakeCurrent(d, w->window, w->context)) {
+    return false;
+  }
+#endif //FRAME_SOFTWARE
+
+  if(pipe(w->wake) < 0) {
+    return false;
+  }
+  fcntl(w->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(w->wake[1], F_SETFL, O_NONBLOCK);
+
+  w->running = FRAME_RUNNING | (flags & FRAME_EVENT_DRIVEN);
+  w->width = width;
+  w->height = height;
+  w->mouse_x = 0.f;
+  w->mouse_y = 0.f;
+  w->hidden_cursor = None;
+  w->xdnd_source = None;
+  w->clipboard_text = NULL;
+  w->clipboard_len = 0;
+  w->dirty = 1;
+  w->redraw_scheduled = false;
+
+  frame_set_title(w, title);
+
+#ifndef FRAME_NO_RENDERER
+  if(!frame_renderer_inited) {
+    if(!frame_renderer_init(&frame_renderer)) {
+      return false;
+    }
+
+    frame_renderer_inited = true;
+  }
+#endif //FRAME_NO_RENDERER
+
+  // use vsync as default, if there is a swap control extension
+  frame_set_vsync(w, true);
+
+  if((flags & FRAME_FULLSCREEN) && !frame_toggle_fullscreen(w)) {
+    return false;
+  }
+
+  w->time = frame_x11_time();
+  w->dt = 0;
+
+  return true;
+}
+
+#ifdef FRAME_SOFTWARE
+// Presenting is paced by ShmCompletion, there is no swap interval
+FRAME_DEF bool frame_set_vsync(Frame *w, bool use_vsync) {
+  (void) w;
+  (void) use_vsync;
+  return false;
+}
+#else
+FRAME_DEF bool frame_set_vsync(Frame *w, bool use_vsync) {
+  const char *extensions = glXQueryExtensionsString(w->display, DefaultScreen(w->display));
+  if(!extensions) {
+    return false;
+  }
+
+  int interval = use_vsync ? 1 : 0;
+  if(strstr(extensions, "GLX_EXT_swap_control")) {
+    PFNGLXSWAPINTERVALEXTPROC swap_interval =
+      (PFNGLXSWAPINTERVALEXTPROC) glXGetProcAddress((const GLubyte *) "glXSwapIntervalEXT");
+    if(swap_interval) {
+      swap_interval(w->display, w->window, interval);
+      return true;
+    }
+  }
+  if(strstr(extensions, "GLX_MESA_swap_control")) {
+    PFNGLXSWAPINTERVALMESAPROC swap_interval =
+      (PFNGLXSWAPINTERVALMESAPROC) glXGetProcAddress((const GLubyte *) "glXSwapIntervalMESA");
+    if(swap_interval) {
+      return swap_interval((unsigned int) interval) == 0;
+    }
+  }
+
+  return false;
+}
+#endif //FRAME_SOFTWARE
+
+static bool frame_x11_take_redraw(Frame *w) {
+  if(w->redraw_scheduled && frame_x11_time() >= w->redraw_time) {
+    w->redraw_scheduled = false;
+    __atomic_store_n(&w->dirty, 0, __ATOMIC_SEQ_CST);
+    return true;
+  }
+
+  return __atomic_exchange_n(&w->dirty, 0, __ATOMIC_SEQ_CST) != 0;
+}
+
+static void frame_x11_wait(Frame *w) {
+  int timeout = -1;
+  if(w->redraw_scheduled) {
+    double ms = w->redraw_time - frame_x11_time();
+    timeout = ms > 0 ? (int) ms + 1 : 0;
+  }
+
+  struct pollfd fds[2];
+  fds[0].fd = ConnectionNumber(w->display);
+  fds[0].events = POLLIN;
+  fds[1].fd = w->wake[0];
+  fds[1].events = POLLIN;
+  poll(fds, 2, timeout);
+
+  char buffer[64];
+  while(read(w->wake[0], buffer, sizeof(buffer)) > 0) ;
+}
+
+static char frame_x11_key(XKeyEvent *key) {
+  switch(XLookupKeysym(key, 0)) {
+  case XK_BackSpace: return FRAME_BACKSPACE;
+  case XK_Escape: return FRAME_ESCAPE;
+  case XK_space: return FRAME_SPACE;
+  case XK_Left: return FRAME_ARROW_LEFT;
+  case XK_Up: return FRAME_ARROW_UP;
+  case XK_Right: return FRAME_ARROW_RIGHT;
+  case XK_Down: return FRAME_ARROW_DOWN;
+  default: break;
+  }
+
+  // the layout and shift are applied by the server
+  char buffer[8];
+  if(XLookupString(key, buffer, sizeof(buffer), NULL, NULL) == 1) {
+    return buffer[0];
+  }
+
+  return 0;
+}
+
+#ifdef FRAME_XINPUT2
+static void frame_x11_query_pointer(Frame *w) {
+  Window root, child;
+  int root_x, root_y, x, y;
+  unsigned int mask;
+  if(XQueryPointer(w->display, w->window, &root, &child, &root_x, &root_y, &x, &y, &mask)) {
+    w->mouse_x = (float) x;
+    w->mouse_y = (float) (w->height - y);
+  }
+}
+#endif //FRAME_XINPUT2
+
+static void frame_x11_client_message(Frame *w, Window target, Atom type, long l0, long l1, long l2, long l3, long l4) {
+  XEvent reply = {0};
+  reply.xclient.type = ClientMessage;
+  reply.xclient.display = w->display;
+  reply.xclient.window = target;
+  reply.xclient.message_type = type;
+  reply.xclient.format = 32;
+  reply.xclient.data.l[0] = l0;
+  reply.xclient.data.l[1] = l1;
+  reply.xclient.data.l[2] = l2;
+  reply.xclient.data.l[3] = l3;
+  reply.xclient.data.l[4] = l4;
+  XSendEvent(w->display, target, False, NoEventMask, &reply);
+}
+
+// Reads and deletes 'property' of the window, as a zero terminated string
+static char *frame_x11_read_property(Frame *w, Atom property, size_t *len) {
+  Atom type;
+  int format;
+  unsigned long count, after;
+  unsigned char *data = NULL;
+  if(XGetWindowProperty(w->display, w->window, property, 0, LONG_MAX / 4, True,
+			AnyPropertyType, &type, &format, &count, &after, &data) != Success || !data) {
+    return NULL;
+  }
+
+  size_t size = count * (size_t) (format / 8);
+  char *text = malloc(size + 1);
+  if(text) {
+    memcpy(text, data, size);
+    text[size] = 0;
+    if(len) *len = size;
+  }
+  XFree(data);
+
+  return text;
+}
+
+static void frame_x11_selection_request(Frame *w, XSelectionRequestEvent *request) {
+  XEvent reply = {0};
+  reply.xselection.type = SelectionNotify;
+  reply.xselection.requestor = request->requestor;
+  reply.xselection.selection = request->selection;
+  reply.xselection.target = request->target;
+  reply.xselection.time = request->time;
+  reply.xselection.property = None;
+
+  if(w->clipboard_text && request->property != None) {
+    if(request->target == w->targets) {
+      Atom supported[] = { w->targets, w->utf8_string, XA_STRING };
+      XChangeProperty(w->display, request->requestor, request->property, XA_ATOM, 32,
+		      PropModeReplace, (unsigned char *) supported, 3);
+      reply.xselection.property = request->property;
+    } else if(request->target == w->utf8_string || request->target == XA_STRING) {
+      XChangeProperty(w->display, request->requestor, request->property, request->target, 8,
+		      PropModeReplace, (unsigned char *) w->clipboard_text, (int) w->clipboard_len);
+      reply.xselection.property = request->property;
+    }
+  }
+
+  XSendEvent(w->display, request->requestor, False, NoEventMask, &reply);
+}
+
+FRAME_DEF bool frame_peek(Frame *w, Frame_Event *e) {
+
+  XEvent *xev = &e->xev;
+
+  while(true) {
+    if(!XPending(w->display)) {
+      if((w->running & FRAME_EVENT_DRIVEN) && !frame_x11_take_redraw(w)) {
+	frame_phase(FRAME_PHASE_WAIT);
+	frame_x11_wait(w);
+	frame_phase(FRAME_PHASE_EVENTS);
+	continue;
+      }
+      break;
+    }
+
+    XNextEvent(w->display, xev);
+#ifdef FRAME_SOFTWARE
+    // not input, the server is done with the last frame
+    if(xev->type == w->shm_completion) {
+      w->shm_pending = false;
+      continue;
+    }
+#endif //FRAME_SOFTWARE
+    __atomic_store_n(&w->dirty, 1, __ATOMIC_SEQ_CST);
+
+    e->type = FRAME_EVENT_NONE;
+
+    switch(xev->type) {
+    case KeyPress:
+    case KeyRelease: {
+      bool is_down = xev->type == KeyPress;
+      unsigned int code = xev->xkey.keycode & 0xff;
+      if(w->keys_down[code] == is_down) {
+	continue;
+      }
+      w->keys_down[code] = is_down;
+
+      char c = frame_x11_key(&xev->xkey);
+      if(c == 0) {
+	continue;
+      }
+
+      e->as.key = c;
+      e->type = is_down ? FRAME_EVENT_KEYPRESS : FRAME_EVENT_KEYRELEASE;
+    } break;
+    case ButtonPress:
+    case ButtonRelease: {
+      bool is_down = xev->type == ButtonPress;
+      switch(xev->xbutton.button) {
+      case Button1:
+      case Button3: {
+	e->type = is_down ? FRAME_EVENT_MOUSEPRESS : FRAME_EVENT_MOUSERELEASE;
+	e->as.key = xev->xbutton.button == Button1 ? 'l' : 'r';
+      } break;
+      case Button4:
+      case Button5:
+      case 6:
+      case 7: {
+	// scrolling is a press and release per step
+	if(is_down) {
+	  e->type = FRAME_EVENT_MOUSEWHEEL;
+	  e->as.amount = (xev->xbutton.button == Button4 || xev->xbutton.button == 7) ? 1 : -1;
+	}
+      } break;
+      }
+      w->mouse_x = (float) xev->xbutton.x;
+      w->mouse_y = (float) (w->height - xev->xbutton.y);
+    } break;
+    case MotionNotify: {
+      // only the latest position matters, but never skip over a press or
+      // release, which read the position of their own event
+      while(XEventsQueued(w->display, QueuedAlready) > 0) {
+	XEvent next;
+	XPeekEvent(w->display, &next);
+	if(next.type != MotionNotify || next.xmotion.window != w->window) break;
+	XNextEvent(w->display, xev);
+      }
+      w->mouse_x = (float) xev->xmotion.x;
+      w->mouse_y = (float) (w->height - xev->xmotion.y);
+    } break;
+    case ConfigureNotify: {
+      w->width = xev->xconfigure.width;
+      w->height = xev->xconfigure.height;
+    } break;
+    case ClientMessage: {
+      XClientMessageEvent *m = &xev->xclient;
+      if(m->message_type == w->wm_protocols &&
+	 (Atom) m->data.l[0] == w->wm_delete_window) {
+	w->running = 0;
+      } else if(m->message_type == w->xdnd_enter) {
+	w->xdnd_source = (Window) m->data.l[0];
+      } else if(m->message_type == w->xdnd_position) {
+	frame_x11_client_message(w, (Window) m->data.l[0], w->xdnd_status,
+				 (long) w->window, 1, 0, 0, (long) w->xdnd_action_copy);
+      } else if(m->message_type == w->xdnd_drop) {
+	w->xdnd_source = (Window) m->data.l[0];
+	XConvertSelection(w->display, w->xdnd_selection, w->text_uri_list,
+			  w->xdnd_selection, w->window, (Time) m->data.l[2]);
+      }
+    } break;
+    case SelectionNotify: {
+      XSelectionEvent *s = &xev->xselection;
+      if(s->selection != w->xdnd_selection) {
+	continue;
+      }
+
+      char *data = NULL;
+      if(s->property != None) {
+	data = frame_x11_read_property(w, s->property, NULL);
+      }
+      frame_x11_client_message(w, w->xdnd_source, w->xdnd_finished,
+			       (long) w->window, data != NULL, (long) w->xdnd_action_copy, 0, 0);
+      w->xdnd_source = None;
+
+      if(data) {
+	e->type = FRAME_EVENT_FILEDROP;
+	e->as.value = (long long) (intptr_t) data;
+      }
+    } break;
+    case SelectionRequest: {
+      frame_x11_selection_request(w, &xev->xselectionrequest);
+    } break;
+    case SelectionClear: {
+      if(xev->xselectionclear.selection == w->clipboard) {
+	free(w->clipboard_text);
+	w->clipboard_text = NULL;
+      }
+    } break;
+#ifdef FRAME_XINPUT2
+    case GenericEvent: {
+      XGenericEventCookie *cookie = &xev->xcookie;
+      if(cookie->extension == w->xi_opcode && XGetEventData(w->display, cookie)) {
+	if(cookie->evtype == XI_RawMotion) {
+	  frame_x11_query_pointer(w);
+	}
+	XFreeEventData(w->display, cookie);
+      }
+    } break;
+#endif //FRAME_XINPUT2
+    default: {
+    } break;
+    }
+
+#ifndef FRAME_NO_RENDERER
+    frame_renderer_imgui_update(w, e);
+#endif //FRAME_NO_RENDERER
+
+    if(e->type != FRAME_EVENT_NONE) {
+      return true;
+    }
+  }
+
+  //dt
+  double time = frame_x11_time();
+  w->dt = time - w->time;
+  w->time = time;
+
+  frame_phase(FRAME_PHASE_BATCH);
+
+  //frame_renderer
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_imgui_begin(w, e);
+  frame_renderer_begin(w->width, w->height);
+#endif // FRAME_NO_RENDERER
+
+  return false;
+}
+
+FRAME_DEF bool frame_get_mouse_position(Frame *w, float *x, float *y) {
+  *x = w->mouse_x;
+  *y = w->mouse_y;
+  return true;
+}
+
+#ifdef FRAME_SOFTWARE
+
+static Bool frame_x11_is_shm_completion(Display *display, XEvent *e, XPointer arg) {
+  (void) display;
+  return e->type == ((Frame *) arg)->shm_completion;
+}
+
+static void frame_x11_shm_wait(Frame *w) {
+  if(!w->shm_pending) return;
+
+  XEvent e;
+  XIfEvent(w->display, &e, frame_x11_is_shm_completion, (XPointer) w);
+  w->shm_pending = false;
+}
+
+static int frame_x11_shm_failed = 0;
+
+static int frame_x11_shm_error(Display *display, XErrorEvent *e) {
+  (void) display;
+  (void) e;
+  frame_x11_shm_failed = 1;
+  return 0;
+}
+
+static void frame_x11_image_free(Frame *w) {
+  if(!w->image) return;
+
+  frame_x11_shm_wait(w);
+  if(w->shm.shmaddr) {
+    XShmDetach(w->display, &w->shm);
+    w->image->data = NULL;
+    XDestroyImage(w->image);
+    shmdt(w->shm.shmaddr);
+    w->shm.shmaddr = NULL;
+  } else {
+    XDestroyImage(w->image); // frees 'data'
+  }
+  w->image = NULL;
+}
+
+// With MIT-SHM the server reads the framebuffer in place, instead of getting
+// every frame through the socket
+static bool frame_x11_image_resize(Frame *w) {
+  if(w->image && w->image->width == w->width && w->image->height == w->height) {
+    return true;
+  }
+  frame_x11_image_free(w);
+
+  Display *d = w->display;
+  unsigned int width = (unsigned int) w->width, height = (unsigned int) w->height;
+
+  if(w->shm_completion >= 0) {
+    w->image = XShmCreateImage(d, w->visual, (unsigned int) w->depth, ZPixmap, NULL, &w->shm, width, height);
+    if(w->image) {
+      w->shm.shmid = shmget(IPC_PRIVATE, (size_t) w->image->bytes_per_line * height, IPC_CREAT | 0600);
+      void *addr = w->shm.shmid < 0 ? (void *) -1 : shmat(w->shm.shmid, NULL, 0);
+      if(addr != (void *) -1) {
+	w->shm.shmaddr = w->image->data = addr;
+	w->shm.readOnly = False;
+
+	// attaching fails for a remote server, which only shows up as an X error
+	frame_x11_shm_failed = 0;
+	XErrorHandler handler = XSetErrorHandler(frame_x11_shm_error);
+	XShmAttach(d, &w->shm);
+	XSync(d, False);
+	XSetErrorHandler(handler);
+      }
+      if(w->shm.shmid >= 0) {
+	shmctl(w->shm.shmid, IPC_RMID, NULL); // released after the last detach
+      }
+
+      if(addr != (void *) -1 && !frame_x11_shm_failed) {
+	return true;
+      }
+
+      if(addr != (void *) -1) shmdt(addr);
+      w->shm.shmaddr = NULL;
+      w->image->data = NULL;
+      XDestroyImage(w->image);
+      w->image = NULL;
+    }
+    w->shm_completion = -1;
+  }
+
+  char *data = malloc((size_t) width * (size_t) height * 4);
+  if(!data) {
+    return false;
+  }
+  w->image = XCreateImage(d, w->visual, (unsigned int) w->depth, ZPixmap, 0, data, width, height, 32, 0);
+  if(!w->image) {
+    free(data);
+    return false;
+  }
+
+  return true;
+}
+
+static void frame_x11_present(Frame *w) {
+  if(w->width <= 0 || w->height <= 0) return;
+
+  // the server may still read the last frame
+  frame_x11_shm_wait(w);
+  if(!frame_x11_image_resize(w)) return;
+
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_software_flush((unsigned int *) w->image->data, w->width, w->height,
+				w->image->bytes_per_line / 4);
+#endif // FRAME_NO_RENDERER
+
+  if(w->shm.shmaddr) {
+    XShmPutImage(w->display, w->window, w->gc, w->image, 0, 0, 0, 0,
+		 (unsigned int) w->width, (unsigned int) w->height, True);
+    w->shm_pending = true;
+  } else {
+    XPutImage(w->display, w->window, w->gc, w->image, 0, 0, 0, 0,
+	      (unsigned int) w->width, (unsigned int) w->height);
+  }
+  XFlush(w->display);
+}
+
+FRAME_DEF void frame_swap_buffers(Frame *w) {
+  frame_phase(FRAME_PHASE_SWAP);
+  FRAME_TRACE_BEGIN("frame_swap_buffers");
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_end_frame();
+  frame_renderer_imgui_end();
+#endif // FRAME_NO_RENDERER
+
+  frame_x11_present(w);
+  FRAME_TRACE_END("frame_swap_buffers");
+  frame_timer_swapped();
+}
+
+#else
+
+FRAME_DEF void frame_swap_buffers(Frame *w) {
+  frame_phase(FRAME_PHASE_SWAP);
+  FRAME_TRACE_BEGIN("frame_swap_buffers");
+#ifndef FRAME_NO_RENDERER
+  frame_renderer_end_frame();
+  frame_renderer_imgui_end();
+#endif // FRAME_NO_RENDERER
+
+  glXSwapBuffers(w->display, w->window);
+  FRAME_TRACE_END("frame_swap_buffers");
+  frame_timer_swapped();
+}
+
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF void frame_request_redraw(Frame *w) {
+  // wake 'frame_peek' only once per frame
+  if(__atomic_exchange_n(&w->dirty, 1, __ATOMIC_SEQ_CST) == 0) {
+    ssize_t n = write(w->wake[1], "", 1);
+    (void) n;
+  }
+}
+
+FRAME_DEF void frame_schedule_redraw(Frame *w, double ms) {
+  double time = frame_x11_time() + ms;
+  if(!w->redraw_scheduled || time < w->redraw_time) {
+    w->redraw_time = time;
+    w->redraw_scheduled = true;
+  }
+}
+
+FRAME_DEF bool frame_toggle_fullscreen(Frame *w) {
+
+  // ask the window manager, the size arrives with ConfigureNotify
+  long action = (w->running & FRAME_FULLSCREEN) ? 0 : 1; // _NET_WM_STATE_REMOVE, _ADD
+  XEvent e = {0};
+  e.xclient.type = ClientMessage;
+  e.xclient.window = w->window;
+  e.xclient.message_type = w->net_wm_state;
+  e.xclient.format = 32;
+  e.xclient.data.l[0] = action;
+  e.xclient.data.l[1] = (long) w->net_wm_state_fullscreen;
+  e.xclient.data.l[3] = 1;
+  if(!XSendEvent(w->display, DefaultRootWindow(w->display), False,
+		 SubstructureRedirectMask | SubstructureNotifyMask, &e)) {
+    return false;
+  }
+  XFlush(w->display);
+
+  w->running ^= FRAME_FULLSCREEN;
+
+  return true;
+}
+
+FRAME_DEF void frame_free(Frame *w) {
+#ifdef FRAME_SOFTWARE
+  frame_x11_image_free(w);
+  XFreeGC(w->display, w->gc);
+#else
+  glXMakeCurrent(w->display, None, NULL);
+  glXDestroyContext(w->display, w->context);
+#endif //FRAME_SOFTWARE
+  if(w->hidden_cursor != None) {
+    XFreeCursor(w->display, w->hidden_cursor);
+  }
+  XDestroyWindow(w->display, w->window);
+  XFreeColormap(w->display, w->colormap);
+  XCloseDisplay(w->display);
+  close(w->wake[0]);
+  close(w->wake[1]);
+  free(w->clipboard_text);
+}
+
+FRAME_DEF bool frame_set_title(Frame *f, const char *title) {
+  XStoreName(f->display, f->window, title);
+  XChangeProperty(f->display, f->window, f->net_wm_name, f->utf8_string, 8,
+		  PropModeReplace, (const unsigned char *) title, (int) strlen(title));
+  return true;
+}
+
+FRAME_DEF bool frame_show_cursor(Frame *w, bool show) {
+  if(show) {
+    XUndefineCursor(w->display, w->window);
+    return true;
+  }
+
+  if(w->hidden_cursor == None) {
+    char empty[1] = {0};
+    Pixmap pixmap = XCreateBitmapFromData(w->display, w->window, empty, 1, 1);
+    if(pixmap == None) {
+      return false;
+    }
+    XColor black = {0};
+    w->hidden_cursor = XCreatePixmapCursor(w->display, pixmap, pixmap, &black, &black, 0, 0);
+    XFreePixmap(w->display, pixmap);
+  }
+  XDefineCursor(w->display, w->window, w->hidden_cursor);
+
+  return true;
+}
+
+FRAME_DEF bool frame_dragged_files_init(Frame_Dragged_Files *files, Frame_Event *event) {
+  files->data = (char *) (intptr_t) event->as.value;
+  files->next = files->data;
+
+  return files->data != NULL;
+}
+
+static int frame_x11_hex(char c) {
+  if('0' <= c && c <= '9') return c - '0';
+  if('a' <= c && c <= 'f') return c - 'a' + 10;
+  if('A' <= c && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+FRAME_DEF bool frame_dragged_files_next(Frame_Dragged_Files *files, char **path) {
+
+  while(*files->next) {
+    char *line = files->next;
+    size_t line_len = strcspn(line, "\r\n");
+    files->next = line + line_len;
+    files->next += strspn(files->next, "\r\n");
+
+    // file://host/path, comments start with '#'
+    if(line_len <= 7 || line[0] == '#' || strncmp(line, "file://", 7) != 0) {
+      continue;
+    }
+    char *end = line + line_len;
+    char *src = memchr(line + 7, '/', (size_t) (end - line - 7));
+    if(!src) {
+      continue;
+    }
+
+    size_t len = 0;
+    while(src < end && len + 1 < sizeof(files->path)) {
+      int hi, lo;
+      if(src[0] == '%' && end - src >= 3 &&
+	 (hi = frame_x11_hex(src[1])) >= 0 && (lo = frame_x11_hex(src[2])) >= 0) {
+	files->path[len++] = (char) (hi * 16 + lo);
+	src += 3;
+      } else {
+	files->path[len++] = *src++;
+      }
+    }
+    files->path[len] = 0;
+    *path = files->path;
+
+    return true;
+  }
+
+  return false;
+}
+
+FRAME_DEF void frame_dragged_files_free(Frame_Dragged_Files *files) {
+  free(files->data);
+}
+
+static Bool frame_x11_is_clipboard_notify(Display *display, XEvent *e, XPointer arg) {
+  (void) display;
+  Frame *w = (Frame *) arg;
+  return e->type == SelectionNotify && e->xselection.selection == w->clipboard;
+}
+
+FRAME_DEF bool frame_clipboard_init(Frame_Clipboard *clipboard, Frame *w, char **text) {
+
+  if(w->clipboard_text) {
+    clipboard->text = malloc(w->clipboard_len + 1);
+    if(!clipboard->text) {
+      return false;
+    }
+    memcpy(clipboard->text, w->clipboard_text, w->clipboard_len + 1);
+    *text = clipboard->text;
+    return true;
+  }
+
+  XConvertSelection(w->display, w->clipboard, w->utf8_string, w->selection, w->window, CurrentTime);
+  XFlush(w->display);
+
+  // the owner answers with SelectionNotify, other events stay queued
+  XEvent e;
+  double deadline = frame_x11_time() + 1000;
+  while(!XCheckIfEvent(w->display, &e, frame_x11_is_clipboard_notify, (XPointer) w)) {
+    double ms = deadline - frame_x11_time();
+    if(ms <= 0) {
+      return false;
+    }
+    struct pollfd fd = { ConnectionNumber(w->display), POLLIN, 0 };
+    poll(&fd, 1, (int) ms + 1);
+  }
+
+  if(e.xselection.property == None) {
+    return false;
+  }
+
+  clipboard->text = frame_x11_read_property(w, e.xselection.property, NULL);
+  if(!clipboard->text) {
+    return false;
+  }
+  *text = clipboard->text;
+
+  return true;
+}
+
+FRAME_DEF bool frame_clipboard_set(Frame *w, const char *text, size_t text_len) {
+
+  char *copy = malloc(text_len + 1);
+  if(!copy) {
+    return false;
+  }
+  memcpy(copy, text, text_len);
+  copy[text_len] = 0;
+
+  free(w->clipboard_text);
+  w->clipboard_text = copy;
+  w->clipboard_len = text_len;
+
+  // served from 'frame_peek' on SelectionRequest
+  XSetSelectionOwner(w->display, w->clipboard, w->window, CurrentTime);
+
+  return XGetSelectionOwner(w->display, w->clipboard) == w->window;
+}
+
+FRAME_DEF void frame_clipboard_free(Frame_Clipboard *clipboard) {
+  free(clipboard->text);
+}
+
+#pragma pop_macro("button")
+
+#endif //_WIN32
+
+
+#ifndef FRAME_SOFTWARE
+
+FRAME_DEF const char *frame_shader_type_name(GLenum shader) {
+  switch (shader) {
+  case GL_VERTEX_SHADER:
+    return "GL_VERTEX_SHADER";
+  case GL_FRAGMENT_SHADER:
+    return "GL_FRAGMENT_SHADER";
+  default:
+    return "(Unknown)";
+  }
+}
+
+FRAME_DEF bool frame_compile_shader(GLuint *shader, GLenum shader_type, const char *shader_source) {
+  *shader = glCreateShader(shader_type);
+  glShaderSource(*shader, 1, &shader_source, NULL);
+  glCompileShader(*shader);
+
+  GLint compiled = 0;
+  glGetShaderiv(*shader, GL_COMPILE_STATUS, &compiled);
+
+  if (!compiled) {
+    GLchar message[1024];
+    GLsizei message_size = 0;
+    glGetShaderInfoLog(*shader, sizeof(message), &message_size, message);
+    FRAME_LOG("Could not compile shader: %s\n", frame_shader_type_name(shader_type));
+    FRAME_LOG("%.*s\n", message_size, message);
+    return false;
+  }
+
+  return true;
+}
+
+FRAME_DEF bool frame_link_program(GLuint *program, GLuint vertex_shader, GLuint fragment_shader) {
+  *program = glCreateProgram();
+  glAttachShader(*program, vertex_shader);
+  glAttachShader(*program, fragment_shader);
+
+  glLinkProgram(*program);
+  
+  GLint linked = 0;
+  glGetProgramiv(*program, GL_LINK_STATUS, &linked);
+  if(!linked) {
+    GLsizei message_size = 0;
+    GLchar message[1024];
+
+    glGetProgramInfoLog(*program, sizeof(message), &message_size, message);
+    FRAME_LOG("Could not link program: %.*s\n", message_size, message);
+    return false;
+  }
+  
+  return true;
+    
+}
+
+#endif //FRAME_SOFTWARE
+
+////////////////////////////////////////////////////////////////////////
+// renderer - definitions
+////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_NO_RENDERER
+
+#ifndef FRAME_SOFTWARE
+
+static const char* frame_renderer_vertex_shader_source =
+  "#version 330 core\n"
+  "\n"
+  "layout(location = 0) in vec2 position;\n"
+  "layout(location = 1) in vec4 color;\n"
+  "layout(location = 2) in vec2 uv;\n"
+  "\n"
+  "uniform vec2 resolution;\n"
   "\n"
   "out vec4 out_color;\n"
   "out vec2 out_uv;\n"
+  "flat out int out_kind;\n"
   "\n"
   "vec2 resolution_project(vec2 point) {\n"
-  "    return 2 * point / vec2(resolution_x, resolution_y) - 1;\n"
+  "    return 2 * point / resolution - 1;\n"
   "}\n"
   "\n"
   "void main() {\n"
   "  out_color = color;\n"
-  "  out_uv = uv;\n"
+  "  if(uv.x == 65535.0) {\n"
+  "    out_kind = 0;\n"
+  "    out_uv = vec2(0, 0);\n"
+  "  } else if(uv.x >= 32768.0) {\n"
+  "    out_kind = 2;\n"
+  "    out_uv = vec2(uv.x - 32768.0, uv.y) / 32767.0;\n"
+  "  } else {\n"
+  "    out_kind = 1;\n"
+  "    out_uv = uv / 32767.0;\n"
+  "  }\n"
   "  gl_Position = vec4(resolution_project(position), 0, 1);\n"
   "}";
 
@@ -923,15 +2949,16 @@ static const char *frame_renderer_fragment_shader_source=
   "\n"
   "in vec4 out_color;\n"
   "in vec2 out_uv;\n"
+  "flat in int out_kind;\n"
   "\n"
   "out vec4 fragColor;\n"
   "\n"
   "void main() {\n"
-  "    if(out_uv.x < 0 && out_uv.y < 0) {\n"
+  "    if(out_kind == 0) {\n"
   "        fragColor = out_color;\n"
-  "    } else if(out_color.w < 0) {\n"
+  "    } else if(out_kind == 2) {\n"
   "        vec4 color = texture(font_tex, vec2(out_uv.x, 1-out_uv.y));\n"
-  "        float a = color.w * -out_color.w;\n"
+  "        float a = color.w * out_color.w;\n"
   "        color = (color + vec4(1, 1, 1, 0)) * out_color;\n"
   "        color.w = a;\n"
   "        fragColor = color;\n"
@@ -942,6 +2969,44 @@ static const char *frame_renderer_fragment_shader_source=
   "    }\n"
   "}\n";
 
+// The quad of an instance comes from gl_VertexID, drawn as a triangle strip
+static const char* frame_renderer_sprite_vertex_shader_source =
+  "#version 330 core\n"
+  "\n"
+  "layout(location = 0) in vec4 rect;\n"
+  "layout(location = 1) in vec4 uv_rect;\n"
+  "layout(location = 2) in vec4 tint;\n"
+  "layout(location = 3) in float layer;\n"
+  "\n"
+  "uniform vec2 resolution;\n"
+  "\n"
+  "out vec4 out_color;\n"
+  "out vec3 out_uv;\n"
+  "\n"
+  "void main() {\n"
+  "  vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+  "  vec2 position = rect.xy + corner * rect.zw;\n"
+  "  out_color = tint;\n"
+  "  out_uv = vec3(uv_rect.xy + corner * uv_rect.zw, layer);\n"
+  "  gl_Position = vec4(2 * position / resolution - 1, 0, 1);\n"
+  "}";
+
+static const char *frame_renderer_sprite_fragment_shader_source=
+  "#version 330 core\n"
+  "\n"
+  "uniform sampler2DArray sprites;\n"
+  "\n"
+  "in vec4 out_color;\n"
+  "in vec3 out_uv;\n"
+  "\n"
+  "out vec4 fragColor;\n"
+  "\n"
+  "void main() {\n"
+  "    fragColor = texture(sprites, vec3(out_uv.x, 1-out_uv.y, out_uv.z)) * out_color;\n"
+  "}\n";
+
+#endif //FRAME_SOFTWARE
+
 FRAME_DEF Frame_Renderer_Vec2f frame_renderer_vec2f(float x, float y) {
   return (Frame_Renderer_Vec2f) { x, y};
 }
@@ -950,22 +3015,271 @@ FRAME_DEF Frame_Renderer_Vec4f frame_renderer_vec4f(float x, float y, float z, f
   return (Frame_Renderer_Vec4f) { x, y, z, w};
 }
 
+#ifdef FRAME_SOFTWARE
+
+// The software renderer records every batch as triangles, already set up
+// for scanline conversion, and rasterizes the whole frame at once in
+// 'frame_renderer_software_flush'. The target is split into bands of
+// FRAME_SOFTWARE_BAND rows, every band is owned by one thread and walks
+// all triangles in order, so blending stays ordered without any locking.
+// The calling thread and jobs of the pool claim bands from 'next' until
+// none is left. A job may start after the flush returned, so the last one
+// to let go frees it, not the calling thread.
+
+typedef struct{
+  int bands;
+  Thread_Atomic next;
+  Thread_Atomic refs;
+  Thread_Mutex mutex; // of 'done'
+  Thread_Cond finished;
+  int done;
+}Frame_Renderer_Bands;
+
+#define FRAME_RENDERER_KIND_SOLID 0
+#define FRAME_RENDERER_KIND_TEX 1
+#define FRAME_RENDERER_KIND_FONT 2
+
+typedef struct{
+  float x, y;
+  float u, v;
+  unsigned char c[4];
+}Frame_Renderer_Corner;
+
+static void frame_renderer_software_triangle(Frame_Renderer *r,
+					     const Frame_Renderer_Corner *a,
+					     const Frame_Renderer_Corner *b,
+					     const Frame_Renderer_Corner *c,
+					     int kind, int source) {
+
+  float det = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+  if(det == 0.f) return;
+
+  if(r->sw_triangles_count == r->sw_triangles_cap) {
+    int cap = r->sw_triangles_cap == 0 ? 1024 : r->sw_triangles_cap * 2;
+    Frame_Renderer_Triangle *triangles = realloc(r->sw_triangles, cap * sizeof(Frame_Renderer_Triangle));
+    if(!triangles) return;
+    r->sw_triangles = triangles;
+    r->sw_triangles_cap = cap;
+  }
+  Frame_Renderer_Triangle *t = &r->sw_triangles[r->sw_triangles_count++];
+
+  // sorted by y, then x, so that an edge shared by two triangles is
+  // walked with the same numbers from both sides
+  const Frame_Renderer_Corner *p[3] = {a, b, c};
+  for(int i=0;i<2;i++) {
+    for(int j=0;j<2-i;j++) {
+      if(p[j]->y > p[j+1]->y || (p[j]->y == p[j+1]->y && p[j]->x > p[j+1]->x)) {
+	const Frame_Renderer_Corner *tmp = p[j]; p[j] = p[j+1]; p[j+1] = tmp;
+      }
+    }
+  }
+  for(int i=0;i<3;i++) {
+    t->x[i] = p[i]->x;
+    t->y[i] = p[i]->y;
+  }
+  t->slope02 = (t->x[2] - t->x[0]) / (t->y[2] - t->y[0]);
+  t->slope01 = t->y[1] > t->y[0] ? (t->x[1] - t->x[0]) / (t->y[1] - t->y[0]) : 0.f;
+  t->slope12 = t->y[2] > t->y[1] ? (t->x[2] - t->x[1]) / (t->y[2] - t->y[1]) : 0.f;
+
+  t->kind = (unsigned char) kind;
+  t->source = (short) source;
+  t->level = 0;
+
+  float ex1 = b->x - a->x, ey1 = b->y - a->y;
+  float ex2 = c->x - a->x, ey2 = c->y - a->y;
+#define FRAME_RENDERER_PLANE(A, B, C, value, dx, dy) do{		\
+    float d1 = (B) - (A), d2 = (C) - (A);				\
+    (dx) = (d1 * ey2 - d2 * ey1) / det;					\
+    (dy) = (d2 * ex1 - d1 * ex2) / det;					\
+    (value) = (A) - (dx) * a->x - (dy) * a->y;				\
+  }while(0)
+
+  t->flat = true;
+  for(int i=0;i<4;i++) {
+    FRAME_RENDERER_PLANE((float) a->c[i], (float) b->c[i], (float) c->c[i], t->c[i], t->dcdx[i], t->dcdy[i]);
+    if(a->c[i] != b->c[i] || a->c[i] != c->c[i]) t->flat = false;
+  }
+
+  if(kind != FRAME_RENDERER_KIND_SOLID) {
+    int width, height;
+    if(source >= FRAME_RENDERER_IMAGES_CAP) {
+      width = r->sprite_width;
+      height = r->sprite_height;
+    } else {
+      Frame_Renderer_Image *image = &r->images[source];
+      width = image->width;
+      height = image->height;
+
+      // texels per pixel decide the level, like GL_LINEAR_MIPMAP_NEAREST
+      if(image->min_filter == GL_LINEAR_MIPMAP_LINEAR &&
+	 image->levels_count > 1 && !image->mipmaps_dirty) {
+	float tex_det = ((b->u - a->u) * (c->v - a->v) - (c->u - a->u) * (b->v - a->v)) *
+	  (float) width * (float) height;
+	float ratio = fabsf(tex_det / det);
+	int level = 0;
+	while(level + 1 < image->levels_count && ratio >= 4.f) {
+	  ratio /= 4.f;
+	  level++;
+	}
+	t->level = (unsigned char) level;
+	width = width >> level > 0 ? width >> level : 1;
+	height = height >> level > 0 ? height >> level : 1;
+      }
+    }
+
+    // in texels of the level, v = 0 is the last row. The half texel
+    // moves the sample to the texel centers.
+    float w = (float) width, h = (float) height;
+    FRAME_RENDERER_PLANE(a->u * w - .5f, b->u * w - .5f, c->u * w - .5f, t->u, t->dudx, t->dudy);
+    FRAME_RENDERER_PLANE((1.f - a->v) * h - .5f, (1.f - b->v) * h - .5f, (1.f - c->v) * h - .5f,
+			 t->v, t->dvdx, t->dvdy);
+  }
+#undef FRAME_RENDERER_PLANE
+}
+
+static void frame_renderer_software_corner(Frame_Renderer_Corner *corner, const Frame_Renderer_Vertex *v) {
+  corner->x = v->position.x;
+  corner->y = v->position.y;
+  corner->u = (float) (v->uv[0] & ~FRAME_RENDERER_UV_FONT) / FRAME_RENDERER_UV_ONE;
+  corner->v = (float) v->uv[1] / FRAME_RENDERER_UV_ONE;
+  memcpy(corner->c, v->color, 4);
+}
+
+static void frame_renderer_sprites_flush(Frame_Renderer *r) {
+  if(r->sprites_count == 0) return;
+
+  for(int i=0;i<r->sprites_count;i++) {
+    Frame_Renderer_Sprite *s = &r->sprites[i];
+    Frame_Renderer_Corner q[4];
+    for(int j=0;j<4;j++) {
+      float cx = (float) (j & 1), cy = (float) (j >> 1);
+      q[j].x = s->rect[0] + cx * s->rect[2];
+      q[j].y = s->rect[1] + cy * s->rect[3];
+      q[j].u = ((float) s->uv[0] + cx * (float) s->uv[2]) / 65535.f;
+      q[j].v = ((float) s->uv[1] + cy * (float) s->uv[3]) / 65535.f;
+      memcpy(q[j].c, s->tint, 4);
+    }
+    int source = FRAME_RENDERER_IMAGES_CAP + (int) s->layer;
+    frame_renderer_software_triangle(r, &q[0], &q[1], &q[3], FRAME_RENDERER_KIND_TEX, source);
+    frame_renderer_software_triangle(r, &q[0], &q[2], &q[3], FRAME_RENDERER_KIND_TEX, source);
+  }
+
+  r->stats.draw_calls++;
+  r->stats.verticies += (unsigned int) r->sprites_count * 4;
+  r->sprites_count = 0;
+}
+
 FRAME_DEF bool frame_renderer_init(Frame_Renderer *r) {
   (void) WHITE;
   (void) RED;
   (void) BLUE;
   (void) GREEN;
   (void) BLACK;
-    
-  // introduce 'verticies' to opengl
-  glGenVertexArrays(1, &r->vao);
-  glBindVertexArray(r->vao);
 
-  glGenBuffers(1, &r->vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(r->verticies), r->verticies, GL_DYNAMIC_DRAW);
+  r->verticies_cap = FRAME_RENDERER_CAP;
+  r->verticies = malloc(r->verticies_cap * sizeof(Frame_Renderer_Vertex));
+  if(!r->verticies) {
+    return false;
+  }
+
+  r->sprites = NULL;
+  r->sprites_count = 0;
+  r->sprites_cap = 0;
+  r->sprite_texels = NULL;
+  r->sprite_layers = 0;
+  r->sw_triangles = NULL;
+  r->sw_triangles_count = 0;
+  r->sw_triangles_cap = 0;
+  r->sw_pool = NULL;
+  r->sw_threads = 0;
+  r->tex_uploaded = -1;
+  r->timer_query = false;
+  r->timer_running = false;
+  r->gpu_ready = false;
+
+  r->images_count = 0;
+  r->verticies_count = 0;
+  r->font_index = -1;
+  r->max_anisotropy = 1.f;
+  r->max_texture_size = 16384; // see FRAME_RENDERER_UV_ONE
+  r->buffer_storage = false;
+
+  frame_renderer_imgui_end();
+  frame_renderer.input = vec2f(-1.f, -1.f);
+
+  return true;
+}
+
+#ifdef FRAME_SOFTWARE
+FRAME_DEF void frame_renderer_software_pool(Pool *pool) {
+  frame_renderer.sw_pool = pool;
+}
+
+FRAME_DEF void frame_renderer_software_threads(int threads) {
+  frame_renderer.sw_threads = threads;
+}
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF void frame_renderer_free(Frame_Renderer *r) {
+  for(int i=0;i<FRAME_RENDERER_IMAGES_CAP;i++) {
+    for(int j=0;j<r->images[i].levels_count;j++) {
+      free(r->images[i].levels[j]);
+    }
+    r->images[i].levels_count = 0;
+  }
+  free(r->verticies);
+  r->verticies = NULL;
+  free(r->sprites);
+  r->sprites = NULL;
+  free(r->sprite_texels);
+  r->sprite_texels = NULL;
+  free(r->sw_triangles);
+  r->sw_triangles = NULL;
+}
+
+FRAME_DEF void frame_renderer_begin(int width, int height) {
+
+  Frame_Renderer *r = &frame_renderer;
+
+  r->last_stats = r->stats;
+  memset(&r->stats, 0, sizeof(r->stats));
+
+  if(width > 0 && height > 0) {
+    r->width = (float) width;
+    r->height = (float) height;
+  }
+  r->sw_triangles_count = 0;
+
+  frame_phase(FRAME_PHASE_UPLOAD);
+  frame_renderer_upload_step(FRAME_RENDERER_UPLOAD_STRIPE);
+  frame_phase(FRAME_PHASE_BATCH);
+
+  r->tex_index = -1;
+}
+
+FRAME_DEF void frame_renderer_set_tex(int index) {
+  Frame_Renderer *r = &frame_renderer;
+
+  r->tex_index = index;
+  r->tex_uploaded = index;
+}
+
+#else
+
+FRAME_DEF bool frame_renderer_has_extension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for(GLint i=0;i<count;i++) {
+    const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+    if(extension && strcmp(extension, name) == 0) {
+      return true;
+    }
+  }
 
-  // introduce 'Vertex' to opengl
+  return false;
+}
+
+static void frame_renderer_vertex_format() {
   glEnableVertexAttribArray(FRAME_RENDERER_VERTEX_ATTR_POSITION);
   glVertexAttribPointer(FRAME_RENDERER_VERTEX_ATTR_POSITION,
 			sizeof(Frame_Renderer_Vec2f)/sizeof(float),
@@ -976,20 +3290,218 @@ FRAME_DEF bool frame_renderer_init(Frame_Renderer *r) {
 
   glEnableVertexAttribArray(FRAME_RENDERER_VERTEX_ATTR_COLOR);
   glVertexAttribPointer(FRAME_RENDERER_VERTEX_ATTR_COLOR,
-			sizeof(Frame_Renderer_Vec4f)/sizeof(float),
-			GL_FLOAT,
-			GL_FALSE,
+			4,
+			GL_UNSIGNED_BYTE,
+			GL_TRUE,
 			sizeof(Frame_Renderer_Vertex),
 			(GLvoid *) offsetof(Frame_Renderer_Vertex, color));
 
+  // not normalized, the vertex shader decodes FRAME_RENDERER_UV_*
   glEnableVertexAttribArray(FRAME_RENDERER_VERTEX_ATTR_UV);
   glVertexAttribPointer(FRAME_RENDERER_VERTEX_ATTR_UV,
-			sizeof(Frame_Renderer_Vec2f)/sizeof(float),
-			GL_FLOAT,
+			2,
+			GL_UNSIGNED_SHORT,
 			GL_FALSE,
 			sizeof(Frame_Renderer_Vertex),
 			(GLvoid *) offsetof(Frame_Renderer_Vertex, uv));
-  
+}
+
+// (Re)creates the vertex ring with segments of 'verticies_cap' verticies and
+// an 'ebo' that covers one segment. The index buffer never changes
+// afterwards, it just lists every quad as two triangles.
+static bool frame_renderer_resize_buffers(Frame_Renderer *r) {
+  size_t quads = (size_t) r->verticies_cap / 4;
+  GLuint *indices = malloc(quads * 6 * sizeof(GLuint));
+  if(!indices) {
+    return false;
+  }
+
+  for(size_t i=0;i<quads;i++) {
+    GLuint v = (GLuint) (i * 4);
+    GLuint *q = &indices[i * 6];
+    q[0] = v; q[1] = v + 1; q[2] = v + 3;
+    q[3] = v; q[4] = v + 2; q[5] = v + 3;
+  }
+
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, quads * 6 * sizeof(GLuint), indices, GL_STATIC_DRAW);
+  free(indices);
+
+  // the gpu may still read the old ring, glDeleteBuffers defers that
+  for(int i=0;i<FRAME_RENDERER_RING_SEGMENTS;i++) {
+    if(r->ring_fences[i]) {
+      glDeleteSync(r->ring_fences[i]);
+      r->ring_fences[i] = NULL;
+    }
+  }
+  if(r->vbo) {
+    glDeleteBuffers(1, &r->vbo);
+    r->ring = NULL;
+  }
+
+  glGenBuffers(1, &r->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+  GLsizeiptr size = (GLsizeiptr) FRAME_RENDERER_RING_SEGMENTS * r->verticies_cap * sizeof(Frame_Renderer_Vertex);
+  if(r->buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    r->ring = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+  }
+
+  // the attribute pointers refer to the buffer object, not the binding
+  frame_renderer_vertex_format();
+
+  r->buffers_cap = r->verticies_cap;
+  r->ring_segment = 0;
+  r->ring_offset = 0;
+  return true;
+}
+
+// Moves on to the next segment of the ring, after fencing every draw that
+// still reads from the current one. Waiting only happens if the gpu is more
+// than FRAME_RENDERER_RING_SEGMENTS - 1 segments behind.
+static void frame_renderer_ring_next(Frame_Renderer *r) {
+  if(r->ring_offset == 0) return;
+
+  GLsync *fence = &r->ring_fences[r->ring_segment];
+  if(*fence) glDeleteSync(*fence);
+  *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  r->stats.gl_calls++;
+
+  r->ring_segment = (r->ring_segment + 1) % FRAME_RENDERER_RING_SEGMENTS;
+  r->ring_offset = 0;
+
+  fence = &r->ring_fences[r->ring_segment];
+  if(*fence) {
+    GLenum status;
+    do {
+      status = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      r->stats.gl_calls++;
+    } while(status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(*fence);
+    r->stats.gl_calls++;
+    *fence = NULL;
+  }
+}
+
+// Every draw call of the frame gets its own GL_TIME_ELAPSED, they can not nest
+static void frame_renderer_timer_draw_begin(Frame_Renderer *r) {
+  if(!r->timer_running || r->timer_draws_count[r->timer_slot] >= FRAME_RENDERER_TIMER_DRAWS) return;
+
+  int slot = r->timer_slot;
+  glBeginQuery(GL_TIME_ELAPSED, r->timer_draws[slot][r->timer_draws_count[slot]]);
+  r->stats.gl_calls++;
+}
+
+static void frame_renderer_timer_draw_end(Frame_Renderer *r) {
+  if(!r->timer_running || r->timer_draws_count[r->timer_slot] >= FRAME_RENDERER_TIMER_DRAWS) return;
+
+  glEndQuery(GL_TIME_ELAPSED);
+  r->timer_draws_count[r->timer_slot]++;
+  r->stats.gl_calls++;
+}
+
+// Never waits, a frame the GPU is not done with is dropped
+static void frame_renderer_timer_collect(Frame_Renderer *r, int slot) {
+  if(!r->timer_issued[slot]) return;
+  r->timer_issued[slot] = false;
+
+  GLint available = 0;
+  glGetQueryObjectiv(r->timer_stamps[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+  r->stats.gl_calls++;
+  if(!available) return;
+
+  // queries finish in order, the draws are done before the last stamp
+  GLuint64 begin = 0, end = 0, draws = 0;
+  glGetQueryObjectui64v(r->timer_stamps[slot][0], GL_QUERY_RESULT, &begin);
+  glGetQueryObjectui64v(r->timer_stamps[slot][1], GL_QUERY_RESULT, &end);
+  for(int i=0;i<r->timer_draws_count[slot];i++) {
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(r->timer_draws[slot][i], GL_QUERY_RESULT, &elapsed);
+    draws += elapsed;
+  }
+  r->stats.gl_calls += 2 + (unsigned int) r->timer_draws_count[slot];
+
+  r->gpu_frame_ms = (double) (end - begin) / 1000000.0;
+  r->gpu_draw_ms = (double) draws / 1000000.0;
+  r->gpu_lag = 1;
+  r->gpu_ready = true;
+}
+
+// The sprite array lives behind the units of 'images'
+#define FRAME_RENDERER_SPRITE_UNIT (GL_TEXTURE0 + FRAME_RENDERER_IMAGES_CAP)
+
+static void frame_renderer_sprites_flush(Frame_Renderer *r) {
+  if(r->sprites_count == 0) return;
+
+  glUseProgram(r->sprite_program);
+  glBindVertexArray(r->sprite_vao);
+  glBindBuffer(GL_ARRAY_BUFFER, r->sprite_vbo);
+  r->stats.gl_calls += 3;
+
+  if(r->sprite_resolution_uploaded[0] != r->width ||
+     r->sprite_resolution_uploaded[1] != r->height) {
+    r->sprite_resolution_uploaded[0] = r->width;
+    r->sprite_resolution_uploaded[1] = r->height;
+    glUniform2fv(r->sprite_resolution_location, 1, r->sprite_resolution_uploaded);
+    r->stats.gl_calls++;
+    r->stats.uniform_uploads++;
+  }
+
+  if(r->sprite_mipmaps_dirty) {
+    glActiveTexture(FRAME_RENDERER_SPRITE_UNIT);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    r->stats.gl_calls += 2;
+    r->sprite_mipmaps_dirty = false;
+  }
+
+  // orphaning: the driver hands out fresh storage instead of waiting
+  glBufferData(GL_ARRAY_BUFFER, r->sprites_count * sizeof(Frame_Renderer_Sprite), r->sprites, GL_STREAM_DRAW);
+  frame_renderer_timer_draw_begin(r);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, r->sprites_count);
+  frame_renderer_timer_draw_end(r);
+  r->stats.gl_calls += 2;
+  r->stats.draw_calls++;
+  r->stats.verticies += (unsigned int) r->sprites_count * 4;
+  r->sprites_count = 0;
+
+  glBindVertexArray(r->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+  glUseProgram(r->program);
+  r->stats.gl_calls += 3;
+}
+
+FRAME_DEF bool frame_renderer_init(Frame_Renderer *r) {
+  (void) WHITE;
+  (void) RED;
+  (void) BLUE;
+  (void) GREEN;
+  (void) BLACK;
+    
+  // introduce 'verticies' to opengl
+  glGenVertexArrays(1, &r->vao);
+  glBindVertexArray(r->vao);
+
+  r->verticies_cap = FRAME_RENDERER_CAP;
+  r->verticies = malloc(r->verticies_cap * sizeof(Frame_Renderer_Vertex));
+  if(!r->verticies) {
+    return false;
+  }
+
+  // 'vbo' is created once 'buffer_storage' is known
+  glGenBuffers(1, &r->ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ebo);
+  r->vbo = 0;
+  r->ring = NULL;
+  r->sprite_program = 0;
+  r->sprites = NULL;
+  r->sprites_count = 0;
+  r->sprites_cap = 0;
+  for(int i=0;i<FRAME_RENDERER_RING_SEGMENTS;i++) {
+    r->ring_fences[i] = NULL;
+  }
+
   // compile shaders
   if(!frame_compile_shader(&r->vertex_shader, GL_VERTEX_SHADER, frame_renderer_vertex_shader_source)) {
     return false;
@@ -1005,11 +3517,57 @@ FRAME_DEF bool frame_renderer_init(Frame_Renderer *r) {
   }
   glUseProgram(r->program);
 
+  r->resolution_location = glGetUniformLocation(r->program, "resolution");
+  r->tex_location = glGetUniformLocation(r->program, "tex");
+  r->font_tex_location = glGetUniformLocation(r->program, "font_tex");
+  r->resolution_uploaded[0] = 0.f;
+  r->resolution_uploaded[1] = 0.f;
+  r->tex_uploaded = -1;
+  r->font_tex_uploaded = -1;
+
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_BLEND);
 
   r->images_count = 0;
   r->verticies_count = 0;
   r->font_index = -1;
 
+  GLint major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  r->buffer_storage = major > 4 || (major == 4 && minor >= 4) ||
+    frame_renderer_has_extension("GL_ARB_buffer_storage");
+
+  if(!frame_renderer_resize_buffers(r)) {
+    return false;
+  }
+
+  r->max_anisotropy = 1.f;
+  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &r->max_anisotropy);
+  if(glGetError() != GL_NO_ERROR || r->max_anisotropy < 1.f) {
+    r->max_anisotropy = 1.f;
+  }
+
+  r->max_texture_size = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &r->max_texture_size);
+  if(r->max_texture_size < 1024) { // what GL 3 guarantees
+    r->max_texture_size = 1024;
+  }
+
+  r->timer_query = major > 3 || (major == 3 && minor >= 3) ||
+    frame_renderer_has_extension("GL_ARB_timer_query");
+  if(r->timer_query) {
+    glGenQueries(FRAME_RENDERER_TIMER_FRAMES * 2, &r->timer_stamps[0][0]);
+    glGenQueries(FRAME_RENDERER_TIMER_FRAMES * FRAME_RENDERER_TIMER_DRAWS, &r->timer_draws[0][0]);
+  }
+  for(int i=0;i<FRAME_RENDERER_TIMER_FRAMES;i++) {
+    r->timer_draws_count[i] = 0;
+    r->timer_issued[i] = false;
+  }
+  r->timer_running = false;
+  r->timer_slot = 0;
+  r->gpu_ready = false;
+
   frame_renderer_imgui_end();
   frame_renderer.input = vec2f(-1.f, -1.f);
   
@@ -1017,7 +3575,15 @@ FRAME_DEF bool frame_renderer_init(Frame_Renderer *r) {
 }
 
 FRAME_DEF void frame_renderer_free(Frame_Renderer *r) {
-  (void) r;
+  if(r->timer_query) {
+    glDeleteQueries(FRAME_RENDERER_TIMER_FRAMES * 2, &r->timer_stamps[0][0]);
+    glDeleteQueries(FRAME_RENDERER_TIMER_FRAMES * FRAME_RENDERER_TIMER_DRAWS, &r->timer_draws[0][0]);
+    r->timer_query = false;
+  }
+  free(r->verticies);
+  r->verticies = NULL;
+  free(r->sprites);
+  r->sprites = NULL;
 }
 
 
@@ -1025,121 +3591,307 @@ FRAME_DEF void frame_renderer_begin(int width, int height) {
 
   Frame_Renderer *r = &frame_renderer;
 
+  r->last_stats = r->stats;
+  memset(&r->stats, 0, sizeof(r->stats));
+
+  if(r->timer_query) {
+    int slot = r->timer_slot;
+    glQueryCounter(r->timer_stamps[slot][0], GL_TIMESTAMP);
+    r->timer_draws_count[slot] = 0;
+    r->timer_running = true;
+    r->stats.gl_calls++;
+  }
+
+  frame_renderer_ring_next(r);
+
   if(width > 0 && height > 0) {
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
+    r->width = (float) width;
+    r->height = (float) height;
     
     glViewport(0, 0, width, height);
-    glClear(GL_COLOR_BUFFER_BIT);
     Frame_Renderer_Vec4f *c = &r->background;
     glClearColor(c->x, c->y, c->z, c->w);
+    glClear(GL_COLOR_BUFFER_BIT);
+    r->stats.gl_calls += 3;
 
     // tell vertex shader what is the resolution is
-    glUniform1fv(glGetUniformLocation(r->program, "resolution_x"), 1, &r->width);
-    glUniform1fv(glGetUniformLocation(r->program, "resolution_y"), 1, &r->height);
+    if(r->resolution_uploaded[0] != r->width ||
+       r->resolution_uploaded[1] != r->height) {
+      r->resolution_uploaded[0] = r->width;
+      r->resolution_uploaded[1] = r->height;
+      glUniform2fv(r->resolution_location, 1, r->resolution_uploaded);
+      r->stats.gl_calls++;
+      r->stats.uniform_uploads++;
+    }
+  }
 
-    r->width = (float) width;
-    r->height = (float) height;
+  frame_phase(FRAME_PHASE_UPLOAD);
+  frame_renderer_upload_step(FRAME_RENDERER_UPLOAD_STRIPE);
+  frame_phase(FRAME_PHASE_BATCH);
+
+  if(r->font_index > 0 && r->font_tex_uploaded != r->font_index) {
+    r->font_tex_uploaded = r->font_index;
+    glUniform1i(r->font_tex_location, r->font_index);
+    r->stats.gl_calls++;
+    r->stats.uniform_uploads++;
+  }
+
+  r->tex_index = -1;  
+}
+
+FRAME_DEF void frame_renderer_set_tex(int index) {
+  Frame_Renderer *r = &frame_renderer;
+
+  r->tex_index = index;
+  if(r->tex_uploaded == index) return;
+
+  r->tex_uploaded = index;
+  glUniform1i(r->tex_location, index);
+  r->stats.gl_calls++;
+  r->stats.uniform_uploads++;
+}
+
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF void frame_renderer_stats(Frame_Renderer_Stats *stats) {
+  *stats = frame_renderer.last_stats;
+}
+
+FRAME_DEF void frame_renderer_imgui_begin(Frame *w, Frame_Event *e) {
+
+  (void) e;
+  float x, y;
+  frame_get_mouse_position(w, &x, &y);
+
+  frame_renderer.pos = frame_renderer_vec2f((float) x, ((float) y));
+  if(frame_renderer.clicked) {
+    frame_renderer.input = frame_renderer.pos;
+  }
+}
+
+FRAME_DEF void frame_renderer_imgui_update(Frame *w, Frame_Event *e) {
+  (void) w;
+  if(e->type == FRAME_EVENT_MOUSEPRESS) {    
+    frame_renderer.clicked = true;
+  } else if(e->type == FRAME_EVENT_MOUSERELEASE) {
+    frame_renderer.released = true;
+  }  
+}
+
+FRAME_DEF void frame_renderer_imgui_end(Frame *w, Frame_Event *e) {
+  (void) w;
+  (void) e;
+  if(frame_renderer.released) {
+    frame_renderer.input = vec2f(-1.f, -1.f);
+  }
+    
+  frame_renderer.clicked = false;
+  frame_renderer.released = false;
+}
+
+#ifdef FRAME_SOFTWARE
+
+FRAME_DEF void frame_renderer_end() {
+  Frame_Renderer *r = &frame_renderer;
+  frame_renderer_sprites_flush(r);
+  if(r->verticies_count == 0) return;
+  FRAME_TRACE_BEGIN("frame_renderer_end");
+
+  for(int i=0;i+3<r->verticies_count;i+=4) {
+    const Frame_Renderer_Vertex *v = &r->verticies[i];
+
+    // like 'flat' in the shader, the last vertex decides
+    int kind = FRAME_RENDERER_KIND_TEX;
+    int source = r->tex_uploaded;
+    if(v[3].uv[0] == FRAME_RENDERER_UV_SOLID) {
+      kind = FRAME_RENDERER_KIND_SOLID;
+    } else if(v[3].uv[0] & FRAME_RENDERER_UV_FONT) {
+      kind = FRAME_RENDERER_KIND_FONT;
+      source = r->font_index;
+    }
+    if(kind != FRAME_RENDERER_KIND_SOLID &&
+       (source < 0 || source >= (int) r->images_count || !r->images[source].levels_count)) {
+      continue;
+    }
+
+    Frame_Renderer_Corner q[4];
+    for(int j=0;j<4;j++) {
+      frame_renderer_software_corner(&q[j], &v[j]);
+    }
+    frame_renderer_software_triangle(r, &q[0], &q[1], &q[3], kind, source);
+    frame_renderer_software_triangle(r, &q[0], &q[2], &q[3], kind, source);
+  }
+
+  r->stats.draw_calls++;
+  r->stats.verticies += (unsigned int) r->verticies_count;
+  r->verticies_count = 0;
+  FRAME_TRACE_END("frame_renderer_end");
+}
+
+// The rasterizer runs in 'frame_renderer_software_flush', which reports it as GPU time
+FRAME_DEF void frame_renderer_end_frame() {
+  frame_renderer_end();
+}
+
+#else
+
+FRAME_DEF void frame_renderer_end() {
+  Frame_Renderer *r = &frame_renderer;
+  frame_renderer_sprites_flush(r);
+  if(r->verticies_count == 0) return;
+  FRAME_TRACE_BEGIN("frame_renderer_end");
+
+  if(r->buffers_cap < r->verticies_cap) {
+    if(!frame_renderer_resize_buffers(r)) {
+      r->verticies_count = 0;
+      FRAME_TRACE_END("frame_renderer_end");
+      return;
+    }
+    r->stats.gl_calls += 4;
   }
 
+  if(r->ring_offset + r->verticies_count > r->buffers_cap) {
+    frame_renderer_ring_next(r);
+  }
 
-  if(r->font_index > 0) {
-    GLint uniformLocation1 = glGetUniformLocation(r->program, "font_tex");
-    glUniform1i(uniformLocation1, r->font_index);	
+  // append to the segment of this frame, nothing in flight is overwritten
+  size_t offset = (size_t) r->ring_segment * r->buffers_cap + r->ring_offset;
+  size_t size = r->verticies_count * sizeof(Frame_Renderer_Vertex);
+  if(r->ring) {
+    memcpy(r->ring + offset, r->verticies, size);
+  } else {
+    void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset * sizeof(Frame_Renderer_Vertex), size,
+				 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(dst) {
+      memcpy(dst, r->verticies, size);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    r->stats.gl_calls += 2;
   }
 
-  r->tex_index = -1;  
+  frame_renderer_timer_draw_begin(r);
+  glDrawElementsBaseVertex(GL_TRIANGLES, r->verticies_count / 4 * 6, GL_UNSIGNED_INT, NULL, (GLint) offset);
+  frame_renderer_timer_draw_end(r);
+  r->ring_offset += r->verticies_count;
+  r->stats.gl_calls++;
+  r->stats.draw_calls++;
+  r->stats.verticies += (unsigned int) r->verticies_count;
+  r->verticies_count = 0;
+  FRAME_TRACE_END("frame_renderer_end");
+}
+
+FRAME_DEF void frame_renderer_end_frame() {
+  Frame_Renderer *r = &frame_renderer;
+  frame_renderer_end();
+  if(!r->timer_running) return;
+
+  int slot = r->timer_slot;
+  glQueryCounter(r->timer_stamps[slot][1], GL_TIMESTAMP);
+  r->stats.gl_calls++;
+  r->timer_issued[slot] = true;
+  r->timer_running = false;
+
+  // the other set is a frame old by now, and the next one to be reused
+  r->timer_slot = (slot + 1) % FRAME_RENDERER_TIMER_FRAMES;
+  frame_renderer_timer_collect(r, r->timer_slot);
+}
+
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF void frame_renderer_set_color(Frame_Renderer_Vec4f color) {
+  Frame_Renderer *r = &frame_renderer;
+  r->background = color;
 }
 
-FRAME_DEF void frame_renderer_imgui_begin(Frame *w, Frame_Event *e) {
+// Makes room for 'count' more verticies. The batch only gets flushed early
+// if it can not grow.
+static void frame_renderer_reserve(Frame_Renderer *r, int count) {
+  frame_renderer_sprites_flush(r);
+  if(r->verticies_count + count <= r->verticies_cap) return;
 
-  (void) e;
-  float x, y;
-  frame_get_mouse_position(w, &x, &y);
+  int cap = r->verticies_cap;
+  while(cap < r->verticies_count + count) cap *= 2;
 
-  frame_renderer.pos = frame_renderer_vec2f((float) x, ((float) y));
-  if(frame_renderer.clicked) {
-    frame_renderer.input = frame_renderer.pos;
+  Frame_Renderer_Vertex *verticies = realloc(r->verticies, cap * sizeof(Frame_Renderer_Vertex));
+  if(!verticies) {
+    frame_renderer_end();
+    return;
   }
+  r->verticies = verticies;
+  r->verticies_cap = cap;
 }
 
-FRAME_DEF void frame_renderer_imgui_update(Frame *w, Frame_Event *e) {
-  (void) w;
-  if(e->type == FRAME_EVENT_MOUSEPRESS) {    
-    frame_renderer.clicked = true;
-  } else if(e->type == FRAME_EVENT_MOUSERELEASE) {
-    frame_renderer.released = true;
-  }  
-}
-
-FRAME_DEF void frame_renderer_imgui_end(Frame *w, Frame_Event *e) {
-  (void) w;
-  (void) e;
-  if(frame_renderer.released) {
-    frame_renderer.input = vec2f(-1.f, -1.f);
-  }
-    
-  frame_renderer.clicked = false;
-  frame_renderer.released = false;
+static unsigned char frame_renderer_unorm8(float f) {
+  if(f <= 0.f) return 0;
+  if(f >= 1.f) return 255;
+  return (unsigned char) (f * 255.f + .5f);
 }
 
-FRAME_DEF void frame_renderer_end() {
-  Frame_Renderer *r = &frame_renderer;
-  
-  glBufferSubData(GL_ARRAY_BUFFER, 0, r->verticies_count * sizeof(Frame_Renderer_Vertex), r->verticies);
-  glDrawArrays(GL_TRIANGLES, 0, r->verticies_count);
-  r->verticies_count = 0;
+static unsigned short frame_renderer_unorm16(float f) {
+  if(f <= 0.f) return 0;
+  if(f >= 1.f) return 0xFFFF;
+  return (unsigned short) (f * 65535.f + .5f);
 }
 
-FRAME_DEF void frame_renderer_set_color(Frame_Renderer_Vec4f color) {
-  Frame_Renderer *r = &frame_renderer;
-  r->background = color;
+static unsigned short frame_renderer_uv16(float f) {
+  if(f <= 0.f) return 0;
+  if(f >= 1.f) return FRAME_RENDERER_UV_ONE;
+  return (unsigned short) (f * FRAME_RENDERER_UV_ONE + .5f);
 }
 
+// 'uv' (-1, -1) is a solid vertex, a negative 'c.w' samples 'font_tex'
 FRAME_DEF void frame_renderer_vertex(Frame_Renderer_Vec2f p, Frame_Renderer_Vec4f c, Frame_Renderer_Vec2f uv) {
 
   Frame_Renderer *r = &frame_renderer;
 
-  if(r->verticies_count < FRAME_RENDERER_CAP) {
-    Frame_Renderer_Vertex *last = &r->verticies[r->verticies_count];
-    last->position = p;
-    last->color = c;
-    last->uv = uv;
-    r->verticies_count++;	
-  } 
+  frame_renderer_reserve(r, 1);
+  
+  Frame_Renderer_Vertex *last = &r->verticies[r->verticies_count++];
+  last->position = p;
+  last->color[0] = frame_renderer_unorm8(c.x);
+  last->color[1] = frame_renderer_unorm8(c.y);
+  last->color[2] = frame_renderer_unorm8(c.z);
+  last->color[3] = frame_renderer_unorm8(c.w < 0 ? -c.w : c.w);
+  if(uv.x < 0 && uv.y < 0) {
+    last->uv[0] = FRAME_RENDERER_UV_SOLID;
+    last->uv[1] = FRAME_RENDERER_UV_SOLID;
+  } else {
+    last->uv[0] = frame_renderer_uv16(uv.x);
+    last->uv[1] = frame_renderer_uv16(uv.y);
+    if(c.w < 0) {
+      last->uv[0] |= FRAME_RENDERER_UV_FONT;
+    }
+  }
 }
 
 FRAME_DEF void frame_renderer_triangle(Frame_Renderer_Vec2f p1, Frame_Renderer_Vec2f p2, Frame_Renderer_Vec2f p3, Frame_Renderer_Vec4f c1, Frame_Renderer_Vec4f c2, Frame_Renderer_Vec4f c3, Frame_Renderer_Vec2f uv1, Frame_Renderer_Vec2f uv2, Frame_Renderer_Vec2f uv3) {
 
   Frame_Renderer *r = &frame_renderer;
 
-  if(r->verticies_count + 3 >= FRAME_RENDERER_CAP) {
-    frame_renderer_end();
-  }
+  frame_renderer_reserve(r, 4);
     
   frame_renderer_vertex(p1, c1, uv1);
   frame_renderer_vertex(p2, c2, uv2);
-  frame_renderer_vertex(p3, c3, uv3);	
+  frame_renderer_vertex(p3, c3, uv3);
+  frame_renderer_vertex(p3, c3, uv3);
 }
 
 FRAME_DEF void frame_renderer_solid_triangle(Frame_Renderer_Vec2f p1, Frame_Renderer_Vec2f p2, Frame_Renderer_Vec2f p3, Frame_Renderer_Vec4f c) {
-
-  Frame_Renderer *r = &frame_renderer;
-
-  if(r->verticies_count + 3 >= FRAME_RENDERER_CAP) {
-    frame_renderer_end();
-  }
-	
   Frame_Renderer_Vec2f uv = frame_renderer_vec2f(-1, -1);
-  frame_renderer_vertex(p1, c, uv);
-  frame_renderer_vertex(p2, c, uv);
-  frame_renderer_vertex(p3, c, uv);
+  frame_renderer_triangle(p1, p2, p3, c, c, c, uv, uv, uv);
 }
 
 FRAME_DEF void frame_renderer_quad(Frame_Renderer_Vec2f p1, Frame_Renderer_Vec2f p2, Frame_Renderer_Vec2f p3, Frame_Renderer_Vec2f p4, Frame_Renderer_Vec4f c1, Frame_Renderer_Vec4f c2, Frame_Renderer_Vec4f c3, Frame_Renderer_Vec4f c4, Frame_Renderer_Vec2f uv1, Frame_Renderer_Vec2f uv2, Frame_Renderer_Vec2f uv3, Frame_Renderer_Vec2f uv4) {
-  frame_renderer_triangle(p1, p2, p4, c1, c2, c4, uv1, uv2, uv4);
-  frame_renderer_triangle(p1, p3, p4, c1, c3, c4, uv1, uv3, uv4);
+
+  Frame_Renderer *r = &frame_renderer;
+
+  frame_renderer_reserve(r, 4);
+
+  frame_renderer_vertex(p1, c1, uv1);
+  frame_renderer_vertex(p2, c2, uv2);
+  frame_renderer_vertex(p3, c3, uv3);
+  frame_renderer_vertex(p4, c4, uv4);
 }
 
 FRAME_DEF void frame_renderer_solid_rect(Frame_Renderer_Vec2f pos, Frame_Renderer_Vec2f size, Frame_Renderer_Vec4f color) {
@@ -1311,6 +4063,475 @@ FRAME_DEF void frame_renderer_solid_rect_angle(Frame_Renderer_Vec2f pos, Frame_R
 			   color, color, color, uv, uv, uv);
 }
 
+FRAME_DEF bool frame_renderer_texture_unit(unsigned int index, GLenum *unit) {
+  if(index >= FRAME_RENDERER_IMAGES_CAP) {
+    return false;
+  }
+
+  *unit = GL_TEXTURE0 + index;
+  return true;
+}
+
+#ifdef FRAME_SOFTWARE
+
+// 0..255 to 0..256, so that blending can shift instead of divide
+#define FRAME_RENDERER_W256(x) ((x) + ((x) >> 7))
+
+#ifdef __SSE2__
+
+static inline __m128i frame_renderer_software_unpack(unsigned int pixel) {
+  return _mm_unpacklo_epi8(_mm_cvtsi32_si128((int) pixel), _mm_setzero_si128());
+}
+
+// Bilinear sample at 16.16 texel coordinates, as four 16 bit lanes (rgba)
+static inline __m128i frame_renderer_software_bilinear(const unsigned int *texels, int width, int height, int u, int v) {
+  int x0 = u >> 16, y0 = v >> 16;
+  int fx = (u >> 8) & 0xFF, fy = (v >> 8) & 0xFF;
+  if(u < 0) { x0 = 0; fx = 0; }
+  if(v < 0) { y0 = 0; fy = 0; }
+  if(x0 >= width - 1) { x0 = width - 1; fx = 0; }
+  if(y0 >= height - 1) { y0 = height - 1; fy = 0; }
+  int x1 = fx ? x0 + 1 : x0;
+  int y1 = fy ? y0 + 1 : y0;
+
+  const unsigned int *row0 = texels + (size_t) y0 * (size_t) width;
+  const unsigned int *row1 = texels + (size_t) y1 * (size_t) width;
+
+  // [left | right] of both rows, weights (256 - f, f) fit into 16 bits
+  __m128i zero = _mm_setzero_si128();
+  __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int) row0[x0]),
+						     _mm_cvtsi32_si128((int) row0[x1])), zero);
+  __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int) row1[x0]),
+							_mm_cvtsi32_si128((int) row1[x1])), zero);
+  __m128i wx = _mm_unpacklo_epi64(_mm_set1_epi16((short) (256 - fx)), _mm_set1_epi16((short) fx));
+  top = _mm_mullo_epi16(top, wx);
+  bottom = _mm_mullo_epi16(bottom, wx);
+  top = _mm_srli_epi16(_mm_add_epi16(top, _mm_srli_si128(top, 8)), 8);
+  bottom = _mm_srli_epi16(_mm_add_epi16(bottom, _mm_srli_si128(bottom, 8)), 8);
+
+  __m128i wy = _mm_unpacklo_epi64(_mm_set1_epi16((short) (256 - fy)), _mm_set1_epi16((short) fy));
+  __m128i both = _mm_mullo_epi16(_mm_unpacklo_epi64(top, bottom), wy);
+  return _mm_srli_epi16(_mm_add_epi16(both, _mm_srli_si128(both, 8)), 8);
+}
+
+// 'src' rgba, 'tint' 0..256 per lane. Writes 0xAARRGGBB.
+static inline void frame_renderer_software_blend(unsigned int *dst, __m128i src, __m128i tint) {
+  src = _mm_srli_epi16(_mm_mullo_epi16(src, tint), 8);
+  int a = _mm_extract_epi16(src, 3);
+  src = _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 0, 1, 2));
+  if(a == 255) {
+    *dst = (unsigned int) _mm_cvtsi128_si32(_mm_packus_epi16(src, src));
+    return;
+  }
+  if(a == 0) return;
+
+  int a256 = FRAME_RENDERER_W256(a);
+  __m128i d = frame_renderer_software_unpack(*dst);
+  __m128i out = _mm_add_epi16(_mm_mullo_epi16(src, _mm_set1_epi16((short) a256)),
+			      _mm_mullo_epi16(d, _mm_set1_epi16((short) (256 - a256))));
+  out = _mm_srli_epi16(out, 8);
+  *dst = (unsigned int) _mm_cvtsi128_si32(_mm_packus_epi16(out, out));
+}
+
+#else
+
+static inline unsigned int frame_renderer_software_bilinear(const unsigned int *texels, int width, int height, int u, int v) {
+  int x0 = u >> 16, y0 = v >> 16;
+  int fx = (u >> 8) & 0xFF, fy = (v >> 8) & 0xFF;
+  if(u < 0) { x0 = 0; fx = 0; }
+  if(v < 0) { y0 = 0; fy = 0; }
+  if(x0 >= width - 1) { x0 = width - 1; fx = 0; }
+  if(y0 >= height - 1) { y0 = height - 1; fy = 0; }
+  int x1 = fx ? x0 + 1 : x0;
+  int y1 = fy ? y0 + 1 : y0;
+
+  const unsigned char *t00 = (const unsigned char *) &texels[(size_t) y0 * (size_t) width + (size_t) x0];
+  const unsigned char *t10 = (const unsigned char *) &texels[(size_t) y0 * (size_t) width + (size_t) x1];
+  const unsigned char *t01 = (const unsigned char *) &texels[(size_t) y1 * (size_t) width + (size_t) x0];
+  const unsigned char *t11 = (const unsigned char *) &texels[(size_t) y1 * (size_t) width + (size_t) x1];
+
+  unsigned int out = 0;
+  for(int i=0;i<4;i++) {
+    int top = (t00[i] * (256 - fx) + t10[i] * fx) >> 8;
+    int bottom = (t01[i] * (256 - fx) + t11[i] * fx) >> 8;
+    out |= (unsigned int) ((top * (256 - fy) + bottom * fy) >> 8) << (i * 8);
+  }
+  return out;
+}
+
+static inline void frame_renderer_software_blend(unsigned int *dst, unsigned int src, const int *tint) {
+  int c[4];
+  for(int i=0;i<4;i++) c[i] = (int) ((src >> (i * 8)) & 0xFF) * tint[i] >> 8;
+  if(c[3] == 0) return;
+
+  int a256 = FRAME_RENDERER_W256(c[3]);
+  unsigned int d = *dst;
+  int r = (c[0] * a256 + (int) ((d >> 16) & 0xFF) * (256 - a256)) >> 8;
+  int g = (c[1] * a256 + (int) ((d >> 8) & 0xFF) * (256 - a256)) >> 8;
+  int b = (c[2] * a256 + (int) (d & 0xFF) * (256 - a256)) >> 8;
+  int a = (c[3] * a256 + (int) (d >> 24) * (256 - a256)) >> 8;
+  *dst = (unsigned int) (((unsigned int) a << 24) | (r << 16) | (g << 8) | b);
+}
+
+#endif //__SSE2__
+
+static inline unsigned int frame_renderer_software_pack(const float *c, float x, float y, const Frame_Renderer_Triangle *t, int *tint) {
+  int rgba[4];
+  for(int i=0;i<4;i++) {
+    float f = c[i] + t->dcdx[i] * x + t->dcdy[i] * y;
+    rgba[i] = f <= 0.f ? 0 : f >= 255.f ? 255 : (int) (f + .5f);
+    tint[i] = FRAME_RENDERER_W256(rgba[i]);
+  }
+  return (unsigned int) (((unsigned int) rgba[3] << 24) | (rgba[0] << 16) | (rgba[1] << 8) | rgba[2]);
+}
+
+static void frame_renderer_software_span(Frame_Renderer *r, const Frame_Renderer_Triangle *t,
+					 unsigned int *row, int x0, int x1, float yc) {
+
+  const unsigned int *texels = NULL;
+  const unsigned char *alpha = NULL;
+  int width = 0, height = 0;
+  if(t->kind != FRAME_RENDERER_KIND_SOLID) {
+    if(t->source >= FRAME_RENDERER_IMAGES_CAP) {
+      width = r->sprite_width;
+      height = r->sprite_height;
+      texels = (const unsigned int *) r->sprite_texels +
+	(size_t) (t->source - FRAME_RENDERER_IMAGES_CAP) * (size_t) width * (size_t) height;
+    } else {
+      const Frame_Renderer_Image *image = &r->images[t->source];
+      width = image->width >> t->level > 0 ? image->width >> t->level : 1;
+      height = image->height >> t->level > 0 ? image->height >> t->level : 1;
+      if(image->grey) alpha = image->levels[t->level];
+      else texels = (const unsigned int *) image->levels[t->level];
+    }
+  }
+
+  float xc = (float) x0 + .5f;
+  int tint[4];
+  unsigned int color = frame_renderer_software_pack(t->c, xc, yc, t, tint);
+
+  if(t->kind == FRAME_RENDERER_KIND_SOLID && t->flat) {
+    if((color >> 24) == 255) {
+      for(int x=x0;x<x1;x++) row[x] = color;
+      return;
+    }
+#ifdef __SSE2__
+    __m128i src = _mm_shufflelo_epi16(frame_renderer_software_unpack(color), _MM_SHUFFLE(3, 0, 1, 2));
+    __m128i full = _mm_set1_epi16(256);
+    for(int x=x0;x<x1;x++) frame_renderer_software_blend(&row[x], src, full);
+#else
+    unsigned int rgba = (color & 0xFF00FF00) | ((color >> 16) & 0xFF) | ((color & 0xFF) << 16);
+    int full[4] = {256, 256, 256, 256};
+    for(int x=x0;x<x1;x++) frame_renderer_software_blend(&row[x], rgba, full);
+#endif //__SSE2__
+    return;
+  }
+
+  // 16.16 texel coordinates, stepped per pixel
+  int u = (int) ((t->u + t->dudx * xc + t->dudy * yc) * 65536.f);
+  int v = (int) ((t->v + t->dvdx * xc + t->dvdy * yc) * 65536.f);
+  int du = (int) (t->dudx * 65536.f);
+  int dv = (int) (t->dvdx * 65536.f);
+
+  for(int x=x0;x<x1;x++, u+=du, v+=dv) {
+    if(!t->flat) {
+      frame_renderer_software_pack(t->c, (float) x + .5f, yc, t, tint);
+    }
+
+    unsigned int src;
+    if(t->kind == FRAME_RENDERER_KIND_SOLID) {
+      src = 0xFFFFFFFF;
+    } else if(alpha) {
+      // like GL_ALPHA, only the coverage comes from the texture
+      int tx = u < 0 ? 0 : (u >> 16) >= width ? width - 1 : u >> 16;
+      int ty = v < 0 ? 0 : (v >> 16) >= height ? height - 1 : v >> 16;
+      src = 0x00FFFFFF | ((unsigned int) alpha[(size_t) ty * (size_t) width + (size_t) tx] << 24);
+    } else {
+#ifdef __SSE2__
+      __m128i tint_lanes = _mm_setr_epi16((short) tint[0], (short) tint[1], (short) tint[2], (short) tint[3], 0, 0, 0, 0);
+      frame_renderer_software_blend(&row[x], frame_renderer_software_bilinear(texels, width, height, u, v), tint_lanes);
+#else
+      frame_renderer_software_blend(&row[x], frame_renderer_software_bilinear(texels, width, height, u, v), tint);
+#endif //__SSE2__
+      continue;
+    }
+
+#ifdef __SSE2__
+    __m128i tint_lanes = _mm_setr_epi16((short) tint[0], (short) tint[1], (short) tint[2], (short) tint[3], 0, 0, 0, 0);
+    frame_renderer_software_blend(&row[x], frame_renderer_software_unpack(src), tint_lanes);
+#else
+    frame_renderer_software_blend(&row[x], src, tint);
+#endif //__SSE2__
+  }
+}
+
+static void frame_renderer_software_band(Frame_Renderer *r, int band) {
+  int row0 = band * FRAME_SOFTWARE_BAND;
+  int row1 = row0 + FRAME_SOFTWARE_BAND;
+  if(row1 > r->sw_height) row1 = r->sw_height;
+
+  Frame_Renderer_Vec4f *bg = &r->background;
+  unsigned int clear = ((unsigned int) frame_renderer_unorm8(bg->w) << 24) |
+    ((unsigned int) frame_renderer_unorm8(bg->x) << 16) |
+    ((unsigned int) frame_renderer_unorm8(bg->y) << 8) |
+    (unsigned int) frame_renderer_unorm8(bg->z);
+  for(int y=row0;y<row1;y++) {
+    unsigned int *row = r->sw_target + (size_t) y * (size_t) r->sw_stride;
+    for(int x=0;x<r->sw_width;x++) row[x] = clear;
+  }
+
+  // rows are top-down, y of the renderer goes up
+  int py0 = r->sw_height - row1;
+  int py1 = r->sw_height - row0;
+  float band_y0 = (float) py0, band_y1 = (float) py1;
+
+  for(int i=0;i<r->sw_triangles_count;i++) {
+    const Frame_Renderer_Triangle *t = &r->sw_triangles[i];
+    if(t->y[2] <= band_y0 || t->y[0] >= band_y1) continue;
+
+    // pixel centers inside [y0, y2) and [xl, xr)
+    int y_start = (int) ceilf(t->y[0] - .5f);
+    int y_end = (int) ceilf(t->y[2] - .5f);
+    if(y_start < py0) y_start = py0;
+    if(y_end > py1) y_end = py1;
+
+    for(int py=y_start;py<y_end;py++) {
+      float yc = (float) py + .5f;
+      float xa = t->x[0] + (yc - t->y[0]) * t->slope02;
+      float xb = yc < t->y[1]
+	? t->x[0] + (yc - t->y[0]) * t->slope01
+	: t->x[1] + (yc - t->y[1]) * t->slope12;
+      float xl = xa < xb ? xa : xb;
+      float xr = xa < xb ? xb : xa;
+
+      int x0 = (int) ceilf(xl - .5f);
+      int x1 = (int) ceilf(xr - .5f);
+      if(x0 < 0) x0 = 0;
+      if(x1 > r->sw_width) x1 = r->sw_width;
+      if(x0 >= x1) continue;
+
+      unsigned int *row = r->sw_target + (size_t) (r->sw_height - 1 - py) * (size_t) r->sw_stride;
+      frame_renderer_software_span(r, t, row, x0, x1, yc);
+    }
+  }
+}
+
+static void frame_renderer_software_work(Frame_Renderer_Bands *b) {
+  while(true) {
+    long band = thread_atomic_add(&b->next, 1);
+    if(band >= b->bands) break;
+    frame_renderer_software_band(&frame_renderer, (int) band);
+
+    thread_mutex_lock(&b->mutex);
+    if(++b->done == b->bands) thread_cond_broadcast(&b->finished);
+    thread_mutex_unlock(&b->mutex);
+  }
+}
+
+static void frame_renderer_software_unref(Frame_Renderer_Bands *b) {
+  if(thread_atomic_add(&b->refs, -1) != 1) return;
+  thread_cond_free(&b->finished);
+  thread_mutex_free(&b->mutex);
+  free(b);
+}
+
+static void frame_renderer_software_job(void *arg, Pool_Token *token) {
+  (void) token;
+  frame_renderer_software_work((Frame_Renderer_Bands *) arg);
+  frame_renderer_software_unref((Frame_Renderer_Bands *) arg);
+}
+
+// Of the calling thread and the workers of 'sw_pool'
+static void frame_renderer_software_spread(Frame_Renderer *r) {
+  int bands = (r->sw_height + FRAME_SOFTWARE_BAND - 1) / FRAME_SOFTWARE_BAND;
+  int threads = r->sw_pool ? r->sw_pool->workers_count + 1 : 1;
+  if(r->sw_threads > 0 && r->sw_threads < threads) threads = r->sw_threads;
+  Frame_Renderer_Bands *b = threads > 1 && bands > 1 ? malloc(sizeof(Frame_Renderer_Bands)) : NULL;
+  if(!b) {
+    for(int band=0;band<bands;band++) frame_renderer_software_band(r, band);
+    return;
+  }
+
+  memset(b, 0, sizeof(*b));
+  b->bands = bands;
+  thread_mutex_init(&b->mutex);
+  thread_cond_init(&b->finished);
+  int helpers = threads - 1 < bands - 1 ? threads - 1 : bands - 1;
+  thread_atomic_store(&b->refs, 1 + helpers);
+  for(int i=0;i<helpers;i++) {
+    if(!pool_submit(r->sw_pool, POOL_VISIBLE, frame_renderer_software_job, NULL, b, NULL)) thread_atomic_add(&b->refs, -1);
+  }
+
+  // only bands that were claimed are waited for, never a job in the queue
+  frame_renderer_software_work(b);
+  thread_mutex_lock(&b->mutex);
+  while(b->done < b->bands) thread_cond_wait(&b->finished, &b->mutex);
+  thread_mutex_unlock(&b->mutex);
+  frame_renderer_software_unref(b);
+}
+
+FRAME_DEF void frame_renderer_software_flush(unsigned int *pixels, int width, int height, int stride) {
+  Frame_Renderer *r = &frame_renderer;
+
+  frame_renderer_end();
+  FRAME_TRACE_BEGIN("frame_renderer_software_flush");
+  double start = frame_clock_ms();
+
+  r->sw_target = pixels;
+  r->sw_width = width;
+  r->sw_height = height;
+  r->sw_stride = stride;
+  frame_renderer_software_spread(r);
+
+  r->sw_triangles_count = 0;
+
+  r->gpu_frame_ms = frame_clock_ms() - start;
+  r->gpu_draw_ms = r->gpu_frame_ms;
+  r->gpu_lag = 0;
+  r->gpu_ready = true;
+  FRAME_TRACE_END("frame_renderer_software_flush");
+}
+
+// 2x2 averages, like glGenerateMipmap
+static inline void frame_renderer_mipmap_box(const unsigned char *src, int width, int height, unsigned char *dst, int w, int h) {
+  for(int y=0;y<h;y++) {
+    const unsigned char *row0 = src + (size_t) (y * 2 < height ? y * 2 : height - 1) * (size_t) width * 4;
+    const unsigned char *row1 = src + (size_t) (y * 2 + 1 < height ? y * 2 + 1 : height - 1) * (size_t) width * 4;
+    for(int x=0;x<w;x++) {
+      int x0 = x * 2 < width ? x * 2 : width - 1;
+      int x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+      for(int i=0;i<4;i++) {
+	int sum = row0[x0 * 4 + i] + row0[x1 * 4 + i] + row1[x0 * 4 + i] + row1[x1 * 4 + i];
+	dst[((size_t) y * (size_t) w + (size_t) x) * 4 + i] = (unsigned char) ((sum + 2) >> 2);
+      }
+    }
+  }
+}
+
+// Box filtered through FRAME_MIPMAP_LEVEL. Only built once a texture is minified.
+FRAME_DEF void frame_renderer_update_mipmaps(unsigned int texture) {
+  Frame_Renderer *r = &frame_renderer;
+  if(texture >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  if(image->grey || !image->mipmaps_dirty || image->min_filter != GL_LINEAR_MIPMAP_LINEAR) return;
+
+  int width = image->width, height = image->height;
+  int level = 1;
+  while(level < FRAME_SOFTWARE_LEVELS && (width > 1 || height > 1)) {
+    int w = width > 1 ? width / 2 : 1;
+    int h = height > 1 ? height / 2 : 1;
+    if(level >= image->levels_count) {
+      image->levels[level] = malloc((size_t) w * (size_t) h * 4);
+      if(!image->levels[level]) break;
+      image->levels_count = level + 1;
+    }
+
+    FRAME_MIPMAP_LEVEL(image->levels[level - 1], width, height, image->levels[level], w, h);
+
+    width = w;
+    height = h;
+    level++;
+  }
+
+  image->mipmaps_dirty = false;
+}
+
+FRAME_DEF void frame_renderer_texture_filter(unsigned int texture, float scale) {
+  Frame_Renderer *r = &frame_renderer;
+  if(texture >= r->images_count) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  if(image->grey) return;
+
+  image->min_filter = scale < 1.f && !image->streaming ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+}
+
+FRAME_DEF void frame_renderer_texture_streaming(unsigned int texture, bool streaming) {
+  Frame_Renderer *r = &frame_renderer;
+  if(texture >= r->images_count) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  image->streaming = streaming;
+  if(streaming) image->min_filter = GL_LINEAR;
+}
+
+#else
+
+// Mipmaps are rebuilt lazily, right before a texture is drawn, so that
+// uploads through 'frame_renderer_push_to_texture' pay for one
+// glGenerateMipmap per frame instead of one per stripe. A streaming texture
+// pays for none until its last strip, see 'frame_renderer_texture_streaming'.
+FRAME_DEF void frame_renderer_update_mipmaps(unsigned int texture) {
+  Frame_Renderer *r = &frame_renderer;
+
+  GLenum unit;
+  if(!frame_renderer_texture_unit(texture, &unit)) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  if(!image->mipmaps_dirty || image->streaming) return;
+
+  glActiveTexture(unit);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  r->stats.gl_calls += 2;
+  image->mipmaps_dirty = false;
+}
+
+FRAME_DEF void frame_renderer_texture_filter(unsigned int texture, float scale) {
+  Frame_Renderer *r = &frame_renderer;
+
+  GLenum unit;
+  if(texture >= r->images_count || !frame_renderer_texture_unit(texture, &unit)) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  if(image->grey) return;
+
+  // 'scale' is screen pixels per texel. Magnification never touches the
+  // mip chain, so plain bilinear is enough. When minifying, trilinear keeps
+  // the sampled footprint around one texel per pixel, which both removes the
+  // aliasing and keeps the texture cache hot.
+  GLint min_filter = GL_LINEAR;
+  float anisotropy = 1.f;
+  if(scale < 1.f) {
+    min_filter = image->streaming ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR;
+    anisotropy = r->max_anisotropy;
+  }
+
+  if(image->min_filter == min_filter && image->anisotropy == anisotropy) {
+    return;
+  }
+
+  glActiveTexture(unit);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+  r->stats.gl_calls += 2;
+  if(r->max_anisotropy > 1.f) {
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+    r->stats.gl_calls++;
+  }
+  image->min_filter = min_filter;
+  image->anisotropy = anisotropy;
+}
+
+// While strips of a texture are still coming, it is sampled from level 0
+// and its mipmaps are only built once, after the last strip.
+FRAME_DEF void frame_renderer_texture_streaming(unsigned int texture, bool streaming) {
+  Frame_Renderer *r = &frame_renderer;
+
+  GLenum unit;
+  if(texture >= r->images_count || !frame_renderer_texture_unit(texture, &unit)) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  image->streaming = streaming;
+  if(!streaming || image->min_filter == GL_LINEAR) return;
+
+  glActiveTexture(unit);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  r->stats.gl_calls += 2;
+  image->min_filter = GL_LINEAR;
+}
+
+#endif //FRAME_SOFTWARE
+
 FRAME_DEF void frame_renderer_texture(unsigned int texture,
 					Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s,
 					Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs) {
@@ -1321,9 +4542,8 @@ FRAME_DEF void frame_renderer_texture(unsigned int texture,
     frame_renderer_end();
   }
 
-  r->tex_index = (int) texture;
-  GLint uniformLocation1 = glGetUniformLocation(r->program, "tex");
-  glUniform1i(uniformLocation1, r->tex_index);
+  frame_renderer_set_tex((int) texture);
+  frame_renderer_update_mipmaps(texture);
     
   Vec4f c = vec4f(1, 1, 1, 1);
   frame_renderer_quad(p,
@@ -1337,32 +4557,228 @@ FRAME_DEF void frame_renderer_texture(unsigned int texture,
 		       frame_renderer_vec2f(uvp.x + uvs.x, uvp.y + uvs.y));
 }
 
-FRAME_DEF void frame_renderer_texture_colored(unsigned int texture,
-						Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s,
-					        Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs,
-						Frame_Renderer_Vec4f c) {
+FRAME_DEF void frame_renderer_texture_colored(unsigned int texture,
+						Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s,
+					        Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs,
+						Frame_Renderer_Vec4f c) {
+  Frame_Renderer *r = &frame_renderer;
+  
+  if(r->tex_index != -1) {
+    frame_renderer_end();
+  }
+
+  frame_renderer_set_tex((int) texture);
+  frame_renderer_update_mipmaps(texture);
+  
+  frame_renderer_quad(
+		       p,
+		       frame_renderer_vec2f(p.x + s.x, p.y),
+		       frame_renderer_vec2f(p.x, p.y + s.y),
+		       frame_renderer_vec2f(p.x + s.x, p.y + s.y),
+		       c, c, c, c,
+		       uvp,
+		       frame_renderer_vec2f(uvp.x + uvs.x, uvp.y),
+		       frame_renderer_vec2f(uvp.x, uvp.y + uvs.y),
+		       frame_renderer_vec2f(uvp.x + uvs.x, uvp.y + uvs.y));
+}
+
+
+#ifdef FRAME_SOFTWARE
+
+FRAME_DEF bool frame_renderer_sprites_init(int width, int height, int layers) {
+  Frame_Renderer *r = &frame_renderer;
+
+  if(width <= 0 || height <= 0 || layers <= 0) {
+    return false;
+  }
+
+  frame_renderer_end();
+
+  unsigned char *texels = calloc((size_t) width * (size_t) height * (size_t) layers, 4);
+  if(!texels) {
+    return false;
+  }
+  free(r->sprite_texels);
+  r->sprite_texels = texels;
+
+  r->sprite_width = width;
+  r->sprite_height = height;
+  r->sprite_layers = layers;
+
+  return true;
+}
+
+FRAME_DEF bool frame_renderer_sprites_upload(int layer, int x_off, int y_off, int width, int height, const void *data) {
+  Frame_Renderer *r = &frame_renderer;
+
+  if(layer < 0 || layer >= r->sprite_layers ||
+     x_off < 0 || y_off < 0 ||
+     x_off + width > r->sprite_width ||
+     y_off + height > r->sprite_height) {
+    return false;
+  }
+
+  // rasterized sprites read the texels at flush time
+  frame_renderer_sprites_flush(r);
+
+  unsigned char *dst = r->sprite_texels + (size_t) layer * (size_t) r->sprite_width * (size_t) r->sprite_height * 4;
+  for(int y=0;y<height;y++) {
+    memcpy(dst + ((size_t) (y_off + y) * (size_t) r->sprite_width + (size_t) x_off) * 4,
+	   (const unsigned char *) data + (size_t) y * (size_t) width * 4,
+	   (size_t) width * 4);
+  }
+
+  return true;
+}
+
+#else
+
+FRAME_DEF bool frame_renderer_sprites_init(int width, int height, int layers) {
+  Frame_Renderer *r = &frame_renderer;
+
+  GLint max_layers = 0;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+  if(width <= 0 || height <= 0 || layers <= 0 || layers > max_layers) {
+    return false;
+  }
+
+  if(r->sprite_program == 0) {
+    if(!frame_compile_shader(&r->sprite_vertex_shader, GL_VERTEX_SHADER, frame_renderer_sprite_vertex_shader_source)) {
+      return false;
+    }
+    if(!frame_compile_shader(&r->sprite_fragment_shader, GL_FRAGMENT_SHADER, frame_renderer_sprite_fragment_shader_source)) {
+      return false;
+    }
+    if(!frame_link_program(&r->sprite_program, r->sprite_vertex_shader, r->sprite_fragment_shader)) {
+      return false;
+    }
+
+    glUseProgram(r->sprite_program);
+    r->sprite_resolution_location = glGetUniformLocation(r->sprite_program, "resolution");
+    r->sprite_resolution_uploaded[0] = 0.f;
+    r->sprite_resolution_uploaded[1] = 0.f;
+    glUniform1i(glGetUniformLocation(r->sprite_program, "sprites"), FRAME_RENDERER_SPRITE_UNIT - GL_TEXTURE0);
+    glUseProgram(r->program);
+
+    // introduce 'Sprite' to opengl, one per instance
+    glGenVertexArrays(1, &r->sprite_vao);
+    glBindVertexArray(r->sprite_vao);
+    glGenBuffers(1, &r->sprite_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, r->sprite_vbo);
+
+    glEnableVertexAttribArray(FRAME_RENDERER_SPRITE_ATTR_RECT);
+    glVertexAttribPointer(FRAME_RENDERER_SPRITE_ATTR_RECT, 4, GL_FLOAT, GL_FALSE,
+			  sizeof(Frame_Renderer_Sprite),
+			  (GLvoid *) offsetof(Frame_Renderer_Sprite, rect));
+    glVertexAttribDivisor(FRAME_RENDERER_SPRITE_ATTR_RECT, 1);
+
+    glEnableVertexAttribArray(FRAME_RENDERER_SPRITE_ATTR_UV);
+    glVertexAttribPointer(FRAME_RENDERER_SPRITE_ATTR_UV, 4, GL_UNSIGNED_SHORT, GL_TRUE,
+			  sizeof(Frame_Renderer_Sprite),
+			  (GLvoid *) offsetof(Frame_Renderer_Sprite, uv));
+    glVertexAttribDivisor(FRAME_RENDERER_SPRITE_ATTR_UV, 1);
+
+    glEnableVertexAttribArray(FRAME_RENDERER_SPRITE_ATTR_TINT);
+    glVertexAttribPointer(FRAME_RENDERER_SPRITE_ATTR_TINT, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+			  sizeof(Frame_Renderer_Sprite),
+			  (GLvoid *) offsetof(Frame_Renderer_Sprite, tint));
+    glVertexAttribDivisor(FRAME_RENDERER_SPRITE_ATTR_TINT, 1);
+
+    glEnableVertexAttribArray(FRAME_RENDERER_SPRITE_ATTR_LAYER);
+    glVertexAttribPointer(FRAME_RENDERER_SPRITE_ATTR_LAYER, 1, GL_FLOAT, GL_FALSE,
+			  sizeof(Frame_Renderer_Sprite),
+			  (GLvoid *) offsetof(Frame_Renderer_Sprite, layer));
+    glVertexAttribDivisor(FRAME_RENDERER_SPRITE_ATTR_LAYER, 1);
+
+    glBindVertexArray(r->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+
+    glGenTextures(1, &r->sprite_texture);
+  }
+
+  frame_renderer_end();
+
+  glActiveTexture(FRAME_RENDERER_SPRITE_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, r->sprite_texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0,
+	       GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, NULL);
+  
+  r->sprite_width = width;
+  r->sprite_height = height;
+  r->sprite_layers = layers;
+  r->sprite_mipmaps_dirty = true;
+
+  return true;
+}
+
+FRAME_DEF bool frame_renderer_sprites_upload(int layer, int x_off, int y_off, int width, int height, const void *data) {
+  Frame_Renderer *r = &frame_renderer;
+
+  if(layer < 0 || layer >= r->sprite_layers ||
+     x_off < 0 || y_off < 0 ||
+     x_off + width > r->sprite_width ||
+     y_off + height > r->sprite_height) {
+    return false;
+  }
+
+  // pending sprites may still show the old content
+  frame_renderer_sprites_flush(r);
+
+  GLint alignment;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+  glActiveTexture(FRAME_RENDERER_SPRITE_UNIT);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x_off, y_off, layer, width, height, 1,
+		  GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+  r->sprite_mipmaps_dirty = true;
+  
+  return true;
+}
+
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF void frame_renderer_sprite(Frame_Renderer_Vec2f p, Frame_Renderer_Vec2f s,
+				     Frame_Renderer_Vec2f uvp, Frame_Renderer_Vec2f uvs,
+				     Frame_Renderer_Vec4f tint, int layer) {
   Frame_Renderer *r = &frame_renderer;
-  
-  if(r->tex_index != -1) {
+
+  // keep the order with everything drawn before
+  if(r->verticies_count > 0) {
     frame_renderer_end();
   }
 
-  r->tex_index = (int) texture;
-  GLint uniformLocation1 = glGetUniformLocation(r->program, "tex");
-  glUniform1i(uniformLocation1, r->tex_index);
-  
-  frame_renderer_quad(
-		       p,
-		       frame_renderer_vec2f(p.x + s.x, p.y),
-		       frame_renderer_vec2f(p.x, p.y + s.y),
-		       frame_renderer_vec2f(p.x + s.x, p.y + s.y),
-		       c, c, c, c,
-		       uvp,
-		       frame_renderer_vec2f(uvp.x + uvs.x, uvp.y),
-		       frame_renderer_vec2f(uvp.x, uvp.y + uvs.y),
-		       frame_renderer_vec2f(uvp.x + uvs.x, uvp.y + uvs.y));
-}
+  if(r->sprites_count >= r->sprites_cap) {
+    int cap = r->sprites_cap == 0 ? 1024 : r->sprites_cap * 2;
+    Frame_Renderer_Sprite *sprites = realloc(r->sprites, cap * sizeof(Frame_Renderer_Sprite));
+    if(!sprites) {
+      frame_renderer_sprites_flush(r);
+      if(r->sprites_cap == 0) return;
+    } else {
+      r->sprites = sprites;
+      r->sprites_cap = cap;
+    }
+  }
 
+  Frame_Renderer_Sprite *sprite = &r->sprites[r->sprites_count++];
+  sprite->rect[0] = p.x;
+  sprite->rect[1] = p.y;
+  sprite->rect[2] = s.x;
+  sprite->rect[3] = s.y;
+  sprite->uv[0] = frame_renderer_unorm16(uvp.x);
+  sprite->uv[1] = frame_renderer_unorm16(uvp.y);
+  sprite->uv[2] = frame_renderer_unorm16(uvs.x);
+  sprite->uv[3] = frame_renderer_unorm16(uvs.y);
+  sprite->tint[0] = frame_renderer_unorm8(tint.x);
+  sprite->tint[1] = frame_renderer_unorm8(tint.y);
+  sprite->tint[2] = frame_renderer_unorm8(tint.z);
+  sprite->tint[3] = frame_renderer_unorm8(tint.w);
+  sprite->layer = (float) layer;
+}
 
 FRAME_DEF void frame_renderer_solid_circle(Frame_Renderer_Vec2f pos,
 					     float start_angle, float end_angle,
@@ -1400,26 +4816,152 @@ FRAME_DEF bool frame_renderer_create_texture(int width, int height, unsigned int
   return true;
 }
 
+#ifdef FRAME_SOFTWARE
+
+FRAME_DEF bool frame_renderer_push_to_texture(unsigned int tex, const void *data, int x_off, int y_off, int width, int height) {
+  Frame_Renderer *r = &frame_renderer;
+
+  if(tex >= r->images_count) return false;
+
+  Frame_Renderer_Image *image = &r->images[tex];
+  if(x_off < 0 || y_off < 0 || x_off + width > image->width || y_off + height > image->height) {
+    return false;
+  }
+
+  size_t bpp = image->grey ? 1 : 4;
+  for(int y=0;y<height;y++) {
+    memcpy(image->levels[0] + ((size_t) (y_off + y) * (size_t) image->width + (size_t) x_off) * bpp,
+	   (const unsigned char *) data + (size_t) y * (size_t) width * bpp,
+	   (size_t) width * bpp);
+  }
+  image->mipmaps_dirty = !image->grey;
+
+  return true;
+}
+
+FRAME_DEF void frame_renderer_upload_release(Frame_Renderer_Image *image) {
+  image->uploading = false;
+  image->committed = false;
+}
+
+static bool frame_renderer_push_texture_impl(int width, int height, const void *data, bool grey, unsigned int *index) {
+
+  Frame_Renderer *r = &frame_renderer;
+  if(r->images_count >= FRAME_RENDERER_IMAGES_CAP) {
+    return false;
+  }
+
+  // slots are reused when the caller resets 'images_count', with the same
+  // size so are their levels
+  Frame_Renderer_Image *image = &r->images[r->images_count];
+  frame_renderer_upload_release(image);
+  size_t size = (size_t) width * (size_t) height * (grey ? 1 : 4);
+  if(image->levels_count > 0 && image->width == width && image->height == height && image->grey == grey) {
+    if(data) memcpy(image->levels[0], data, size);
+    else memset(image->levels[0], 0, size);
+  } else {
+    for(int i=0;i<image->levels_count;i++) {
+      free(image->levels[i]);
+    }
+    image->levels_count = 0;
+
+    image->levels[0] = data ? malloc(size) : calloc(size, 1);
+    if(!image->levels[0]) {
+      return false;
+    }
+    if(data) memcpy(image->levels[0], data, size);
+    image->levels_count = 1;
+  }
+
+  image->width = width;
+  image->height = height;
+  image->grey = grey;
+  image->min_filter = GL_LINEAR;
+  image->anisotropy = 1.f;
+  image->mipmaps_dirty = !grey;
+  image->streaming = false;
+
+  *index = r->images_count++;
+
+  return true;
+}
+
+// The texture itself is the upload buffer, there is nothing to stream
+FRAME_DEF bool frame_renderer_upload_begin(int width, int height, unsigned int *index, void **pixels) {
+  Frame_Renderer *r = &frame_renderer;
+
+  if(!frame_renderer_push_texture(width, height, NULL, false, index)) {
+    return false;
+  }
+  Frame_Renderer_Image *image = &r->images[*index];
+
+  image->uploading = true;
+  image->committed = false;
+  image->mipmaps_dirty = false;
+
+  *pixels = image->levels[0];
+  return true;
+}
+
+FRAME_DEF void frame_renderer_upload_commit(unsigned int index) {
+  Frame_Renderer *r = &frame_renderer;
+  if(index >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  Frame_Renderer_Image *image = &r->images[index];
+  if(!image->uploading) return;
+
+  frame_renderer_upload_release(image);
+  image->mipmaps_dirty = true;
+}
+
+FRAME_DEF void frame_renderer_upload_cancel(unsigned int index) {
+  Frame_Renderer *r = &frame_renderer;
+  if(index >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  frame_renderer_upload_release(&r->images[index]);
+}
+
+FRAME_DEF bool frame_renderer_upload_done(unsigned int index) {
+  Frame_Renderer *r = &frame_renderer;
+  if(index >= FRAME_RENDERER_IMAGES_CAP) return false;
+
+  return r->images[index].levels_count > 0 && !r->images[index].uploading;
+}
+
+FRAME_DEF bool frame_renderer_upload_step(size_t budget) {
+  Frame_Renderer *r = &frame_renderer;
+  (void) budget;
+
+  for(unsigned int i=0;i<FRAME_RENDERER_IMAGES_CAP;i++) {
+    if(r->images[i].uploading) return true;
+  }
+
+  return false;
+}
+
+FRAME_DEF void frame_renderer_texture_free(unsigned int texture) {
+  Frame_Renderer *r = &frame_renderer;
+  if(texture >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  frame_renderer_upload_release(image);
+  for(int i=0;i<image->levels_count;i++) {
+    free(image->levels[i]);
+  }
+  image->levels_count = 0;
+  image->width = 0;
+  image->height = 0;
+}
+
+#else
+
 FRAME_DEF bool frame_renderer_push_to_texture(unsigned int tex, const void *data, int x_off, int y_off, int width, int height) {
   Frame_Renderer *r = &frame_renderer;
   
   if(tex >= r->images_count) return false;
   
   GLenum current_texture;
-  switch(tex) {
-  case 0:
-    current_texture = GL_TEXTURE0;
-    break;
-  case 1:
-    current_texture = GL_TEXTURE1;
-    break;
-  case 2:
-    current_texture = GL_TEXTURE2;
-    break;
-  case 3:
-    current_texture = GL_TEXTURE3;
-    break;
-  default:
+  if(!frame_renderer_texture_unit(tex, &current_texture)) {
     return false;
   }
 
@@ -1432,36 +4974,79 @@ FRAME_DEF bool frame_renderer_push_to_texture(unsigned int tex, const void *data
 		  GL_RGBA,
 		  GL_UNSIGNED_INT_8_8_8_8_REV,
 		  data);
+  r->images[tex].mipmaps_dirty = true;
 
   return true;
 }
 
-FRAME_DEF bool frame_renderer_push_texture(int width, int height, const void *data, bool grey, unsigned int *index) {
+// Ends the upload, the buffer stays for the next one
+FRAME_DEF void frame_renderer_upload_release(Frame_Renderer_Image *image) {
+  if(image->pbo == 0) return;
+
+  if(image->pbo_pixels && !image->pbo_persistent) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    image->pbo_pixels = NULL;
+  }
+  if(image->committed && !image->pbo_fence) {
+    image->pbo_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  image->uploading = false;
+  image->committed = false;
+}
+
+static void frame_renderer_upload_free(Frame_Renderer_Image *image) {
+  frame_renderer_upload_release(image);
+  if(image->pbo == 0) return;
+
+  if(image->pbo_pixels) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &image->pbo);
+  if(image->pbo_fence) glDeleteSync(image->pbo_fence);
+
+  image->pbo = 0;
+  image->pbo_size = 0;
+  image->pbo_fence = NULL;
+  image->pbo_pixels = NULL;
+}
+
+static bool frame_renderer_push_texture_impl(int width, int height, const void *data, bool grey, unsigned int *index) {
 
   Frame_Renderer *r = &frame_renderer;
 
   GLenum current_texture;
-  switch(r->images_count) {
-  case 0:
-    current_texture = GL_TEXTURE0;
-    break;
-  case 1:
-    current_texture = GL_TEXTURE1;
-    break;
-  case 2:
-    current_texture = GL_TEXTURE2;
-    break;
-  case 3:
-    current_texture = GL_TEXTURE3;
-    break;
-  default:
+  if(!frame_renderer_texture_unit(r->images_count, &current_texture)) {
     return false;
   }
   
   glActiveTexture(current_texture);
-  
-  glGenTextures(1, &r->textures);
-  glBindTexture(GL_TEXTURE_2D, r->textures);
+
+  // slots are reused when the caller resets 'images_count'. With the same
+  // size and format, so is the storage of their texture.
+  Frame_Renderer_Image *image = &r->images[r->images_count];
+  frame_renderer_upload_release(image);
+  bool same = image->id != 0 && image->width == width && image->height == height && image->grey == grey;
+  if(image->id != 0 && !same) {
+    glDeleteTextures(1, &image->id);
+    image->id = 0;
+  }
+
+  if(image->id == 0) {
+    glGenTextures(1, &image->id);
+  }
+  glBindTexture(GL_TEXTURE_2D, image->id);
+  image->width = width;
+  image->height = height;
+  image->grey = grey;
+  image->min_filter = GL_LINEAR;
+  image->anisotropy = 1.f;
+  image->mipmaps_dirty = !grey;
+  image->streaming = false;
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -1470,14 +5055,29 @@ FRAME_DEF bool frame_renderer_push_texture(int width, int height, const void *da
 
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-  if(grey) {
+  // GL_ALPHA is gone from the core profile, a swizzled GL_R8 samples the same
+  GLint swizzle[] = {GL_ZERO, GL_ZERO, GL_ZERO, GL_RED};
+  GLint identity[] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, grey ? swizzle : identity);
+
+  if(same) {
+    if(data) {
+      glTexSubImage2D(GL_TEXTURE_2D,
+		      0,
+		      0, 0,
+		      width, height,
+		      grey ? GL_RED : GL_RGBA,
+		      grey ? GL_UNSIGNED_BYTE : GL_UNSIGNED_INT_8_8_8_8_REV,
+		      data);
+    }
+  } else if(grey) {
     glTexImage2D(GL_TEXTURE_2D,
 		 0,
-		 GL_ALPHA,
+		 GL_R8,
 		 width,
 		 height,
 		 0,
-		 GL_ALPHA,
+		 GL_RED,
 		 GL_UNSIGNED_BYTE,
 		 data);	
   } else {
@@ -1497,6 +5097,289 @@ FRAME_DEF bool frame_renderer_push_texture(int width, int height, const void *da
   return true;
 }
 
+FRAME_DEF bool frame_renderer_upload_begin(int width, int height, unsigned int *index, void **pixels) {
+  Frame_Renderer *r = &frame_renderer;
+
+  if(!frame_renderer_push_texture(width, height, NULL, false, index)) {
+    return false;
+  }
+  Frame_Renderer_Image *image = &r->images[*index];
+
+  GLsizeiptr size = (GLsizeiptr) width * (GLsizeiptr) height * 4;
+  if(image->pbo != 0 && image->pbo_size != size) {
+    frame_renderer_upload_free(image);
+  }
+
+  // A persistent mapping stays valid while the GL thread keeps issuing
+  // commands, so the decoder never has to hand the pointer back. Without
+  // GL_ARB_buffer_storage, the buffer is unmapped on commit instead.
+  if(image->pbo == 0) {
+    glGenBuffers(1, &image->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    if(r->buffer_storage) {
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+      image->pbo_pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+      image->pbo_persistent = true;
+    } else {
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+      image->pbo_persistent = false;
+    }
+    image->pbo_size = size;
+  } else {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+  }
+
+  // the persistent mapping is written right away, the last upload out of
+  // it has to be done. A new mapping is invalidated instead.
+  if(image->pbo_fence) {
+    if(image->pbo_persistent) {
+      GLenum status;
+      do {
+	status = glClientWaitSync(image->pbo_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      } while(status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(image->pbo_fence);
+    image->pbo_fence = NULL;
+  }
+  if(!image->pbo_persistent) {
+    image->pbo_pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+					 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  if(!image->pbo_pixels) {
+    FRAME_LOG("Can not map pixel buffer of %lld bytes\n", (long long) size);
+    frame_renderer_upload_free(image);
+    return false;
+  }
+
+  image->uploading = true;
+  image->committed = false;
+  image->rows_uploaded = 0;
+  image->mipmaps_dirty = false;
+
+  *pixels = image->pbo_pixels;
+  return true;
+}
+
+FRAME_DEF void frame_renderer_upload_commit(unsigned int index) {
+  Frame_Renderer *r = &frame_renderer;
+  if(index >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  Frame_Renderer_Image *image = &r->images[index];
+  if(!image->uploading) return;
+
+  if(!image->pbo_persistent) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    image->pbo_pixels = NULL;
+  }
+  image->committed = true;
+}
+
+FRAME_DEF void frame_renderer_upload_cancel(unsigned int index) {
+  Frame_Renderer *r = &frame_renderer;
+  if(index >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  frame_renderer_upload_release(&r->images[index]);
+}
+
+FRAME_DEF bool frame_renderer_upload_done(unsigned int index) {
+  Frame_Renderer *r = &frame_renderer;
+  if(index >= FRAME_RENDERER_IMAGES_CAP) return false;
+
+  return r->images[index].id != 0 && !r->images[index].uploading;
+}
+
+FRAME_DEF bool frame_renderer_upload_step(size_t budget) {
+  Frame_Renderer *r = &frame_renderer;
+
+  bool pending = false;
+  for(unsigned int i=0;i<FRAME_RENDERER_IMAGES_CAP;i++) {
+    Frame_Renderer_Image *image = &r->images[i];
+    if(!image->uploading) continue;
+    if(!image->committed || budget == 0) {
+      pending = true;
+      continue;
+    }
+
+    size_t row_size = (size_t) image->width * 4;
+    int rows = (int) (budget / row_size);
+    if(rows < 1) rows = 1;
+    if(rows > image->height - image->rows_uploaded) {
+      rows = image->height - image->rows_uploaded;
+    }
+
+    // with a bound GL_PIXEL_UNPACK_BUFFER, the data pointer is an offset into it
+    FRAME_TRACE_BEGIN("frame_renderer_upload_step");
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image->pbo);
+    glTexSubImage2D(GL_TEXTURE_2D,
+		    0,
+		    0, image->rows_uploaded,
+		    image->width, rows,
+		    GL_RGBA,
+		    GL_UNSIGNED_INT_8_8_8_8_REV,
+		    (const void *) (row_size * (size_t) image->rows_uploaded));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    r->stats.gl_calls += 4;
+    FRAME_TRACE_END("frame_renderer_upload_step");
+
+    image->rows_uploaded += rows;
+    size_t uploaded = row_size * (size_t) rows;
+    budget = uploaded < budget ? budget - uploaded : 0;
+
+    if(image->rows_uploaded >= image->height) {
+      frame_renderer_upload_release(image);
+      image->mipmaps_dirty = true;
+    } else {
+      pending = true;
+    }
+  }
+
+  return pending;
+}
+
+FRAME_DEF void frame_renderer_texture_free(unsigned int texture) {
+  Frame_Renderer *r = &frame_renderer;
+  if(texture >= FRAME_RENDERER_IMAGES_CAP) return;
+
+  Frame_Renderer_Image *image = &r->images[texture];
+  frame_renderer_upload_free(image);
+  if(image->id != 0) {
+    glDeleteTextures(1, &image->id);
+    r->stats.gl_calls++;
+  }
+  image->id = 0;
+  image->width = 0;
+  image->height = 0;
+}
+
+#endif //FRAME_SOFTWARE
+
+FRAME_DEF bool frame_renderer_push_texture(int width, int height, const void *data, bool grey, unsigned int *index) {
+  FRAME_TRACE_BEGIN("frame_renderer_push_texture");
+  bool ok = frame_renderer_push_texture_impl(width, height, data, grey, index);
+  FRAME_TRACE_END("frame_renderer_push_texture");
+  return ok;
+}
+
+// 3x5 glyphs of ASCII 32..95, row-major from the top left bit. Lowercase
+// is drawn as uppercase.
+static const unsigned short frame_renderer_debug_font[64] = {
+  0x0000, 0x2482, 0x5A00, 0x5F7D, 0x3C9E, 0x52A5, 0x2AAB, 0x2400,
+  0x1491, 0x4494, 0x0AA8, 0x05D0, 0x0014, 0x01C0, 0x0002, 0x12A4,
+  0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249,
+  0x7BEF, 0x7BCF, 0x0410, 0x0414, 0x1511, 0x0E38, 0x4454, 0x7282,
+  0x7BE7, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4, 0x396B,
+  0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D, 0x2B6A,
+  0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A, 0x5BFD,
+  0x5AAD, 0x5A92, 0x72A7, 0x6926, 0x4889, 0x324B, 0x2A00, 0x0007
+};
+
+// Needs no font, 'pos' is the bottom left of the line, glyphs are 4 * 'scale' apart
+FRAME_DEF void frame_renderer_debug_text(const char *cstr, size_t cstr_len, Frame_Renderer_Vec2f pos, float scale, Frame_Renderer_Vec4f color) {
+  for(size_t i=0;i<cstr_len;i++) {
+    unsigned char c = (unsigned char) cstr[i];
+    if(c >= 'a' && c <= 'z') c = (unsigned char) (c - 'a' + 'A');
+    if(c < 32 || c >= 96) c = '?';
+    unsigned short glyph = frame_renderer_debug_font[c - 32];
+
+    float x = pos.x + (float) i * 4 * scale;
+    for(int row=0;row<5;row++) {
+      float y = pos.y + (float) (4 - row) * scale;
+      // one rect per run of set pixels
+      int col = 0;
+      while(col < 3) {
+	if(!(glyph & (1 << (14 - row * 3 - col)))) {
+	  col++;
+	  continue;
+	}
+	int start = col;
+	while(col < 3 && (glyph & (1 << (14 - row * 3 - col)))) col++;
+	frame_renderer_solid_rect(vec2f(x + (float) start * scale, y),
+				  vec2f((float) (col - start) * scale, scale), color);
+      }
+    }
+  }
+}
+
+#define FRAME_RENDERER_HUD_AVERAGE 60 // frames
+#define FRAME_RENDERER_HUD_GRAPH_MS 33.3f // top of the graph
+
+FRAME_DEF float frame_renderer_hud(Frame_Renderer_Vec2f pos, float scale) {
+  static const char *names[FRAME_PHASE_COUNT] = {"WAIT", "EVENTS", "DECODE", "UPLOAD", "BATCH", "SWAP"};
+
+  int count = 0, gpu_count = 0;
+  double interval = 0, cpu = 0, gpu = 0;
+  double phases[FRAME_PHASE_COUNT] = {0};
+  Frame_Timing t;
+  for(int ago=0;ago<FRAME_RENDERER_HUD_AVERAGE && frame_timing(&t, ago);ago++) {
+    for(int i=0;i<FRAME_PHASE_COUNT;i++) {
+      phases[i] += t.cpu_ms[i];
+      interval += t.cpu_ms[i];
+    }
+    cpu += t.cpu_frame_ms;
+    if(t.gpu_frame_ms >= 0) {
+      gpu += t.gpu_frame_ms;
+      gpu_count++;
+    }
+    count++;
+  }
+
+  float pad = 2 * scale;
+  float line = 7 * scale;
+  float graph = 20 * scale;
+  int lines = 2 + FRAME_PHASE_COUNT;
+  Frame_Renderer_Vec2f size = vec2f(FRAME_TIMING_HISTORY * scale + 2 * pad,
+				    (float) lines * line + graph + 3 * pad);
+  frame_renderer_solid_rect(vec2f(pos.x, pos.y - size.y), size, vec4f(0, 0, 0, .6f));
+
+  char buf[64];
+  int n;
+  float x = pos.x + pad;
+  float y = pos.y - pad - line + scale;
+  Frame_Renderer_Vec4f color = vec4f(1, 1, 1, 1);
+
+  n = snprintf(buf, sizeof(buf), "FPS %.1f", count > 0 && interval > 0 ? count * 1000.0 / interval : 0.0);
+  frame_renderer_debug_text(buf, (size_t) n, vec2f(x, y), scale, color);
+  y -= line;
+
+  if(gpu_count > 0) {
+    n = snprintf(buf, sizeof(buf), "CPU %6.2f MS  GPU %6.2f MS",
+		 count > 0 ? cpu / count : 0.0, gpu / gpu_count);
+  } else {
+    n = snprintf(buf, sizeof(buf), "CPU %6.2f MS  GPU    --", count > 0 ? cpu / count : 0.0);
+  }
+  frame_renderer_debug_text(buf, (size_t) n, vec2f(x, y), scale, color);
+  y -= line;
+
+  for(int i=0;i<FRAME_PHASE_COUNT;i++) {
+    n = snprintf(buf, sizeof(buf), "%-6s %6.2f MS", names[i], count > 0 ? phases[i] / count : 0.0);
+    frame_renderer_debug_text(buf, (size_t) n, vec2f(x, y), scale, vec4f(.7f, .7f, .7f, 1));
+    y -= line;
+  }
+
+  // one column per frame, oldest on the left: CPU and on top of it GPU
+  float bottom = pos.y - size.y + pad;
+  float unit = graph / FRAME_RENDERER_HUD_GRAPH_MS;
+  for(int i=0;i<FRAME_TIMING_HISTORY;i++) {
+    if(!frame_timing(&t, FRAME_TIMING_HISTORY - 1 - i)) continue;
+    float column = x + (float) i * scale;
+    float h = (float) t.cpu_frame_ms * unit;
+    frame_renderer_solid_rect(vec2f(column, bottom), vec2f(scale, h < graph ? h : graph), vec4f(.2f, .8f, .2f, 1));
+    if(t.gpu_frame_ms >= 0) {
+      h = (float) t.gpu_frame_ms * unit;
+      frame_renderer_solid_rect(vec2f(column, bottom), vec2f(scale, h < graph ? h : graph), vec4f(1, .5f, 0, .8f));
+    }
+  }
+  frame_renderer_solid_rect(vec2f(x, bottom + 16.7f * unit), vec2f(FRAME_TIMING_HISTORY * scale, 1), vec4f(1, 1, 1, .5f));
+
+  return size.y;
+}
+
 #ifdef FRAME_STB_TRUETYPE
 #include <stdio.h>
 
@@ -1504,6 +5387,7 @@ FRAME_DEF bool frame_renderer_push_texture(int width, int height, const void *da
 
 FRAME_DEF bool frame_renderer_push_font(const char *filepath, float pixel_height) {
 
+#ifdef _WIN32
   HANDLE handle = CreateFile(filepath, GENERIC_READ,
 			 FILE_SHARE_READ,
 			 NULL,
@@ -1537,6 +5421,37 @@ FRAME_DEF bool frame_renderer_push_font(const char *filepath, float pixel_height
   }
 
   CloseHandle(handle);
+#else
+  FILE *f = fopen(filepath, "rb");
+  if(!f) {
+    FRAME_LOG("Can not open file: %s\n", filepath);
+    return false;
+  }
+
+  long m = -1;
+  if(fseek(f, 0, SEEK_END) == 0) m = ftell(f);
+  if(m < 0 || fseek(f, 0, SEEK_SET) != 0) {
+    FRAME_LOG("Can not query file size: %s\n", filepath);
+    fclose(f);
+    return false;
+  }
+
+  unsigned char *buffer = (unsigned char *) malloc((size_t) m);
+  if(!buffer) {
+    FRAME_LOG("Can not allocate enough memory\n");
+    fclose(f);
+    return false;
+  }
+
+  if(fread(buffer, 1, (size_t) m, f) != (size_t) m) {
+    FRAME_LOG("Failed to read from file: %s\n", filepath);
+    free(buffer);
+    fclose(f);
+    return false;
+  }
+
+  fclose(f);
+#endif //_WIN32
   
   unsigned char *temp_bitmap = malloc(FRAME_RENDERER_STB_TEMP_BITMAP_SIZE *
 				      FRAME_RENDERER_STB_TEMP_BITMAP_SIZE);
@@ -1730,6 +5645,8 @@ FRAME_DEF bool frame_renderer_push_image_memory(unsigned char *data, size_t data
 
 #endif //FRAME_NO_RENDERER
 
+#ifdef _WIN32
+
 ////////////////////////////////////////////////////////////////////////
 // opengl - definitions
 ////////////////////////////////////////////////////////////////////////
@@ -1888,6 +5805,87 @@ void glCreateTextures(GLenum target, GLsizei n, GLuint *textures) {
   _glCreateTextures(target, n, textures);
 }
 
+PROC _glGenerateMipmap = NULL;
+void glGenerateMipmap(GLenum target) { _glGenerateMipmap(target); }
+
+PROC _glDeleteBuffers = NULL;
+void glDeleteBuffers(GLsizei n, const GLuint *buffers) { _glDeleteBuffers(n, buffers); }
+
+PROC _glMapBufferRange = NULL;
+void *glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+  return (void *) _glMapBufferRange(target, offset, length, access);
+}
+
+PROC _glUnmapBuffer = NULL;
+GLboolean glUnmapBuffer(GLenum target) { return (GLboolean) _glUnmapBuffer(target); }
+
+PROC _glBufferStorage = NULL;
+void glBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags) {
+  _glBufferStorage(target, size, data, flags);
+}
+
+PROC _glGetStringi = NULL;
+const GLubyte *glGetStringi(GLenum name, GLuint index) {
+  return (const GLubyte *) _glGetStringi(name, index);
+}
+
+PROC _glFenceSync = NULL;
+GLsync glFenceSync(GLenum condition, GLbitfield flags) {
+  return (GLsync) _glFenceSync(condition, flags);
+}
+
+PROC _glClientWaitSync = NULL;
+GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+  return (GLenum) _glClientWaitSync(sync, flags, timeout);
+}
+
+PROC _glDeleteSync = NULL;
+void glDeleteSync(GLsync sync) { _glDeleteSync(sync); }
+
+PROC _glDrawElementsBaseVertex = NULL;
+void glDrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex) {
+  _glDrawElementsBaseVertex(mode, count, type, indices, basevertex);
+}
+
+PROC _glDrawArraysInstanced = NULL;
+void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount) {
+  _glDrawArraysInstanced(mode, first, count, instancecount);
+}
+
+PROC _glVertexAttribDivisor = NULL;
+void glVertexAttribDivisor(GLuint index, GLuint divisor) { _glVertexAttribDivisor(index, divisor); }
+
+PROC _glTexImage3D = NULL;
+void glTexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels) {
+  _glTexImage3D(target, level, internalFormat, width, height, depth, border, format, type, pixels);
+}
+
+PROC _glTexSubImage3D = NULL;
+void glTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels) {
+  _glTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+}
+
+PROC _glGenQueries = NULL;
+void glGenQueries(GLsizei n, GLuint *ids) { _glGenQueries(n, ids); }
+
+PROC _glDeleteQueries = NULL;
+void glDeleteQueries(GLsizei n, const GLuint *ids) { _glDeleteQueries(n, ids); }
+
+PROC _glBeginQuery = NULL;
+void glBeginQuery(GLenum target, GLuint id) { _glBeginQuery(target, id); }
+
+PROC _glEndQuery = NULL;
+void glEndQuery(GLenum target) { _glEndQuery(target); }
+
+PROC _glQueryCounter = NULL;
+void glQueryCounter(GLuint id, GLenum target) { _glQueryCounter(id, target); }
+
+PROC _glGetQueryObjectiv = NULL;
+void glGetQueryObjectiv(GLuint id, GLenum pname, GLint *params) { _glGetQueryObjectiv(id, pname, params); }
+
+PROC _glGetQueryObjectui64v = NULL;
+void glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params) { _glGetQueryObjectui64v(id, pname, params); }
+
 FRAME_DEF void frame_win32_opengl_init() {
   if(_glActiveTexture != NULL) {
     return;
@@ -1923,9 +5921,32 @@ FRAME_DEF void frame_win32_opengl_init() {
   _glUniform2fv= wglGetProcAddress("glUniform2fv");
   _glGetUniformiv= wglGetProcAddress("glGetUniformiv");
   _glCreateTextures = wglGetProcAddress("glCreateTextures");
+  _glGenerateMipmap = wglGetProcAddress("glGenerateMipmap");
+  _glDeleteBuffers = wglGetProcAddress("glDeleteBuffers");
+  _glMapBufferRange = wglGetProcAddress("glMapBufferRange");
+  _glUnmapBuffer = wglGetProcAddress("glUnmapBuffer");
+  _glBufferStorage = wglGetProcAddress("glBufferStorage");
+  _glGetStringi = wglGetProcAddress("glGetStringi");
+  _glFenceSync = wglGetProcAddress("glFenceSync");
+  _glClientWaitSync = wglGetProcAddress("glClientWaitSync");
+  _glDeleteSync = wglGetProcAddress("glDeleteSync");
+  _glDrawElementsBaseVertex = wglGetProcAddress("glDrawElementsBaseVertex");
+  _glDrawArraysInstanced = wglGetProcAddress("glDrawArraysInstanced");
+  _glVertexAttribDivisor = wglGetProcAddress("glVertexAttribDivisor");
+  _glTexImage3D = wglGetProcAddress("glTexImage3D");
+  _glTexSubImage3D = wglGetProcAddress("glTexSubImage3D");
+  _glGenQueries = wglGetProcAddress("glGenQueries");
+  _glDeleteQueries = wglGetProcAddress("glDeleteQueries");
+  _glBeginQuery = wglGetProcAddress("glBeginQuery");
+  _glEndQuery = wglGetProcAddress("glEndQuery");
+  _glQueryCounter = wglGetProcAddress("glQueryCounter");
+  _glGetQueryObjectiv = wglGetProcAddress("glGetQueryObjectiv");
+  _glGetQueryObjectui64v = wglGetProcAddress("glGetQueryObjectui64v");
   _wglSwapIntervalEXT = wglGetProcAddress("wglSwapIntervalEXT");
 }
 
+#endif //_WIN32
+
 #endif //FRAME_IMPLEMENTATION
 
 #endif //FRAME_H
@@ -0,0 +1,306 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+// Decodes the formats of the viewer into rgba8, for the viewer and the
+// bench alike. QOI and PNM are read with their own decoders, which write
+// into a given buffer or hand out rows. Everything else goes through
+// stb_image, which only decodes all of it into a buffer of its own.
+//
+//   int width, height;
+//   if(image_info(path, &width, &height)) {
+//     void *out = malloc((size_t) width * (size_t) height * 4);
+//     image_decode_into(path, &width, &height, out, (size_t) width * (size_t) height * 4, 0, false);
+//   }
+//
+// Uses trace.h, alloc.h, qoi.h, pnm.h, stb_image.h, downscale.h and
+// resample.h, include them first.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef IMAGE_DEF
+#  define IMAGE_DEF static inline
+#endif //IMAGE_DEF
+
+#ifndef IMAGE_STEP_ROWS
+#  define IMAGE_STEP_ROWS 16 // decoded at once, when shrinking while decoding
+#endif //IMAGE_STEP_ROWS
+
+#ifndef IMAGE_STB_PEAK
+#  define IMAGE_STB_PEAK 6 // times the rgba8 image, held by stb_image for formats other than PNG and JPEG
+#endif //IMAGE_STB_PEAK
+
+IMAGE_DEF bool image_info(const char *path, int *width, int *height);
+// With the bytes a decode of the file holds beside its output, shrunk or not
+IMAGE_DEF bool image_info_peak(const char *path, int *width, int *height, size_t *peak);
+// Freed with 'alloc_free', NULL on failure
+IMAGE_DEF unsigned char *image_decode(const char *path, int *width, int *height);
+IMAGE_DEF bool image_decode_into(const char *path, int *width, int *height, void *out, size_t out_size, size_t out_stride, bool flip);
+IMAGE_DEF bool image_decode_scaled_into(const char *path, int src_width, int src_height, void *out, int width, int height);
+// Fits the image into 'side' x 'side', 'out' holds side * side * 4 bytes
+IMAGE_DEF bool image_thumb(const char *path, int side, unsigned char *out, int *width, int *height);
+
+// Polled between the strips of 'image_decode_scaled_into', which fails once
+// it returns true. Per thread, stb_image polls its progress callback instead.
+typedef bool (*Image_Cancelled)(void *user);
+IMAGE_DEF void image_set_cancel(Image_Cancelled cancelled, void *user);
+
+#ifdef IMAGE_IMPLEMENTATION
+
+#ifdef _MSC_VER
+#  define IMAGE_THREAD_LOCAL __declspec(thread)
+#else
+#  define IMAGE_THREAD_LOCAL __thread
+#endif //_MSC_VER
+
+static IMAGE_THREAD_LOCAL Image_Cancelled image_cancelled = NULL;
+static IMAGE_THREAD_LOCAL void *image_cancelled_user = NULL;
+
+IMAGE_DEF void image_set_cancel(Image_Cancelled cancelled, void *user) {
+  image_cancelled = cancelled;
+  image_cancelled_user = user;
+}
+
+IMAGE_DEF bool image_info(const char *path, int *width, int *height) {
+  qoi_desc desc;
+  if(qoi_info(path, &desc)) {
+    *width = (int) desc.width;
+    *height = (int) desc.height;
+    return true;
+  }
+  if(pnm_info(path, width, height, NULL)) {
+    return true;
+  }
+  return stbi_info(path, width, height, NULL);
+}
+
+// The SOF marker of a JPEG, 0 if there is none
+static int image_jpeg_frame(FILE *f) {
+  unsigned char m[4];
+  if(fseek(f, 2, SEEK_SET) != 0) return 0;
+  while(fread(m, 1, 4, f) == 4 && m[0] == 0xFF) {
+    if(m[1] >= 0xC0 && m[1] <= 0xCF && m[1] != 0xC4 && m[1] != 0xC8 && m[1] != 0xCC) return m[1];
+    if(fseek(f, ((long) m[2] << 8 | m[3]) - 2, SEEK_CUR) != 0) return 0;
+  }
+  return 0;
+}
+
+// What stb_image holds of a 'comp' channel file, rgba8 output included.
+// PNG keeps the compressed data, the inflated rows while it grows them and
+// its image before the rgba8 copy, interlaced the passes as well. JPEG keeps
+// a plane per channel, progressive the coefficients as well, BMP its image.
+static size_t image_stb_peak(const char *path, int width, int height, int comp) {
+  size_t pixels = (size_t) width * (size_t) height;
+  FILE *f = fopen(path, "rb");
+  if(!f) return pixels * 4 * IMAGE_STB_PEAK;
+  unsigned char h[29];
+  size_t n = fread(h, 1, sizeof(h), f);
+  size_t peak = pixels * 4 * IMAGE_STB_PEAK;
+  if(n == sizeof(h) && memcmp(h, "\x89PNG", 4) == 0 && fseek(f, 0, SEEK_END) == 0) {
+    size_t file_size = (size_t) ftell(f);
+    size_t raw = (size_t) comp * (h[24] == 16 ? 2 : 1);
+    peak = file_size * 2 + pixels * (h[28] ? raw * 4 + 8 : raw * 2 + 6);
+  } else if(n >= 2 && h[0] == 0xFF && h[1] == 0xD8) {
+    int frame = image_jpeg_frame(f);
+    bool progressive = frame == 0xC2 || frame == 0xC6 || frame == 0xCA || frame == 0xCE;
+    peak = pixels * (size_t) (progressive ? comp * 3 + 4 : comp + 4);
+  } else if(n >= 2 && h[0] == 'B' && h[1] == 'M') {
+    peak = pixels * (size_t) (comp + 4);
+  }
+  fclose(f);
+  return peak;
+}
+
+// QOI and PNM stream IMAGE_STEP_ROWS rows at a time, stb_image holds all of
+// the image and more
+IMAGE_DEF bool image_info_peak(const char *path, int *width, int *height, size_t *peak) {
+  qoi_desc desc;
+  if(qoi_info(path, &desc)) {
+    *width = (int) desc.width;
+    *height = (int) desc.height;
+    *peak = (size_t) *width * 4 * IMAGE_STEP_ROWS;
+    return true;
+  }
+  if(pnm_info(path, width, height, NULL)) {
+    *peak = (size_t) *width * 4 * IMAGE_STEP_ROWS;
+    return true;
+  }
+  int comp;
+  if(!stbi_info(path, width, height, &comp)) return false;
+  *peak = image_stb_peak(path, *width, *height, comp);
+  return true;
+}
+
+IMAGE_DEF unsigned char *image_decode(const char *path, int *width, int *height) {
+  qoi_desc desc;
+  unsigned char *data = qoi_read(path, &desc, 4);
+  if(data) {
+    *width = (int) desc.width;
+    *height = (int) desc.height;
+    return data;
+  }
+  data = pnm_load(path, width, height, NULL, 4);
+  if(data) {
+    return data;
+  }
+  TRACE_BEGIN("stbi_load");
+  data = stbi_load(path, width, height, 0, 4);
+  TRACE_END("stbi_load");
+  return data;
+}
+
+// Like 'image_decode_into' for QOI and PNM, IMAGE_STEP_ROWS rows at a time
+// so that 'image_cancelled' is polled in between. -1 for other formats.
+static int image_decode_steps(const char *path, int *width, int *height, void *out, size_t out_size, size_t out_stride, bool flip) {
+  qoi_decoder qoi;
+  Pnm_Decoder pnm;
+  bool is_qoi = qoi_decoder_open(&qoi, path, 4);
+  bool is_pnm = !is_qoi && pnm_decoder_open(&pnm, path, 4);
+  if(!is_qoi && !is_pnm) return -1;
+
+  *width = is_qoi ? (int) qoi.desc.width : (int) pnm.width;
+  *height = is_qoi ? (int) qoi.desc.height : (int) pnm.height;
+  size_t row_size = (size_t) *width * 4;
+  if(out_stride == 0) out_stride = row_size;
+  bool ok = *height > 0 && out_stride >= row_size && out_stride * (size_t) (*height - 1) + row_size <= out_size;
+  int step = flip ? 1 : IMAGE_STEP_ROWS;
+  for(int y=0;ok && y<*height;y+=step) {
+    if(image_cancelled(image_cancelled_user)) {
+      ok = false;
+      break;
+    }
+    int rows = *height - y < step ? *height - y : step;
+    unsigned char *dst = (unsigned char *) out + out_stride * (size_t) (flip ? *height - 1 - y : y);
+    if(is_qoi) {
+      ok = qoi_decoder_step(&qoi, rows, dst, (int) out_stride) == rows;
+    } else {
+      ok = (int) pnm_decoder_step(&pnm, rows, dst, out_stride) == rows && !pnm.reader.error;
+    }
+  }
+
+  if(is_qoi) qoi_decoder_free(&qoi);
+  else pnm_decoder_close(&pnm);
+  return ok;
+}
+
+// Decodes into 'out' of 'out_size' bytes, rows 'out_stride' apart (0 packs
+// them) and with 'flip' bottom up. QOI and PNM write into it directly, in
+// strips while 'image_set_cancel' is set. stb_image has no such entry point
+// and is copied.
+IMAGE_DEF bool image_decode_into(const char *path, int *width, int *height, void *out, size_t out_size, size_t out_stride, bool flip) {
+  if(image_cancelled) {
+    int ok = image_decode_steps(path, width, height, out, out_size, out_stride, flip);
+    if(ok >= 0) return ok;
+  }
+
+  qoi_desc desc;
+  if(qoi_read_into(path, &desc, 4, out, (int) out_size, (int) out_stride, flip)) {
+    *width = (int) desc.width;
+    *height = (int) desc.height;
+    return true;
+  }
+  if(pnm_load_into(path, width, height, NULL, 4, out, (unsigned long long) out_size, (unsigned long long) out_stride, flip)) {
+    return true;
+  }
+  TRACE_BEGIN("stbi_load");
+  unsigned char *data = stbi_load(path, width, height, 0, 4);
+  TRACE_END("stbi_load");
+  if(!data) return false;
+
+  size_t row_size = (size_t) *width * 4;
+  if(out_stride == 0) out_stride = row_size;
+  bool fits = out_stride >= row_size && out_stride * (size_t) (*height - 1) + row_size <= out_size;
+  for(int y=0;fits && y<*height;y++) {
+    int row = flip ? *height - 1 - y : y;
+    memcpy((unsigned char *) out + out_stride * (size_t) row, data + row_size * (size_t) y, row_size);
+  }
+  alloc_free(data);
+  return fits;
+}
+
+// Decodes into 'out' at 'width' x 'height', shrunk while the rows come in.
+// QOI and PNM are read IMAGE_STEP_ROWS rows at a time, so nothing of the
+// full size is held. stb_image has no such entry point and decodes all of
+// it first.
+IMAGE_DEF bool image_decode_scaled_into(const char *path, int src_width, int src_height, void *out, int width, int height) {
+  Downscale d;
+  if(!downscale_init(&d, src_width, src_height, width, height, 4, out, (size_t) width * 4)) {
+    return false;
+  }
+
+  TRACE_BEGIN("image_decode_scaled");
+  size_t row_size = (size_t) src_width * 4;
+  qoi_decoder qoi;
+  Pnm_Decoder pnm;
+  bool is_qoi = qoi_decoder_open(&qoi, path, 4);
+  bool is_pnm = !is_qoi && pnm_decoder_open(&pnm, path, 4);
+  if(is_qoi || is_pnm) {
+    bool fits = is_qoi
+      ? (int) qoi.desc.width == src_width && (int) qoi.desc.height == src_height
+      : (int) pnm.width == src_width && (int) pnm.height == src_height;
+    unsigned char *strip = fits ? alloc_malloc(ALLOC_TAG_OTHER, row_size * IMAGE_STEP_ROWS) : NULL;
+    while(strip && d.src_y < src_height) {
+      if(image_cancelled && image_cancelled(image_cancelled_user)) break;
+      int rows;
+      if(is_qoi) {
+	rows = qoi_decoder_step(&qoi, IMAGE_STEP_ROWS, strip, (int) row_size);
+      } else {
+	rows = (int) pnm_decoder_step(&pnm, IMAGE_STEP_ROWS, strip, row_size);
+	if(pnm.reader.error) rows = 0;
+      }
+      if(rows == 0) break;
+      downscale_rows(&d, strip, rows, row_size);
+    }
+    alloc_free(strip);
+    if(is_qoi) qoi_decoder_free(&qoi);
+    else pnm_decoder_close(&pnm);
+  } else {
+    int w, h;
+    TRACE_BEGIN("stbi_load");
+    unsigned char *data = stbi_load(path, &w, &h, 0, 4);
+    TRACE_END("stbi_load");
+    if(data && w == src_width && h == src_height) {
+      downscale_rows(&d, data, h, row_size);
+    }
+    alloc_free(data);
+  }
+  TRACE_END("image_decode_scaled");
+
+  bool ok = d.dst_y == height;
+  downscale_free(&d);
+  return ok;
+}
+
+// QOI and PNM stream through the downscaler, stb_image decodes in full and
+// is resampled
+IMAGE_DEF bool image_thumb(const char *path, int side, unsigned char *out, int *width, int *height) {
+  int src_width, src_height;
+  qoi_desc desc;
+  if(qoi_info(path, &desc)) {
+    src_width = (int) desc.width;
+    src_height = (int) desc.height;
+  } else if(!pnm_info(path, &src_width, &src_height, NULL)) {
+    src_width = 0;
+  }
+
+  if(src_width > 0) {
+    downscale_fit(src_width, src_height, side, side, width, height);
+    return image_decode_scaled_into(path, src_width, src_height, out, *width, *height);
+  }
+
+  TRACE_BEGIN("stbi_load");
+  unsigned char *data = stbi_load(path, &src_width, &src_height, 0, 4);
+  TRACE_END("stbi_load");
+  if(!data) return false;
+  downscale_fit(src_width, src_height, side, side, width, height);
+  bool ok = resample(data, src_width, src_height, (size_t) src_width * 4,
+		     out, *width, *height, (size_t) *width * 4, RESAMPLE_BICUBIC, RESAMPLE_PREMULTIPLY, NULL);
+  alloc_free(data);
+  return ok;
+}
+
+#endif //IMAGE_IMPLEMENTATION
+
+#endif //IMAGE_H
@@ -46,6 +46,8 @@ IO_DEF bool io_create_dir(const char *dir_path, bool *existed);
 IO_DEF bool io_delete_dir(const char *dir_path);
 
 IO_DEF bool io_exists(const char *file_path, bool *is_file);
+IO_DEF bool io_stat(const char *file_path, unsigned long long *size, long long *mtime); // 'mtime' only compares to others
+IO_DEF bool io_touch(const char *file_path); // sets 'mtime' to now
 
 IO_DEF bool io_getenv(const char *name, char *buffer, size_t buffer_cap, size_t *buffer_len);
 
@@ -309,6 +311,44 @@ IO_DEF bool io_exists(const char *file_path, bool *is_file) {
 #endif // _WIN32
 }
 
+IO_DEF bool io_stat(const char *file_path, unsigned long long *size, long long *mtime) {
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if(!GetFileAttributesEx(file_path, GetFileExInfoStandard, &data)) {
+    return false;
+  }
+  if(size) *size = ((unsigned long long) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+  if(mtime) *mtime = (long long) (((unsigned long long) data.ftLastWriteTime.dwHighDateTime << 32) |
+				  data.ftLastWriteTime.dwLowDateTime);
+  return true;
+#else
+  struct stat path_stat;
+  if(stat(file_path, &path_stat) < 0) {
+    return false;
+  }
+  if(size) *size = (unsigned long long) path_stat.st_size;
+  if(mtime) *mtime = (long long) path_stat.st_mtim.tv_sec * 1000000000 + (long long) path_stat.st_mtim.tv_nsec;
+  return true;
+#endif // _WIN32
+}
+
+IO_DEF bool io_touch(const char *file_path) {
+#ifdef _WIN32
+  HANDLE handle = CreateFile(file_path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			     NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  FILETIME now;
+  GetSystemTimeAsFileTime(&now);
+  BOOL ok = SetFileTime(handle, NULL, NULL, &now);
+  CloseHandle(handle);
+  return ok != 0;
+#else
+  return utimensat(AT_FDCWD, file_path, NULL, 0) == 0;
+#endif // _WIN32
+}
+
 IO_DEF bool io_getenv(const char *name, char *buffer, size_t buffer_cap, size_t *buffer_len) {
 #ifdef _WIN32
   if(buffer_len) *buffer_len = 0;
@@ -322,7 +362,7 @@ IO_DEF bool io_getenv(const char *name, char *buffer, size_t buffer_cap, size_t
   if(buffer_len) *buffer_len = size;
 
   if(size > buffer_cap) {
-    IO_LOG("Environment-Variable: '%s' does not fit into %llu chars. %lu needed", name, buffer_cap, size);
+    IO_LOG("Environment-Variable: '%s' does not fit into %llu chars. %lu needed", name, (unsigned long long) buffer_cap, (unsigned long) size);
     return false;
   }
 
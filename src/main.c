@@ -1,4 +1,26 @@
 
+// First, the others build on it
+#define THREAD_IMPLEMENTATION
+#include "thread.h"
+
+// Before the rest, it wires up the hooks of the others
+#define TRACE_IMPLEMENTATION
+#include "trace.h"
+
+// Before the decoders, it takes over their allocations
+#define ALLOC_IMPLEMENTATION
+#include "alloc.h"
+
+#define BUDGET_IMPLEMENTATION
+#include "budget.h"
+
+#define POOL_IMPLEMENTATION
+#include "pool.h"
+
+// Before frame.h, it builds the mipmaps of the software renderer
+#define RESAMPLE_IMPLEMENTATION
+#include "resample.h"
+
 #define FRAME_IMPLEMENTATION
 #include "frame.h"
 
@@ -13,107 +35,1576 @@
 #define QOI_IMPLEMENTATION
 #include "qoi.h"
 
+#define DOWNSCALE_IMPLEMENTATION
+#include "downscale.h"
+
+// For listing folders and caching thumbnails
+
+#define IO_QUIET // failures are reported here
+#define IO_IMPLEMENTATION
+#include "io.h"
+
+#define CACHE_IMPLEMENTATION
+#include "cache.h"
+
+// What it holds is charged to the budget of RAM
+Budget budget;
+int ram_cache_client = -1;
+#define RAM_CACHE_RESERVE(bytes) budget_reserve(&budget, ram_cache_client, bytes)
+#define RAM_CACHE_RELEASE(bytes) budget_release(&budget, ram_cache_client, bytes)
+#define RAM_CACHE_IMPLEMENTATION
+#include "ramcache.h"
+
+#define IMAGE_IMPLEMENTATION
+#include "image.h"
+
+#define VIEW_IMPLEMENTATION
+#include "view.h"
+
 #define PADDING 48
 #define BORDER_PADDING 4
+#define PATH_CAP 1024
+#define STEP_MS 6.0 // of decoding per frame, without a decode thread
+#define STEP_ROWS 16
+#define ATLAS_TEX 0 // slot of the thumbnails, images take the two after it
+#define PREVIEW_TEX 3 // slot of the approximations of a progressive image
+#define SCALE_ABOVE (64 << 20) // pixels, larger images are shrunk while decoding
+#define SCALED_SIZE 2048 // fitted into this square, more of it is loaded when zoomed in
+#define THUMB_SIZE 128
+#define THUMB_PADDING 16
+#define THUMB_WORKERS 4 // jobs at once at most, fewer on fewer cores
+#define THUMB_UPLOADS 128 // into the atlas per frame, a folder of 5000 fills in 40 frames
+#define CACHE_BYTES (512ULL << 20) // of thumbnails, shrunk images and previews on disk
+#define PREVIEW_SIZE 1920 // larger images keep one fitted into this square on disk
+#define RAM_CACHE_BYTES ((size_t) 256 << 20) // of recently viewed images
+#define RAM_BUDGET_MB 4096 // of decodes, caches and thumbnails, unless --ram
+#define VRAM_BUDGET_MB 2048 // of textures, unless --vram
+#define BUDGET_MIN_SIDE 256 // images are shrunk down to this before a load fails
+#define HUD_REFRESH_MS 250.0 // while nothing else redraws
+#define ARENA_KEEP ((size_t) 64 << 20) // of the decode arena, between loads
+#define ATLAS_SIZE 2048 // grown up to ATLAS_SIZE_MAX while a screen fills more than two thirds of it
+#define ATLAS_SIZE_MAX 8192
+#define ATLAS_CELL (THUMB_SIZE + 2) // a texel apart, so filtering never reaches a neighbour
+#define ATLAS_SLOTS_MAX ((ATLAS_SIZE_MAX / ATLAS_CELL) * (ATLAS_SIZE_MAX / ATLAS_CELL))
 
 static Frame frame;
-float zoom = 1.f;
-float initial_zoom = 1.f;
+View view;
 bool show_border = false;
+bool show_hud = false;
+bool show_stats = false; // --stats
+bool cooperative = false; // --no-threads, or when no thread can be started
+Pool pool; // decodes images and thumbnails
+Cache cache;
+bool has_cache = false; // unless --no-cache
+Ram_Cache ram_cache;
+bool has_ram_cache = false; // unless --no-cache
+FILE *timing_csv = NULL; // VIEWER_TIMING_CSV
 
-float y_off = 0.f;
-float y_start = 0.f;
-bool y_drag = false;
-
-float x_off = 0.f;
-float x_start = 0.f;
-bool x_drag = false;
+// Clients of 'budget'. Only the main thread reserves VRAM, so only it runs
+// the callbacks that free textures.
+int arena_client = -1; // what the decode arena keeps between loads
+int decode_client = -1; // what loads and thumbnails hold while they decode, and previews
+int cache_jobs_client = -1; // pixels handed to 'cache_job'
+int thumbs_client = -1; // thumbnails waiting for the atlas
+int atlas_client = -1;
+int textures_client = -1; // the images and the preview
+size_t texture_bytes[FRAME_RENDERER_IMAGES_CAP]; // charged to 'textures_client'
 
 unsigned int tex;
 const char *last_path = NULL;
+char shown_path[PATH_CAP];
 int img_width, img_height;
+int img_src_width, img_src_height; // of the file, larger when it is shrunk
+int img_side_wanted; // of the last reload of a shrunk image, see 'load_sharpen'
 
-void load_file(const char *path) {
+// A load decodes on its own thread, straight into the pixel buffer of the
+// upload. The main loop only commits it and lets 'frame_renderer_begin'
+// stream it into the texture, while the previous image stays on screen.
+typedef struct{
+  char path[PATH_CAP];
+  int width, height;
+  int src_width, src_height; // of the file, larger when it is shrunk
+  bool refit; // unless it replaces the shown image at another resolution
+  void *pixels;
+  unsigned int tex;
+  size_t reserved; // of 'decode_client', until it is shown
 
-  qoi_desc desc;	
-  unsigned char *data = NULL;
-  
-  data = qoi_read(path, &desc, 4);
-  img_width = desc.width;
-  img_height = desc.height;
-  if(!data) {
-    data = pnm_load(path, &img_width, &img_height, NULL, 4);
-  }
-  if(!data) {
-    data = stbi_load(path, &img_width, &img_height, 0, 4);
-  }  
-  if(!data) {
+  Alloc_Scope allocs; // of the decode
+  Alloc_Arena arena; // of the decode thread, reset after every load
+  Thread_Mutex arena_mutex; // held while a job decodes, 'arena_evict' skips it then
+  size_t arena_charged; // to 'arena_client'
+
+  Pool_Token token;
+  bool done; // set by 'load_done'
+  bool ok;
+  bool decoding;
+  bool active;
+
+  // Interlaced PNGs and progressive JPEGs hand an approximation to the main
+  // loop after every pass, which shows it in PREVIEW_TEX until the upload is done.
+  // So do images larger than PREVIEW_SIZE whose preview is on disk, from
+  // before the decode. Both sides copy outside of 'preview_mutex', it only
+  // guards the swaps of the buffers.
+  Thread_Mutex preview_mutex;
+  unsigned char *preview; // the newest, until the main loop takes it
+  int preview_width, preview_height; // smaller than the image if it came from disk
+  unsigned char *preview_spare; // for the next pass
+  Thread_Atomic previews; // written by the decode thread
+  long previews_taken;
+  long previews_shown;
+  bool preview_uploading; // into PREVIEW_TEX, streamed like the image
+
+  // Without a thread, 'load_step' decodes a strip of rows per call and
+  // pushes it into the texture, which is already on screen.
+  bool stepping;
+  bool is_qoi;
+  qoi_decoder qoi;
+  Pnm_Decoder pnm;
+  unsigned char *strip; // STEP_ROWS rows, in the arena
+  int rows;
+  Downscale scale;
+  unsigned char *scaled; // the shrunk image, in the arena
+}Load;
+
+Load load = {0};
+Alloc_Scope last_load_allocs = {0};
+char pending_path[PATH_CAP];
+int pending_side;
+bool has_pending = false;
+
+void ram_cache_evict(void *user, size_t bytes) {
+  ram_cache_trim((Ram_Cache *) user, bytes);
+}
+
+// With 'arena_mutex' held, after a load
+void load_arena_charge(Load *l) {
+  if(l->arena.held > l->arena_charged) {
+    budget_charge(&budget, arena_client, l->arena.held - l->arena_charged);
+  } else {
+    budget_release(&budget, arena_client, l->arena_charged - l->arena.held);
+  }
+  l->arena_charged = l->arena.held;
+}
+
+// Frees what the decode arena keeps, unless a load uses it
+void arena_evict(void *user, size_t bytes) {
+  Load *l = (Load *) user;
+  (void) bytes;
+  if(!thread_mutex_trylock(&l->arena_mutex)) return;
+  alloc_arena_trim(&l->arena, 0);
+  load_arena_charge(l);
+  thread_mutex_unlock(&l->arena_mutex);
+}
+
+// Charged to 'decode_client' while they are held, NULL if there is no room
+unsigned char *preview_alloc(int width, int height) {
+  size_t size = (size_t) width * (size_t) height * 4;
+  if(!budget_reserve(&budget, decode_client, size)) return NULL;
+  unsigned char *preview = malloc(size);
+  if(!preview) budget_release(&budget, decode_client, size);
+  return preview;
+}
+
+void preview_free(unsigned char *preview, int width, int height) {
+  if(!preview) return;
+  free(preview);
+  budget_release(&budget, decode_client, (size_t) width * (size_t) height * 4);
+}
+
+// From a worker of 'pool', so the main loop polls it
+void redraw(void *user) {
+  (void) user;
+  frame_request_redraw(&frame);
+}
+
+// Shrunk images are told apart by their size
+bool load_key(Load *l, unsigned long long *key) {
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  return cache_key(l->path, scaled ? (l->width > l->height ? l->width : l->height) : 0, key);
+}
+
+// Whether the load is kept in a cache, and so has to be decoded on the heap
+// first. The upload buffer is only ever written.
+bool load_cacheable(Load *l) {
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  return (scaled && has_cache) || (has_ram_cache && ram_cache_fits(&ram_cache, l->width, l->height));
+}
+
+// As it was when it was viewed before: the image from memory, or the shrunk
+// one of a very large file from memory or disk
+bool load_cache_get(Load *l, void *out) {
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  size_t size = (size_t) l->width * (size_t) l->height * 4;
+  unsigned long long key;
+  int width, height;
+  if(!load_key(l, &key)) return false;
+  if(has_ram_cache && ram_cache_get(&ram_cache, key, out, size, &width, &height)) {
+    return width == l->width && height == l->height;
+  }
+  return scaled && has_cache && cache_get(&cache, key, out, size, &width, &height) &&
+    width == l->width && height == l->height;
+}
+
+void load_cache_put(Load *l, const void *pixels) {
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  unsigned long long key;
+  if(!load_key(l, &key)) return;
+  if(has_ram_cache) ram_cache_put(&ram_cache, key, pixels, l->width, l->height);
+  if(scaled && has_cache) cache_put(&cache, key, pixels, l->width, l->height);
+}
+
+// On the decode thread, after every pass of a progressive image
+int load_progress(void *user, const unsigned char *data, int width, int height, int comp) {
+  Load *l = (Load *) user;
+  if(!data) return pool_cancelled(&l->token) ? -1 : 1; // only polled
+  if(width != l->width || height != l->height || comp != 4) return 0;
+
+  TRACE_BEGIN("load_progress");
+  thread_mutex_lock(&l->preview_mutex);
+  unsigned char *buffer = l->preview_spare;
+  l->preview_spare = NULL;
+  thread_mutex_unlock(&l->preview_mutex);
+
+  if(!buffer) buffer = preview_alloc(width, height);
+  if(buffer) {
+    memcpy(buffer, data, (size_t) width * (size_t) height * 4);
+
+    // an older one the main loop did not take becomes the spare
+    thread_mutex_lock(&l->preview_mutex);
+    unsigned char *old = l->preview;
+    int old_width = l->preview_width;
+    int old_height = l->preview_height;
+    bool old_fits = old_width == width && old_height == height;
+    l->preview = buffer;
+    l->preview_width = width;
+    l->preview_height = height;
+    if(!l->preview_spare && old_fits) {
+      l->preview_spare = old;
+      old = NULL;
+    }
+    thread_mutex_unlock(&l->preview_mutex);
+    preview_free(old, old_width, old_height);
+  }
+  TRACE_END("load_progress");
+
+  if(buffer) {
+    thread_atomic_add(&l->previews, 1);
+    frame_request_redraw(&frame);
+  }
+  return buffer != NULL;
+}
+
+// Whether a preview of the image is kept on disk
+bool load_previewable(Load *l) {
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  return has_cache && !scaled && (l->width > PREVIEW_SIZE || l->height > PREVIEW_SIZE);
+}
+
+// On the decode thread, hands the preview from an earlier view to the main loop
+bool load_disk_preview(Load *l, unsigned long long key) {
+  int fit_width, fit_height, width, height;
+  downscale_fit(l->width, l->height, PREVIEW_SIZE, PREVIEW_SIZE, &fit_width, &fit_height);
+  size_t size = (size_t) fit_width * (size_t) fit_height * 4;
+  unsigned char *buffer = preview_alloc(fit_width, fit_height);
+  if(!buffer || !cache_get(&cache, key, buffer, size, &width, &height) ||
+     width != fit_width || height != fit_height) {
+    preview_free(buffer, fit_width, fit_height);
+    return false;
+  }
+
+  thread_mutex_lock(&l->preview_mutex);
+  unsigned char *old = l->preview;
+  int old_width = l->preview_width;
+  int old_height = l->preview_height;
+  l->preview = buffer;
+  l->preview_width = width;
+  l->preview_height = height;
+  thread_mutex_unlock(&l->preview_mutex);
+  preview_free(old, old_width, old_height);
+
+  thread_atomic_add(&l->previews, 1);
+  frame_request_redraw(&frame);
+  return true;
+}
+
+// What a load leaves to the caches, kept once the upload has the pixels
+typedef struct{
+  unsigned char *pixels; // from 'alloc_malloc_heap', freed by the job
+  int width, height;
+  unsigned long long key; // see 'load_key'
+  bool ram; // into 'ram_cache'
+  bool disk; // into 'cache', a shrunk image
+  bool preview; // shrunk into its preview, into 'cache'
+  unsigned long long preview_key;
+}Cache_Job;
+
+void cache_job(void *arg, Pool_Token *token) {
+  Cache_Job *j = (Cache_Job *) arg;
+  (void) token;
+
+  trace_thread_name("worker");
+  TRACE_BEGIN("cache_put");
+  size_t size = (size_t) j->width * (size_t) j->height * 4;
+  if(j->ram) ram_cache_put(&ram_cache, j->key, j->pixels, j->width, j->height);
+  if(j->disk) cache_put(&cache, j->key, j->pixels, j->width, j->height);
+  if(j->preview) {
+    int width, height;
+    downscale_fit(j->width, j->height, PREVIEW_SIZE, PREVIEW_SIZE, &width, &height);
+    size_t preview_size = (size_t) width * (size_t) height * 4;
+    budget_charge(&budget, cache_jobs_client, preview_size);
+    unsigned char *preview = malloc(preview_size);
+    Downscale d;
+    if(preview && downscale_init(&d, j->width, j->height, width, height, 4, preview, (size_t) width * 4)) {
+      downscale_rows(&d, j->pixels, j->height, (size_t) j->width * 4);
+      if(d.dst_y == height) cache_put(&cache, j->preview_key, preview, width, height);
+      downscale_free(&d);
+    }
+    free(preview);
+    budget_release(&budget, cache_jobs_client, preview_size);
+  }
+  alloc_free(j->pixels);
+  budget_release(&budget, cache_jobs_client, size);
+  free(j);
+  TRACE_END("cache_put");
+}
+
+// Hands 'pixels' to a 'cache_job' of POOL_MAINTENANCE, which frees them and
+// their charge to 'cache_jobs_client'. Previews are made with a 'preview_key'.
+void load_cache_later(Load *l, unsigned char *pixels, const unsigned long long *preview_key) {
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  Cache_Job *j = malloc(sizeof(Cache_Job));
+  if(!j) {
+    alloc_free(pixels);
+    return;
+  }
+  j->pixels = pixels;
+  j->width = l->width;
+  j->height = l->height;
+  bool keyed = load_key(l, &j->key);
+  j->ram = keyed && has_ram_cache && ram_cache_fits(&ram_cache, l->width, l->height);
+  j->disk = keyed && scaled && has_cache;
+  j->preview = preview_key != NULL;
+  j->preview_key = preview_key ? *preview_key : 0;
+  budget_charge(&budget, cache_jobs_client, (size_t) l->width * (size_t) l->height * 4);
+  if(!pool_submit(&pool, POOL_MAINTENANCE, cache_job, NULL, j, NULL)) cache_job(j, NULL);
+}
+
+// Stops the decoders of image.h
+bool load_cancelled(void *user) {
+  return pool_cancelled((Pool_Token *) user);
+}
+
+void load_job(void *arg, Pool_Token *token) {
+  Load *l = (Load *) arg;
+
+  trace_thread_name("worker");
+  stbi_set_progress_callback(load_progress, l);
+  image_set_cancel(load_cancelled, token);
+  TRACE_BEGIN("image_decode");
+  thread_mutex_lock(&l->arena_mutex);
+  alloc_scope_begin(&l->allocs);
+  alloc_arena_begin(&l->arena);
+  int width, height;
+  size_t size = (size_t) l->width * (size_t) l->height * 4;
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  unsigned long long preview_key;
+  bool preview = false; // to be made and kept on disk
+  if(load_cache_get(l, l->pixels)) {
+    l->ok = true;
+  } else if(load_previewable(l) && cache_key(l->path, PREVIEW_SIZE, &preview_key)) {
+    preview = !load_disk_preview(l, preview_key);
+  }
+
+  if(l->ok) {
+    // from memory
+  } else if(scaled || preview || load_cacheable(l)) {
+    // on the heap, the caches get it after the upload
+    unsigned char *data = alloc_malloc_heap(ALLOC_TAG_OTHER, size);
+    if(data && scaled) {
+      l->ok = image_decode_scaled_into(l->path, l->src_width, l->src_height, data, l->width, l->height);
+    } else if(data && image_decode_into(l->path, &width, &height, data, size, 0, false)) {
+      l->ok = width == l->width && height == l->height;
+    }
+    if(l->ok) {
+      memcpy(l->pixels, data, size);
+      load_cache_later(l, data, preview ? &preview_key : NULL);
+    } else {
+      alloc_free(data);
+    }
+  } else if(image_decode_into(l->path, &width, &height, l->pixels, size, 0, false)) {
+    l->ok = width == l->width && height == l->height;
+  }
+  alloc_arena_end();
+  alloc_scope_end();
+
+  // the pixels are in the upload buffer, nothing of the decode is needed anymore
+  alloc_arena_reset(&l->arena);
+  load_arena_charge(l);
+  thread_mutex_unlock(&l->arena_mutex);
+  stbi_set_progress_callback(NULL, NULL);
+  image_set_cancel(NULL, NULL);
+  TRACE_END("image_decode");
+}
+
+// On the main thread, from 'pool_poll'
+void load_done(void *arg, bool cancelled) {
+  Load *l = (Load *) arg;
+  if(cancelled) l->ok = false;
+  l->done = true;
+}
+
+void load_show() {
+  TRACE_INSTANT("load_shown");
+
+  if(load.refit) {
+    view_fit(&view, frame.width, frame.height, load.width, load.height, PADDING);
+    img_side_wanted = 0;
+  } else {
+    view_resize(&view, img_width, load.width);
+  }
+
+  tex = load.tex;
+  img_width = load.width;
+  img_height = load.height;
+  img_src_width = load.src_width;
+  img_src_height = load.src_height;
+  memcpy(shown_path, load.path, sizeof(shown_path));
+  last_path = shown_path;
+  frame_set_title(&frame, last_path);
+}
+
+void load_steps_end() {
+  Load *l = &load;
+  if(l->stepping) {
+    if(l->is_qoi) qoi_decoder_free(&l->qoi);
+    else pnm_decoder_close(&l->pnm);
+    l->stepping = false;
+    frame_renderer_texture_streaming(l->tex, false);
+  }
+  downscale_free(&l->scale);
+  l->strip = NULL;
+  l->scaled = NULL;
+  alloc_arena_reset(&l->arena);
+  thread_mutex_lock(&l->arena_mutex);
+  load_arena_charge(l);
+  thread_mutex_unlock(&l->arena_mutex);
+  last_load_allocs = l->allocs;
+}
+
+// Opens the resumable decoder and an empty texture for 'load_step'. Formats
+// of stb_image have no such decoder, they are decoded here in one go.
+bool load_steps_begin() {
+  Load *l = &load;
+
+  TRACE_BEGIN("image_decode");
+  alloc_scope_begin(&l->allocs);
+  alloc_arena_begin(&l->arena);
+  l->rows = 0;
+  bool scaled = l->width != l->src_width || l->height != l->src_height;
+  unsigned char *cached = NULL;
+  if(load_cacheable(l)) {
+    cached = alloc_malloc(ALLOC_TAG_OTHER, (size_t) l->width * (size_t) l->height * 4);
+    if(cached && !load_cache_get(l, cached)) {
+      alloc_free(cached);
+      cached = NULL;
+    }
+  }
+
+  l->is_qoi = !cached && qoi_decoder_open(&l->qoi, l->path, 4);
+  if(cached) {
+    l->stepping = false;
+  } else if(l->is_qoi) {
+    l->stepping = (int) l->qoi.desc.width == l->src_width && (int) l->qoi.desc.height == l->src_height;
+    if(!l->stepping) qoi_decoder_free(&l->qoi);
+  } else if(pnm_decoder_open(&l->pnm, l->path, 4)) {
+    l->stepping = (int) l->pnm.width == l->src_width && (int) l->pnm.height == l->src_height;
+    if(!l->stepping) pnm_decoder_close(&l->pnm);
+  } else {
+    l->stepping = false;
+  }
+
+  bool ok = false;
+  if(cached) {
+    ok = frame_renderer_push_texture(l->width, l->height, cached, false, &l->tex);
+    alloc_free(cached);
+  } else if(l->stepping) {
+    l->strip = alloc_malloc(ALLOC_TAG_OTHER, (size_t) l->src_width * 4 * STEP_ROWS);
+    ok = l->strip != NULL;
+    if(ok && scaled) {
+      l->scaled = alloc_malloc(ALLOC_TAG_OTHER, (size_t) l->width * (size_t) l->height * 4);
+      ok = l->scaled &&
+	downscale_init(&l->scale, l->src_width, l->src_height, l->width, l->height, 4, l->scaled, (size_t) l->width * 4);
+    }
+    ok = ok && frame_renderer_push_texture(l->width, l->height, NULL, false, &l->tex);
+    if(ok) frame_renderer_texture_streaming(l->tex, true);
+  } else if(scaled) {
+    unsigned char *data = alloc_malloc(ALLOC_TAG_OTHER, (size_t) l->width * (size_t) l->height * 4);
+    if(data && image_decode_scaled_into(l->path, l->src_width, l->src_height, data, l->width, l->height)) {
+      load_cache_put(l, data);
+      ok = frame_renderer_push_texture(l->width, l->height, data, false, &l->tex);
+    }
+    alloc_free(data);
+  } else {
+    int width, height;
+    TRACE_BEGIN("stbi_load");
+    unsigned char *data = stbi_load(l->path, &width, &height, 0, 4);
+    TRACE_END("stbi_load");
+    if(data && width == l->width && height == l->height) {
+      load_cache_put(l, data);
+      ok = frame_renderer_push_texture(width, height, data, false, &l->tex);
+    }
+    alloc_free(data);
+  }
+  alloc_arena_end();
+  alloc_scope_end();
+  TRACE_END("image_decode");
+
+  if(!ok) {
+    load_steps_end();
+  }
+  return ok;
+}
+
+// Decodes strips for up to STEP_MS and pushes them, returns whether rows are left
+bool load_step() {
+  Load *l = &load;
+  if(!l->stepping) return false;
+
+  TRACE_BEGIN("load_step");
+  size_t row_size = (size_t) l->src_width * 4;
+  double start = frame_clock_ms();
+  do {
+    int rows;
+    if(l->is_qoi) {
+      rows = qoi_decoder_step(&l->qoi, STEP_ROWS, l->strip, (int) row_size);
+    } else {
+      rows = (int) pnm_decoder_step(&l->pnm, STEP_ROWS, l->strip, row_size);
+      if(l->pnm.reader.error) rows = 0; // keep what is there
+    }
+    if(rows == 0) {
+      l->rows = l->height;
+      break;
+    }
+    if(l->scaled) {
+      // push the rows of the target that are complete
+      downscale_rows(&l->scale, l->strip, rows, row_size);
+      int done = l->scale.dst_y;
+      if(done > l->rows) {
+	frame_renderer_push_to_texture(l->tex, l->scaled + (size_t) l->width * 4 * (size_t) l->rows,
+				       0, l->rows, l->width, done - l->rows);
+      }
+      l->rows = done;
+    } else {
+      frame_renderer_push_to_texture(l->tex, l->strip, 0, l->rows, l->width, rows);
+      l->rows += rows;
+    }
+  } while(l->rows < l->height && frame_clock_ms() - start < STEP_MS);
+  TRACE_END("load_step");
+
+  if(l->rows < l->height) return true;
+  if(l->scaled && l->scale.dst_y == l->height) load_cache_put(l, l->scaled);
+  load_steps_end();
+  return false;
+}
+
+// Images alternate between the two slots after ATLAS_TEX
+unsigned int load_slot() {
+  return (last_path != NULL && tex == ATLAS_TEX + 1) ? ATLAS_TEX + 2 : ATLAS_TEX + 1;
+}
+
+// With its mipmaps
+size_t texture_size(int width, int height) {
+  size_t size = (size_t) width * (size_t) height * 4;
+  return size + size / 3;
+}
+
+// Charges a texture of 'width' x 'height' in 'slot' in place of what the
+// slot held. If there is no room, the slot is freed.
+bool texture_reserve(unsigned int slot, int width, int height) {
+  budget_release(&budget, textures_client, texture_bytes[slot]);
+  texture_bytes[slot] = 0;
+  size_t size = texture_size(width, height);
+  if(!budget_reserve(&budget, textures_client, size)) {
+    frame_renderer_texture_free(slot);
+    return false;
+  }
+  texture_bytes[slot] = size;
+  return true;
+}
+
+// Frees the images that are neither on screen nor loading
+void textures_evict(void *user, size_t bytes) {
+  (void) user;
+  size_t freed = 0;
+  for(unsigned int i=ATLAS_TEX+1;i<FRAME_RENDERER_IMAGES_CAP && freed<bytes;i++) {
+    if(texture_bytes[i] == 0 || (last_path && i == tex)) continue;
+    if(load.active && (i == load.tex || i == PREVIEW_TEX)) continue;
+    frame_renderer_texture_free(i);
+    budget_release(&budget, textures_client, texture_bytes[i]);
+    freed += texture_bytes[i];
+    texture_bytes[i] = 0;
+  }
+}
+
+// The texture of the load, its upload buffer, the copy the caches get and
+// the 'peak' of the decode
+bool load_reserve(unsigned int slot, int width, int height, size_t peak) {
+  size_t size = (size_t) width * (size_t) height * 4 * 2 + peak;
+  if(!budget_reserve(&budget, decode_client, size)) return false;
+  if(!texture_reserve(slot, width, height)) {
+    budget_release(&budget, decode_client, size);
+    return false;
+  }
+  load.reserved = size;
+  return true;
+}
+
+void load_release() {
+  budget_release(&budget, decode_client, load.reserved);
+  load.reserved = 0;
+}
+
+// Very large images are shrunk to fit into 'side' x 'side'. With 'sharpen'
+// the load replaces the shown image, and is dropped unless the budget has
+// room for more of it than is shown.
+void load_file_side(const char *path, int side, bool sharpen) {
+
+  size_t path_len = strlen(path);
+  if(path_len >= PATH_CAP) {
+    fprintf(stderr, "ERROR: Path is too long '%s'\n", path); fflush(stderr);
+    return;
+  }
+
+  if(load.active) {
+    // the one in flight is not shown, it is skipped if it did not start yet
+    // and stops between rows otherwise
+    if(load.decoding) pool_cancel(&load.token);
+    memcpy(pending_path, path, path_len + 1);
+    pending_side = side;
+    has_pending = true;
+    return;
+  }
+
+  TRACE_BEGIN("load_file");
+  int src_width, src_height;
+  size_t peak;
+  if(!image_info_peak(path, &src_width, &src_height, &peak)) {
     fprintf(stderr, "ERROR: Can not open '%s'\n", path); fflush(stderr);
+    TRACE_END("load_file");
     return; 
   }
-  
-  last_path = path;
-  frame_set_title(&frame, path);
-  
-  frame_renderer.images_count = 0;
-  frame_renderer_push_texture(img_width, img_height, data, false, &tex);
 
-  free(data); // all libs use 'free'
+  // too large to hold, only the shrunk image is ever allocated
+  int width = src_width;
+  int height = src_height;
+  int max_side = frame_renderer.max_texture_size;
+  if(side > max_side) side = max_side;
+  if((long long) src_width * (long long) src_height > SCALE_ABOVE ||
+     src_width > max_side || src_height > max_side) {
+    downscale_fit(src_width, src_height, side, side, &width, &height);
+  }
+
+  // shrunk further while the budget has no room for it
+  int shown_side = sharpen ? (img_width > img_height ? img_width : img_height) : 0;
+  unsigned int slot = load_slot();
+  int fit_width = width;
+  size_t ram_limit = budget.limits[BUDGET_RAM];
+  while(!load_reserve(slot, width, height, peak)) {
+    // shrinking does not help a decode that alone is over the limit
+    int half = (width > height ? width : height) / 2;
+    if((width <= BUDGET_MIN_SIDE && height <= BUDGET_MIN_SIDE) || half <= shown_side ||
+       (ram_limit != 0 && peak >= ram_limit)) {
+      if(!sharpen) {
+	fprintf(stderr, "ERROR: No memory left for '%s'\n", path); fflush(stderr);
+      }
+      TRACE_END("load_file");
+      return;
+    }
+    downscale_fit(src_width, src_height, half, half, &width, &height);
+  }
+  if(width != fit_width) {
+    fprintf(stderr, "WARNING: Showing '%s' at %dx%d, the memory budget is exhausted\n", path, width, height); fflush(stderr);
+  }
+
+  memcpy(load.path, path, path_len + 1);
+  load.width = width;
+  load.height = height;
+  load.src_width = src_width;
+  load.src_height = src_height;
+  load.refit = !sharpen;
+  load.ok = false;
+  load.done = false;
+  thread_atomic_store(&load.token.cancelled, 0);
+  thread_atomic_store(&load.previews, 0);
+  load.previews_taken = 0;
+  load.previews_shown = 0;
+  load.preview_uploading = false;
+
+  // upload into the slot that is not on screen
+  frame_renderer.images_count = slot;
+  if(!cooperative) {
+    if(!frame_renderer_upload_begin(width, height, &load.tex, &load.pixels)) {
+      fprintf(stderr, "ERROR: Can not upload '%s'\n", path); fflush(stderr);
+      load_release();
+      TRACE_END("load_file");
+      return;
+    }
+
+    if(pool_submit(&pool, POOL_VISIBLE, load_job, load_done, &load, &load.token)) {
+      load.decoding = true;
+      load.active = true;
+      TRACE_END("load_file");
+      return;
+    }
+
+    fprintf(stderr, "WARNING: Can not queue the decode, decoding between frames\n"); fflush(stderr);
+    frame_renderer_upload_cancel(load.tex);
+    frame_renderer.images_count = load_slot();
+    cooperative = true;
+  }
+
+  if(!load_steps_begin()) {
+    fprintf(stderr, "ERROR: Can not open '%s'\n", path); fflush(stderr);
+    load_release();
+    TRACE_END("load_file");
+    return;
+  }
+  load.active = true;
+  load_show();
+  TRACE_END("load_file");
+}
+
+void load_file(const char *path) {
+  load_file_side(path, SCALED_SIZE, false);
+}
+
+// Zoomed in past the pixels of a shrunk image, loads it again at twice the
+// size or more, up to what a texture holds
+void load_sharpen() {
+  if(last_path == NULL || load.active || tex == PREVIEW_TEX) return;
+  int side = img_width > img_height ? img_width : img_height;
+  int src_side = img_src_width > img_src_height ? img_src_width : img_src_height;
+  if(side >= src_side || side >= frame_renderer.max_texture_size || view.zoom <= 1.f) return;
+
+  int want = side * 2;
+  while((float) want < (float) side * view.zoom && want < src_side) want *= 2;
+  if(want <= img_side_wanted) return; // the budget had no room for it
+  img_side_wanted = want;
+  load_file_side(last_path, want, true);
+}
+
+void load_finish() {
+  load.active = false;
+  load_release();
+  // the decode is over, nothing hands in previews anymore
+  if(load.preview_uploading) {
+    frame_renderer_upload_cancel(PREVIEW_TEX);
+    load.preview_uploading = false;
+  }
+  preview_free(load.preview, load.preview_width, load.preview_height);
+  preview_free(load.preview_spare, load.width, load.height);
+  load.preview = NULL;
+  load.preview_spare = NULL;
+  if(has_pending) {
+    has_pending = false;
+    load_file_side(pending_path, pending_side, false);
+  }
+}
+
+// Streams the newest approximation into PREVIEW_TEX, the first one is
+// shown once it is in
+void load_preview() {
+  if(load.preview_uploading) {
+    if(!frame_renderer_upload_done(PREVIEW_TEX)) return;
+    load.preview_uploading = false;
+    if(load.previews_shown == 0) {
+      load_show();
+      tex = PREVIEW_TEX;
+    }
+    load.previews_shown = load.previews_taken;
+  }
+
+  long previews = thread_atomic_load(&load.previews);
+  if(previews == load.previews_taken) return;
 
-  if(img_width > img_height) {
-    zoom = ((float) frame.width - 2 * PADDING) / (float) img_width;
+  TRACE_BEGIN("load_preview");
+  thread_mutex_lock(&load.preview_mutex);
+  unsigned char *preview = load.preview;
+  int width = load.preview_width;
+  int height = load.preview_height;
+  load.preview = NULL;
+  thread_mutex_unlock(&load.preview_mutex);
+
+  // drawn over the rectangle of the image, whatever its size
+  unsigned int index;
+  void *pixels;
+  frame_renderer.images_count = PREVIEW_TEX;
+  if(preview && texture_reserve(PREVIEW_TEX, width, height) &&
+     frame_renderer_upload_begin(width, height, &index, &pixels)) {
+    memcpy(pixels, preview, (size_t) width * (size_t) height * 4);
+    frame_renderer_upload_commit(index);
+    load.preview_uploading = true;
+  }
+  load.previews_taken = previews;
+
+  // back to the decode thread, for its next pass
+  thread_mutex_lock(&load.preview_mutex);
+  if(!load.preview_spare && width == load.width && height == load.height) {
+    load.preview_spare = preview;
+    preview = NULL;
+  }
+  thread_mutex_unlock(&load.preview_mutex);
+  preview_free(preview, width, height);
+  TRACE_END("load_preview");
+}
+
+void load_update() {
+  if(!load.active) return;
+
+  if(cooperative) {
+    if(!load_step()) load_finish();
+    return;
+  }
+
+  if(load.decoding) {
+    load_preview();
+    if(!load.done) return;
+    load.decoding = false;
+
+    last_load_allocs = load.allocs;
+    if(show_stats) {
+      printf("load '%s'\n", load.path);
+      for(int i=0;i<ALLOC_TAG_COUNT;i++) {
+	if(load.allocs.tags[i].allocs == 0) continue;
+	alloc_report(stdout, alloc_tag_name((Alloc_Tag) i), &load.allocs.tags[i]);
+      }
+      fflush(stdout);
+    }
+
+    if(!load.ok || pool_cancelled(&load.token)) {
+      if(!pool_cancelled(&load.token)) {
+	fprintf(stderr, "ERROR: Can not open '%s'\n", load.path); fflush(stderr);
+      }
+      frame_renderer_upload_cancel(load.tex);
+      load_finish();
+      return;
+    }
+    frame_renderer_upload_commit(load.tex);
+  }
+
+  if(!frame_renderer_upload_done(load.tex)) return;
+  if(load.previews_shown > 0) {
+    // keep the zoom and offset of the preview
+    TRACE_INSTANT("load_shown");
+    tex = load.tex;
+  } else {
+    load_show();
+  }
+  load_finish();
+}
+
+void cache_scan_job(void *arg, Pool_Token *token) {
+  (void) token;
+  trace_thread_name("worker");
+  TRACE_BEGIN("cache_scan");
+  cache_evict((Cache *) arg);
+  TRACE_END("cache_scan");
+}
+
+// Grid
+
+// A folder is shown as a grid of thumbnails. Jobs of the pool decode them in
+// the order of 'queue', which the main loop rebuilds from what is on screen,
+// and hand them back through 'done'. The main loop copies them into the atlas, whose
+// slots go to the thumbnails drawn least recently once it is full. Only as
+// many rows around the screen are queued as the atlas holds beside it, and
+// their slots are never taken.
+typedef enum{
+  THUMB_EMPTY = 0,
+  THUMB_DECODING,
+  THUMB_DONE, // 'pixels' wait for the atlas
+  THUMB_READY, // in the atlas at 'slot'
+  THUMB_FAILED,
+}Thumb_State;
+
+typedef struct{
+  char *path;
+  Thumb_State state;
+  int width, height;
+  unsigned char *pixels; // THUMB_SIZE * THUMB_SIZE * 4
+  int slot;
+}Thumb;
+
+typedef struct{
+  bool active;
+  char dir[PATH_CAP];
+  Thumb *thumbs;
+  int count;
+  float scroll; // pixels below the top of the grid
+
+  Thread_Mutex mutex; // of the states, 'queue', 'jobs' and 'done'
+  Pool_Token token;
+  int jobs; // in the pool
+  int *queue; // 'count'
+  int queue_count, queue_next;
+  int first_row, last_row; // on screen
+  int queue_first, queue_last, queue_columns; // rows it was built for
+  int keep_first, keep_last; // thumbs the queue was built from, their slots stay
+  bool requeue; // thumbnails went back to THUMB_EMPTY
+  bool refused; // under 'mutex', the budget had no room for a decode
+  int reserved; // under 'mutex', decodes holding a reservation of 'decode_client'
+  Thread_Cond released; // of 'reserved'
+  int *done; // 'count'
+  int done_count;
+
+  bool has_atlas;
+  unsigned int atlas;
+  int atlas_size;
+  int atlas_columns, atlas_slots;
+  int slots[ATLAS_SLOTS_MAX]; // thumb, or -1
+  long long slots_drawn[ATLAS_SLOTS_MAX]; // frame
+  long long frame;
+}Grid;
+
+Grid grid = {0};
+float grid_press_y = 0.f;
+float grid_scroll_start = 0.f;
+bool grid_drag = false;
+
+bool grid_is_image(const char *name) {
+  static const char *exts[] = {
+    "qoi", "png", "jpg", "jpeg", "bmp", "gif", "tga", "psd", "hdr", "pic",
+    "ppm", "pgm", "pbm", "pam", "pnm",
+  };
+  const char *dot = strrchr(name, '.');
+  if(!dot) return false;
+  for(size_t i=0;i<sizeof(exts)/sizeof(*exts);i++) {
+    const char *a = dot + 1;
+    const char *b = exts[i];
+    while(*a && *b && (*a | 0x20) == *b) { a++; b++; }
+    if(*a == 0 && *b == 0) return true;
+  }
+  return false;
+}
+
+int grid_compare(const void *a, const void *b) {
+  return strcmp(((const Thumb *) a)->path, ((const Thumb *) b)->path);
+}
+
+// From the cache if the file did not change since
+// THUMB_DONE, THUMB_FAILED, or THUMB_EMPTY if the budget has no room for it
+Thumb_State thumb_decode(const char *path, unsigned char *out, int *width, int *height) {
+  unsigned long long key;
+  bool cached = has_cache && cache_key(path, THUMB_SIZE, &key);
+  if(cached && cache_get(&cache, key, out, THUMB_SIZE * THUMB_SIZE * 4, width, height)) {
+    return THUMB_DONE;
+  }
+
+  // stb_image decodes the full size first. While other thumbnails hold
+  // their reservations it waits for them, alone it gives up.
+  int src_width, src_height;
+  size_t peak;
+  if(!image_info_peak(path, &src_width, &src_height, &peak)) return THUMB_FAILED;
+  thread_mutex_lock(&grid.mutex);
+  while(!budget_reserve(&budget, decode_client, peak)) {
+    if(grid.reserved == 0 || pool_cancelled(&grid.token)) {
+      thread_mutex_unlock(&grid.mutex);
+      return THUMB_EMPTY;
+    }
+    thread_cond_wait(&grid.released, &grid.mutex);
+  }
+  grid.reserved++;
+  thread_mutex_unlock(&grid.mutex);
+
+  bool ok = image_thumb(path, THUMB_SIZE, out, width, height);
+  budget_release(&budget, decode_client, peak);
+  thread_mutex_lock(&grid.mutex);
+  grid.reserved--;
+  thread_cond_broadcast(&grid.released);
+  thread_mutex_unlock(&grid.mutex);
+  if(!ok) return THUMB_FAILED;
+  if(cached) cache_put(&cache, key, out, *width, *height);
+  return THUMB_DONE;
+}
+
+// With 'grid.mutex' locked, the next thumbnail to decode or -1
+int grid_take() {
+  while(grid.queue_next < grid.queue_count) {
+    int index = grid.queue[grid.queue_next++];
+    if(grid.thumbs[index].state == THUMB_EMPTY) {
+      grid.thumbs[index].state = THUMB_DECODING;
+      return index;
+    }
+  }
+  return -1;
+}
+
+// False if the budget had no room for it, it is queued again with the next
+// queue
+bool grid_decode(int index) {
+  Thumb *t = &grid.thumbs[index];
+  int width = 0, height = 0;
+  TRACE_BEGIN("thumb_decode");
+  unsigned char *pixels = malloc(THUMB_SIZE * THUMB_SIZE * 4);
+  Thumb_State state = pixels ? thumb_decode(t->path, pixels, &width, &height) : THUMB_FAILED;
+  TRACE_END("thumb_decode");
+  if(state == THUMB_DONE) budget_charge(&budget, thumbs_client, THUMB_SIZE * THUMB_SIZE * 4);
+
+  thread_mutex_lock(&grid.mutex);
+  t->state = state;
+  if(state == THUMB_DONE) {
+    t->pixels = pixels;
+    t->width = width;
+    t->height = height;
   } else {
-    zoom = ((float) frame.height - 2 * PADDING) / (float) img_height;
+    free(pixels);
+  }
+  if(state == THUMB_EMPTY) grid.refused = true;
+  else grid.done[grid.done_count++] = index;
+  thread_mutex_unlock(&grid.mutex);
+  return state != THUMB_EMPTY;
+}
+
+// Decodes the next thumbnail of the queue and submits itself again, until
+// the queue is empty. One per job, so jobs of a higher priority go first.
+void grid_job(void *arg, Pool_Token *token) {
+  (void) arg;
+  trace_thread_name("worker");
+
+  thread_mutex_lock(&grid.mutex);
+  int index = grid_take();
+  if(index < 0) grid.jobs--;
+  thread_mutex_unlock(&grid.mutex);
+  if(index < 0) return;
+
+  if(grid_decode(index)) frame_request_redraw(&frame);
+  if(!pool_submit(&pool, POOL_THUMBNAIL, grid_job, NULL, NULL, token)) {
+    thread_mutex_lock(&grid.mutex);
+    grid.jobs--;
+    thread_mutex_unlock(&grid.mutex);
+  }
+}
+
+void grid_close() {
+  pool_cancel(&grid.token);
+  pool_wait(&pool, &grid.token);
+  thread_atomic_store(&grid.token.cancelled, 0);
+  grid.jobs = 0;
+
+  for(int i=0;i<grid.count;i++) {
+    free(grid.thumbs[i].path);
+    if(grid.thumbs[i].pixels) budget_release(&budget, thumbs_client, THUMB_SIZE * THUMB_SIZE * 4);
+    free(grid.thumbs[i].pixels);
+  }
+  for(int i=0;i<ATLAS_SLOTS_MAX;i++) {
+    grid.slots[i] = -1;
+    grid.slots_drawn[i] = 0;
+  }
+  free(grid.thumbs);
+  free(grid.queue);
+  free(grid.done);
+  grid.thumbs = NULL;
+  grid.queue = NULL;
+  grid.done = NULL;
+  grid.count = 0;
+  grid.queue_count = 0;
+  grid.queue_next = 0;
+  grid.done_count = 0;
+  grid.active = false;
+}
+
+float grid_cell() {
+  return (float) (THUMB_SIZE + THUMB_PADDING);
+}
+
+int grid_columns() {
+  int columns = (frame.width - THUMB_PADDING) / (THUMB_SIZE + THUMB_PADDING);
+  return columns < 1 ? 1 : columns;
+}
+
+// Cells on screen, with the rows cut at the top and the bottom
+int grid_visible() {
+  return grid_columns() * ((int) ((float) frame.height / grid_cell()) + 2);
+}
+
+// The cells of the screen and half a screen more fit, up to ATLAS_SIZE_MAX
+// and what a texture holds
+int grid_atlas_size() {
+  int max_size = frame_renderer.max_texture_size < ATLAS_SIZE_MAX ? frame_renderer.max_texture_size : ATLAS_SIZE_MAX;
+  int size = ATLAS_SIZE;
+  while(size * 2 <= max_size && (size / ATLAS_CELL) * (size / ATLAS_CELL) < 3 * grid_visible() / 2) size *= 2;
+  return size;
+}
+
+// The atlas keeps slot ATLAS_TEX, images go after it. Smaller ones are
+// tried while the budget has no room for it.
+bool grid_atlas() {
+  if(grid.has_atlas) return true;
+
+  for(int size=grid_atlas_size();size>=ATLAS_SIZE && !grid.has_atlas;size/=2) {
+    if(!budget_reserve(&budget, atlas_client, texture_size(size, size))) continue;
+
+    unsigned int count = frame_renderer.images_count;
+    frame_renderer.images_count = ATLAS_TEX;
+    grid.has_atlas = frame_renderer_push_texture(size, size, NULL, false, &grid.atlas);
+    frame_renderer.images_count = count > ATLAS_TEX + 1 ? count : ATLAS_TEX + 1;
+    if(!grid.has_atlas) {
+      budget_release(&budget, atlas_client, texture_size(size, size));
+      continue;
+    }
+    grid.atlas_size = size;
+    grid.atlas_columns = size / ATLAS_CELL;
+    grid.atlas_slots = grid.atlas_columns * grid.atlas_columns;
   }
-  y_off = 0.f;
-  x_off = 0.f;
-  initial_zoom = zoom;
+  return grid.has_atlas;
+}
+
+// Its thumbnails are decoded again
+void grid_atlas_free() {
+  thread_mutex_lock(&grid.mutex);
+  for(int i=0;i<grid.atlas_slots;i++) {
+    if(grid.slots[i] < 0) continue;
+    grid.thumbs[grid.slots[i]].state = THUMB_EMPTY;
+    grid.thumbs[grid.slots[i]].slot = -1;
+    grid.slots[i] = -1;
+  }
+  thread_mutex_unlock(&grid.mutex);
+  grid.requeue = true;
+
+  frame_renderer_texture_free(grid.atlas);
+  budget_release(&budget, atlas_client, texture_size(grid.atlas_size, grid.atlas_size));
+  grid.has_atlas = false;
+  grid.atlas_slots = 0;
+}
+
+// Frees the atlas while the grid is hidden, until it is back
+void atlas_evict(void *user, size_t bytes) {
+  (void) user;
+  (void) bytes;
+  if(grid.active || !grid.has_atlas) return;
+  grid_atlas_free();
+}
+
+bool grid_open(const char *dir) {
+  size_t dir_len = strlen(dir);
+  if(dir_len + 2 >= PATH_CAP) {
+    fprintf(stderr, "ERROR: Path is too long '%s'\n", dir); fflush(stderr);
+    return false;
+  }
+
+  grid_close();
+  memcpy(grid.dir, dir, dir_len + 1);
+#ifdef _WIN32
+  // io_dir_open globs 'dir/*' there
+  if(dir_len > 0 && grid.dir[dir_len - 1] != '/' && grid.dir[dir_len - 1] != '\\') {
+    grid.dir[dir_len++] = '/';
+    grid.dir[dir_len] = 0;
+  }
+#endif //_WIN32
+
+  TRACE_BEGIN("grid_open");
+  Io_Dir d;
+  if(!io_dir_open(&d, grid.dir)) {
+    fprintf(stderr, "ERROR: Can not open the folder '%s'\n", dir); fflush(stderr);
+    TRACE_END("grid_open");
+    return false;
+  }
+  int cap = 0;
+  Io_Dir_Entry entry;
+  while(io_dir_next(&d, &entry)) {
+    if(entry.is_dir || !grid_is_image(entry.name)) continue;
+    if(grid.count == cap) {
+      int new_cap = cap ? cap * 2 : 64;
+      Thumb *thumbs = realloc(grid.thumbs, sizeof(Thumb) * (size_t) new_cap);
+      if(!thumbs) break;
+      grid.thumbs = thumbs;
+      cap = new_cap;
+    }
+    char *path = malloc(strlen(entry.abs_name) + 1);
+    if(!path) break;
+    strcpy(path, entry.abs_name);
+    memset(&grid.thumbs[grid.count], 0, sizeof(Thumb));
+    grid.thumbs[grid.count].path = path;
+    grid.thumbs[grid.count].slot = -1;
+    grid.count++;
+  }
+  io_dir_close(&d);
+  if(grid.count > 0) qsort(grid.thumbs, (size_t) grid.count, sizeof(Thumb), grid_compare);
+
+  grid.queue = malloc(sizeof(int) * (size_t) (grid.count + 1));
+  grid.done = malloc(sizeof(int) * (size_t) (grid.count + 1));
+  if(!grid.queue || !grid.done) {
+    grid_close();
+    TRACE_END("grid_open");
+    return false;
+  }
+  grid.first_row = 0;
+  grid.last_row = -1;
+  grid.queue_first = -1;
+  grid.queue_last = -1;
+  grid.scroll = 0.f;
+
+  if(!grid_atlas()) {
+    fprintf(stderr, "ERROR: Can not create the thumbnail atlas\n"); fflush(stderr);
+    grid_close();
+    TRACE_END("grid_open");
+    return false;
+  }
+
+  grid.active = true;
+  frame_set_title(&frame, grid.dir);
+  TRACE_END("grid_open");
+  return true;
+}
+
+float grid_left(int columns) {
+  return floorf(((float) frame.width - (float) columns * grid_cell() + THUMB_PADDING) / 2);
+}
+
+// The thumbnail under 'mouse', or -1
+int grid_hit(Vec2f mouse) {
+  int columns = grid_columns();
+  float x = mouse.x - grid_left(columns);
+  float y = (float) frame.height - mouse.y + grid.scroll - THUMB_PADDING;
+  if(x < 0 || y < 0) return -1;
+  int column = (int) (x / grid_cell());
+  int row = (int) (y / grid_cell());
+  if(column >= columns ||
+     x - (float) column * grid_cell() >= THUMB_SIZE ||
+     y - (float) row * grid_cell() >= THUMB_SIZE) {
+    return -1;
+  }
+  int index = row * columns + column;
+  return index < grid.count ? index : -1;
+}
+
+// Rows on screen first, then up to a screen below and one above, as far as
+// the atlas holds them beside the screen
+void grid_queue(int first, int last, int columns) {
+  thread_mutex_lock(&grid.mutex);
+  if(grid.refused) grid.requeue = true;
+  grid.refused = false;
+  thread_mutex_unlock(&grid.mutex);
+  if(!grid.requeue && first == grid.queue_first && last == grid.queue_last && columns == grid.queue_columns) return;
+  grid.requeue = false;
+  grid.queue_first = first;
+  grid.queue_last = last;
+  grid.queue_columns = columns;
+
+  int rows = last - first + 1;
+  int spare = grid.atlas_slots / columns - rows;
+  if(spare < 0) spare = 0;
+  int below = spare < rows ? spare : rows;
+  int above = spare - below < rows ? spare - below : rows;
+  if(above > first) above = first;
+  grid.keep_first = (first - above) * columns;
+  grid.keep_last = (last + below + 1) * columns;
+
+  thread_mutex_lock(&grid.mutex);
+  grid.queue_count = 0;
+  grid.queue_next = 0;
+  for(int i=0;i<rows+below+above;i++) {
+    int row = i < rows+below ? first + i : first - (i - rows - below) - 1;
+    if(row < 0) continue;
+    for(int c=0;c<columns;c++) {
+      int index = row * columns + c;
+      if(index >= grid.count) break;
+      if(grid.thumbs[index].state == THUMB_EMPTY) grid.queue[grid.queue_count++] = index;
+    }
+  }
+
+  // leaves the other workers to the images
+  int workers = pool.workers_count < THUMB_WORKERS ? pool.workers_count : THUMB_WORKERS;
+  while(grid.jobs < workers && grid.queue_next < grid.queue_count) {
+    if(!pool_submit(&pool, POOL_THUMBNAIL, grid_job, NULL, NULL, &grid.token)) break;
+    grid.jobs++;
+  }
+  thread_mutex_unlock(&grid.mutex);
+}
+
+// A free slot, else the one drawn longest ago that is neither on screen
+// nor queued around it
+int grid_slot() {
+  int best = -1;
+  for(int i=0;i<grid.atlas_slots;i++) {
+    if(grid.slots[i] < 0) return i;
+    if(grid.slots_drawn[i] >= grid.frame - 1) continue;
+    if(grid.slots[i] >= grid.keep_first && grid.slots[i] < grid.keep_last) continue;
+    if(best < 0 || grid.slots_drawn[i] < grid.slots_drawn[best]) best = i;
+  }
+  return best;
+}
+
+// Copies up to THUMB_UPLOADS finished thumbnails into the atlas
+void grid_upload() {
+  TRACE_BEGIN("grid_upload");
+  thread_mutex_lock(&grid.mutex);
+  bool full = false;
+  for(int uploads=0;grid.done_count>0 && uploads<THUMB_UPLOADS;uploads++) {
+    int index = grid.done[grid.done_count - 1];
+    Thumb *t = &grid.thumbs[index];
+    if(t->state != THUMB_DONE) {
+      grid.done_count--;
+      continue;
+    }
+
+    int slot = grid_slot();
+    bool kept = index >= grid.keep_first && index < grid.keep_last;
+    if(slot < 0 && kept) {
+      // every slot is on screen or queued around it, wait for a scroll
+      full = true;
+      break;
+    }
+    grid.done_count--;
+    if(slot < 0) {
+      // scrolled away while it was decoded, decoded again once it is back
+      t->state = THUMB_EMPTY;
+    } else {
+      if(grid.slots[slot] >= 0) {
+	// outside of the queue, decoded again once it scrolls back in
+	Thumb *old = &grid.thumbs[grid.slots[slot]];
+	old->state = THUMB_EMPTY;
+	old->slot = -1;
+	grid.slots[slot] = -1;
+      }
+      int x = (slot % grid.atlas_columns) * ATLAS_CELL + 1;
+      int y = (slot / grid.atlas_columns) * ATLAS_CELL + 1;
+      if(frame_renderer_push_to_texture(grid.atlas, t->pixels, x, y, t->width, t->height)) {
+	t->state = THUMB_READY;
+	t->slot = slot;
+	grid.slots[slot] = index;
+	grid.slots_drawn[slot] = grid.frame;
+      } else {
+	t->state = THUMB_FAILED;
+      }
+    }
+    budget_release(&budget, thumbs_client, THUMB_SIZE * THUMB_SIZE * 4);
+    free(t->pixels);
+    t->pixels = NULL;
+  }
+  bool more = !full && grid.done_count > 0;
+  thread_mutex_unlock(&grid.mutex);
+  TRACE_END("grid_upload");
+
+  if(more) frame_request_redraw(&frame);
+}
+
+void grid_update() {
+  // a larger screen than the atlas was made for
+  if(grid.has_atlas && grid_atlas_size() > grid.atlas_size) grid_atlas_free();
+  if(!grid_atlas()) return;
+
+  int columns = grid_columns();
+  int rows = (grid.count + columns - 1) / columns;
+  float height = (float) rows * grid_cell() + THUMB_PADDING;
+  float max_scroll = height - (float) frame.height;
+  if(grid.scroll > max_scroll) grid.scroll = max_scroll;
+  if(grid.scroll < 0) grid.scroll = 0;
+
+  int first = (int) ((grid.scroll - THUMB_PADDING) / grid_cell());
+  int last = (int) ((grid.scroll + (float) frame.height) / grid_cell());
+  if(first < 0) first = 0;
+  if(last > rows - 1) last = rows - 1;
+  grid.first_row = first;
+  grid.last_row = last;
+  grid_queue(first, last, columns);
+
+  if(pool.workers_count == 0) {
+    // without workers, decode between frames
+    double start = frame_clock_ms();
+    int index;
+    do {
+      index = grid_take();
+      if(index >= 0) grid_decode(index);
+    } while(index >= 0 && frame_clock_ms() - start < STEP_MS);
+    if(index >= 0) frame_request_redraw(&frame);
+  }
+
+  grid_upload();
+}
+
+void grid_draw(Vec2f mouse) {
+  int columns = grid_columns();
+  float left = grid_left(columns);
+  int hover = grid_drag ? -1 : grid_hit(mouse);
+
+  // the workers write the states
+  thread_mutex_lock(&grid.mutex);
+  for(int row=grid.first_row;row<=grid.last_row;row++) {
+    for(int c=0;c<columns;c++) {
+      int index = row * columns + c;
+      if(index >= grid.count) break;
+      Thumb *t = &grid.thumbs[index];
+      Vec2f pos = vec2f(left + (float) c * grid_cell(),
+			floorf((float) frame.height - THUMB_PADDING - (float) row * grid_cell() + grid.scroll) - THUMB_SIZE);
+
+      if(index == hover) {
+	frame_renderer_solid_rect(vec2f(pos.x - BORDER_PADDING, pos.y - BORDER_PADDING),
+				  vec2f(THUMB_SIZE + 2 * BORDER_PADDING, THUMB_SIZE + 2 * BORDER_PADDING), WHITE);
+      }
+      float shade = t->state == THUMB_FAILED ? .3f : .15f;
+      frame_renderer_solid_rect(pos, vec2f(THUMB_SIZE, THUMB_SIZE), vec4f(shade, .15f, .15f, 1));
+      if(t->state != THUMB_READY) continue;
+
+      int sx = (t->slot % grid.atlas_columns) * ATLAS_CELL + 1;
+      int sy = (t->slot / grid.atlas_columns) * ATLAS_CELL + 1;
+      float size = (float) grid.atlas_size;
+      Vec2f p = vec2f(pos.x + (float) ((THUMB_SIZE - t->width) / 2),
+		      pos.y + (float) ((THUMB_SIZE - t->height) / 2));
+      frame_renderer_texture_filter(grid.atlas, 1);
+      frame_renderer_texture(grid.atlas, p, vec2f((float) t->width, (float) t->height),
+			     vec2f((float) sx / size, 1.f - (float) (sy + t->height) / size),
+			     vec2f((float) t->width / size, (float) t->height / size));
+      grid.slots_drawn[t->slot] = grid.frame;
+    }
+  }
+  thread_mutex_unlock(&grid.mutex);
+  grid.frame++;
+}
+
+void alloc_hud(Vec2f pos, float scale) {
+  Alloc_Stats total;
+  alloc_stats(ALLOC_TAG_COUNT, &total);
+  const Alloc_Stats *l = &last_load_allocs.total;
+
+  char buf[64];
+  float line = 7 * scale;
+  frame_renderer_solid_rect(vec2f(pos.x, pos.y - 2 * line - 4 * scale),
+			    vec2f(128 * scale + 4 * scale, 2 * line + 4 * scale), vec4f(0, 0, 0, .6f));
+
+  int n = snprintf(buf, sizeof(buf), "HEAP %.1f MB PEAK %.1f MB",
+		   (double) total.live / (1024 * 1024), (double) total.peak / (1024 * 1024));
+  frame_renderer_debug_text(buf, (size_t) n, vec2f(pos.x + 2 * scale, pos.y - line - scale), scale, WHITE);
+  n = snprintf(buf, sizeof(buf), "LOAD %lld ALLOCS PEAK %.1f MB",
+	       l->allocs, (double) l->peak / (1024 * 1024));
+  frame_renderer_debug_text(buf, (size_t) n, vec2f(pos.x + 2 * scale, pos.y - 2 * line - scale), scale, WHITE);
 }
 
 int main(int argc, char **argv) {
  
-  if(!frame_init(&frame, 800, 800, argv[0], FRAME_DRAG_N_DROP)) {
+  if(!frame_init(&frame, 800, 800, argv[0], FRAME_DRAG_N_DROP | FRAME_EVENT_DRIVEN)) {
     return 1;
   }
 
-  if(argc > 1) {
-    load_file(argv[1]);
+  // VIEWER_TRACE=viewer.json records until exit
+  const char *trace_path = getenv("VIEWER_TRACE");
+  if(trace_path) {
+    trace_thread_name("main");
+    trace_start();
+  }
+
+  const char *csv_path = getenv("VIEWER_TIMING_CSV");
+  if(csv_path) {
+    timing_csv = fopen(csv_path, "wb");
+    if(timing_csv) frame_timing_csv_header(timing_csv);
+  }
+
+  const char *path = NULL;
+  bool no_cache = false;
+  unsigned long long ram_mb = RAM_BUDGET_MB;
+  unsigned long long vram_mb = VRAM_BUDGET_MB;
+  for(int i=1;i<argc;i++) {
+    if(strcmp(argv[i], "--stats") == 0) {
+      show_stats = true;
+    } else if(strcmp(argv[i], "--no-threads") == 0) {
+      cooperative = true;
+    } else if(strcmp(argv[i], "--no-cache") == 0) {
+      no_cache = true;
+    } else if(strcmp(argv[i], "--ram") == 0 && i + 1 < argc) {
+      ram_mb = strtoull(argv[++i], NULL, 10); // 0 for no limit
+    } else if(strcmp(argv[i], "--vram") == 0 && i + 1 < argc) {
+      vram_mb = strtoull(argv[++i], NULL, 10);
+    } else if(!path) {
+      path = argv[i];
+    }
+  }
+  budget_init(&budget, (size_t) (ram_mb << 20), (size_t) (vram_mb << 20));
+  arena_client = budget_register(&budget, "decode arena", BUDGET_RAM, 0, arena_evict, &load);
+  ram_cache_client = budget_register(&budget, "ram cache", BUDGET_RAM, 1, ram_cache_evict, &ram_cache);
+  thumbs_client = budget_register(&budget, "thumbnails", BUDGET_RAM, 2, NULL, NULL);
+  decode_client = budget_register(&budget, "decode", BUDGET_RAM, 3, NULL, NULL);
+  cache_jobs_client = budget_register(&budget, "cache jobs", BUDGET_RAM, 3, NULL, NULL);
+  atlas_client = budget_register(&budget, "atlas", BUDGET_VRAM, 0, atlas_evict, NULL);
+  textures_client = budget_register(&budget, "textures", BUDGET_VRAM, 1, textures_evict, NULL);
+  thread_mutex_init(&load.preview_mutex);
+  thread_mutex_init(&load.arena_mutex);
+  thread_mutex_init(&grid.mutex);
+  thread_cond_init(&grid.released);
+  load.arena.keep = ARENA_KEEP;
+  pool_init(&pool, cooperative ? 0 : thread_cpu_count(), redraw, NULL);
+  if(!cooperative && pool.workers_count == 0) {
+    fprintf(stderr, "WARNING: Can not start a worker thread, decoding between frames\n"); fflush(stderr);
+    cooperative = true;
+  }
+#ifdef FRAME_SOFTWARE
+  frame_renderer_software_pool(&pool);
+#endif //FRAME_SOFTWARE
+  if(!no_cache && !(has_cache = cache_open(&cache, "viewer", CACHE_BYTES))) {
+    fprintf(stderr, "WARNING: Can not open the thumbnail cache\n"); fflush(stderr);
+  }
+  // reads the size of every file in it
+  if(has_cache && (cooperative || !pool_submit(&pool, POOL_MAINTENANCE, cache_scan_job, NULL, &cache, NULL))) {
+    cache_evict(&cache);
+  }
+  if(!no_cache) {
+    ram_cache_init(&ram_cache, RAM_CACHE_BYTES);
+    has_ram_cache = true;
+  }
+  bool is_file;
+  if(path && io_exists(path, &is_file) && !is_file) {
+    grid_open(path);
+  } else if(path) {
+    load_file(path);
   }
 
   ///////////////////////////////////////////////////////////////////////////
   
 
-  float DT = 1000.f / 60.f;
   float last_click = 0.f;
   Frame_Event event;
   while(frame.running) {
     Vec2f mouse;
-    frame_get_mouse_position(&frame, &mouse.x, &mouse.y);
       
     while(frame_peek(&frame, &event)) {
+      // 'frame_peek' may have been waiting, read the mouse after waking up
+      frame_get_mouse_position(&frame, &mouse.x, &mouse.y);
 
       switch(event.type) {
 
       case FRAME_EVENT_MOUSEWHEEL: {
-	zoom += 0.025f * (float) event.as.amount;
+	if(grid.active) {
+	  grid.scroll -= grid_cell() * (float) event.as.amount;
+	} else {
+	  view_wheel(&view, event.as.amount);
+	}
       } break;
 
       case FRAME_EVENT_MOUSEPRESS: {
-	if(last_click > 0.0f) {
+	if(grid.active) {
+	  grid_press_y = mouse.y;
+	  grid_scroll_start = grid.scroll;
+	  grid_drag = true;
+	} else if(last_click > 0.0f) {
 	  frame_toggle_fullscreen(&frame);
 	  last_click = 0.f;
 	} else {
 	  last_click = FRAME_DOUBLE_CLICK_TIME_MS;
-	  y_start = mouse.y - y_off;
-	  y_drag = true;
-	  x_start = mouse.x - x_off;
-	  x_drag = true;
+	  view_press(&view, mouse.x, mouse.y);
 	}
       } break;
 
       case FRAME_EVENT_MOUSERELEASE: {
-	y_drag = false;
-	x_drag = false;
+	view_release(&view);
+	if(grid.active && grid_drag) {
+	  grid_drag = false;
+	  // a click, not a scroll, opens the image
+	  int index = fabsf(mouse.y - grid_press_y) < 4 ? grid_hit(mouse) : -1;
+	  if(index >= 0) {
+	    grid.active = false;
+	    load_file(grid.thumbs[index].path);
+	    if(last_path) frame_set_title(&frame, last_path);
+	  }
+	}
       } break;
       case FRAME_EVENT_KEYPRESS: {
 
@@ -121,10 +1612,18 @@ int main(int argc, char **argv) {
 	case 'b': {
 	  show_border = !show_border;
 	} break;
+	case 'h': {
+	  show_hud = !show_hud;
+	} break;
+	case 'g': {
+	  if(grid.count > 0 && (grid.active || grid_atlas())) {
+	    grid.active = !grid.active;
+	    grid_drag = false;
+	    frame_set_title(&frame, grid.active || !last_path ? grid.dir : last_path);
+	  }
+	} break;
 	case 'r': {
-	  zoom = initial_zoom;
-	  x_off = 0.f;
-	  y_off = 0.f;
+	  view_reset(&view);
 	} break;
 	case 'q': {
 	  frame.running = false;
@@ -147,7 +1646,12 @@ int main(int argc, char **argv) {
 	if(frame_dragged_files_init(&files, &event)) {
 	  char *path;
 	  if(frame_dragged_files_next(&files, &path)) {
-	    load_file(path);
+	    if(io_exists(path, &is_file) && !is_file) {
+	      grid_open(path);
+	    } else {
+	      grid.active = false;
+	      load_file(path);
+	    }
 	  }
 
 	  frame_dragged_files_free(&files);
@@ -160,23 +1664,32 @@ int main(int argc, char **argv) {
       
     }
 
-    if(y_drag) {
-      y_off = mouse.y - y_start;
-    }
-    if(x_drag) {
-      x_off = mouse.x - x_start;
+    frame_get_mouse_position(&frame, &mouse.x, &mouse.y);
+
+    frame_phase(FRAME_PHASE_DECODE);
+    pool_poll(&pool);
+    load_update();
+    frame_phase(FRAME_PHASE_BATCH);
+    if(load.active && !load.decoding) {
+      // keep streaming the upload
+      frame_request_redraw(&frame);
     }
 
-    float target_width = (float) img_width * zoom;
-    float target_height = (float) img_height * zoom;    
+    if(grid_drag) {
+      grid.scroll = grid_scroll_start + mouse.y - grid_press_y;
+    }
+    view_drag(&view, mouse.x, mouse.y);
+    if(!grid.active) load_sharpen();
 
-    if(last_path != NULL) {
+    if(grid.active) {
+      grid_update();
+      grid_draw(mouse);
+    } else if(last_path != NULL) {
       float ratio =  (float) img_width / (float) img_height;
       (void) ratio;
 
-      Vec2f pos = vec2f((float) frame.width/2 - target_width/2 + x_off,
-			(float) frame.height/2 - target_height/2 + y_off);
-      Vec2f size = vec2f(target_width, target_height);
+      Vec2f pos, size;
+      view_rect(&view, frame.width, frame.height, img_width, img_height, &pos.x, &pos.y, &size.x, &size.y);
 
       if(show_border) {
 	frame_renderer_solid_rect(vec2f(pos.x - BORDER_PADDING,
@@ -186,13 +1699,65 @@ int main(int argc, char **argv) {
 				  WHITE);     	
       }
       
+      // a preview may have fewer pixels than the image
+      frame_renderer_texture_filter(tex, view.zoom * (float) img_width / (float) frame_renderer.images[tex].width);
       frame_renderer_texture(tex, pos, size, vec2f(0, 0), vec2f(1, 1));   
     }
 
-    last_click -= DT;
+    if(show_hud) {
+      float height = frame_renderer_hud(vec2f(8, (float) frame.height - 8), 2);
+      alloc_hud(vec2f(8, (float) frame.height - 8 - height), 2);
+      // keep the numbers moving, without drawing every frame only for them
+      frame_schedule_redraw(&frame, HUD_REFRESH_MS);
+    }
+
+    last_click -= (float) frame.dt;
     frame_swap_buffers(&frame);    
+
+    Frame_Timing timing;
+    if(timing_csv && frame_timing(&timing, 1)) {
+      frame_timing_csv(timing_csv, &timing);
+    }
   }
 
+  pool_cancel(&load.token);
+  pool_wait(&pool, &load.token);
+  load_steps_end();
+  grid_close();
+#ifdef FRAME_SOFTWARE
+  frame_renderer_software_pool(NULL);
+#endif //FRAME_SOFTWARE
+  pool_free(&pool);
+  thread_cond_free(&grid.released);
+  thread_mutex_free(&grid.mutex);
+  if(has_cache) cache_close(&cache);
+  if(has_ram_cache) {
+    if(show_stats) {
+      printf("ram cache: %lld hits, %lld misses, %lld kept as QOI, %lld raw, %.1f of %.1f MB\n",
+	     ram_cache.hits, ram_cache.misses, ram_cache.puts_qoi, ram_cache.puts_raw,
+	     (double) ram_cache.bytes_kept / (1024 * 1024), (double) ram_cache.bytes_in / (1024 * 1024));
+    }
+    ram_cache_free(&ram_cache);
+  }
+  if(show_stats) budget_report(&budget, stdout);
+  budget_free(&budget);
+  alloc_arena_free(&load.arena);
+  thread_mutex_free(&load.preview_mutex);
+  thread_mutex_free(&load.arena_mutex);
+  free(load.preview);
+  free(load.preview_spare);
+  if(timing_csv) fclose(timing_csv);
+  if(show_stats) {
+    for(int i=0;i<=ALLOC_TAG_COUNT;i++) {
+      Alloc_Stats stats;
+      alloc_stats((Alloc_Tag) i, &stats);
+      if(stats.allocs == 0 && i != ALLOC_TAG_COUNT) continue;
+      alloc_report(stdout, alloc_tag_name((Alloc_Tag) i), &stats);
+    }
+  }
+  if(trace_path && !trace_write(trace_path)) {
+    fprintf(stderr, "ERROR: Can not write the trace '%s'\n", trace_path); fflush(stderr);
+  }
   frame_free(&frame);
   
   return 0;
@@ -30,6 +30,11 @@ typedef unsigned long long int Pnm_u64;
 #  define PNM_FREE free
 #endif // PNM_FREE
 
+#ifndef PNM_TRACE_BEGIN
+#  define PNM_TRACE_BEGIN(name)
+#  define PNM_TRACE_END(name)
+#endif // PNM_TRACE_BEGIN
+
 #if defined(PNM_MALLOC) && defined(PNM_FREE)
 // ok
 #elif !defined(PNM_MALLOC) && !defined(PNM_FREE)
@@ -43,6 +48,10 @@ typedef unsigned long long int Pnm_u64;
 #    include <windows.h>
 typedef HANDLE Pnm_Fd;
 #  else // linux
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/stat.h>
+typedef int Pnm_Fd;
 #  endif // _WIN32
 #endif // PNM_NO_STDIO
 
@@ -126,8 +135,26 @@ PNM_DEF int pnm_reader_parse_pam_tupletype(Pnm_Reader *r);
 PNM_DEF u32 pnm_reader_parse_cstr_u32(Pnm_Reader *r, const char *cstr);
 
 PNM_DEF void pnm_reader_relayout(Pnm_Reader *r, u32 width, u32 height, u32 channels, u8 *target, u32 desired_channels);
+// Rows of 'target' start 'target_stride' bytes apart, with 'flip' the last one first
+PNM_DEF void pnm_reader_relayout_rows(Pnm_Reader *r, u32 width, u32 height, u32 channels, u8 *target, u32 desired_channels, u64 target_stride, int flip);
 PNM_DEF int pnm_reader_info(Pnm_Reader *r, int *width, int *height, int *channels);
 PNM_DEF void *pnm_reader_decode(Pnm_Reader *r, int *width, int *height, int *channels, int desired_channels);
+// 'out' holds 'height' rows of 'out_stride' in its 'out_size' bytes. A stride
+// of 0 packs them at width * desired_channels, see 'pnm_reader_relayout_rows'
+PNM_DEF void *pnm_reader_decode_into(Pnm_Reader *r, int *width, int *height, int *channels, int desired_channels, void *out, u64 out_size, u64 out_stride, int flip);
+
+// A decode that is resumed row by row. Set up 'reader' as for 'pnm_reader_decode',
+// then 'pnm_decoder_begin' reads the header. It is done once 'y' reaches 'height'.
+typedef struct{
+  Pnm_Reader reader;
+  u32 width, height, channels;
+  u32 desired_channels;
+  u32 y;
+}Pnm_Decoder;
+
+PNM_DEF int pnm_decoder_begin(Pnm_Decoder *d, int desired_channels);
+// Decodes up to 'rows' of the next rows into 'out', 'out_stride' bytes apart. Returns how many
+PNM_DEF u32 pnm_decoder_step(Pnm_Decoder *d, u32 rows, void *out, u64 out_stride);
 
 typedef struct{
   Pnm_Error error;
@@ -156,7 +183,10 @@ PNM_DEF void pnm_writer_encode(Pnm_Writer *w, int width, int height, int comp, c
 #ifndef PNM_NO_STDIO
 PNM_DEF int pnm_info(const char *filepath, int *width, int *height, int *channels);
 PNM_DEF void *pnm_load(const char *filepath, int *width, int *height, int *channels, int desired_channels);
+PNM_DEF void *pnm_load_into(const char *filepath, int *width, int *height, int *channels, int desired_channels, void *out, u64 out_size, u64 out_stride, int flip);
 PNM_DEF int pnm_write(const char *filepath, int width, int height, int comp, const void *data);
+PNM_DEF int pnm_decoder_open(Pnm_Decoder *d, const char *filepath, int desired_channels);
+PNM_DEF void pnm_decoder_close(Pnm_Decoder *d);
 #endif // PNM_NO_STDIO
 
 PNM_DEF int pnm_info_from_memory(const unsigned char *data, u64 data_len, int *width, int *height, int *channels);
@@ -217,7 +247,33 @@ PNM_DEF int pnm_file_init(Pnm_File *f, const char *filepath, int for_reading) {
   }
   
 #else // linux
-  return 0;
+  if(for_reading) {
+    f->fd = open(filepath, O_RDONLY);
+    if(f->fd < 0) {
+      return 0;
+    }
+
+    struct stat st;
+    if(fstat(f->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+      close(f->fd);
+      return 0;
+    }
+
+    f->len = (u64) st.st_size;
+    f->pos = 0;
+
+    return 1;
+  } else {
+    f->fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(f->fd < 0) {
+      return 0;
+    }
+
+    f->pos = 0;
+    f->len = 0;
+
+    return 1;
+  }
   
 #endif // _WIN32
 }
@@ -227,6 +283,7 @@ PNM_DEF void pnm_file_free(Pnm_File *f) {
   CloseHandle(f->fd);
 
 #else // linux
+  close(f->fd);
   
 #endif // _WIN32
 }
@@ -238,6 +295,7 @@ PNM_DEF int pnm_info(const char *filepath, int *width, int *height, int *channel
   }
   reader.mode = PNM_MODE_FILE;
   reader.error = PNM_ERROR_NONE;
+  reader.buf_len = 0;
 
   int result = pnm_reader_info(&reader, width, height, channels);
   pnm_file_free(&reader.as.file);
@@ -253,6 +311,7 @@ PNM_DEF void *pnm_load(const char *filepath, int *width, int *height, int *chann
   }
   reader.mode = PNM_MODE_FILE;
   reader.error = PNM_ERROR_NONE;
+  reader.buf_len = 0;
   
   unsigned char *data = pnm_reader_decode(&reader, width, height, channels, desired_channels);  
   pnm_file_free(&reader.as.file);
@@ -260,6 +319,46 @@ PNM_DEF void *pnm_load(const char *filepath, int *width, int *height, int *chann
   return data;
 }
 
+PNM_DEF void *pnm_load_into(const char *filepath, int *width, int *height, int *channels, int desired_channels, void *out, u64 out_size, u64 out_stride, int flip) {
+
+  Pnm_Reader reader;
+  if(!pnm_file_init(&reader.as.file, filepath, 1)) {
+    return NULL;
+  }
+  reader.mode = PNM_MODE_FILE;
+  reader.error = PNM_ERROR_NONE;
+  reader.buf_len = 0;
+
+  void *data = pnm_reader_decode_into(&reader, width, height, channels, desired_channels, out, out_size, out_stride, flip);
+  pnm_file_free(&reader.as.file);
+
+  return data;
+}
+
+PNM_DEF int pnm_decoder_open(Pnm_Decoder *d, const char *filepath, int desired_channels) {
+
+  if(!pnm_file_init(&d->reader.as.file, filepath, 1)) {
+    return 0;
+  }
+  d->reader.mode = PNM_MODE_FILE;
+  d->reader.error = PNM_ERROR_NONE;
+  d->reader.buf_len = 0;
+
+  if(!pnm_decoder_begin(d, desired_channels)) {
+    pnm_file_free(&d->reader.as.file);
+    return 0;
+  }
+
+  return 1;
+}
+
+PNM_DEF void pnm_decoder_close(Pnm_Decoder *d) {
+  if(d->reader.mode == PNM_MODE_FILE) {
+    pnm_file_free(&d->reader.as.file);
+  }
+  d->reader.mode = PNM_MODE_NONE;
+}
+
 PNM_DEF int pnm_write(const char *filepath, int width, int height, int comp, const void *data) {
   Pnm_Writer writer;
   if(!pnm_file_init(&writer.as.file, filepath, 0)) {
@@ -380,6 +479,20 @@ PNM_DEF u8 pnm_reader_u8(Pnm_Reader *r) {
       r->buf_len = (u64) read;
       
 #else // linux
+      ssize_t n = read(f->fd, r->buf, (size_t) remaining);
+      if(n < 0) {
+	r->error = PNM_ERROR_IO;
+	return 0;
+      }
+      if(n == 0) {
+	r->error = PNM_ERROR_EOF;
+	return 0;
+      }
+      f->pos += (u64) n;
+
+      r->buf_off = 0;
+      r->buf_len = (u64) n;
+      
 #endif //_WIN32
     }
 
@@ -565,13 +678,16 @@ PNM_DEF int pnm_reader_parse_pam_tupletype(Pnm_Reader *r) {
 }
 
 PNM_DEF void pnm_reader_relayout(Pnm_Reader *r, u32 width, u32 height, u32 channels, u8 *target, u32 desired_channels) {
+  pnm_reader_relayout_rows(r, width, height, channels, target, desired_channels, (u64) width * desired_channels, 0);
+}
+
+static void pnm_reader_relayout_row(Pnm_Reader *r, u32 width, u32 channels, u8 *row, u32 desired_channels) {
 
   u64 target_off = 0;
 
   u8 red, blu, gre, alp;
   red = blu = gre = alp = 0;
-  for(u32 i=0;i<width*height;i++) {
-
+  for(u32 x=0;x<width;x++) {
     red = pnm_reader_u8(r);
 
     if(channels > 1) {
@@ -605,30 +721,36 @@ PNM_DEF void pnm_reader_relayout(Pnm_Reader *r, u32 width, u32 height, u32 chann
 
     switch(desired_channels) {
     case 1: {
-      target[target_off++] = grey;
+      row[target_off++] = grey;
     } break;
     case 2: {
-      target[target_off++] = grey;
-      target[target_off++] = alp;
+      row[target_off++] = grey;
+      row[target_off++] = alp;
     } break;
     case 3: {
-      target[target_off++] = red;
-      target[target_off++] = blu;
-      target[target_off++] = gre;
+      row[target_off++] = red;
+      row[target_off++] = blu;
+      row[target_off++] = gre;
     } break;
     case 4: {
-      target[target_off++] = red;
-      target[target_off++] = blu;
-      target[target_off++] = gre;
-      target[target_off++] = alp;
+      row[target_off++] = red;
+      row[target_off++] = blu;
+      row[target_off++] = gre;
+      row[target_off++] = alp;
     } break;
-      
+
     }
-    
   }
   
 }
 
+PNM_DEF void pnm_reader_relayout_rows(Pnm_Reader *r, u32 width, u32 height, u32 channels, u8 *target, u32 desired_channels, u64 target_stride, int flip) {
+  for(u32 y=0;y<height;y++) {
+    u8 *row = target + target_stride * (flip ? height - 1 - y : y);
+    pnm_reader_relayout_row(r, width, channels, row, desired_channels);
+  }
+}
+
 PNM_DEF int pnm_reader_info_impl(Pnm_Reader *r, u32 *width, u32 *height, u32 *channels) {
   u8 p = pnm_reader_u8(r);
   if(r->error) return 0;
@@ -686,6 +808,37 @@ PNM_DEF int pnm_reader_info_impl(Pnm_Reader *r, u32 *width, u32 *height, u32 *ch
   return r->error == 0;
 }
 
+PNM_DEF int pnm_decoder_begin(Pnm_Decoder *d, int desired_channels) {
+
+  if(desired_channels < 1 || desired_channels > 4) {
+    d->reader.error = PNM_ERROR_INVALID_INPUT;
+    return 0;
+  }
+
+  if(!pnm_reader_info_impl(&d->reader, &d->width, &d->height, &d->channels)) {
+    // error will already be set
+    return 0;
+  }
+  d->desired_channels = (u32) desired_channels;
+  d->y = 0;
+
+  return 1;
+}
+
+PNM_DEF u32 pnm_decoder_step(Pnm_Decoder *d, u32 rows, void *out, u64 out_stride) {
+  if(rows > d->height - d->y) rows = d->height - d->y;
+
+  PNM_TRACE_BEGIN("pnm_reader_decode");
+  for(u32 y=0;y<rows;y++) {
+    pnm_reader_relayout_row(&d->reader, d->width, d->channels,
+			    (u8 *) out + out_stride * y, d->desired_channels);
+  }
+  PNM_TRACE_END("pnm_reader_decode");
+
+  d->y += rows;
+  return rows;
+}
+
 PNM_DEF int pnm_reader_info(Pnm_Reader *r, int *out_width, int *out_height, int *out_channels) {
 
   u32 width, height, channels;
@@ -719,9 +872,14 @@ PNM_DEF void *pnm_reader_decode(Pnm_Reader *r, int *out_width, int *out_height,
     return NULL;
   }
 
+  PNM_TRACE_BEGIN("pnm_reader_decode");
   pnm_reader_relayout(r, width, height, channels,
 		      data, (u32) desired_channels);
-  if(r->error) return NULL;
+  PNM_TRACE_END("pnm_reader_decode");
+  if(r->error) {
+    PNM_FREE(data);
+    return NULL;
+  }
 
   if(out_width) *out_width = (int) width;
   if(out_height) *out_height = (int) height;
@@ -730,6 +888,40 @@ PNM_DEF void *pnm_reader_decode(Pnm_Reader *r, int *out_width, int *out_height,
   return data;
 }
 
+PNM_DEF void *pnm_reader_decode_into(Pnm_Reader *r, int *out_width, int *out_height, int *out_channels, int desired_channels, void *out, u64 out_size, u64 out_stride, int flip) {
+
+  if(desired_channels < 1 || desired_channels > 4 || !out) {
+    r->error = PNM_ERROR_INVALID_INPUT;
+    return NULL;
+  }
+
+  u32 width, height, channels;
+  if(!pnm_reader_info_impl(r, &width, &height, &channels)) {
+    // error will already be set
+    return NULL;
+  }
+
+  u64 row_size = (u64) width * (u64) desired_channels;
+  if(out_stride == 0) out_stride = row_size;
+  if(width == 0 || height == 0 || out_stride < row_size ||
+     out_stride * (u64) (height - 1) + row_size > out_size) {
+    r->error = PNM_ERROR_INVALID_INPUT;
+    return NULL;
+  }
+
+  PNM_TRACE_BEGIN("pnm_reader_decode");
+  pnm_reader_relayout_rows(r, width, height, channels,
+			   (u8 *) out, (u32) desired_channels, out_stride, flip);
+  PNM_TRACE_END("pnm_reader_decode");
+  if(r->error) return NULL;
+
+  if(out_width) *out_width = (int) width;
+  if(out_height) *out_height = (int) height;
+  if(out_channels) *out_channels = (int) channels;
+
+  return out;
+}
+
 PNM_DEF void pnm_writer_flush(Pnm_Writer *w) {
   if(w->error) return;
   
@@ -738,12 +930,24 @@ PNM_DEF void pnm_writer_flush(Pnm_Writer *w) {
 
     Pnm_File *f = &w->as.file;
 
+#ifdef _WIN32
     DWORD written;
     if(!WriteFile(f->fd, w->buf, (DWORD) w->buf_len, &written, NULL) ||
        (u64) written != w->buf_len) {
       w->error = PNM_ERROR_IO;
       return;
     }
+#else // linux
+    u64 off = 0;
+    while(off < w->buf_len) {
+      ssize_t n = write(f->fd, w->buf + off, (size_t) (w->buf_len - off));
+      if(n <= 0) {
+	w->error = PNM_ERROR_IO;
+	return;
+      }
+      off += (u64) n;
+    }
+#endif // _WIN32
 
     w->buf_len = 0;
   } break;
@@ -0,0 +1,394 @@
+#ifndef POOL_H
+#define POOL_H
+
+// Runs the jobs of the whole program on one worker per core. Every worker
+// has a deque per priority. A job submitted from a worker goes onto its own
+// deque, one from any other thread onto the next worker's in turn. Workers
+// take the newest job of their own and steal the oldest of the others, the
+// highest priority first.
+//
+//   Pool p;
+//   pool_init(&p, thread_cpu_count(), notify, NULL);
+//   Pool_Token t = {0};
+//   pool_submit(&p, POOL_VISIBLE, decode, decoded, image, &t);
+//   ...
+//   pool_poll(&p); // every frame, runs 'decoded' on this thread
+//   ...
+//   pool_cancel(&t);
+//   pool_wait(&p, &t);
+//   pool_free(&p);
+//
+// A job whose token was cancelled before it started is skipped, one that runs
+// polls 'pool_cancelled'. Either way its 'done' is queued for 'pool_poll',
+// which the main loop calls, and 'notify' is called from the worker to wake
+// it. Uses thread.h, include it first.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef POOL_DEF
+#  define POOL_DEF static inline
+#endif //POOL_DEF
+
+#define POOL_WORKERS_CAP 16
+
+typedef enum{
+  POOL_VISIBLE = 0, // the image on screen
+  POOL_PREFETCH,
+  POOL_THUMBNAIL,
+  POOL_MAINTENANCE, // of caches
+  POOL_PRIORITY_COUNT,
+}Pool_Priority;
+
+// Shared by any number of jobs, zero initialized
+typedef struct{
+  Thread_Atomic cancelled;
+  Thread_Atomic pending; // submitted and not queued for 'pool_poll' yet
+}Pool_Token;
+
+typedef void (*Pool_Function)(void *arg, Pool_Token *token);
+// On the thread of 'pool_poll', 'cancelled' if 'function' was skipped
+typedef void (*Pool_Done)(void *arg, bool cancelled);
+typedef void (*Pool_Notify)(void *user);
+
+typedef struct{
+  Pool_Function function;
+  Pool_Done done;
+  void *arg;
+  Pool_Token *token;
+  bool cancelled;
+}Pool_Job;
+
+// A ring of 'cap' jobs from 'head' on
+typedef struct{
+  Pool_Job *jobs;
+  size_t cap, head, count;
+}Pool_Deque;
+
+typedef struct Pool Pool;
+
+typedef struct{
+  Thread thread;
+  Pool *pool;
+  int index;
+  Thread_Mutex mutex; // of 'deques'
+  Pool_Deque deques[POOL_PRIORITY_COUNT];
+  Thread_Atomic ran, stolen;
+}Pool_Worker;
+
+struct Pool{
+  Pool_Worker workers[POOL_WORKERS_CAP];
+  int workers_count; // 0 runs everything in 'pool_help'
+  Thread_Atomic next; // worker of the next submit from outside
+  Thread_Atomic queued; // in the deques
+
+  Thread_Mutex mutex; // of the rest
+  Thread_Cond wake;
+  int sleeping;
+  Thread_Cond finished; // a token may have no jobs left
+  Thread_Atomic waiting; // in 'pool_wait'
+  bool quit;
+  Pool_Job *completed;
+  size_t completed_count, completed_cap;
+  size_t completing; // jobs with a 'done' that hold a slot of 'completed'
+  Pool_Notify notify;
+  void *user;
+};
+
+// Starts up to 'workers' threads, fewer if they can not be started
+POOL_DEF void pool_init(Pool *p, int workers, Pool_Notify notify, void *user);
+// The workers finish what is queued first, cancel the tokens to skip it.
+// Without workers, it is dropped.
+POOL_DEF void pool_free(Pool *p);
+
+// Fails only without memory, a 'done' is run once the job is. 'done' and
+// 'token' may be NULL.
+POOL_DEF bool pool_submit(Pool *p, Pool_Priority priority, Pool_Function function, Pool_Done done, void *arg, Pool_Token *token);
+// Runs the 'done' of the finished jobs, returns how many
+POOL_DEF int pool_poll(Pool *p);
+// Runs one job on the calling thread, fails if there is none
+POOL_DEF bool pool_help(Pool *p);
+// Until every job of 'token' is done, their 'done' is left to 'pool_poll'.
+// Without workers, it runs the jobs itself.
+POOL_DEF void pool_wait(Pool *p, Pool_Token *token);
+
+POOL_DEF void pool_cancel(Pool_Token *token);
+POOL_DEF bool pool_cancelled(Pool_Token *token);
+
+#ifdef POOL_IMPLEMENTATION
+
+#ifdef _MSC_VER
+#  define POOL_THREAD_LOCAL __declspec(thread)
+#else
+#  define POOL_THREAD_LOCAL __thread
+#endif //_MSC_VER
+
+static POOL_THREAD_LOCAL Pool_Worker *pool_self = NULL;
+
+static bool pool_deque_push(Pool_Deque *d, const Pool_Job *job) {
+  if(d->count == d->cap) {
+    size_t cap = d->cap ? d->cap * 2 : 64;
+    Pool_Job *jobs = malloc(sizeof(Pool_Job) * cap);
+    if(!jobs) return false;
+    for(size_t i=0;i<d->count;i++) {
+      jobs[i] = d->jobs[(d->head + i) % d->cap];
+    }
+    free(d->jobs);
+    d->jobs = jobs;
+    d->cap = cap;
+    d->head = 0;
+  }
+  d->jobs[(d->head + d->count) % d->cap] = *job;
+  d->count++;
+  return true;
+}
+
+static bool pool_deque_pop_newest(Pool_Deque *d, Pool_Job *job) {
+  if(d->count == 0) return false;
+  d->count--;
+  *job = d->jobs[(d->head + d->count) % d->cap];
+  return true;
+}
+
+static bool pool_deque_pop_oldest(Pool_Deque *d, Pool_Job *job) {
+  if(d->count == 0) return false;
+  *job = d->jobs[d->head];
+  d->head = (d->head + 1) % d->cap;
+  d->count--;
+  return true;
+}
+
+// For 'self', or for a thread that is no worker if it is NULL
+static bool pool_take(Pool *p, Pool_Worker *self, Pool_Job *job) {
+  if(thread_atomic_load(&p->queued) == 0) return false;
+
+  int count = p->workers_count > 0 ? p->workers_count : 1;
+  int start = self ? self->index : 0;
+  for(int priority=0;priority<POOL_PRIORITY_COUNT;priority++) {
+    for(int i=0;i<count;i++) {
+      Pool_Worker *w = &p->workers[(start + i) % count];
+      thread_mutex_lock(&w->mutex);
+      bool ok = w == self
+	? pool_deque_pop_newest(&w->deques[priority], job)
+	: pool_deque_pop_oldest(&w->deques[priority], job);
+      thread_mutex_unlock(&w->mutex);
+      if(!ok) continue;
+
+      thread_atomic_add(&p->queued, -1);
+      if(self) {
+	thread_atomic_add(&self->ran, 1);
+	if(w != self) thread_atomic_add(&self->stolen, 1);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// The slot of 'completed' of a job with a 'done', with the mutex held
+static bool pool_reserve_completed(Pool *p) {
+  if(p->completed_count + p->completing == p->completed_cap) {
+    size_t cap = p->completed_cap ? p->completed_cap * 2 : 64;
+    Pool_Job *completed = realloc(p->completed, sizeof(Pool_Job) * cap);
+    if(!completed) return false;
+    p->completed = completed;
+    p->completed_cap = cap;
+  }
+  p->completing++;
+  return true;
+}
+
+static void pool_run(Pool *p, Pool_Job *job) {
+  job->cancelled = job->token && pool_cancelled(job->token);
+  if(!job->cancelled) job->function(job->arg, job->token);
+
+  // into the slot reserved by 'pool_submit'
+  if(job->done) {
+    thread_mutex_lock(&p->mutex);
+    p->completed[p->completed_count++] = *job;
+    p->completing--;
+    thread_mutex_unlock(&p->mutex);
+  }
+
+  // the last access to the token, it may be reused from here on. 'pool_wait'
+  // counts itself in 'waiting' and checks 'pending' with the mutex held before
+  // it sleeps.
+  if(job->token && thread_atomic_add(&job->token->pending, -1) == 1 &&
+     thread_atomic_load(&p->waiting) > 0) {
+    thread_mutex_lock(&p->mutex);
+    thread_cond_broadcast(&p->finished);
+    thread_mutex_unlock(&p->mutex);
+  }
+  if(job->done && p->notify) p->notify(p->user);
+}
+
+static void *pool_worker(void *arg) {
+  Pool_Worker *w = (Pool_Worker *) arg;
+  Pool *p = w->pool;
+  pool_self = w;
+
+  Pool_Job job;
+  while(true) {
+    if(pool_take(p, w, &job)) {
+      pool_run(p, &job);
+      continue;
+    }
+
+    thread_mutex_lock(&p->mutex);
+    while(!p->quit && thread_atomic_load(&p->queued) == 0) {
+      p->sleeping++;
+      thread_cond_wait(&p->wake, &p->mutex);
+      p->sleeping--;
+    }
+    bool quit = p->quit;
+    thread_mutex_unlock(&p->mutex);
+    if(quit) break;
+  }
+
+  pool_self = NULL;
+  return NULL;
+}
+
+POOL_DEF void pool_init(Pool *p, int workers, Pool_Notify notify, void *user) {
+  memset(p, 0, sizeof(*p));
+  p->notify = notify;
+  p->user = user;
+  thread_mutex_init(&p->mutex);
+  thread_cond_init(&p->wake);
+  thread_cond_init(&p->finished);
+  for(int i=0;i<POOL_WORKERS_CAP;i++) {
+    p->workers[i].pool = p;
+    p->workers[i].index = i;
+    thread_mutex_init(&p->workers[i].mutex);
+  }
+
+  // the workers sleep until the first submit, only then they read the count
+  if(workers > POOL_WORKERS_CAP) workers = POOL_WORKERS_CAP;
+  for(int i=0;i<workers;i++) {
+    if(!thread_create(&p->workers[i].thread, pool_worker, &p->workers[i])) break;
+    p->workers_count++;
+  }
+}
+
+POOL_DEF void pool_free(Pool *p) {
+  thread_mutex_lock(&p->mutex);
+  p->quit = true;
+  thread_cond_broadcast(&p->wake);
+  thread_mutex_unlock(&p->mutex);
+  for(int i=0;i<p->workers_count;i++) {
+    thread_join(&p->workers[i].thread);
+  }
+
+  Pool_Job job;
+  for(int i=0;i<POOL_WORKERS_CAP;i++) {
+    Pool_Worker *w = &p->workers[i];
+    for(int priority=0;priority<POOL_PRIORITY_COUNT;priority++) {
+      while(pool_deque_pop_oldest(&w->deques[priority], &job)) {
+	if(job.token) thread_atomic_add(&job.token->pending, -1);
+      }
+      free(w->deques[priority].jobs);
+    }
+    thread_mutex_free(&w->mutex);
+  }
+  free(p->completed);
+  thread_cond_free(&p->finished);
+  thread_cond_free(&p->wake);
+  thread_mutex_free(&p->mutex);
+}
+
+POOL_DEF bool pool_submit(Pool *p, Pool_Priority priority, Pool_Function function, Pool_Done done, void *arg, Pool_Token *token) {
+  if((int) priority < 0 || priority >= POOL_PRIORITY_COUNT) return false;
+
+  Pool_Job job = {function, done, arg, token, false};
+  Pool_Worker *w = pool_self;
+  if(!w || w->pool != p) {
+    int count = p->workers_count > 0 ? p->workers_count : 1;
+    w = &p->workers[(unsigned long) thread_atomic_add(&p->next, 1) % (unsigned long) count];
+  }
+
+  if(done) {
+    thread_mutex_lock(&p->mutex);
+    bool reserved = pool_reserve_completed(p);
+    thread_mutex_unlock(&p->mutex);
+    if(!reserved) return false;
+  }
+
+  if(token) thread_atomic_add(&token->pending, 1);
+  thread_mutex_lock(&w->mutex);
+  bool ok = pool_deque_push(&w->deques[priority], &job);
+  thread_mutex_unlock(&w->mutex);
+  if(!ok) {
+    if(token) thread_atomic_add(&token->pending, -1);
+    if(done) {
+      thread_mutex_lock(&p->mutex);
+      p->completing--;
+      thread_mutex_unlock(&p->mutex);
+    }
+    return false;
+  }
+  thread_atomic_add(&p->queued, 1);
+
+  // a worker checks 'queued' with the mutex held before it sleeps
+  thread_mutex_lock(&p->mutex);
+  if(p->sleeping > 0) thread_cond_signal(&p->wake);
+  thread_mutex_unlock(&p->mutex);
+  return true;
+}
+
+POOL_DEF int pool_poll(Pool *p) {
+  thread_mutex_lock(&p->mutex);
+  size_t count = p->completed_count;
+  thread_mutex_unlock(&p->mutex);
+  if(count == 0) return 0;
+
+  // the slots stay with the array, a 'done' may submit again and move it but
+  // the first 'count' keep their place
+  for(size_t i=0;i<count;i++) {
+    thread_mutex_lock(&p->mutex);
+    Pool_Job job = p->completed[i];
+    thread_mutex_unlock(&p->mutex);
+    job.done(job.arg, job.cancelled);
+  }
+
+  thread_mutex_lock(&p->mutex);
+  p->completed_count -= count;
+  memmove(p->completed, p->completed + count, sizeof(Pool_Job) * p->completed_count);
+  thread_mutex_unlock(&p->mutex);
+  return (int) count;
+}
+
+POOL_DEF bool pool_help(Pool *p) {
+  Pool_Job job;
+  Pool_Worker *self = pool_self && pool_self->pool == p ? pool_self : NULL;
+  if(!pool_take(p, self, &job)) return false;
+  pool_run(p, &job);
+  return true;
+}
+
+POOL_DEF void pool_wait(Pool *p, Pool_Token *token) {
+  // with workers, helping could take up a long job of another token
+  if(p->workers_count == 0) {
+    while(thread_atomic_load(&token->pending) > 0 && pool_help(p));
+  }
+
+  thread_mutex_lock(&p->mutex);
+  thread_atomic_add(&p->waiting, 1);
+  while(thread_atomic_load(&token->pending) > 0) {
+    thread_cond_wait(&p->finished, &p->mutex);
+  }
+  thread_atomic_add(&p->waiting, -1);
+  thread_mutex_unlock(&p->mutex);
+}
+
+POOL_DEF void pool_cancel(Pool_Token *token) {
+  thread_atomic_store(&token->cancelled, 1);
+}
+
+POOL_DEF bool pool_cancelled(Pool_Token *token) {
+  return token && thread_atomic_load(&token->cancelled) != 0;
+}
+
+#endif //POOL_IMPLEMENTATION
+
+#endif //POOL_H
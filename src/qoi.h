@@ -247,6 +247,31 @@ typedef struct {
 	unsigned char colorspace;
 } qoi_desc;
 
+typedef union {
+	struct { unsigned char r, g, b, a; } rgba;
+	unsigned int v;
+} qoi_rgba_t;
+
+/* The state of a decode that is resumed row by row, see qoi_decoder_step. The
+encoded data has to stay valid until the last row. After qoi_decoder_open only a
+window of the file is held, refilled as the rows advance. */
+
+typedef struct {
+	const unsigned char *bytes;
+	int size;
+	int p;
+	int run;
+	qoi_rgba_t index[64];
+	qoi_rgba_t px;
+	qoi_desc desc;
+	int channels;
+	unsigned int y;
+	void *owned;
+	void *file;
+	int eof;
+	int cap;
+} qoi_decoder;
+
 #ifndef QOI_NO_STDIO
 
 /* Encode raw RGB or RGBA pixels into a QOI image and write it to the file
@@ -271,6 +296,31 @@ The returned pixel data should be free()d after use. */
 
 void *qoi_read(const char *filename, qoi_desc *desc, int channels);
 
+
+/* Read only the header of a QOI file. This is cheap enough to size output
+buffers before the actual decode.
+
+The function returns 0 on failure (fopen failed or not a valid QOI header)
+and 1 on success, in which case the qoi_desc struct is filled. */
+
+int qoi_info(const char *filename, qoi_desc *desc);
+
+
+/* Open a QOI file for qoi_decoder_step. The file is read as the rows are
+decoded, through a buffer of about 64 KB or 5 bytes per pixel of a row, whichever
+is larger. The decoder owns the file and the buffer until qoi_decoder_free.
+
+The function returns 0 on failure (fopen or malloc failed or not a valid QOI
+header) and 1 on success, in which case dec->desc is filled. */
+
+int qoi_decoder_open(qoi_decoder *dec, const char *filename, int channels);
+
+
+/* Like qoi_read, but decode into a buffer of out_size bytes. See
+qoi_decode_into. */
+
+void *qoi_read_into(const char *filename, qoi_desc *desc, int channels, void *out, int out_size, int out_stride, int flip);
+
 #endif /* QOI_NO_STDIO */
 
 
@@ -285,6 +335,15 @@ The returned qoi data should be free()d after use. */
 void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len);
 
 
+/* Encode into a buffer of out_size bytes instead.
+
+Returns the size in bytes of the encoded data, or 0 on invalid parameters
+or when it does not fit. Gives up as soon as it runs out of room, so a small
+buffer also tells cheaply that an image does not compress well. */
+
+int qoi_encode_into(const void *data, const qoi_desc *desc, void *out, int out_size);
+
+
 /* Decode a QOI image from memory.
 
 The function either returns NULL on failure (invalid parameters or malloc
@@ -296,6 +355,39 @@ The returned pixel data should be free()d after use. */
 void *qoi_decode(const void *data, int size, qoi_desc *desc, int channels);
 
 
+/* Decode a QOI image from memory into a buffer of out_size bytes.
+
+Rows start out_stride bytes apart, 0 packs them at width * channels. With
+flip set, the last row is written first, at the start of out.
+
+The function returns NULL on failure (invalid parameters or out_size is too
+small for height rows of out_stride) or out. */
+
+void *qoi_decode_into(const void *data, int size, qoi_desc *desc, int channels, void *out, int out_size, int out_stride, int flip);
+
+
+/* Start a decode of QOI data in memory, that is advanced by
+qoi_decoder_step.
+
+The function returns 0 on failure (invalid parameters or header) and 1 on
+success, in which case dec->desc is filled. */
+
+int qoi_decoder_init(qoi_decoder *dec, const void *data, int size, int channels);
+
+
+/* Decode up to rows of the next rows into out, out_stride bytes apart. The
+decode is done once dec->y reaches dec->desc.height.
+
+The function returns the number of rows written. */
+
+int qoi_decoder_step(qoi_decoder *dec, int rows, void *out, int out_stride);
+
+
+/* Release the file and buffer of qoi_decoder_open. */
+
+void qoi_decoder_free(qoi_decoder *dec);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -316,6 +408,10 @@ Implementation */
 #ifndef QOI_ZEROARR
 	#define QOI_ZEROARR(a) memset((a),0,sizeof(a))
 #endif
+#ifndef QOI_TRACE_BEGIN
+	#define QOI_TRACE_BEGIN(name)
+	#define QOI_TRACE_END(name)
+#endif
 
 #define QOI_OP_INDEX  0x00 /* 00xxxxxx */
 #define QOI_OP_DIFF   0x40 /* 01xxxxxx */
@@ -338,11 +434,6 @@ pixel, rounded down to a nice clean value. 400 million pixels ought to be
 enough for anybody. */
 #define QOI_PIXELS_MAX ((unsigned int)400000000)
 
-typedef union {
-	struct { unsigned char r, g, b, a; } rgba;
-	unsigned int v;
-} qoi_rgba_t;
-
 static const unsigned char qoi_padding[8] = {0,0,0,0,0,0,0,1};
 
 static void qoi_write_32(unsigned char *bytes, int *p, unsigned int v) {
@@ -360,9 +451,9 @@ static unsigned int qoi_read_32(const unsigned char *bytes, int *p) {
 	return a << 24 | b << 16 | c << 8 | d;
 }
 
-void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len) {
-	int i, max_size, p, run;
-	int px_len, px_end, px_pos, channels;
+int qoi_encode_into(const void *data, const qoi_desc *desc, void *out, int out_size) {
+	int i, p, p_max, run;
+	int px_len, px_end, px_pos;
 	unsigned char *bytes;
 	const unsigned char *pixels;
 	qoi_rgba_t index[64];
@@ -374,25 +465,24 @@ void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len) {
 	}
 
 	if (
-		data == NULL || out_len == NULL || desc == NULL ||
+		data == NULL || out == NULL || desc == NULL ||
 		desc->width == 0 || desc->height == 0 ||
 		desc->channels < 1 ||
 		desc_channels < 3 || desc_channels > 4 ||
 		desc->colorspace > 1 ||
 		desc->height >= QOI_PIXELS_MAX / desc->width
 	) {
-		return NULL;
+		return 0;
 	}
 
-	max_size =
-		desc->width * desc->height * (desc_channels + 1) +
-		QOI_HEADER_SIZE + sizeof(qoi_padding);
+	if (out_size < QOI_HEADER_SIZE + (int)sizeof(qoi_padding)) {
+		return 0;
+	}
 
 	p = 0;
-	bytes = (unsigned char *) QOI_MALLOC(max_size);
-	if (!bytes) {
-		return NULL;
-	}
+	bytes = (unsigned char *)out;
+	/* room for a run, the largest op and the padding */
+	p_max = out_size - 6 - (int)sizeof(qoi_padding);
 
 	qoi_write_32(bytes, &p, QOI_MAGIC);
 	qoi_write_32(bytes, &p, desc->width);
@@ -413,9 +503,11 @@ void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len) {
 
 	px_len = desc->width * desc->height * desc->channels;
 	px_end = px_len - desc->channels;
-	channels = desc_channels;
 	
 	for (px_pos = 0; px_pos < px_len; px_pos += desc->channels) {
+		if (p > p_max) {
+			return 0;
+		}
 
 	       switch(desc->channels) {
 	       case 1: {
@@ -511,25 +603,54 @@ void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len) {
 		bytes[p++] = qoi_padding[i];
 	}
 
-	*out_len = p;
+	return p;
+}
+
+void *qoi_encode(const void *data, const qoi_desc *desc, int *out_len) {
+	int max_size;
+	unsigned char *bytes;
+
+	int desc_channels = desc->channels;
+	if(desc->channels < 3) {
+	  desc_channels += 2;
+	}
+
+	if (
+		data == NULL || out_len == NULL || desc == NULL ||
+		desc->width == 0 || desc->height == 0 ||
+		desc->channels < 1 ||
+		desc_channels < 3 || desc_channels > 4 ||
+		desc->colorspace > 1 ||
+		desc->height >= QOI_PIXELS_MAX / desc->width
+	) {
+		return NULL;
+	}
+
+	/* with the room qoi_encode_into checks for past the last pixel */
+	max_size =
+		desc->width * desc->height * (desc_channels + 1) +
+		QOI_HEADER_SIZE + sizeof(qoi_padding) + 6;
+
+	bytes = (unsigned char *) QOI_MALLOC(max_size);
+	if (!bytes) {
+		return NULL;
+	}
+
+	*out_len = qoi_encode_into(data, desc, bytes, max_size);
 	return bytes;
 }
 
-void *qoi_decode(const void *data, int size, qoi_desc *desc, int channels) {
+static int qoi_decode_header(const void *data, int size, qoi_desc *desc, int channels) {
 	const unsigned char *bytes;
 	unsigned int header_magic;
-	unsigned char *pixels;
-	qoi_rgba_t index[64];
-	qoi_rgba_t px;
-	int px_len, chunks_len, px_pos;
-	int p = 0, run = 0;
+	int p = 0;
 
 	if (
 		data == NULL || desc == NULL ||
 		(channels != 0 && channels != 3 && channels != 4) ||
 		size < QOI_HEADER_SIZE + (int)sizeof(qoi_padding)
 	) {
-		return NULL;
+		return 0;
 	}
 
 	bytes = (const unsigned char *)data;
@@ -547,75 +668,204 @@ void *qoi_decode(const void *data, int size, qoi_desc *desc, int channels) {
 		header_magic != QOI_MAGIC ||
 		desc->height >= QOI_PIXELS_MAX / desc->width
 	) {
-		return NULL;
+		return 0;
 	}
 
 	if (channels == 0) {
 		channels = desc->channels;
 	}
 
-	px_len = desc->width * desc->height * channels;
-	pixels = (unsigned char *) QOI_MALLOC(px_len);
-	if (!pixels) {
-		return NULL;
+	return desc->width * desc->height * channels;
+}
+
+int qoi_decoder_init(qoi_decoder *dec, const void *data, int size, int channels) {
+	if (dec == NULL || !qoi_decode_header(data, size, &dec->desc, channels)) {
+		return 0;
 	}
 
-	QOI_ZEROARR(index);
-	px.rgba.r = 0;
-	px.rgba.g = 0;
-	px.rgba.b = 0;
-	px.rgba.a = 255;
-
-	chunks_len = size - (int)sizeof(qoi_padding);
-	for (px_pos = 0; px_pos < px_len; px_pos += channels) {
-		if (run > 0) {
-			run--;
-		}
-		else if (p < chunks_len) {
-			int b1 = bytes[p++];
+	dec->bytes = (const unsigned char *)data;
+	dec->size = size;
+	dec->p = QOI_HEADER_SIZE;
+	dec->run = 0;
+	QOI_ZEROARR(dec->index);
+	dec->px.rgba.r = 0;
+	dec->px.rgba.g = 0;
+	dec->px.rgba.b = 0;
+	dec->px.rgba.a = 255;
+	dec->channels = channels == 0 ? dec->desc.channels : channels;
+	dec->y = 0;
+	dec->owned = NULL;
+	dec->file = NULL;
+	dec->eof = 1;
+	dec->cap = size;
+	return 1;
+}
 
-			if (b1 == QOI_OP_RGB) {
-				px.rgba.r = bytes[p++];
-				px.rgba.g = bytes[p++];
-				px.rgba.b = bytes[p++];
-			}
-			else if (b1 == QOI_OP_RGBA) {
-				px.rgba.r = bytes[p++];
-				px.rgba.g = bytes[p++];
-				px.rgba.b = bytes[p++];
-				px.rgba.a = bytes[p++];
-			}
-			else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
-				px = index[b1];
-			}
-			else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
-				px.rgba.r += ((b1 >> 4) & 0x03) - 2;
-				px.rgba.g += ((b1 >> 2) & 0x03) - 2;
-				px.rgba.b += ( b1       & 0x03) - 2;
-			}
-			else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
-				int b2 = bytes[p++];
-				int vg = (b1 & 0x3f) - 32;
-				px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
-				px.rgba.g += vg;
-				px.rgba.b += vg - 8 +  (b2       & 0x0f);
+#ifndef QOI_NO_STDIO
+#include <stdio.h>
+
+/* Move the unread tail of the window to its start and read up to the end */
+static void qoi_decoder_refill(qoi_decoder *dec) {
+	unsigned char *window = (unsigned char *)dec->owned;
+	int left = dec->size - dec->p;
+	int n;
+
+	memmove(window, window + dec->p, left);
+	n = (int)fread(window + left, 1, dec->cap - left, (FILE *)dec->file);
+	dec->size = left + n;
+	dec->p = 0;
+	if (n < dec->cap - left) {
+		dec->eof = 1;
+	}
+}
+#endif /* QOI_NO_STDIO */
+
+int qoi_decoder_step(qoi_decoder *dec, int rows, void *out, int out_stride) {
+	const unsigned char *bytes;
+	unsigned char *pixels;
+	qoi_rgba_t *index = dec->index;
+	qoi_rgba_t px = dec->px;
+	int channels = dec->channels;
+	int row_len = dec->desc.width * channels;
+	int p = dec->p, run = dec->run;
+	int px_pos, y, chunks_len;
+
+	if (rows > (int)(dec->desc.height - dec->y)) {
+		rows = (int)(dec->desc.height - dec->y);
+	}
+
+	QOI_TRACE_BEGIN("qoi_decode");
+	for (y = 0; y < rows; y++) {
+#ifndef QOI_NO_STDIO
+		/* A row takes at most 5 bytes per pixel, refill before one could run
+		past the window. Until the end of the file the whole window is chunks. */
+		if (!dec->eof && dec->size - p < (int)dec->desc.width * 5) {
+			dec->p = p;
+			qoi_decoder_refill(dec);
+			p = dec->p;
+		}
+#endif /* QOI_NO_STDIO */
+		chunks_len = dec->eof ? dec->size - (int)sizeof(qoi_padding) : dec->size;
+		bytes = dec->bytes;
+		pixels = (unsigned char *)out + (long long)out_stride * y;
+		for (px_pos = 0; px_pos < row_len; px_pos += channels) {
+			if (run > 0) {
+				run--;
 			}
-			else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
-				run = (b1 & 0x3f);
+			else if (p < chunks_len) {
+				int b1 = bytes[p++];
+
+				if (b1 == QOI_OP_RGB) {
+					px.rgba.r = bytes[p++];
+					px.rgba.g = bytes[p++];
+					px.rgba.b = bytes[p++];
+				}
+				else if (b1 == QOI_OP_RGBA) {
+					px.rgba.r = bytes[p++];
+					px.rgba.g = bytes[p++];
+					px.rgba.b = bytes[p++];
+					px.rgba.a = bytes[p++];
+				}
+				else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX) {
+					px = index[b1];
+				}
+				else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF) {
+					px.rgba.r += ((b1 >> 4) & 0x03) - 2;
+					px.rgba.g += ((b1 >> 2) & 0x03) - 2;
+					px.rgba.b += ( b1       & 0x03) - 2;
+				}
+				else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA) {
+					int b2 = bytes[p++];
+					int vg = (b1 & 0x3f) - 32;
+					px.rgba.r += vg - 8 + ((b2 >> 4) & 0x0f);
+					px.rgba.g += vg;
+					px.rgba.b += vg - 8 +  (b2       & 0x0f);
+				}
+				else if ((b1 & QOI_MASK_2) == QOI_OP_RUN) {
+					run = (b1 & 0x3f);
+				}
+
+				index[QOI_COLOR_HASH(px) % 64] = px;
 			}
 
-			index[QOI_COLOR_HASH(px) % 64] = px;
-		}
+			pixels[px_pos + 0] = px.rgba.r;
+			pixels[px_pos + 1] = px.rgba.g;
+			pixels[px_pos + 2] = px.rgba.b;
 
-		pixels[px_pos + 0] = px.rgba.r;
-		pixels[px_pos + 1] = px.rgba.g;
-		pixels[px_pos + 2] = px.rgba.b;
-		
-		if (channels == 4) {
-			pixels[px_pos + 3] = px.rgba.a;
+			if (channels == 4) {
+				pixels[px_pos + 3] = px.rgba.a;
+			}
 		}
 	}
+	QOI_TRACE_END("qoi_decode");
+
+	dec->px = px;
+	dec->p = p;
+	dec->run = run;
+	dec->y += rows;
+	return rows;
+}
+
+void qoi_decoder_free(qoi_decoder *dec) {
+	if (dec->owned) {
+		QOI_FREE(dec->owned);
+		dec->owned = NULL;
+	}
+#ifndef QOI_NO_STDIO
+	if (dec->file) {
+		fclose((FILE *)dec->file);
+		dec->file = NULL;
+	}
+#endif /* QOI_NO_STDIO */
+}
+
+void *qoi_decode_into(const void *data, int size, qoi_desc *desc, int channels, void *out, int out_size, int out_stride, int flip) {
+	qoi_decoder dec;
+	int row_len, y;
+
+	if (out == NULL || !qoi_decoder_init(&dec, data, size, channels)) {
+		return NULL;
+	}
+	*desc = dec.desc;
+
+	row_len = dec.desc.width * dec.channels;
+	if (out_stride == 0) {
+		out_stride = row_len;
+	}
+	if (
+		out_stride < row_len ||
+		(long long)out_stride * (dec.desc.height - 1) + row_len > out_size
+	) {
+		return NULL;
+	}
 
+	if (!flip) {
+		qoi_decoder_step(&dec, (int)dec.desc.height, out, out_stride);
+		return out;
+	}
+
+	for (y = (int)dec.desc.height - 1; y >= 0; y--) {
+		qoi_decoder_step(&dec, 1, (unsigned char *)out + (long long)out_stride * y, out_stride);
+	}
+	return out;
+}
+
+void *qoi_decode(const void *data, int size, qoi_desc *desc, int channels) {
+	void *pixels;
+	int px_len = qoi_decode_header(data, size, desc, channels);
+	if (px_len == 0) {
+		return NULL;
+	}
+
+	pixels = QOI_MALLOC(px_len);
+	if (!pixels) {
+		return NULL;
+	}
+
+	if (!qoi_decode_into(data, size, desc, channels, pixels, px_len, 0, 0)) {
+		QOI_FREE(pixels);
+		return NULL;
+	}
 	return pixels;
 }
 
@@ -646,10 +896,10 @@ int qoi_write(const char *filename, const void *data, const qoi_desc *desc) {
 	return err ? 0 : size;
 }
 
-void *qoi_read(const char *filename, qoi_desc *desc, int channels) {
+static void *qoi_slurp(const char *filename, int *out_size) {
 	FILE *f = fopen(filename, "rb");
 	int size, bytes_read;
-	void *pixels, *data;
+	void *data;
 
 	if (!f) {
 		return NULL;
@@ -670,11 +920,118 @@ void *qoi_read(const char *filename, qoi_desc *desc, int channels) {
 
 	bytes_read = fread(data, 1, size, f);
 	fclose(f);
-	pixels = (bytes_read != size) ? NULL : qoi_decode(data, bytes_read, desc, channels);
+	if (bytes_read != size) {
+		QOI_FREE(data);
+		return NULL;
+	}
+
+	*out_size = size;
+	return data;
+}
+
+void *qoi_read(const char *filename, qoi_desc *desc, int channels) {
+	int size;
+	void *pixels, *data;
+
+	data = qoi_slurp(filename, &size);
+	if (!data) {
+		return NULL;
+	}
+
+	pixels = qoi_decode(data, size, desc, channels);
 	QOI_FREE(data);
 	return pixels;
 }
 
+void *qoi_read_into(const char *filename, qoi_desc *desc, int channels, void *out, int out_size, int out_stride, int flip) {
+	int size;
+	void *pixels, *data;
+
+	data = qoi_slurp(filename, &size);
+	if (!data) {
+		return NULL;
+	}
+
+	pixels = qoi_decode_into(data, size, desc, channels, out, out_size, out_stride, flip);
+	QOI_FREE(data);
+	return pixels;
+}
+
+int qoi_decoder_open(qoi_decoder *dec, const char *filename, int channels) {
+	FILE *f = fopen(filename, "rb");
+	unsigned char *window, *larger;
+	int cap = 65536, size, need;
+
+	if (!f) {
+		return 0;
+	}
+
+	window = (unsigned char *)QOI_MALLOC(cap);
+	if (!window) {
+		fclose(f);
+		return 0;
+	}
+
+	size = (int)fread(window, 1, cap, f);
+	if (!qoi_decoder_init(dec, window, size, channels)) {
+		QOI_FREE(window);
+		fclose(f);
+		return 0;
+	}
+
+	/* Room for the longest row on top of what may be left over */
+	need = (int)dec->desc.width * 5 + 16;
+	if (need > cap) {
+		larger = (unsigned char *)QOI_MALLOC(need);
+		if (!larger) {
+			QOI_FREE(window);
+			fclose(f);
+			return 0;
+		}
+		memcpy(larger, window, size);
+		QOI_FREE(window);
+		window = larger;
+		cap = need;
+		dec->bytes = window;
+	}
+
+	dec->owned = window;
+	dec->file = f;
+	dec->cap = cap;
+	dec->eof = size < 65536;
+	return 1;
+}
+
+int qoi_info(const char *filename, qoi_desc *desc) {
+	FILE *f = fopen(filename, "rb");
+	unsigned char bytes[QOI_HEADER_SIZE];
+	unsigned int header_magic;
+	int p = 0;
+
+	if (!f) {
+		return 0;
+	}
+
+	if (fread(bytes, 1, QOI_HEADER_SIZE, f) != QOI_HEADER_SIZE) {
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	header_magic = qoi_read_32(bytes, &p);
+	desc->width = qoi_read_32(bytes, &p);
+	desc->height = qoi_read_32(bytes, &p);
+	desc->channels = bytes[p++];
+	desc->colorspace = bytes[p++];
+
+	return
+		header_magic == QOI_MAGIC &&
+		desc->width != 0 && desc->height != 0 &&
+		desc->channels >= 3 && desc->channels <= 4 &&
+		desc->colorspace <= 1 &&
+		desc->height < QOI_PIXELS_MAX / desc->width;
+}
+
 #endif /* QOI_NO_STDIO */
 #endif /* QOI_IMPLEMENTATION */
 
@@ -0,0 +1,243 @@
+#ifndef RAM_CACHE_H
+#define RAM_CACHE_H
+
+// Keeps recently decoded images in memory. An image is held QOI encoded if
+// that makes it 'min_ratio' times smaller, raw otherwise. The encoder writes
+// into a buffer of just that size and gives up once it is full, so finding
+// out that an image does not compress costs little. Past the budget the
+// entries used longest ago are dropped.
+//
+//   Ram_Cache c;
+//   ram_cache_init(&c, 256 << 20);
+//   if(!ram_cache_get(&c, key, out, out_size, &width, &height)) {
+//     ...
+//     ram_cache_put(&c, key, out, width, height);
+//   }
+//   ram_cache_free(&c);
+//
+// 'key' is any hash of what was decoded, like the one of cache_key. Uses
+// thread.h and qoi.h, include them first. Safe to call from any thread, a
+// get copies and decodes outside of the lock.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef RAM_CACHE_DEF
+#  define RAM_CACHE_DEF static inline
+#endif //RAM_CACHE_DEF
+
+#ifndef RAM_CACHE_MALLOC
+#  define RAM_CACHE_MALLOC(size) malloc(size)
+#  define RAM_CACHE_REALLOC(ptr, size) realloc(ptr, size)
+#  define RAM_CACHE_FREE(ptr) free(ptr)
+#endif //RAM_CACHE_MALLOC
+
+// Around what the entries hold, for a budget shared with other parts. A put
+// that is refused its bytes caches nothing.
+#ifndef RAM_CACHE_RESERVE
+#  define RAM_CACHE_RESERVE(bytes) true
+#  define RAM_CACHE_RELEASE(bytes)
+#endif //RAM_CACHE_RESERVE
+
+#define RAM_CACHE_ENTRIES_CAP 64
+#define RAM_CACHE_MIN_RATIO 1.5f // QOI is only worth its decode from here on
+
+// The bytes of an entry, they follow it. Freed by the last of the entry and
+// the gets reading them.
+typedef struct{
+  int refs;
+  size_t size;
+}Ram_Cache_Block;
+
+typedef struct{
+  unsigned long long key;
+  int width, height;
+  bool raw;
+  Ram_Cache_Block *data;
+  size_t size;
+  unsigned long long used;
+}Ram_Cache_Entry;
+
+typedef struct{
+  Ram_Cache_Entry entries[RAM_CACHE_ENTRIES_CAP];
+  int count;
+  size_t budget; // bytes
+  size_t size; // of the entries
+  float min_ratio; // RAM_CACHE_MIN_RATIO, 0 keeps everything raw
+  unsigned long long clock;
+  Thread_Mutex mutex;
+
+  long long hits, misses;
+  long long puts_qoi, puts_raw;
+  long long bytes_in; // raw, of every put
+  long long bytes_kept; // of every put
+}Ram_Cache;
+
+RAM_CACHE_DEF void ram_cache_init(Ram_Cache *c, size_t budget);
+RAM_CACHE_DEF void ram_cache_free(Ram_Cache *c);
+
+// Whether an image of 'width' x 'height' can be cached at all
+RAM_CACHE_DEF bool ram_cache_fits(Ram_Cache *c, int width, int height);
+// RGBA with packed rows, fails if it is not cached or does not fit
+RAM_CACHE_DEF bool ram_cache_get(Ram_Cache *c, unsigned long long key, void *out, size_t out_size, int *width, int *height);
+RAM_CACHE_DEF bool ram_cache_put(Ram_Cache *c, unsigned long long key, const void *pixels, int width, int height);
+// Drops the entries used longest ago until 'bytes' are freed, or none are left
+RAM_CACHE_DEF void ram_cache_trim(Ram_Cache *c, size_t bytes);
+
+#ifdef RAM_CACHE_IMPLEMENTATION
+
+RAM_CACHE_DEF void ram_cache_init(Ram_Cache *c, size_t budget) {
+  memset(c, 0, sizeof(*c));
+  c->budget = budget;
+  c->min_ratio = RAM_CACHE_MIN_RATIO;
+  thread_mutex_init(&c->mutex);
+}
+
+static unsigned char *ram_cache_bytes(Ram_Cache_Block *b) {
+  return (unsigned char *) (b + 1);
+}
+
+// With the lock held
+static void ram_cache_unref(Ram_Cache_Block *b) {
+  if(--b->refs == 0) RAM_CACHE_FREE(b);
+}
+
+static void ram_cache_remove(Ram_Cache *c, int i) {
+  ram_cache_unref(c->entries[i].data);
+  RAM_CACHE_RELEASE(c->entries[i].size);
+  c->size -= c->entries[i].size;
+  c->entries[i] = c->entries[--c->count];
+}
+
+static int ram_cache_oldest(Ram_Cache *c) {
+  int oldest = 0;
+  for(int i=1;i<c->count;i++) {
+    if(c->entries[i].used < c->entries[oldest].used) oldest = i;
+  }
+  return oldest;
+}
+
+RAM_CACHE_DEF void ram_cache_free(Ram_Cache *c) {
+  while(c->count > 0) ram_cache_remove(c, 0);
+  thread_mutex_free(&c->mutex);
+}
+
+RAM_CACHE_DEF bool ram_cache_fits(Ram_Cache *c, int width, int height) {
+  size_t size = (size_t) width * (size_t) height * 4;
+  return width > 0 && height > 0 && size <= c->budget && size <= 0x7fffffff;
+}
+
+RAM_CACHE_DEF bool ram_cache_get(Ram_Cache *c, unsigned long long key, void *out, size_t out_size, int *width, int *height) {
+  thread_mutex_lock(&c->mutex);
+  Ram_Cache_Entry *e = NULL;
+  for(int i=0;i<c->count;i++) {
+    if(c->entries[i].key == key) {
+      e = &c->entries[i];
+      break;
+    }
+  }
+
+  // read outside of the lock, the entry may be dropped meanwhile
+  Ram_Cache_Block *b = NULL;
+  bool raw = false;
+  if(e && (size_t) e->width * (size_t) e->height * 4 <= out_size) {
+    b = e->data;
+    b->refs++;
+    raw = e->raw;
+    e->used = ++c->clock;
+    *width = e->width;
+    *height = e->height;
+  }
+  thread_mutex_unlock(&c->mutex);
+
+  bool ok = false;
+  if(b && raw) {
+    memcpy(out, ram_cache_bytes(b), b->size);
+    ok = true;
+  } else if(b) {
+    qoi_desc desc;
+    ok = qoi_decode_into(ram_cache_bytes(b), (int) b->size, &desc, 4, out, (int) out_size, 0, 0) != NULL;
+  }
+
+  thread_mutex_lock(&c->mutex);
+  if(b) ram_cache_unref(b);
+  if(ok) c->hits++;
+  else c->misses++;
+  thread_mutex_unlock(&c->mutex);
+  return ok;
+}
+
+RAM_CACHE_DEF bool ram_cache_put(Ram_Cache *c, unsigned long long key, const void *pixels, int width, int height) {
+  if(!ram_cache_fits(c, width, height)) return false;
+  size_t raw_size = (size_t) width * (size_t) height * 4;
+
+  // encoded outside of the lock
+  Ram_Cache_Block *data = NULL;
+  int len = 0;
+  if(c->min_ratio > 0) {
+    size_t cap = (size_t) ((double) raw_size / c->min_ratio);
+    qoi_desc desc = {(unsigned int) width, (unsigned int) height, 4, QOI_SRGB};
+    data = RAM_CACHE_MALLOC(sizeof(Ram_Cache_Block) + cap);
+    if(data) len = qoi_encode_into(pixels, &desc, ram_cache_bytes(data), (int) cap);
+  }
+  bool raw = len == 0;
+  size_t size = raw ? raw_size : (size_t) len;
+  if(raw) {
+    RAM_CACHE_FREE(data);
+    data = RAM_CACHE_MALLOC(sizeof(Ram_Cache_Block) + raw_size);
+    if(!data) return false;
+    memcpy(ram_cache_bytes(data), pixels, raw_size);
+  } else {
+    Ram_Cache_Block *shrunk = RAM_CACHE_REALLOC(data, sizeof(Ram_Cache_Block) + size);
+    if(shrunk) data = shrunk;
+  }
+  data->refs = 1;
+  data->size = size;
+  if(!(RAM_CACHE_RESERVE(size))) {
+    RAM_CACHE_FREE(data);
+    return false;
+  }
+
+  thread_mutex_lock(&c->mutex);
+  for(int i=0;i<c->count;i++) {
+    if(c->entries[i].key == key) {
+      ram_cache_remove(c, i);
+      break;
+    }
+  }
+  while(c->count > 0 && (c->size + size > c->budget || c->count == RAM_CACHE_ENTRIES_CAP)) {
+    ram_cache_remove(c, ram_cache_oldest(c));
+  }
+  Ram_Cache_Entry *e = &c->entries[c->count++];
+  e->key = key;
+  e->width = width;
+  e->height = height;
+  e->raw = raw;
+  e->data = data;
+  e->size = size;
+  e->used = ++c->clock;
+  c->size += size;
+
+  if(raw) c->puts_raw++;
+  else c->puts_qoi++;
+  c->bytes_in += (long long) raw_size;
+  c->bytes_kept += (long long) size;
+  thread_mutex_unlock(&c->mutex);
+  return true;
+}
+
+RAM_CACHE_DEF void ram_cache_trim(Ram_Cache *c, size_t bytes) {
+  thread_mutex_lock(&c->mutex);
+  size_t freed = 0;
+  while(c->count > 0 && freed < bytes) {
+    int oldest = ram_cache_oldest(c);
+    freed += c->entries[oldest].size;
+    ram_cache_remove(c, oldest);
+  }
+  thread_mutex_unlock(&c->mutex);
+}
+
+#endif //RAM_CACHE_IMPLEMENTATION
+
+#endif //RAM_CACHE_H
@@ -0,0 +1,464 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+// Scales RGBA images on the CPU with separable filters. The weights of
+// every target column and row are computed once per call, the inner loops
+// run on SSE2, or on AVX2 when built for it. Bands of target rows are
+// spread over the workers of a pool.
+//
+//   resample(src, width, height, width * 4,
+//            dst, dst_width, dst_height, dst_width * 4,
+//            RESAMPLE_LANCZOS, RESAMPLE_LINEAR_LIGHT | RESAMPLE_PREMULTIPLY, &pool);
+//
+// Uses thread.h and pool.h, include them first. Included before frame.h with
+// RESAMPLE_MIPMAP_FLAGS defined, the software renderer builds its mipmaps
+// with it instead of its own box filter of the sRGB values.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define RESAMPLE_SSE2
+#  include <emmintrin.h>
+#endif //__SSE2__
+
+#ifdef __AVX2__
+#  define RESAMPLE_AVX2
+#  include <immintrin.h>
+#endif //__AVX2__
+
+#ifndef RESAMPLE_DEF
+#  define RESAMPLE_DEF static inline
+#endif //RESAMPLE_DEF
+
+#ifndef RESAMPLE_MALLOC
+#  define RESAMPLE_MALLOC(size) malloc(size)
+#  define RESAMPLE_FREE(ptr) free(ptr)
+#endif //RESAMPLE_MALLOC
+
+#define RESAMPLE_BAND_MIN 16 // target rows, fewer are not worth a job
+#define RESAMPLE_BANDS_PER_THREAD 4 // so busy workers leave theirs to the others
+
+typedef enum{
+  RESAMPLE_BOX = 0, // the area average when shrinking, nearest when enlarging
+  RESAMPLE_BILINEAR,
+  RESAMPLE_BICUBIC, // Catmull-Rom
+  RESAMPLE_LANCZOS, // 3 lobes
+  RESAMPLE_FILTER_COUNT,
+}Resample_Filter;
+
+// The pixels are sRGB, filter them in linear light
+#define RESAMPLE_LINEAR_LIGHT 0x1
+// The alpha is straight, weight the colors by it while filtering so that
+// transparent pixels do not bleed into their neighbours
+#define RESAMPLE_PREMULTIPLY 0x2
+
+// With a 'pool' its workers help the calling thread, NULL uses only the latter
+RESAMPLE_DEF bool resample(const void *src, int src_width, int src_height, size_t src_stride,
+			   void *dst, int dst_width, int dst_height, size_t dst_stride,
+			   Resample_Filter filter, int flags, Pool *pool);
+
+RESAMPLE_DEF float resample_filter(Resample_Filter filter, float x);
+RESAMPLE_DEF float resample_filter_support(Resample_Filter filter); // radius, at scale 1
+RESAMPLE_DEF const char *resample_filter_name(Resample_Filter filter);
+
+// e.g. RESAMPLE_LINEAR_LIGHT | RESAMPLE_PREMULTIPLY. A level is small and
+// follows the one before it, so it is built on the calling thread.
+#if defined(RESAMPLE_MIPMAP_FLAGS) && !defined(FRAME_MIPMAP_LEVEL)
+#  define FRAME_MIPMAP_LEVEL(src, width, height, dst, w, h)		\
+  resample(src, width, height, (size_t) (width) * 4, dst, w, h, (size_t) (w) * 4, \
+	   RESAMPLE_BOX, RESAMPLE_MIPMAP_FLAGS, NULL)
+#endif //RESAMPLE_MIPMAP_FLAGS
+
+#ifdef RESAMPLE_IMPLEMENTATION
+
+#define RESAMPLE_ENCODE_SIZE 4096 // linear light to sRGB, entries
+#define RESAMPLE_TABLES_READY 0x40000000L // above any count of threads waiting for them
+
+// Target coordinate i sums 'taps' source pixels from 'first[i]' on, with
+// 'weights + i * stride'. The stride is even, padded with zero weights.
+typedef struct{
+  int *first;
+  float *weights;
+  int taps;
+  int stride;
+}Resample_Axis;
+
+typedef struct{
+  const unsigned char *src;
+  int src_width, src_height;
+  size_t src_stride;
+  unsigned char *dst;
+  int dst_width, dst_height;
+  size_t dst_stride;
+  int flags;
+
+  Resample_Axis x, y;
+  const float *to_float; // of a byte
+}Resample;
+
+// The calling thread and jobs of the pool claim bands from 'next' until none
+// is left. A job may start after all of them are done, so the last one to
+// let go frees it, not the calling thread.
+typedef struct{
+  Resample *r;
+  int bands;
+  Thread_Atomic next;
+  Thread_Atomic refs;
+  Thread_Atomic failed;
+  Thread_Mutex mutex; // of 'done'
+  Thread_Cond finished;
+  int done;
+}Resample_Bands;
+
+RESAMPLE_DEF float resample_filter(Resample_Filter filter, float x) {
+  if(x < 0) x = -x;
+  switch(filter) {
+  case RESAMPLE_BOX:
+    return x < .5f ? 1.f : 0.f;
+  case RESAMPLE_BILINEAR:
+    return x < 1.f ? 1.f - x : 0.f;
+  case RESAMPLE_BICUBIC:
+    if(x < 1.f) return (1.5f * x - 2.5f) * x * x + 1.f;
+    if(x < 2.f) return ((-.5f * x + 2.5f) * x - 4.f) * x + 2.f;
+    return 0.f;
+  case RESAMPLE_LANCZOS:
+    if(x < 1e-6f) return 1.f;
+    if(x >= 3.f) return 0.f;
+    {
+      float pi_x = 3.14159265358979f * x;
+      return 3.f * sinf(pi_x) * sinf(pi_x / 3.f) / (pi_x * pi_x);
+    }
+  default:
+    return 0.f;
+  }
+}
+
+RESAMPLE_DEF float resample_filter_support(Resample_Filter filter) {
+  switch(filter) {
+  case RESAMPLE_BOX: return .5f;
+  case RESAMPLE_BILINEAR: return 1.f;
+  case RESAMPLE_BICUBIC: return 2.f;
+  case RESAMPLE_LANCZOS: return 3.f;
+  default: return 0.f;
+  }
+}
+
+RESAMPLE_DEF const char *resample_filter_name(Resample_Filter filter) {
+  switch(filter) {
+  case RESAMPLE_BOX: return "box";
+  case RESAMPLE_BILINEAR: return "bilinear";
+  case RESAMPLE_BICUBIC: return "bicubic";
+  case RESAMPLE_LANCZOS: return "lanczos";
+  default: return "unknown";
+  }
+}
+
+// Built once, by the first call, the others wait for it
+static float resample_to_unit[256];
+static float resample_to_linear[256];
+static unsigned char resample_to_srgb[RESAMPLE_ENCODE_SIZE + 1];
+static Thread_Atomic resample_tables;
+
+static void resample_tables_init() {
+  if(thread_atomic_load(&resample_tables) >= RESAMPLE_TABLES_READY) return;
+  if(thread_atomic_add(&resample_tables, 1) != 0) {
+    while(thread_atomic_load(&resample_tables) < RESAMPLE_TABLES_READY) thread_yield();
+    return;
+  }
+
+  for(int i=0;i<256;i++) {
+    float v = (float) i / 255.f;
+    resample_to_unit[i] = v;
+    resample_to_linear[i] = v <= .04045f ? v / 12.92f : powf((v + .055f) / 1.055f, 2.4f);
+  }
+  for(int i=0;i<=RESAMPLE_ENCODE_SIZE;i++) {
+    float v = (float) i / RESAMPLE_ENCODE_SIZE;
+    v = v <= .0031308f ? v * 12.92f : 1.055f * powf(v, 1.f / 2.4f) - .055f;
+    resample_to_srgb[i] = (unsigned char) (v * 255.f + .5f);
+  }
+  thread_atomic_store(&resample_tables, RESAMPLE_TABLES_READY);
+}
+
+static void resample_axis_free(Resample_Axis *a) {
+  if(a->first) RESAMPLE_FREE(a->first);
+  if(a->weights) RESAMPLE_FREE(a->weights);
+  a->first = NULL;
+  a->weights = NULL;
+}
+
+// Taps past an edge fold onto the edge pixel, the window is shifted to stay inside
+static bool resample_axis_init(Resample_Axis *a, Resample_Filter filter, int src, int dst) {
+  float scale = (float) dst / (float) src;
+  float stretch = scale < 1.f ? 1.f / scale : 1.f; // the kernel widens when shrinking
+  float support = resample_filter_support(filter) * stretch;
+  int window = (int) ceilf(support * 2.f) + 1;
+  int taps = window < src ? window : src;
+
+  a->taps = taps;
+  a->stride = (taps + 1) & ~1;
+  a->first = RESAMPLE_MALLOC(sizeof(int) * (size_t) dst);
+  a->weights = RESAMPLE_MALLOC(sizeof(float) * (size_t) dst * (size_t) a->stride);
+  if(!a->first || !a->weights) {
+    resample_axis_free(a);
+    return false;
+  }
+  memset(a->weights, 0, sizeof(float) * (size_t) dst * (size_t) a->stride);
+
+  for(int i=0;i<dst;i++) {
+    float center = ((float) i + .5f) / scale;
+    int lo = (int) floorf(center - support + .5f);
+    int first = lo < 0 ? 0 : lo;
+    if(first > src - taps) first = src - taps;
+    a->first[i] = first;
+
+    float *w = a->weights + (size_t) i * (size_t) a->stride;
+    float sum = 0.f;
+    for(int k=0;k<window;k++) {
+      int j = lo + k;
+      float v = resample_filter(filter, ((float) j + .5f - center) / stretch);
+      j = j < 0 ? 0 : (j >= src ? src - 1 : j);
+      w[j - first] += v;
+      sum += v;
+    }
+    if(sum != 0.f) {
+      for(int k=0;k<taps;k++) w[k] /= sum;
+    }
+  }
+
+  return true;
+}
+
+static void resample_convert_row(const Resample *r, const unsigned char *src, float *line) {
+  bool premultiply = (r->flags & RESAMPLE_PREMULTIPLY) != 0;
+  for(int x=0;x<r->src_width;x++) {
+    const unsigned char *s = src + x * 4;
+    float *p = line + x * 4;
+    float a = (float) s[3] * (1.f / 255.f);
+    float m = premultiply ? a : 1.f;
+    p[0] = r->to_float[s[0]] * m;
+    p[1] = r->to_float[s[1]] * m;
+    p[2] = r->to_float[s[2]] * m;
+    p[3] = a;
+  }
+}
+
+static void resample_row_x(const Resample *r, const float *line, float *out) {
+  const Resample_Axis *a = &r->x;
+  for(int x=0;x<r->dst_width;x++) {
+    const float *w = a->weights + (size_t) x * (size_t) a->stride;
+    const float *p = line + (size_t) a->first[x] * 4;
+#if defined(RESAMPLE_AVX2)
+    // two pixels per register, the padding weight reads the spare pixel of 'line'
+    __m256 acc = _mm256_setzero_ps();
+    for(int k=0;k<a->stride;k+=2) {
+      __m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(w[k])), _mm_set1_ps(w[k + 1]), 1);
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(weight, _mm256_loadu_ps(p + k * 4)));
+    }
+    _mm_storeu_ps(out + x * 4, _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+#elif defined(RESAMPLE_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for(int k=0;k<a->taps;k++) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(p + k * 4)));
+    }
+    _mm_storeu_ps(out + x * 4, acc);
+#else
+    float acc[4] = {0};
+    for(int k=0;k<a->taps;k++) {
+      for(int c=0;c<4;c++) acc[c] += w[k] * p[k * 4 + c];
+    }
+    memcpy(out + x * 4, acc, sizeof(acc));
+#endif //RESAMPLE_AVX2
+  }
+}
+
+// 'len' is a multiple of 4
+static void resample_row_y(const float *const *rows, const float *w, int taps, int len, float *out) {
+  int i = 0;
+#if defined(RESAMPLE_AVX2)
+  for(;i+8<=len;i+=8) {
+    __m256 acc = _mm256_setzero_ps();
+    for(int k=0;k<taps;k++) {
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(rows[k] + i)));
+    }
+    _mm256_storeu_ps(out + i, acc);
+  }
+#endif //RESAMPLE_AVX2
+#if defined(RESAMPLE_SSE2)
+  for(;i<len;i+=4) {
+    __m128 acc = _mm_setzero_ps();
+    for(int k=0;k<taps;k++) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(rows[k] + i)));
+    }
+    _mm_storeu_ps(out + i, acc);
+  }
+#else
+  for(;i<len;i++) {
+    float acc = 0.f;
+    for(int k=0;k<taps;k++) acc += w[k] * rows[k][i];
+    out[i] = acc;
+  }
+#endif //RESAMPLE_SSE2
+}
+
+static void resample_store_row(const Resample *r, const float *in, unsigned char *dst) {
+  bool premultiply = (r->flags & RESAMPLE_PREMULTIPLY) != 0;
+  bool linear = (r->flags & RESAMPLE_LINEAR_LIGHT) != 0;
+  for(int x=0;x<r->dst_width;x++) {
+    const float *p = in + x * 4;
+    float a = p[3] < 0.f ? 0.f : (p[3] > 1.f ? 1.f : p[3]);
+    float m = !premultiply ? 1.f : (a > 0.f ? 1.f / a : 0.f);
+    for(int c=0;c<3;c++) {
+      float v = p[c] * m;
+      v = v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+      dst[x * 4 + c] = linear
+	? resample_to_srgb[(int) (v * RESAMPLE_ENCODE_SIZE + .5f)]
+	: (unsigned char) (v * 255.f + .5f);
+    }
+    dst[x * 4 + 3] = (unsigned char) (a * 255.f + .5f);
+  }
+}
+
+// Source rows go through the horizontal pass once each, into a ring of the
+// last 'taps' of them, which the vertical pass reads.
+static bool resample_band(Resample *r, int y0, int y1) {
+  const Resample_Axis *a = &r->y;
+  int taps = a->taps;
+  size_t row_len = (size_t) r->dst_width * 4;
+
+  float *line = RESAMPLE_MALLOC(sizeof(float) * ((size_t) r->src_width + 1) * 4);
+  float *ring = RESAMPLE_MALLOC(sizeof(float) * row_len * (size_t) taps);
+  float *out = RESAMPLE_MALLOC(sizeof(float) * row_len);
+  const float **rows = RESAMPLE_MALLOC(sizeof(float *) * (size_t) taps);
+  bool ok = line && ring && out && rows;
+
+  if(ok) {
+    memset(line + (size_t) r->src_width * 4, 0, sizeof(float) * 4);
+    int next = a->first[y0];
+    for(int y=y0;y<y1;y++) {
+      int first = a->first[y];
+      if(next < first) next = first;
+      for(;next<first+taps;next++) {
+	resample_convert_row(r, r->src + r->src_stride * (size_t) next, line);
+	resample_row_x(r, line, ring + row_len * (size_t) (next % taps));
+      }
+      for(int k=0;k<taps;k++) {
+	rows[k] = ring + row_len * (size_t) ((first + k) % taps);
+      }
+      resample_row_y(rows, a->weights + (size_t) y * (size_t) a->stride, taps, (int) row_len, out);
+      resample_store_row(r, out, r->dst + r->dst_stride * (size_t) y);
+    }
+  }
+
+  if(line) RESAMPLE_FREE(line);
+  if(ring) RESAMPLE_FREE(ring);
+  if(out) RESAMPLE_FREE(out);
+  if(rows) RESAMPLE_FREE((void *) rows);
+  return ok;
+}
+
+static void resample_bands_run(Resample_Bands *b) {
+  while(true) {
+    long i = thread_atomic_add(&b->next, 1);
+    if(i >= b->bands) break;
+    int height = b->r->dst_height;
+    int y0 = (int) ((long long) height * i / b->bands);
+    int y1 = (int) ((long long) height * (i + 1) / b->bands);
+    if(!resample_band(b->r, y0, y1)) thread_atomic_store(&b->failed, 1);
+
+    thread_mutex_lock(&b->mutex);
+    if(++b->done == b->bands) thread_cond_broadcast(&b->finished);
+    thread_mutex_unlock(&b->mutex);
+  }
+}
+
+static void resample_bands_unref(Resample_Bands *b) {
+  if(thread_atomic_add(&b->refs, -1) != 1) return;
+  thread_cond_free(&b->finished);
+  thread_mutex_free(&b->mutex);
+  free(b);
+}
+
+static void resample_bands_job(void *arg, Pool_Token *token) {
+  (void) token;
+  resample_bands_run((Resample_Bands *) arg);
+  resample_bands_unref((Resample_Bands *) arg);
+}
+
+// Of the calling thread, false if any band failed
+static bool resample_spread(Resample *r, Pool *pool) {
+  int threads = pool ? pool->workers_count + 1 : 1;
+  int bands = threads * RESAMPLE_BANDS_PER_THREAD;
+  int max_bands = (r->dst_height + RESAMPLE_BAND_MIN - 1) / RESAMPLE_BAND_MIN;
+  if(bands > max_bands) bands = max_bands;
+  Resample_Bands *b = threads > 1 && bands > 1 ? malloc(sizeof(Resample_Bands)) : NULL;
+  if(!b) return resample_band(r, 0, r->dst_height);
+
+  memset(b, 0, sizeof(*b));
+  b->r = r;
+  b->bands = bands;
+  thread_mutex_init(&b->mutex);
+  thread_cond_init(&b->finished);
+  int helpers = threads - 1 < bands - 1 ? threads - 1 : bands - 1;
+  thread_atomic_store(&b->refs, 1 + helpers);
+  for(int i=0;i<helpers;i++) {
+    // the calling thread waits for them
+    if(!pool_submit(pool, POOL_VISIBLE, resample_bands_job, NULL, b, NULL)) thread_atomic_add(&b->refs, -1);
+  }
+
+  // only bands that were claimed are waited for, never a job in the queue
+  resample_bands_run(b);
+  thread_mutex_lock(&b->mutex);
+  while(b->done < b->bands) thread_cond_wait(&b->finished, &b->mutex);
+  thread_mutex_unlock(&b->mutex);
+
+  bool ok = thread_atomic_load(&b->failed) == 0;
+  resample_bands_unref(b);
+  return ok;
+}
+
+RESAMPLE_DEF bool resample(const void *src, int src_width, int src_height, size_t src_stride,
+			   void *dst, int dst_width, int dst_height, size_t dst_stride,
+			   Resample_Filter filter, int flags, Pool *pool) {
+  if(!src || !dst || src_width < 1 || src_height < 1 || dst_width < 1 || dst_height < 1 ||
+     src_stride < (size_t) src_width * 4 || dst_stride < (size_t) dst_width * 4 ||
+     (int) filter < 0 || filter >= RESAMPLE_FILTER_COUNT) {
+    return false;
+  }
+
+  Resample *r = RESAMPLE_MALLOC(sizeof(Resample));
+  if(!r) return false;
+  memset(r, 0, sizeof(*r));
+  r->src = (const unsigned char *) src;
+  r->src_width = src_width;
+  r->src_height = src_height;
+  r->src_stride = src_stride;
+  r->dst = (unsigned char *) dst;
+  r->dst_width = dst_width;
+  r->dst_height = dst_height;
+  r->dst_stride = dst_stride;
+  r->flags = flags;
+
+  if(!resample_axis_init(&r->x, filter, src_width, dst_width) ||
+     !resample_axis_init(&r->y, filter, src_height, dst_height)) {
+    resample_axis_free(&r->x);
+    RESAMPLE_FREE(r);
+    return false;
+  }
+
+  resample_tables_init();
+  r->to_float = (flags & RESAMPLE_LINEAR_LIGHT) ? resample_to_linear : resample_to_unit;
+
+  bool ok = resample_spread(r, pool);
+
+  resample_axis_free(&r->x);
+  resample_axis_free(&r->y);
+  RESAMPLE_FREE(r);
+  return ok;
+}
+
+#endif //RESAMPLE_IMPLEMENTATION
+
+#endif //RESAMPLE_H
@@ -0,0 +1,270 @@
+// Smoke test of the X11 backend, needs a server, see smoke.sh:
+//
+//   xvfb-run -a bin/smoke bin/viewer
+//
+// Writes an image, red on the left and blue on the right, starts the viewer
+// on it and waits for its window. Then drags, resets and zooms the image
+// with synthetic events, reads the window back after every step to check
+// where the halves went, and quits the viewer with 'q'.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+
+#define IMAGE_WIDTH 64
+#define IMAGE_HEIGHT 32
+#define WAIT_MS 10000 // for the window, every check and the exit
+#define SETTLE_MS 100 // between events, so that the viewer draws a frame
+#define ZOOM_STEPS 80 // of the wheel, the image then covers the padding
+
+typedef enum{
+  COLOR_OTHER = 0,
+  COLOR_RED,
+  COLOR_BLUE,
+}Color;
+
+static const char *color_names[] = {"neither", "red", "blue"};
+
+static Display *display;
+static Window window;
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1000 + (double) ts.tv_nsec / 1000000;
+}
+
+static void sleep_ms(int ms) {
+  usleep((useconds_t) ms * 1000);
+}
+
+static bool write_image(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if(!f) return false;
+
+  fprintf(f, "P6\n%d %d\n255\n", IMAGE_WIDTH, IMAGE_HEIGHT);
+  for(int y=0;y<IMAGE_HEIGHT;y++) {
+    for(int x=0;x<IMAGE_WIDTH;x++) {
+      unsigned char red = x < IMAGE_WIDTH / 2 ? 255 : 0;
+      unsigned char rgb[3] = {red, 0, (unsigned char) (255 - red)};
+      fwrite(rgb, 1, 3, f);
+    }
+  }
+  return fclose(f) == 0;
+}
+
+// A top level window titled 'title', which the viewer sets once the image
+// is shown. Without a window manager they are children of the root.
+static bool find_window(const char *title) {
+  double start = now_ms();
+  while(now_ms() - start < WAIT_MS) {
+    Window root, parent, *children = NULL;
+    unsigned int count = 0;
+    if(XQueryTree(display, DefaultRootWindow(display), &root, &parent, &children, &count)) {
+      for(unsigned int i=0;i<count && !window;i++) {
+	char *name = NULL;
+	if(XFetchName(display, children[i], &name) && name) {
+	  if(strcmp(name, title) == 0) window = children[i];
+	  XFree(name);
+	}
+      }
+      if(children) XFree(children);
+    }
+    if(window) return true;
+    sleep_ms(SETTLE_MS);
+  }
+  return false;
+}
+
+static int channel(unsigned long pixel, unsigned long mask) {
+  if(mask == 0) return 0;
+  while(!(mask & 1)) {
+    mask >>= 1;
+    pixel >>= 1;
+  }
+  return (int) ((pixel & mask) * 255 / mask);
+}
+
+static Color read_color(int x, int y) {
+  XImage *image = XGetImage(display, window, x, y, 1, 1, AllPlanes, ZPixmap);
+  if(!image) return COLOR_OTHER;
+
+  unsigned long pixel = XGetPixel(image, 0, 0);
+  int r = channel(pixel, image->red_mask);
+  int g = channel(pixel, image->green_mask);
+  int b = channel(pixel, image->blue_mask);
+  XDestroyImage(image);
+
+  if(r > 200 && g < 56 && b < 56) return COLOR_RED;
+  if(b > 200 && r < 56 && g < 56) return COLOR_BLUE;
+  return COLOR_OTHER;
+}
+
+// Waits until the window shows 'color' at x, y, from the top left
+static bool expect(const char *step, int x, int y, Color color) {
+  double start = now_ms();
+  Color seen = COLOR_OTHER;
+  while(now_ms() - start < WAIT_MS) {
+    seen = read_color(x, y);
+    if(seen == color) return true;
+    sleep_ms(SETTLE_MS);
+  }
+  fprintf(stderr, "ERROR: After the %s, %s at %d, %d instead of %s\n",
+	  step, color_names[seen], x, y, color_names[color]);
+  return false;
+}
+
+static void send_event(XEvent *e, long mask) {
+  XSendEvent(display, window, True, mask, e);
+  XFlush(display);
+}
+
+static void send_button(int type, unsigned int button, int x, int y) {
+  XEvent e;
+  memset(&e, 0, sizeof(e));
+  e.xbutton.type = type;
+  e.xbutton.display = display;
+  e.xbutton.window = window;
+  e.xbutton.root = DefaultRootWindow(display);
+  e.xbutton.time = CurrentTime;
+  e.xbutton.x = x;
+  e.xbutton.y = y;
+  e.xbutton.button = button;
+  e.xbutton.same_screen = True;
+  send_event(&e, type == ButtonPress ? ButtonPressMask : ButtonReleaseMask);
+}
+
+static void send_motion(int x, int y) {
+  XEvent e;
+  memset(&e, 0, sizeof(e));
+  e.xmotion.type = MotionNotify;
+  e.xmotion.display = display;
+  e.xmotion.window = window;
+  e.xmotion.root = DefaultRootWindow(display);
+  e.xmotion.time = CurrentTime;
+  e.xmotion.x = x;
+  e.xmotion.y = y;
+  e.xmotion.state = Button1Mask;
+  e.xmotion.same_screen = True;
+  send_event(&e, PointerMotionMask);
+}
+
+static void send_key(KeySym sym) {
+  XEvent e;
+  memset(&e, 0, sizeof(e));
+  e.xkey.display = display;
+  e.xkey.window = window;
+  e.xkey.root = DefaultRootWindow(display);
+  e.xkey.time = CurrentTime;
+  e.xkey.keycode = XKeysymToKeycode(display, sym);
+  e.xkey.same_screen = True;
+  e.xkey.type = KeyPress;
+  send_event(&e, KeyPressMask);
+  e.xkey.type = KeyRelease;
+  send_event(&e, KeyReleaseMask);
+}
+
+static bool drive() {
+  XWindowAttributes attributes;
+  if(!XGetWindowAttributes(display, window, &attributes)) return false;
+  int width = attributes.width;
+  int cx = attributes.width / 2, cy = attributes.height / 2;
+
+  // fitted to the width, the halves meet in the center
+  if(!expect("load", cx / 2, cy, COLOR_RED) ||
+     !expect("load", cx + cx / 2, cy, COLOR_BLUE) ||
+     !expect("load", 4, 4, COLOR_OTHER)) {
+    return false;
+  }
+
+  // dragged to the right by a quarter, with a frame between the events
+  send_button(ButtonPress, Button1, cx, cy);
+  sleep_ms(SETTLE_MS);
+  send_motion(cx + width / 4, cy);
+  sleep_ms(SETTLE_MS);
+  send_button(ButtonRelease, Button1, cx + width / 4, cy);
+  if(!expect("drag", cx + width / 8, cy, COLOR_RED)) return false;
+
+  send_key(XK_r);
+  if(!expect("reset", cx + width / 8, cy, COLOR_BLUE)) return false;
+
+  for(int i=0;i<ZOOM_STEPS;i++) {
+    send_button(ButtonPress, Button4, cx, cy);
+    send_button(ButtonRelease, Button4, cx, cy);
+  }
+  if(!expect("zoom", 4, cy, COLOR_RED)) return false;
+
+  send_key(XK_q);
+  return true;
+}
+
+static bool wait_exit(pid_t pid, int *status) {
+  double start = now_ms();
+  while(now_ms() - start < WAIT_MS) {
+    if(waitpid(pid, status, WNOHANG) == pid) return true;
+    sleep_ms(SETTLE_MS);
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, status, 0);
+  return false;
+}
+
+int main(int argc, char **argv) {
+  if(argc != 2) {
+    fprintf(stderr, "Usage: %s VIEWER\n", argv[0]);
+    return 1;
+  }
+  const char *viewer = argv[1];
+
+  display = XOpenDisplay(NULL);
+  if(!display) {
+    fprintf(stderr, "ERROR: Can not open the display, run it under Xvfb\n");
+    return 1;
+  }
+
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/smoke-%d.ppm", (int) getpid());
+  if(!write_image(path)) {
+    fprintf(stderr, "ERROR: Can not write '%s'\n", path);
+    return 1;
+  }
+
+  pid_t pid = fork();
+  if(pid < 0) {
+    fprintf(stderr, "ERROR: Can not start '%s'\n", viewer);
+    unlink(path);
+    return 1;
+  }
+  if(pid == 0) {
+    execl(viewer, viewer, path, (char *) NULL);
+    _exit(127);
+  }
+
+  bool ok = find_window(path);
+  if(!ok) fprintf(stderr, "ERROR: '%s' did not show '%s'\n", viewer, path);
+  ok = ok && drive();
+  if(!ok) kill(pid, SIGTERM);
+
+  int status = 0;
+  if(!wait_exit(pid, &status)) {
+    fprintf(stderr, "ERROR: '%s' did not quit\n", viewer);
+    ok = false;
+  } else if(ok && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+    fprintf(stderr, "ERROR: '%s' quit with status %d\n", viewer, status);
+    ok = false;
+  }
+  unlink(path);
+  XCloseDisplay(display);
+
+  printf("smoke    : %s %s\n", viewer, ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <sched.h>
+#  include <unistd.h>
+#endif //_WIN32
+
+#ifndef THREAD_DEF
+#  define THREAD_DEF static inline
+#endif //THREAD_DEF
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Thread
+
+typedef void *(*Thread_Function)(void *arg);
+
+typedef struct{
+#ifdef _WIN32
+  HANDLE handle;
+#else
+  pthread_t handle;
+#endif //_WIN32
+
+  Thread_Function function;
+  void *arg;
+  void *result;
+}Thread;
+
+// 't' must stay alive until 'thread_join' returns
+THREAD_DEF bool thread_create(Thread *t, Thread_Function function, void *arg);
+THREAD_DEF void *thread_join(Thread *t);
+THREAD_DEF void thread_yield();
+THREAD_DEF int thread_cpu_count(); // online cores, at least 1
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Thread_Mutex
+
+typedef struct{
+#ifdef _WIN32
+  CRITICAL_SECTION section;
+#else
+  pthread_mutex_t mutex;
+#endif //_WIN32
+}Thread_Mutex;
+
+THREAD_DEF void thread_mutex_init(Thread_Mutex *m);
+THREAD_DEF void thread_mutex_lock(Thread_Mutex *m);
+// false if it is held, on Windows only if held by another thread
+THREAD_DEF bool thread_mutex_trylock(Thread_Mutex *m);
+THREAD_DEF void thread_mutex_unlock(Thread_Mutex *m);
+THREAD_DEF void thread_mutex_free(Thread_Mutex *m);
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Thread_Cond
+//   waits may wake up spuriously, check the condition in a loop
+
+typedef struct{
+#ifdef _WIN32
+  CONDITION_VARIABLE cond;
+#else
+  pthread_cond_t cond;
+#endif //_WIN32
+}Thread_Cond;
+
+THREAD_DEF void thread_cond_init(Thread_Cond *c);
+THREAD_DEF void thread_cond_wait(Thread_Cond *c, Thread_Mutex *m); // 'm' is locked
+THREAD_DEF void thread_cond_signal(Thread_Cond *c);
+THREAD_DEF void thread_cond_broadcast(Thread_Cond *c);
+THREAD_DEF void thread_cond_free(Thread_Cond *c);
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Thread_Atomic
+//   64 bits, sequentially consistent, safe to poll from the main loop
+
+#ifdef _WIN32
+typedef volatile LONG64 Thread_Atomic;
+#else
+typedef volatile long long Thread_Atomic;
+#endif //_WIN32
+
+THREAD_DEF long long thread_atomic_load(Thread_Atomic *a);
+THREAD_DEF void thread_atomic_store(Thread_Atomic *a, long long value);
+THREAD_DEF long long thread_atomic_add(Thread_Atomic *a, long long value); // returns the previous value
+// Stores 'value' if 'a' still holds 'expected'
+THREAD_DEF bool thread_atomic_cas(Thread_Atomic *a, long long expected, long long value);
+
+#ifdef THREAD_IMPLEMENTATION
+
+#ifdef _WIN32
+static DWORD WINAPI thread_win32_entry(LPVOID param) {
+  Thread *t = (Thread *) param;
+  t->result = t->function(t->arg);
+  return 0;
+}
+#else
+static void *thread_posix_entry(void *param) {
+  Thread *t = (Thread *) param;
+  t->result = t->function(t->arg);
+  return NULL;
+}
+#endif //_WIN32
+
+THREAD_DEF bool thread_create(Thread *t, Thread_Function function, void *arg) {
+  t->function = function;
+  t->arg = arg;
+  t->result = NULL;
+
+#ifdef _WIN32
+  t->handle = CreateThread(NULL, 0, thread_win32_entry, t, 0, NULL);
+  return t->handle != NULL;
+#else
+  return pthread_create(&t->handle, NULL, thread_posix_entry, t) == 0;
+#endif //_WIN32
+}
+
+THREAD_DEF void *thread_join(Thread *t) {
+#ifdef _WIN32
+  WaitForSingleObject(t->handle, INFINITE);
+  CloseHandle(t->handle);
+#else
+  pthread_join(t->handle, NULL);
+#endif //_WIN32
+
+  return t->result;
+}
+
+THREAD_DEF void thread_yield() {
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif //_WIN32
+}
+
+THREAD_DEF int thread_cpu_count() {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  int count = (int) info.dwNumberOfProcessors;
+#else
+  int count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif //_WIN32
+  return count < 1 ? 1 : count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+THREAD_DEF void thread_mutex_init(Thread_Mutex *m) {
+#ifdef _WIN32
+  InitializeCriticalSection(&m->section);
+#else
+  pthread_mutex_init(&m->mutex, NULL);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_mutex_lock(Thread_Mutex *m) {
+#ifdef _WIN32
+  EnterCriticalSection(&m->section);
+#else
+  pthread_mutex_lock(&m->mutex);
+#endif //_WIN32
+}
+
+THREAD_DEF bool thread_mutex_trylock(Thread_Mutex *m) {
+#ifdef _WIN32
+  return TryEnterCriticalSection(&m->section) != 0;
+#else
+  return pthread_mutex_trylock(&m->mutex) == 0;
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_mutex_unlock(Thread_Mutex *m) {
+#ifdef _WIN32
+  LeaveCriticalSection(&m->section);
+#else
+  pthread_mutex_unlock(&m->mutex);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_mutex_free(Thread_Mutex *m) {
+#ifdef _WIN32
+  DeleteCriticalSection(&m->section);
+#else
+  pthread_mutex_destroy(&m->mutex);
+#endif //_WIN32
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+THREAD_DEF void thread_cond_init(Thread_Cond *c) {
+#ifdef _WIN32
+  InitializeConditionVariable(&c->cond);
+#else
+  pthread_cond_init(&c->cond, NULL);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_cond_wait(Thread_Cond *c, Thread_Mutex *m) {
+#ifdef _WIN32
+  SleepConditionVariableCS(&c->cond, &m->section, INFINITE);
+#else
+  pthread_cond_wait(&c->cond, &m->mutex);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_cond_signal(Thread_Cond *c) {
+#ifdef _WIN32
+  WakeConditionVariable(&c->cond);
+#else
+  pthread_cond_signal(&c->cond);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_cond_broadcast(Thread_Cond *c) {
+#ifdef _WIN32
+  WakeAllConditionVariable(&c->cond);
+#else
+  pthread_cond_broadcast(&c->cond);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_cond_free(Thread_Cond *c) {
+#ifdef _WIN32
+  (void) c;
+#else
+  pthread_cond_destroy(&c->cond);
+#endif //_WIN32
+}
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+THREAD_DEF long long thread_atomic_load(Thread_Atomic *a) {
+#ifdef _WIN32
+  return InterlockedCompareExchange64(a, 0, 0);
+#else
+  return __atomic_load_n(a, __ATOMIC_SEQ_CST);
+#endif //_WIN32
+}
+
+THREAD_DEF void thread_atomic_store(Thread_Atomic *a, long long value) {
+#ifdef _WIN32
+  InterlockedExchange64(a, value);
+#else
+  __atomic_store_n(a, value, __ATOMIC_SEQ_CST);
+#endif //_WIN32
+}
+
+THREAD_DEF long long thread_atomic_add(Thread_Atomic *a, long long value) {
+#ifdef _WIN32
+  return InterlockedExchangeAdd64(a, value);
+#else
+  return __atomic_fetch_add(a, value, __ATOMIC_SEQ_CST);
+#endif //_WIN32
+}
+
+THREAD_DEF bool thread_atomic_cas(Thread_Atomic *a, long long expected, long long value) {
+#ifdef _WIN32
+  return InterlockedCompareExchange64(a, value, expected) == expected;
+#else
+  return __atomic_compare_exchange_n(a, &expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif //_WIN32
+}
+
+#endif //THREAD_IMPLEMENTATION
+
+#endif //THREAD_H
@@ -0,0 +1,234 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Records begin/end events into a ring per thread and writes them as
+// Chrome trace JSON, loadable in chrome://tracing or ui.perfetto.dev.
+//
+//   trace_start();
+//   TRACE_BEGIN("decode"); ... TRACE_END("decode");
+//   trace_write("viewer.json");
+//
+// Names are stored by pointer, pass string literals. Until 'trace_start'
+// every event is a single branch, with TRACE_DISABLE not even that.
+//
+// Include this before frame.h, pnm.h and qoi.h to wire up their hooks. Uses
+// thread.h, include it first.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif //_WIN32
+
+#ifndef TRACE_DEF
+#  define TRACE_DEF static inline
+#endif //TRACE_DEF
+
+#ifndef TRACE_EVENTS_CAP
+#  define TRACE_EVENTS_CAP 16384 // per thread, the oldest are overwritten
+#endif //TRACE_EVENTS_CAP
+
+#ifdef TRACE_DISABLE
+#  define TRACE_BEGIN(name)
+#  define TRACE_END(name)
+#  define TRACE_INSTANT(name)
+#else
+#  define TRACE_BEGIN(name) trace_begin(name)
+#  define TRACE_END(name) trace_end(name)
+#  define TRACE_INSTANT(name) trace_instant(name)
+#endif //TRACE_DISABLE
+
+#ifndef FRAME_TRACE_BEGIN
+#  define FRAME_TRACE_BEGIN(name) TRACE_BEGIN(name)
+#  define FRAME_TRACE_END(name) TRACE_END(name)
+#endif //FRAME_TRACE_BEGIN
+
+#ifndef PNM_TRACE_BEGIN
+#  define PNM_TRACE_BEGIN(name) TRACE_BEGIN(name)
+#  define PNM_TRACE_END(name) TRACE_END(name)
+#endif //PNM_TRACE_BEGIN
+
+#ifndef QOI_TRACE_BEGIN
+#  define QOI_TRACE_BEGIN(name) TRACE_BEGIN(name)
+#  define QOI_TRACE_END(name) TRACE_END(name)
+#endif //QOI_TRACE_BEGIN
+
+typedef struct{
+  const char *name;
+  double time; // us
+  char phase; // 'B', 'E' or 'i'
+}Trace_Event;
+
+// Written by its thread only. 'count' is published after the event, so
+// a reader sees complete events up to it.
+typedef struct Trace_Buffer Trace_Buffer;
+struct Trace_Buffer{
+  Trace_Event events[TRACE_EVENTS_CAP];
+  Thread_Atomic count;
+  int tid;
+  const char *thread_name;
+  Trace_Buffer *next;
+};
+
+TRACE_DEF double trace_now(); // us, monotonic
+TRACE_DEF void trace_start();
+TRACE_DEF void trace_stop();
+
+TRACE_DEF void trace_begin(const char *name);
+TRACE_DEF void trace_end(const char *name);
+TRACE_DEF void trace_instant(const char *name);
+TRACE_DEF void trace_thread_name(const char *name); // of the calling thread
+
+// Call while the other threads are not recording
+TRACE_DEF bool trace_write(const char *path);
+
+#ifdef TRACE_IMPLEMENTATION
+
+#ifdef _MSC_VER
+#  define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#  define TRACE_THREAD_LOCAL __thread
+#endif //_MSC_VER
+
+static Thread_Atomic trace_enabled = 0;
+static double trace_origin = 0;
+static Thread_Mutex trace_mutex; // of 'trace_buffers', from the first 'trace_start' on
+static Trace_Buffer *trace_buffers = NULL; // every thread that recorded
+static int trace_tids = 0;
+static TRACE_THREAD_LOCAL Trace_Buffer *trace_buffer = NULL;
+static TRACE_THREAD_LOCAL const char *trace_buffer_name = NULL; // until it exists
+
+#ifdef _WIN32
+TRACE_DEF double trace_now() {
+  static LARGE_INTEGER frequency = {0};
+  if(frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+
+  LARGE_INTEGER time;
+  QueryPerformanceCounter(&time);
+  return (double) time.QuadPart * 1000000 / (double) frequency.QuadPart;
+}
+#else
+TRACE_DEF double trace_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1000000 + (double) ts.tv_nsec / 1000;
+}
+#endif //_WIN32
+
+TRACE_DEF void trace_start() {
+  if(trace_origin == 0) {
+    trace_origin = trace_now();
+    thread_mutex_init(&trace_mutex);
+  }
+  thread_atomic_store(&trace_enabled, 1);
+}
+
+TRACE_DEF void trace_stop() {
+  thread_atomic_store(&trace_enabled, 0);
+}
+
+// The first event of a thread links its buffer into 'trace_buffers'
+static Trace_Buffer *trace_thread_buffer() {
+  if(trace_buffer) return trace_buffer;
+
+  Trace_Buffer *b = malloc(sizeof(Trace_Buffer));
+  if(!b) return NULL;
+  b->count = 0;
+  b->thread_name = trace_buffer_name;
+
+  thread_mutex_lock(&trace_mutex);
+  b->tid = ++trace_tids;
+  b->next = trace_buffers;
+  trace_buffers = b;
+  thread_mutex_unlock(&trace_mutex);
+
+  trace_buffer = b;
+  return b;
+}
+
+static void trace_push(const char *name, char phase) {
+  Trace_Buffer *b = trace_thread_buffer();
+  if(!b) return;
+
+  Trace_Event *e = &b->events[b->count % TRACE_EVENTS_CAP];
+  e->name = name;
+  e->time = trace_now() - trace_origin;
+  e->phase = phase;
+
+  thread_atomic_store(&b->count, b->count + 1);
+}
+
+TRACE_DEF void trace_begin(const char *name) {
+  if(!trace_enabled) return;
+  trace_push(name, 'B');
+}
+
+TRACE_DEF void trace_end(const char *name) {
+  if(!trace_enabled) return;
+  trace_push(name, 'E');
+}
+
+TRACE_DEF void trace_instant(const char *name) {
+  if(!trace_enabled) return;
+  trace_push(name, 'i');
+}
+
+// Kept for the first event, threads that never record allocate nothing
+TRACE_DEF void trace_thread_name(const char *name) {
+  trace_buffer_name = name;
+  if(trace_buffer) trace_buffer->thread_name = name;
+}
+
+TRACE_DEF bool trace_write(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if(!f) return false;
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+
+  Trace_Buffer *b = NULL;
+  if(trace_origin != 0) {
+    thread_mutex_lock(&trace_mutex);
+    b = trace_buffers;
+    thread_mutex_unlock(&trace_mutex);
+  }
+  for(;b;b = b->next) {
+    if(b->thread_name) {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+	      first ? "" : ",\n", b->tid, b->thread_name);
+      first = false;
+    }
+
+    long long count = thread_atomic_load(&b->count);
+    long long start = count > TRACE_EVENTS_CAP ? count - TRACE_EVENTS_CAP : 0;
+
+    // after a wrap the ring may start inside a span, skip its ends
+    int depth = 0;
+    for(long long i=start;i<count;i++) {
+      Trace_Event *e = &b->events[i % TRACE_EVENTS_CAP];
+      if(e->phase == 'B') depth++;
+      if(e->phase == 'E') {
+	if(depth == 0) continue;
+	depth--;
+      }
+
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d%s}",
+	      first ? "" : ",\n", e->name, e->phase, e->time, b->tid,
+	      e->phase == 'i' ? ",\"s\":\"t\"" : "");
+      first = false;
+    }
+  }
+
+  fprintf(f, "\n]}\n");
+  return fclose(f) == 0;
+}
+
+#endif //TRACE_IMPLEMENTATION
+
+#endif //TRACE_H
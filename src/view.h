@@ -0,0 +1,104 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+// Zoom and pan of the image on screen, from the mouse. The viewer feeds it
+// the events of the window, the bench those of its scripted session.
+//
+//   View v;
+//   view_fit(&v, frame.width, frame.height, img_width, img_height, PADDING);
+//   ...
+//   case FRAME_EVENT_MOUSEWHEEL:   view_wheel(&v, event.as.amount); break;
+//   case FRAME_EVENT_MOUSEPRESS:   view_press(&v, mouse_x, mouse_y); break;
+//   case FRAME_EVENT_MOUSERELEASE: view_release(&v); break;
+//   ...
+//   view_drag(&v, mouse_x, mouse_y);
+//   float x, y, w, h;
+//   view_rect(&v, frame.width, frame.height, img_width, img_height, &x, &y, &w, &h);
+
+#include <stdbool.h>
+
+#ifndef VIEW_DEF
+#  define VIEW_DEF static inline
+#endif //VIEW_DEF
+
+#define VIEW_WHEEL_ZOOM 0.025f // per step of the wheel
+
+typedef struct{
+  float zoom; // screen pixels per image pixel
+  float initial_zoom; // of the last 'view_fit'
+  float x_off, y_off; // of the center
+  float x_start, y_start; // mouse minus offset, when the drag started
+  bool drag;
+}View;
+
+// Fits 'img_width' x 'img_height' into the screen, 'padding' pixels from
+// its longer side, and centers it
+VIEW_DEF void view_fit(View *v, int width, int height, int img_width, int img_height, float padding);
+VIEW_DEF void view_reset(View *v);
+// Keeps the image where it is on screen, when it is swapped for the same one
+// at another resolution
+VIEW_DEF void view_resize(View *v, int img_width, int new_img_width);
+VIEW_DEF void view_wheel(View *v, int amount);
+VIEW_DEF void view_press(View *v, float mouse_x, float mouse_y);
+VIEW_DEF void view_release(View *v);
+// Once per frame, moves the image with the mouse while dragging
+VIEW_DEF void view_drag(View *v, float mouse_x, float mouse_y);
+VIEW_DEF void view_rect(const View *v, int width, int height, int img_width, int img_height,
+			float *x, float *y, float *w, float *h);
+
+#ifdef VIEW_IMPLEMENTATION
+
+VIEW_DEF void view_fit(View *v, int width, int height, int img_width, int img_height, float padding) {
+  if(img_width > img_height) {
+    v->zoom = ((float) width - 2 * padding) / (float) img_width;
+  } else {
+    v->zoom = ((float) height - 2 * padding) / (float) img_height;
+  }
+  v->initial_zoom = v->zoom;
+  v->x_off = 0.f;
+  v->y_off = 0.f;
+}
+
+VIEW_DEF void view_reset(View *v) {
+  v->zoom = v->initial_zoom;
+  v->x_off = 0.f;
+  v->y_off = 0.f;
+}
+
+VIEW_DEF void view_resize(View *v, int img_width, int new_img_width) {
+  float scale = (float) img_width / (float) new_img_width;
+  v->zoom *= scale;
+  v->initial_zoom *= scale;
+}
+
+VIEW_DEF void view_wheel(View *v, int amount) {
+  v->zoom += VIEW_WHEEL_ZOOM * (float) amount;
+}
+
+VIEW_DEF void view_press(View *v, float mouse_x, float mouse_y) {
+  v->x_start = mouse_x - v->x_off;
+  v->y_start = mouse_y - v->y_off;
+  v->drag = true;
+}
+
+VIEW_DEF void view_release(View *v) {
+  v->drag = false;
+}
+
+VIEW_DEF void view_drag(View *v, float mouse_x, float mouse_y) {
+  if(!v->drag) return;
+  v->x_off = mouse_x - v->x_start;
+  v->y_off = mouse_y - v->y_start;
+}
+
+VIEW_DEF void view_rect(const View *v, int width, int height, int img_width, int img_height,
+			float *x, float *y, float *w, float *h) {
+  *w = (float) img_width * v->zoom;
+  *h = (float) img_height * v->zoom;
+  *x = (float) width / 2 - *w / 2 + v->x_off;
+  *y = (float) height / 2 - *h / 2 + v->y_off;
+}
+
+#endif //VIEW_IMPLEMENTATION
+
+#endif //VIEW_H